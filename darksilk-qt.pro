@@ -260,6 +260,7 @@ HEADERS +=  src/qt/darksilkgui.h src/crypto/aes.h \
             src/utilstrencodings.h \
             src/utilmoneystr.h \
             src/hash.h \
+            src/headerchain.h \
             src/uint256.h \
             src/kernel.h \
             src/scrypt.h \
@@ -341,6 +342,8 @@ HEADERS +=  src/qt/darksilkgui.h src/crypto/aes.h \
             src/qt/sandstormconfig.h \
             src/anon/stormnode/stormnode.h \ 
             src/anon/stormnode/stormnode-budget.h \
+            src/anon/stormnode/stormnode-cache.h \
+            src/anon/stormnode/stormnode-sigverify.h \
             src/anon/stormnode/stormnode-payments.h \
             src/anon/sandstorm/sandstorm.h \    
             src/anon/sandstorm/sandstorm-relay.h \
@@ -370,6 +373,9 @@ HEADERS +=  src/qt/darksilkgui.h src/crypto/aes.h \
             src/primitives/block.h \
             src/primitives/transaction.h \
             src/anon/stormnode/stormnode-sync.h \
+            src/blockfile.h \
+            src/blockverify.h \
+            src/txverify.h \
             src/chain.h \
             src/coins.h \
             src/script/compressor.h \
@@ -438,6 +444,7 @@ SOURCES +=  src/qt/darksilk.cpp src/qt/darksilkgui.cpp src/rest.cpp src/crypto/a
             src/script/script_error.cpp \
             src/main.cpp \
             src/miner.cpp \
+            src/headerchain.cpp \
             src/init.cpp \
             src/net.cpp \
             src/checkpoints.cpp \
@@ -502,6 +509,8 @@ SOURCES +=  src/qt/darksilk.cpp src/qt/darksilkgui.cpp src/rest.cpp src/crypto/a
             src/qt/sandstormconfig.cpp \
             src/anon/stormnode/stormnode.cpp \
             src/anon/stormnode/stormnode-budget.cpp \
+            src/anon/stormnode/stormnode-cache.cpp \
+            src/anon/stormnode/stormnode-sigverify.cpp \
             src/anon/stormnode/stormnode-payments.cpp \
             src/anon/sandstorm/sandstorm.cpp \
             src/anon/sandstorm/sandstorm-relay.cpp \
@@ -516,6 +525,9 @@ SOURCES +=  src/qt/darksilk.cpp src/qt/darksilkgui.cpp src/rest.cpp src/crypto/a
             src/crypto/ripemd160.cpp \
             src/crypto/sha1.cpp \
             src/crypto/sha256.cpp \
+            src/crypto/sha256_avx2.cpp \
+            src/crypto/sha256_shani.cpp \
+            src/crypto/sha256_sse41.cpp \
             src/crypto/sha512.cpp \
             src/qt/stormnodemanager.cpp \
             src/qt/addeditstormnode.cpp \
@@ -532,6 +544,9 @@ SOURCES +=  src/qt/darksilk.cpp src/qt/darksilkgui.cpp src/rest.cpp src/crypto/a
             src/primitives/block.cpp \
             src/primitives/transaction.cpp \
             src/anon/stormnode/stormnode-sync.cpp \
+            src/blockfile.cpp \
+            src/blockverify.cpp \
+            src/txverify.cpp \
             src/chain.cpp \
             src/uint256.cpp \
             src/coins.cpp \
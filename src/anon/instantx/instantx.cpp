@@ -21,11 +21,7 @@
 using namespace std;
 using namespace boost;
 
-std::map<uint256, CTransaction> mapTxLockReq;
-std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
+CTxLockManager txLockManager;
 std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
 int nCompleteTXLocks;
 
@@ -35,6 +31,54 @@ int nCompleteTXLocks;
 //step 2.) Top INSTANTX_SIGNATURES_TOTAL stormnodes, open connect to top 1 stormnode.
 //         Send "txvote", CTransaction, Signature, Approve
 //step 3.) Top 1 stormnode, waits for INSTANTX_SIGNATURES_REQUIRED messages. Upon success, sends "txlock'
+//step 4.) Once a lock is complete its votes are relayed together, "txlproof", CTxLockProof
+
+// Offer the proof of a complete lock to the peers that take proofs
+static void RelayTxLockProof(const uint256& txHash)
+{
+    // the signature count includes repeated votes of a stormnode, there may be no proof yet
+    CTxLockProof proof;
+    if(!txLockManager.GetLockProof(txHash, proof)) return;
+
+    CInv inv(MSG_TXLOCK_PROOF, txHash);
+    RelayInv(inv, MIN_TXLOCK_PROOF_PROTO_VERSION);
+}
+
+// Votes of a complete lock only go to the peers that don't take its proof
+static void RelayTxLockVoteToOldPeers(CInv& inv)
+{
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+        if(pnode->nVersion >= MIN_INSTANTX_PROTO_VERSION && pnode->nVersion < MIN_TXLOCK_PROOF_PROTO_VERSION)
+            pnode->PushInventory(inv);
+}
+
+//Spam/Dos protection
+/*
+    Stormnodes will sometimes propagate votes before the transaction is known to the client.
+    This tracks those messages and allows it at the same rate of the rest of the network, if
+    a peer violates it, its votes are not relayed
+*/
+static bool IsUnknownVoteSpam(const CConsensusVote& ctx)
+{
+    if(txLockManager.HasRequest(ctx.txHash) || txLockManager.IsRejected(ctx.txHash)) return false;
+
+    if(!mapUnknownVotes.count(ctx.vinStormnode.prevout.hash)){
+        mapUnknownVotes[ctx.vinStormnode.prevout.hash] = GetTime()+(60*10);
+    }
+
+    if(mapUnknownVotes[ctx.vinStormnode.prevout.hash] > GetTime() &&
+        mapUnknownVotes[ctx.vinStormnode.prevout.hash] - GetAverageVoteTime() > 60*10){
+            LogPrintf("ProcessMessageInstantX - stormnode is spamming transaction votes: %s %s\n",
+                ctx.vinStormnode.ToString().c_str(),
+                ctx.txHash.ToString().c_str()
+            );
+            return true;
+    }
+
+    mapUnknownVotes[ctx.vinStormnode.prevout.hash] = GetTime()+(60*10);
+    return false;
+}
 
 void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
@@ -48,11 +92,12 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
         CDataStream vMsg(vRecv);
         CTransaction tx;
         vRecv >> tx;
+        tx.CacheHash();
 
         CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if(mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())){
+        if(txLockManager.HasRequest(tx.GetHash()) || txLockManager.IsRejected(tx.GetHash())){
             return;
         }
 
@@ -86,7 +131,7 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRequest(tx);
 
             LogPrintf("ProcessMessageInstantX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -96,7 +141,7 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
             return;
 
         } else {
-            mapTxLockReqRejected.insert(make_pair(tx.GetHash(), tx));
+            txLockManager.AddRejected(tx);
 
             // can we get the conflicting transaction as proof?
 
@@ -105,24 +150,17 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
                 tx.GetHash().ToString().c_str()
             );
 
-            BOOST_FOREACH(const CTxIn& in, tx.vin){
-                if(!mapLockedInputs.count(in.prevout)){
-                    mapLockedInputs.insert(make_pair(in.prevout, tx.GetHash()));
-                }
-            }
+            txLockManager.LockInputs(tx);
 
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()){
-                //we only care if we have a complete tx lock
-                if((*i).second.CountSignatures() >= INSTANTX_SIGNATURES_REQUIRED){
-                    if(!CheckForConflictingLocks(tx)){
-                        LogPrintf("ProcessMessageInstantX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(make_pair(tx.GetHash(), tx));
-                    }
+            //we only care if we have a complete tx lock
+            if(txLockManager.GetLockSignatures(tx.GetHash()) >= INSTANTX_SIGNATURES_REQUIRED){
+                if(!CheckForConflictingLocks(tx)){
+                    LogPrintf("ProcessMessageInstantX::ix - Found Existing Complete IX Lock\n");
+
+                    //reprocess the last 15 blocks
+                    ReprocessBlocks(15);
+                    txLockManager.AddRequest(tx);
                 }
             }
 
@@ -137,38 +175,58 @@ void ProcessMessageInstantX(CNode* pfrom, std::string& strCommand, CDataStream&
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if(mapTxLockVote.count(ctx.GetHash())){
+        if(!txLockManager.AddVote(ctx)){
             return;
         }
 
-        mapTxLockVote.insert(make_pair(ctx.GetHash(), ctx));
-
         if(ProcessConsensusVote(pfrom, ctx)){
-            //Spam/Dos protection
-            /*
-                Stormnodes will sometimes propagate votes before the transaction is known to the client.
-                This tracks those messages and allows it at the same rate of the rest of the network, if
-                a peer violates it, it will simply be ignored
-            */
-            if(!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)){
-                if(!mapUnknownVotes.count(ctx.vinStormnode.prevout.hash)){
-                    mapUnknownVotes[ctx.vinStormnode.prevout.hash] = GetTime()+(60*10);
-                }
+            if(IsUnknownVoteSpam(ctx)) return;
+
+            // peers that take proofs get the votes of a complete lock with its proof
+            CTxLockProof proof;
+            if(txLockManager.GetLockProof(ctx.txHash, proof))
+                RelayTxLockVoteToOldPeers(inv);
+            else
+                RelayInv(inv);
+        }
 
-                if(mapUnknownVotes[ctx.vinStormnode.prevout.hash] > GetTime() &&
-                    mapUnknownVotes[ctx.vinStormnode.prevout.hash] - GetAverageVoteTime() > 60*10){
-                        LogPrintf("ProcessMessageInstantX::ix - stormnode is spamming transaction votes: %s %s\n",
-                            ctx.vinStormnode.ToString().c_str(),
-                            ctx.txHash.ToString().c_str()
-                        );
-                        return;
-                } else {
-                    mapUnknownVotes[ctx.vinStormnode.prevout.hash] = GetTime()+(60*10);
-                }
-            }
-            RelayInv(inv);
+        return;
+    }
+    else if (strCommand == "txlproof") //InstantX Lock Proof, the votes of a complete lock
+    {
+        CTxLockProof proof;
+        vRecv >> proof;
+
+        CInv inv(MSG_TXLOCK_PROOF, proof.GetHash());
+        pfrom->AddInventoryKnown(inv);
+
+        CTxLockProof proofHave;
+        if(txLockManager.GetLockProof(proof.txHash, proofHave)){
+            return;
         }
 
+        std::string strError;
+        if(!proof.IsWellFormed(strError)){
+            LogPrintf("ProcessMessageInstantX::txlproof - Invalid proof for %s : %s\n", proof.txHash.ToString(), strError);
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+
+        // each vote counts as if it came alone, ProcessConsensusVote relays the proof once the lock is complete,
+        // peers that don't take proofs still get the votes one by one
+        int nAccepted = 0;
+        BOOST_FOREACH(CConsensusVote& ctx, proof.vecVotes){
+            if(!txLockManager.AddVote(ctx)) continue;
+            if(!ProcessConsensusVote(pfrom, ctx)) continue;
+            if(IsUnknownVoteSpam(ctx)) continue;
+            nAccepted++;
+            CInv invVote(MSG_TXLOCK_VOTE, ctx.GetHash());
+            RelayTxLockVoteToOldPeers(invVote);
+        }
+
+        LogPrint("instantx", "ProcessMessageInstantX::txlproof - %s : %d of %d votes new and valid, lock has %d\n",
+            proof.txHash.ToString(), nAccepted, proof.vecVotes.size(), txLockManager.GetLockSignatures(proof.txHash));
+
         return;
     }
 }
@@ -245,18 +303,13 @@ int64_t CreateNewLock(CTransaction tx)
         else return 0;
     }
 
-    if (!mapTxLocks.count(tx.GetHash())){
+    if (txLockManager.CreateLock(tx.GetHash(), nBlockHeight)){
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime()+(60*60); //locks expire after 60 minutes (56-60 confirmations)
-        newLock.nTimeout = GetTime()+(60*5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(make_pair(tx.GetHash(), newLock));
     } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
         LogPrint("instantx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
+        // the votes may all have come before the request
+        if(txLockManager.GetLockSignatures(tx.GetHash()) >= INSTANTX_SIGNATURES_REQUIRED)
+            RelayTxLockProof(tx.GetHash());
     }
 
     return nBlockHeight;
@@ -299,7 +352,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    txLockManager.AddVote(ctx);
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
@@ -335,22 +388,14 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)){
+    if (txLockManager.CreateLock(ctx.txHash, 0)){
         LogPrintf("InstantX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime()+(60*60);
-        newLock.nTimeout = GetTime()+(60*5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(make_pair(ctx.txHash, newLock));
     } else
         LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()){
-        (*i).second.AddSignature(ctx);
+    int nSignatures = 0;
+    if (txLockManager.AddLockSignature(ctx, nSignatures)){
 
 #ifdef ENABLE_WALLET
         if(pwalletMain){
@@ -360,34 +405,34 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         }
 #endif
 
-        LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+        LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
+
+        if(nSignatures >= INSTANTX_SIGNATURES_REQUIRED){
+            LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-        if((*i).second.CountSignatures() >= INSTANTX_SIGNATURES_REQUIRED){
-            LogPrint("instantx", "InstantX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+            // peers that already know the proof are not offered it again
+            RelayTxLockProof(ctx.txHash);
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
+            CTransaction tx;
+            bool fHaveRequest = txLockManager.GetRequest(ctx.txHash, tx);
             if(!CheckForConflictingLocks(tx)){
 
 #ifdef ENABLE_WALLET
                 if(pwalletMain){
-                    if(pwalletMain->UpdatedTransaction((*i).second.txHash)){
+                    if(pwalletMain->UpdatedTransaction(ctx.txHash)){
                         nCompleteTXLocks++;
                     }
                 }
 #endif
 
-                if(mapTxLockReq.count(ctx.txHash)){
-                    BOOST_FOREACH(const CTxIn& in, tx.vin){
-                        if(!mapLockedInputs.count(in.prevout)){
-                            mapLockedInputs.insert(make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
+                if(fHaveRequest){
+                    txLockManager.LockInputs(tx);
                 }
 
                 // resolve conflicts
 
                 //if this tx lock was rejected, we need to remove the conflicting blocks
-                if(mapTxLockReqRejected.count((*i).second.txHash)){
+                if(txLockManager.IsRejected(ctx.txHash)){
                     //reprocess the last 15 blocks
                     ReprocessBlocks(15);
                 }
@@ -409,15 +454,12 @@ bool CheckForConflictingLocks(CTransaction& tx)
         Blocks could have been rejected during this time, which is OK. After they cancel out, the client will
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                LogPrintf("InstantX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if(mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if(mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
-                return true;
-            }
-        }
+    uint256 txHashLock;
+    if(txLockManager.HasConflictingLock(tx, txHashLock)){
+        LogPrintf("InstantX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), txHashLock.ToString().c_str());
+        txLockManager.ExpireLock(tx.GetHash());
+        txLockManager.ExpireLock(txHashLock);
+        return true;
     }
 
     return false;
@@ -438,44 +480,21 @@ int64_t GetAverageVoteTime()
     return total / count;
 }
 
-void CleanTransactionLocksList()
-{
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
-
-    while(it != mapTxLocks.end()) {
-        if(GetTime() > it->second.nExpiration){ //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
-
-            if(mapTxLockReq.count(it->second.txHash)){
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
-
-                BOOST_FOREACH(const CTxIn& in, tx.vin)
-                    mapLockedInputs.erase(in.prevout);
-
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
-
-                BOOST_FOREACH(CConsensusVote& v, it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
-
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
-        }
-    }
-}
-
 uint256 CConsensusVote::GetHash() const
 {
     return vinStormnode.prevout.hash + vinStormnode.prevout.n + txHash;
 }
 
 
+std::string CConsensusVote::GetSignatureMessage() const
+{
+    return txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+}
+
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetSignatureMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
     CStormnode* psn = snodeman.Find(vinStormnode);
@@ -500,7 +519,7 @@ bool CConsensusVote::Sign()
 
     CKey key2;
     CPubKey pubkey2;
-    std::string strMessage = txHash.ToString().c_str() + boost::lexical_cast<std::string>(nBlockHeight);
+    std::string strMessage = GetSignatureMessage();
     //LogPrintf("signing strMessage %s \n", strMessage.c_str());
     //LogPrintf("signing privkey %s \n", strStormNodePrivKey.c_str());
 
@@ -552,6 +571,27 @@ bool CTransactionLock::SignaturesValid()
     return true;
 }
 
+bool CTxLockProof::IsWellFormed(std::string& strErrorRet) const
+{
+    if(vecVotes.size() < INSTANTX_SIGNATURES_REQUIRED || vecVotes.size() > INSTANTX_SIGNATURES_TOTAL){
+        strErrorRet = strprintf("%d votes", vecVotes.size());
+        return false;
+    }
+
+    std::set<COutPoint> setStormnodes;
+    BOOST_FOREACH(const CConsensusVote& vote, vecVotes){
+        if(vote.txHash != txHash || vote.nBlockHeight != nBlockHeight){
+            strErrorRet = strprintf("vote for %s at %d", vote.txHash.ToString(), vote.nBlockHeight);
+            return false;
+        }
+        if(!setStormnodes.insert(vote.vinStormnode.prevout).second){
+            strErrorRet = strprintf("two votes of stormnode %s", vote.vinStormnode.prevout.ToStringShort());
+            return false;
+        }
+    }
+    return true;
+}
+
 void CTransactionLock::AddSignature(CConsensusVote& cv)
 {
     vecConsensusVotes.push_back(cv);
@@ -574,3 +614,277 @@ int CTransactionLock::CountSignatures()
     }
     return n;
 }
+
+// upper bounds of the lock completion latency buckets, in milliseconds
+static const int64_t nLatencyBuckets[] = {250, 500, 1000, 2000, 3000, 5000, 10000, 30000, 60000};
+static const unsigned int nLatencyBucketCount = sizeof(nLatencyBuckets) / sizeof(nLatencyBuckets[0]);
+
+int64_t CTxLockManager::Stats::GetLatencyPercentile(double dFraction) const
+{
+    uint64_t nCount = 0;
+    for (unsigned int i = 0; i < vLatency.size(); i++)
+    {
+        nCount += vLatency[i].second;
+        if (nCount > 0 && nCount >= dFraction * nCompleted)
+            return vLatency[i].first >= 0 ? vLatency[i].first : nMaxCompleteTime;
+    }
+    return 0;
+}
+
+CTxLockManager::CTxLockManager()
+{
+    stats.nRequests = 0;
+    stats.nRejected = 0;
+    stats.nVotes = 0;
+    stats.nLocks = 0;
+    stats.nLockedInputs = 0;
+    stats.nCompleted = 0;
+    stats.nCompleteTime = 0;
+    stats.nMaxCompleteTime = 0;
+    for (unsigned int i = 0; i < nLatencyBucketCount; i++)
+        stats.vLatency.push_back(make_pair(nLatencyBuckets[i], (uint64_t)0));
+    stats.vLatency.push_back(make_pair((int64_t)-1, (uint64_t)0));
+}
+
+bool CTxLockManager::HasRequest(const uint256& txHash)
+{
+    return mapTxLockReq.Contains(txHash);
+}
+
+bool CTxLockManager::GetRequest(const uint256& txHash, CTransaction& txRet)
+{
+    return mapTxLockReq.Get(txHash, txRet);
+}
+
+bool CTxLockManager::AddRequest(const CTransaction& tx)
+{
+    return mapTxLockReq.Insert(tx.GetHash(), tx);
+}
+
+bool CTxLockManager::IsRejected(const uint256& txHash)
+{
+    return mapTxLockReqRejected.Contains(txHash);
+}
+
+bool CTxLockManager::AddRejected(const CTransaction& tx)
+{
+    return mapTxLockReqRejected.Insert(tx.GetHash(), tx);
+}
+
+bool CTxLockManager::HasVote(const uint256& hash)
+{
+    return mapTxLockVote.Contains(hash);
+}
+
+bool CTxLockManager::GetVote(const uint256& hash, CConsensusVote& voteRet)
+{
+    return mapTxLockVote.Get(hash, voteRet);
+}
+
+bool CTxLockManager::AddVote(const CConsensusVote& vote)
+{
+    return mapTxLockVote.Insert(vote.GetHash(), vote);
+}
+
+// Record the latency of a lock the first time it has enough signatures, requires its stripe lock
+void CTxLockManager::CheckCompleted(CTransactionLock& lock)
+{
+    if (lock.fCompleted || lock.CountSignatures() < INSTANTX_SIGNATURES_REQUIRED)
+        return;
+    lock.fCompleted = true;
+
+    int64_t nTime = std::max(GetTimeMillis() - lock.nTimeCreated, (int64_t)0);
+    unsigned int nBucket = 0;
+    while (nBucket < nLatencyBucketCount && nTime > nLatencyBuckets[nBucket])
+        nBucket++;
+
+    LOCK(cs_stats);
+    stats.nCompleted++;
+    stats.nCompleteTime += nTime;
+    stats.nMaxCompleteTime = std::max(stats.nMaxCompleteTime, nTime);
+    stats.vLatency[nBucket].second++;
+    LogPrint("instantx", "CTxLockManager - Transaction Lock %s complete after %dms\n", lock.txHash.ToString(), nTime);
+}
+
+bool CTxLockManager::CreateLock(const uint256& txHash, int nBlockHeight)
+{
+    CLockStripedMap<uint256, CTransactionLock>::Stripe& stripe = mapTxLocks.GetStripe(txHash);
+    LOCK(stripe.cs);
+
+    std::map<uint256, CTransactionLock>::iterator it = stripe.map.find(txHash);
+    if (it != stripe.map.end()) {
+        if (nBlockHeight != 0) {
+            (*it).second.nBlockHeight = nBlockHeight;
+            CheckCompleted((*it).second);
+        }
+        return false;
+    }
+
+    CTransactionLock newLock;
+    newLock.nBlockHeight = nBlockHeight;
+    newLock.nExpiration = GetTime()+(60*60); //locks expire after 60 minutes (56-60 confirmations)
+    newLock.nTimeout = GetTime()+(60*5);
+    newLock.nTimeCreated = GetTimeMillis();
+    newLock.fCompleted = false;
+    newLock.txHash = txHash;
+    stripe.map.insert(make_pair(txHash, newLock));
+
+    {
+        LOCK(cs_expiry);
+        setExpiry.insert(make_pair((int64_t)newLock.nExpiration, txHash));
+    }
+    return true;
+}
+
+bool CTxLockManager::AddLockSignature(const CConsensusVote& vote, int& nSignaturesRet)
+{
+    CLockStripedMap<uint256, CTransactionLock>::Stripe& stripe = mapTxLocks.GetStripe(vote.txHash);
+    LOCK(stripe.cs);
+
+    std::map<uint256, CTransactionLock>::iterator it = stripe.map.find(vote.txHash);
+    if (it == stripe.map.end())
+        return false;
+
+    CConsensusVote cv = vote;
+    (*it).second.AddSignature(cv);
+    CheckCompleted((*it).second);
+    nSignaturesRet = (*it).second.CountSignatures();
+    return true;
+}
+
+int CTxLockManager::GetLockSignatures(const uint256& txHash)
+{
+    CLockStripedMap<uint256, CTransactionLock>::Stripe& stripe = mapTxLocks.GetStripe(txHash);
+    LOCK(stripe.cs);
+
+    std::map<uint256, CTransactionLock>::iterator it = stripe.map.find(txHash);
+    if (it == stripe.map.end())
+        return -1;
+    return (*it).second.CountSignatures();
+}
+
+bool CTxLockManager::IsLockTimedOut(const uint256& txHash)
+{
+    CLockStripedMap<uint256, CTransactionLock>::Stripe& stripe = mapTxLocks.GetStripe(txHash);
+    LOCK(stripe.cs);
+
+    std::map<uint256, CTransactionLock>::const_iterator it = stripe.map.find(txHash);
+    if (it == stripe.map.end())
+        return false;
+    return GetTime() > (*it).second.nTimeout;
+}
+
+bool CTxLockManager::GetLockProof(const uint256& txHash, CTxLockProof& proofRet)
+{
+    CLockStripedMap<uint256, CTransactionLock>::Stripe& stripe = mapTxLocks.GetStripe(txHash);
+    LOCK(stripe.cs);
+
+    std::map<uint256, CTransactionLock>::iterator it = stripe.map.find(txHash);
+    if (it == stripe.map.end() || (*it).second.CountSignatures() < INSTANTX_SIGNATURES_REQUIRED)
+        return false;
+
+    const CTransactionLock& lock = (*it).second;
+    proofRet.txHash = txHash;
+    proofRet.nBlockHeight = lock.nBlockHeight;
+    proofRet.vecVotes.clear();
+
+    std::set<COutPoint> setStormnodes;
+    BOOST_FOREACH(const CConsensusVote& vote, lock.vecConsensusVotes) {
+        if (proofRet.vecVotes.size() >= INSTANTX_SIGNATURES_TOTAL)
+            break;
+        if (vote.nBlockHeight == lock.nBlockHeight && setStormnodes.insert(vote.vinStormnode.prevout).second)
+            proofRet.vecVotes.push_back(vote);
+    }
+    return proofRet.vecVotes.size() >= INSTANTX_SIGNATURES_REQUIRED;
+}
+
+void CTxLockManager::ExpireLock(const uint256& txHash)
+{
+    CLockStripedMap<uint256, CTransactionLock>::Stripe& stripe = mapTxLocks.GetStripe(txHash);
+    LOCK(stripe.cs);
+
+    std::map<uint256, CTransactionLock>::iterator it = stripe.map.find(txHash);
+    if (it == stripe.map.end())
+        return;
+
+    {
+        LOCK(cs_expiry);
+        setExpiry.erase(make_pair((int64_t)(*it).second.nExpiration, txHash));
+        (*it).second.nExpiration = GetTime();
+        setExpiry.insert(make_pair((int64_t)(*it).second.nExpiration, txHash));
+    }
+}
+
+bool CTxLockManager::GetLockedInput(const COutPoint& outpoint, uint256& txHashRet)
+{
+    return mapLockedInputs.Get(outpoint, txHashRet);
+}
+
+void CTxLockManager::LockInputs(const CTransaction& tx)
+{
+    BOOST_FOREACH(const CTxIn& in, tx.vin)
+        mapLockedInputs.Insert(in.prevout, tx.GetHash());
+}
+
+bool CTxLockManager::HasConflictingLock(const CTransaction& tx, uint256& txHashLockRet)
+{
+    BOOST_FOREACH(const CTxIn& in, tx.vin){
+        if(mapLockedInputs.Get(in.prevout, txHashLockRet) && txHashLockRet != tx.GetHash())
+            return true;
+    }
+    return false;
+}
+
+void CTxLockManager::Clean()
+{
+    // keep transaction locks in memory for an hour
+    std::vector<uint256> vExpired;
+    {
+        LOCK(cs_expiry);
+        while (!setExpiry.empty() && GetTime() > setExpiry.begin()->first) {
+            vExpired.push_back(setExpiry.begin()->second);
+            setExpiry.erase(setExpiry.begin());
+        }
+    }
+
+    BOOST_FOREACH(const uint256& txHash, vExpired) {
+        CTransactionLock lock;
+        {
+            CLockStripedMap<uint256, CTransactionLock>::Stripe& stripe = mapTxLocks.GetStripe(txHash);
+            LOCK(stripe.cs);
+            std::map<uint256, CTransactionLock>::iterator it = stripe.map.find(txHash);
+            if (it == stripe.map.end())
+                continue;
+            lock = (*it).second;
+            stripe.map.erase(it);
+        }
+        LogPrintf("Removing old transaction lock %s\n", txHash.ToString().c_str());
+
+        CTransaction tx;
+        if(GetRequest(txHash, tx)){
+            BOOST_FOREACH(const CTxIn& in, tx.vin)
+                mapLockedInputs.Erase(in.prevout);
+
+            mapTxLockReq.Erase(txHash);
+            mapTxLockReqRejected.Erase(txHash);
+
+            BOOST_FOREACH(CConsensusVote& v, lock.vecConsensusVotes)
+                mapTxLockVote.Erase(v.GetHash());
+        }
+    }
+}
+
+CTxLockManager::Stats CTxLockManager::GetStats()
+{
+    Stats ret;
+    {
+        LOCK(cs_stats);
+        ret = stats;
+    }
+    ret.nRequests = mapTxLockReq.size();
+    ret.nRejected = mapTxLockReqRejected.size();
+    ret.nVotes = mapTxLockVote.size();
+    ret.nLocks = mapTxLocks.size();
+    ret.nLockedInputs = mapLockedInputs.size();
+    return ret;
+}
@@ -7,6 +7,9 @@
 
 #include "primitives/transaction.h"
 #include "streams.h"
+#include "sync.h"
+
+#include <set>
 
 /*
     At 15 signatures, 1/2 of the stormnode network can be owned by
@@ -20,17 +23,19 @@
 #define INSTANTX_SIGNATURES_REQUIRED           10
 #define INSTANTX_SIGNATURES_TOTAL              15
 
+/** Stripes of each InstantX table, every one behind its own lock */
+static const unsigned int INSTANTX_LOCK_STRIPES = 16;
+
 using namespace std;
 using namespace boost;
 
 class CConsensusVote;
 class CTransactionLock;
+class CTxLockProof;
 
-extern map<uint256, CTransaction> mapTxLockReq;
-extern map<uint256, CTransaction> mapTxLockReqRejected;
-extern map<uint256, CConsensusVote> mapTxLockVote;
-extern map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
+class CTxLockManager;
+
+extern CTxLockManager txLockManager;
 extern int nCompleteTXLocks;
 
 
@@ -50,9 +55,6 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight);
 //process consensus vote message
 bool ProcessConsensusVote(CNode *pnode, CConsensusVote& ctx);
 
-// keep transaction locks in memory for an hour
-void CleanTransactionLocksList();
-
 int64_t GetAverageVoteTime();
 
 class CConsensusVote
@@ -65,6 +67,7 @@ public:
 
     uint256 GetHash() const;
 
+    std::string GetSignatureMessage() const;
     bool SignatureValid();
     bool Sign();
 
@@ -87,6 +90,8 @@ public:
     std::vector<CConsensusVote> vecConsensusVotes;
     int nExpiration;
     int nTimeout;
+    int64_t nTimeCreated; // GetTimeMillis() when the lock was first seen
+    bool fCompleted; // reached INSTANTX_SIGNATURES_REQUIRED, its latency is recorded
 
     bool SignaturesValid();
     int CountSignatures();
@@ -98,5 +103,186 @@ public:
     }
 };
 
+/**
+ * The votes of a complete transaction lock in one message ("txlproof").
+ *
+ * Once a lock has INSTANTX_SIGNATURES_REQUIRED signatures, peers get this
+ * one inventory instead of an inv and getdata round trip for every vote, and
+ * check all the signatures at once. Its hash is that of the transaction, a
+ * lock has one proof whichever votes it carries.
+ */
+class CTxLockProof
+{
+public:
+    uint256 txHash;
+    int nBlockHeight;
+    std::vector<CConsensusVote> vecVotes;
+
+    CTxLockProof() : nBlockHeight(0) {}
+
+    uint256 GetHash() const { return txHash; }
+
+    /** Enough votes for the lock, all for it, at its height and from different stormnodes */
+    bool IsWellFormed(std::string& strErrorRet) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(txHash);
+        READWRITE(nBlockHeight);
+        READWRITE(vecVotes);
+    }
+};
+
+inline unsigned int GetLockStripe(const uint256& hash) { return hash.GetLow64() % INSTANTX_LOCK_STRIPES; }
+inline unsigned int GetLockStripe(const COutPoint& outpoint) { return (outpoint.hash.GetLow64() + outpoint.n) % INSTANTX_LOCK_STRIPES; }
+
+/** A map split into INSTANTX_LOCK_STRIPES maps by key hash, each with its own lock */
+template <typename K, typename V>
+class CLockStripedMap
+{
+public:
+    struct Stripe
+    {
+        CCriticalSection cs;
+        std::map<K, V> map;
+    };
+
+    Stripe& GetStripe(const K& key) { return vStripes[GetLockStripe(key)]; }
+
+    bool Contains(const K& key)
+    {
+        Stripe& stripe = GetStripe(key);
+        LOCK(stripe.cs);
+        return stripe.map.count(key) > 0;
+    }
+
+    bool Get(const K& key, V& valueRet)
+    {
+        Stripe& stripe = GetStripe(key);
+        LOCK(stripe.cs);
+        typename std::map<K, V>::const_iterator it = stripe.map.find(key);
+        if (it == stripe.map.end())
+            return false;
+        valueRet = it->second;
+        return true;
+    }
+
+    /** False if key is already there, its value is kept */
+    bool Insert(const K& key, const V& value)
+    {
+        Stripe& stripe = GetStripe(key);
+        LOCK(stripe.cs);
+        return stripe.map.insert(std::make_pair(key, value)).second;
+    }
+
+    bool Erase(const K& key)
+    {
+        Stripe& stripe = GetStripe(key);
+        LOCK(stripe.cs);
+        return stripe.map.erase(key) > 0;
+    }
+
+    unsigned int size()
+    {
+        unsigned int nSize = 0;
+        for (unsigned int i = 0; i < INSTANTX_LOCK_STRIPES; i++)
+        {
+            LOCK(vStripes[i].cs);
+            nSize += vStripes[i].map.size();
+        }
+        return nSize;
+    }
+
+private:
+    Stripe vStripes[INSTANTX_LOCK_STRIPES];
+};
+
+/**
+ * Holds the lock requests, votes, transaction locks and locked inputs of InstantX.
+ *
+ * The tables are looked up by the message handler, block and mempool checks,
+ * the wallet and RPC. Each is striped by hash so that lookups of different
+ * transactions don't wait on each other, and the locks are indexed by
+ * expiration so Clean() only visits those that are due. A stripe lock is
+ * never held while taking another, except cs_expiry, which comes last.
+ *
+ * The time from the first sight of a lock to INSTANTX_SIGNATURES_REQUIRED
+ * signatures is recorded in a histogram for getinstantxstats.
+ */
+class CTxLockManager
+{
+public:
+    struct Stats
+    {
+        unsigned int nRequests;
+        unsigned int nRejected;
+        unsigned int nVotes;
+        unsigned int nLocks;
+        unsigned int nLockedInputs;
+        uint64_t nCompleted;            //! locks that reached INSTANTX_SIGNATURES_REQUIRED since startup
+        int64_t nCompleteTime;          //! milliseconds, summed over those locks
+        int64_t nMaxCompleteTime;
+        //! upper bound in milliseconds of each latency bucket and its count, the last is unbounded (-1)
+        std::vector<std::pair<int64_t, uint64_t> > vLatency;
+
+        /** Latency in milliseconds below which dFraction of the completed locks fall, by bucket */
+        int64_t GetLatencyPercentile(double dFraction) const;
+    };
+
+    CTxLockManager();
+
+    bool HasRequest(const uint256& txHash);
+    bool GetRequest(const uint256& txHash, CTransaction& txRet);
+    bool AddRequest(const CTransaction& tx);
+    bool IsRejected(const uint256& txHash);
+    bool AddRejected(const CTransaction& tx);
+
+    bool HasVote(const uint256& hash);
+    bool GetVote(const uint256& hash, CConsensusVote& voteRet);
+    /** False if the vote was already known */
+    bool AddVote(const CConsensusVote& vote);
+
+    /** Start tracking the lock of a transaction, nBlockHeight 0 if it is only known from a vote.
+     *  False if it was tracked already, its height is then updated unless nBlockHeight is 0. */
+    bool CreateLock(const uint256& txHash, int nBlockHeight);
+    /** Add a vote to the lock of its transaction and count the signatures. False without a lock. */
+    bool AddLockSignature(const CConsensusVote& vote, int& nSignaturesRet);
+    /** Signatures of the lock of txHash, -1 without a lock or its block height */
+    int GetLockSignatures(const uint256& txHash);
+    bool IsLockTimedOut(const uint256& txHash);
+    /** The proof of the lock of txHash from its votes at the lock height. False until it is complete. */
+    bool GetLockProof(const uint256& txHash, CTxLockProof& proofRet);
+    /** Let the lock of txHash expire at the next Clean() */
+    void ExpireLock(const uint256& txHash);
+
+    bool GetLockedInput(const COutPoint& outpoint, uint256& txHashRet);
+    /** Lock the inputs of tx that no other transaction has locked */
+    void LockInputs(const CTransaction& tx);
+    /** True if an input of tx is locked by another transaction, returned in txHashLockRet */
+    bool HasConflictingLock(const CTransaction& tx, uint256& txHashLockRet);
+
+    /** Remove the locks that expired, with their requests, votes and inputs */
+    void Clean();
+
+    Stats GetStats();
+
+private:
+    CLockStripedMap<uint256, CTransaction> mapTxLockReq;
+    CLockStripedMap<uint256, CTransaction> mapTxLockReqRejected;
+    CLockStripedMap<uint256, CConsensusVote> mapTxLockVote;
+    CLockStripedMap<uint256, CTransactionLock> mapTxLocks;
+    CLockStripedMap<COutPoint, uint256> mapLockedInputs;
+
+    CCriticalSection cs_expiry;
+    std::set<std::pair<int64_t, uint256> > setExpiry;
+
+    CCriticalSection cs_stats;
+    Stats stats;
+
+    void CheckCompleted(CTransactionLock& lock);
+};
+
 
 #endif //INSTANTX_H
@@ -15,7 +15,10 @@
 #include "anon/sandstorm/sandstorm.h"
 #include "init.h"
 #include "util.h"
+#include "anon/stormnode/stormnode-budget.h"
+#include "anon/stormnode/stormnode-cache.h"
 #include "anon/stormnode/stormnode-payments.h"
+#include "anon/stormnode/stormnode-sigverify.h"
 #include "anon/stormnode/stormnode-sync.h"
 #include "script/script.h"
 #include "anon/instantx/instantx.h"
@@ -2079,20 +2082,17 @@ bool CSandStormSigner::SignMessage(std::string strMessage, std::string& errorMes
 
 bool CSandStormSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
 {
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << strMessageMagic;
-    ss << strMessage;
-
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+    // the key was usually recovered ahead of time by sigVerifyQueue
+    CKeyID keyID;
+    if (!sigVerifyQueue.Recover(CSigCheck(strMessage, vchSig), keyID)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CSandStormSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CSandStormSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
 
-    return (pubkey2.GetID() == pubkey.GetID());
+    return (keyID == pubkey.GetID());
 }
 
 bool CSandstormQueue::Sign()
@@ -2235,10 +2235,16 @@ void ThreadCheckSandStormPool()
                 snodeman.CheckAndRemove();
                 snodeman.ProcessStormnodeConnections();
                 stormnodePayments.CleanPaymentList();
-                CleanTransactionLocksList();
+                txLockManager.Clean();
             }
 
-            //if(c % STORMNODES_DUMP_SECONDS == 0) DumpStormnodes();
+            // write what changed since the last flush, so a crash loses at most this much
+            if(c % STORMNODE_CACHE_FLUSH_SECONDS == 0)
+            {
+                DumpStormnodes();
+                DumpBudgets();
+                DumpStormnodePayments();
+            }
 
             sandStormPool.CheckTimeout();
             sandStormPool.CheckForCompleteQueue();
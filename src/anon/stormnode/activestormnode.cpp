@@ -35,7 +35,7 @@ void CActiveStormnode::ManageStatus()
         CStormnode *psn;
         psn = snodeman.Find(pubKeyStormnode);
         if(psn != NULL) {
-            psn->Check();
+            snodeman.CheckAndMark(*psn);
             if((psn->IsEnabled() || psn->IsPreEnabled()) && psn->protocolVersion == PROTOCOL_VERSION)
                     EnableHotColdStormNode(psn->vin, psn->addr);
         }
@@ -6,6 +6,7 @@
 #include <boost/lexical_cast.hpp>
 
 #include "anon/stormnode/stormnode-budget.h"
+#include "anon/stormnode/stormnode-cache.h"
 #include "main.h"
 #include "init.h"
 #include "anon/stormnode/stormnode.h"
@@ -16,6 +17,8 @@
 #include "addrman.h"
 
 CBudgetManager budget;
+/** Incremental on-disk copy of budget */
+static CCacheJournal budgetCacheJournal("budget.jnl", "StormnodeBudget");
 CCriticalSection cs_budget;
 
 std::map<uint256, int64_t> askedForSourceProposalOrBudget;
@@ -333,37 +336,69 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
     return Ok;
 }
 
-void DumpBudgets()
+void LoadBudgets()
 {
     int64_t nStart = GetTimeMillis();
 
-    CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
+    if (LoadFromJournal(budgetCacheJournal, budget))
+    {
+        LogPrintf("Loaded info from budget.jnl  %dms\n", GetTimeMillis() - nStart);
+        LogPrintf("  %s\n", budget.ToString());
+        LogPrintf("Budget manager - cleaning....\n");
+        budget.CheckAndRemove();
+        LogPrintf("Budget manager - %s\n", budget.ToString());
+        return;
+    }
 
-    LogPrintf("Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
+    // no journal yet, take over the cache file of older versions; the first flush starts the journal
+    CBudgetDB budgetdb;
+    CBudgetDB::ReadResult readResult = budgetdb.Read(budget);
     if (readResult == CBudgetDB::FileError)
-        LogPrintf("Missing budgets file - budget.dat, will try to recreate\n");
+        LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
     else if (readResult != CBudgetDB::Ok)
     {
         LogPrintf("Error reading budget.dat: ");
         if(readResult == CBudgetDB::IncorrectFormat)
             LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
         else
-        {
             LogPrintf("file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
     }
-    LogPrintf("Writting info to budget.dat...\n");
-    budgetdb.Write(budget);
+}
 
-    LogPrintf("Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+void DumpBudgets()
+{
+    int64_t nStart = GetTimeMillis();
+
+    if (FlushToJournal(budgetCacheJournal, budget))
+        LogPrint("stormnode", "Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+}
+
+void CBudgetManager::GetCacheSections(CCacheSections& sections) const
+{
+    LOCK(cs);
+    sections.AddSeenMap(mapSeenStormnodeBudgetProposals);
+    sections.AddSeenMap(mapSeenStormnodeBudgetVotes);
+    sections.AddSeenMap(mapSeenFinalizedBudgets);
+    sections.AddSeenMap(mapSeenFinalizedBudgetVotes);
+    sections.AddMap(mapOrphanStormnodeBudgetVotes);
+    sections.AddSeenMap(mapSeenStormnodeBudgetVotes);
+
+    sections.AddMap(mapProposals);
+    sections.AddMap(mapFinalizedBudgets);
+}
+
+// A vote keeps its place in the change log when a stormnode changes it
+static uint256 GetVoteSyncKey(const uint256& nParentHash, const CTxIn& vin)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << nParentHash;
+    ss << vin.prevout;
+    return ss.GetHash();
 }
 
 bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
 {
+    LOCK(cs);
     std::string strError = "";
     if(!finalizedBudget.IsValid(strError)) return false;
 
@@ -372,6 +407,7 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
     }
 
     mapFinalizedBudgets.insert(make_pair(finalizedBudget.GetHash(), finalizedBudget));
+    changeLog.Changed(finalizedBudget.GetHash(), CInv(MSG_BUDGET_FINALIZED, finalizedBudget.GetHash()));
     return true;
 }
 
@@ -388,10 +424,54 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
         return false;
     }
 
-    mapProposals.insert(make_pair(budgetProposal.GetHash(), budgetProposal));
+    uint256 nHash = budgetProposal.GetHash();
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.insert(make_pair(nHash, budgetProposal)).first;
+    UpdateProposalRank(nHash, (*it).second);
+    changeLog.Changed(nHash, CInv(MSG_BUDGET_PROPOSAL, nHash));
     return true;
 }
 
+// requires cs
+void CBudgetManager::UpdateProposalRank(const uint256& nHash, CBudgetProposal& budgetProposal)
+{
+    CProposalRank rank;
+    rank.nAbsoluteYesCount = budgetProposal.GetAbsoluteYesCount();
+    rank.nFeeTXHash = budgetProposal.nFeeTXHash;
+    rank.nHash = nHash;
+
+    std::map<uint256, CProposalRank>::iterator it = mapProposalRanks.find(nHash);
+    if(it != mapProposalRanks.end()) {
+        if(!((*it).second < rank) && !(rank < (*it).second)) return;
+        setProposalRanks.erase((*it).second);
+    }
+    setProposalRanks.insert(rank);
+    mapProposalRanks[nHash] = rank;
+}
+
+void CBudgetManager::RebuildProposalRanks()
+{
+    LOCK(cs);
+
+    setProposalRanks.clear();
+    mapProposalRanks.clear();
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while(it != mapProposals.end()) {
+        UpdateProposalRank((*it).first, (*it).second);
+        ++it;
+    }
+}
+
+// Recheck the votes of every proposal against the stormnode list, requires cs
+void CBudgetManager::CleanProposals()
+{
+    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
+    while(it != mapProposals.end()) {
+        (*it).second.CleanAndRemove(false, &changeLog);
+        UpdateProposalRank((*it).first, (*it).second);
+        ++it;
+    }
+}
+
 void CBudgetManager::CheckAndRemove()
 {
     LogPrintf("CBudgetManager::CheckAndRemove \n");
@@ -405,15 +485,25 @@ void CBudgetManager::CheckAndRemove()
     {
         CFinalizedBudget* pfinalizedBudget = &((*it).second);
 
+        bool fWasValid = pfinalizedBudget->fValid;
         pfinalizedBudget->fValid = pfinalizedBudget->IsValid(strError);
+        // peers skip invalid items when syncing, one that turned valid has to show up in their next delta
+        if(pfinalizedBudget->fValid != fWasValid)
+            changeLog.Changed((*it).first, CInv(MSG_BUDGET_FINALIZED, (*it).first));
         if(pfinalizedBudget->fValid) {
             pfinalizedBudget->AutoCheck();
             ++it;
         continue;
         } else if(pfinalizedBudget->nBlockStart != 0 && pfinalizedBudget->nBlockStart < pindexPrev->nHeight - GetBudgetPaymentCycleBlocks()) {
         // if it's too old, remove it        
-            mapFinalizedBudgets.erase(it++);
             LogPrintf("CBudgetManager::CheckAndRemove - removing budget %s\n", pfinalizedBudget->GetHash().ToString());
+            changeLog.Forget((*it).first);
+            std::map<uint256, CFinalizedBudgetVote>::iterator it3 = pfinalizedBudget->mapVotes.begin();
+            while(it3 != pfinalizedBudget->mapVotes.end()) {
+                changeLog.Forget(GetVoteSyncKey((*it).first, (*it3).second.vin));
+                ++it3;
+            }
+            mapFinalizedBudgets.erase(it++);
             continue;
         }
         // it's not valid already but it's not too old yet, keep it and move to the next one
@@ -424,7 +514,10 @@ void CBudgetManager::CheckAndRemove()
     while(it2 != mapProposals.end())
     {
         CBudgetProposal* pbudgetProposal = &((*it2).second);
+        bool fWasValid = pbudgetProposal->fValid;
         pbudgetProposal->fValid = pbudgetProposal->IsValid(strError);
+        if(pbudgetProposal->fValid != fWasValid)
+            changeLog.Changed((*it2).first, CInv(MSG_BUDGET_PROPOSAL, (*it2).first));
         ++it2;
     }
 }
@@ -610,11 +703,11 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 
     std::vector<CBudgetProposal*> vBudgetProposalRet;
 
+    CleanProposals();
+
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while(it != mapProposals.end())
     {
-        (*it).second.CleanAndRemove(false);
-
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
 
@@ -624,34 +717,14 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
     return vBudgetProposalRet;
 }
 
-//
-// Sort by votes, if there's a tie sort by their feeHash TX
-//
-struct sortProposalsByVotes {
-    bool operator()(const std::pair<CBudgetProposal*, int> &left, const std::pair<CBudgetProposal*, int> &right) {
-      if( left.second != right.second)
-        return (left.second > right.second);
-      return (left.first->nFeeTXHash > right.first->nFeeTXHash);
-    }
-};
-
 //Need to review this function
 std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
-    // ------- Sort budgets by Yes Count
+    // ------- Budgets are kept sorted by Yes Count, if there's a tie by their feeHash TX
 
-    std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
-
-    std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
-    while(it != mapProposals.end()){
-        (*it).second.CleanAndRemove(false);
-        vBudgetPorposalsSort.push_back(make_pair(&((*it).second), (*it).second.GetYesCount()-(*it).second.GetNoCount()));
-        ++it;
-    }
-
-    std::sort(vBudgetPorposalsSort.begin(), vBudgetPorposalsSort.end(), sortProposalsByVotes());
+    CleanProposals();
 
     // ------- Grab The Budgets In Order
 
@@ -664,12 +737,16 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % GetBudgetPaymentCycleBlocks() + GetBudgetPaymentCycleBlocks();
     int nBlockEnd  =  nBlockStart + 100;
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
+    int nMinAbsoluteYesCount = snodeman.CountEnabled(MIN_BUDGET_PEER_PROTO_VERSION)/10;
 
 
-    std::vector<std::pair<CBudgetProposal*, int> >::iterator it2 = vBudgetPorposalsSort.begin();
-    while(it2 != vBudgetPorposalsSort.end())
+    std::set<CProposalRank>::iterator it2 = setProposalRanks.begin();
+    while(it2 != setProposalRanks.end())
     {
-        CBudgetProposal* pbudgetProposal = (*it2).first;
+        // the rest have even fewer votes
+        if((*it2).nAbsoluteYesCount <= nMinAbsoluteYesCount) break;
+
+        CBudgetProposal* pbudgetProposal = &mapProposals[(*it2).nHash];
 
         printf("-> Budget Name : %s\n", pbudgetProposal->strProposalName.c_str());
         printf("------- nBlockStart : %d\n", pbudgetProposal->nBlockStart);
@@ -679,13 +756,13 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 
         printf("------- 1 : %d\n", pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= nBlockStart);
         printf("------- 2 : %d\n", pbudgetProposal->nBlockEnd >= nBlockEnd);
-        printf("------- 3 : %d\n", pbudgetProposal->GetYesCount() - pbudgetProposal->GetNoCount() > snodeman.CountEnabled(MIN_BUDGET_PEER_PROTO_VERSION)/10);
+        printf("------- 3 : %d\n", pbudgetProposal->GetAbsoluteYesCount() > nMinAbsoluteYesCount);
         printf("------- 4 : %d\n", pbudgetProposal->IsEstablished());
 
         //prop start/end should be inside this period
         if(pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= nBlockStart &&
                 pbudgetProposal->nBlockEnd >= nBlockEnd &&
-                pbudgetProposal->GetYesCount() - pbudgetProposal->GetNoCount() > snodeman.CountEnabled(MIN_BUDGET_PEER_PROTO_VERSION)/10 &&
+                pbudgetProposal->GetAbsoluteYesCount() > nMinAbsoluteYesCount &&
                 pbudgetProposal->IsEstablished())
         {
             printf("------- In range \n");
@@ -824,15 +901,11 @@ void CBudgetManager::NewBlock()
         }
     }
 
-    std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
-    while(it2 != mapProposals.end()){
-        (*it2).second.CleanAndRemove(false);
-        ++it2;
-    }
+    CleanProposals();
 
     std::map<uint256, CFinalizedBudget>::iterator it3 = mapFinalizedBudgets.begin();
     while(it3 != mapFinalizedBudgets.end()){
-        (*it3).second.CleanAndRemove(false);
+        (*it3).second.CleanAndRemove(false, &changeLog);
         ++it3;
     }
 
@@ -896,7 +969,11 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
     if (strCommand == "snvs") { //Stormnode vote sync
         uint256 nProp;
         vRecv >> nProp;
+        // peers that synced the budgets with us before add the cursor they got back then
+        CSyncCursor cursor;
+        if(!vRecv.empty()) vRecv >> cursor;
 
+        // once per connection, whether for all budget items or the changes
         if(Params().NetworkID() == CChainParams::MAIN){
             if(nProp == 0) {
                 if(pfrom->HasFulfilledRequest("snvs")) {
@@ -908,6 +985,11 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             }
         }
 
+        if(nProp == 0 && SyncChanges(pfrom, cursor)) {
+            LogPrintf("snvs - Sent changed budget items to %s\n", pfrom->addr.ToString());
+            return;
+        }
+
         Sync(pfrom, nProp);
         LogPrintf("snvs - Sent Stormnode votes to %s\n", pfrom->addr.ToString());
     }
@@ -1178,7 +1260,11 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
         ++it1;
     }
 
-    pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_PROP, nInvCount);
+    // a complete sync brings the peer up to our current change sequence
+    if(nProp == 0 && !fPartial)
+        pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_PROP, nInvCount, changeLog.GetCursor());
+    else
+        pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_PROP, nInvCount);
 
     LogPrintf("CBudgetManager::Sync - sent %d items\n", nInvCount);
 
@@ -1206,11 +1292,71 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial)
         ++it3;
     }
 
-    pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_FIN, nInvCount);
+    if(nProp == 0 && !fPartial)
+        pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_FIN, nInvCount, changeLog.GetCursor());
+    else
+        pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_FIN, nInvCount);
     LogPrintf("CBudgetManager::Sync - sent %d items\n", nInvCount);
 
 }
 
+// The checks Sync makes before it sends an item, requires cs
+bool CBudgetManager::IsSyncable(const CInv& inv)
+{
+    if(inv.type == MSG_BUDGET_PROPOSAL) {
+        CBudgetProposal* pbudgetProposal = FindProposal(inv.hash);
+        return mapSeenStormnodeBudgetProposals.count(inv.hash) && pbudgetProposal && pbudgetProposal->fValid;
+    }
+
+    if(inv.type == MSG_BUDGET_FINALIZED) {
+        CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget(inv.hash);
+        return mapSeenFinalizedBudgets.count(inv.hash) && pfinalizedBudget && pfinalizedBudget->fValid;
+    }
+
+    // only the current vote of a stormnode, the log may still name one it replaced
+    if(inv.type == MSG_BUDGET_VOTE) {
+        std::map<uint256, CBudgetVote>::iterator it = mapSeenStormnodeBudgetVotes.find(inv.hash);
+        if(it == mapSeenStormnodeBudgetVotes.end() || !IsSyncable(CInv(MSG_BUDGET_PROPOSAL, (*it).second.nProposalHash))) return false;
+        CBudgetProposal* pbudgetProposal = FindProposal((*it).second.nProposalHash);
+        std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.find((*it).second.vin.prevout.GetHash());
+        return it2 != pbudgetProposal->mapVotes.end() && (*it2).second.fValid && (*it2).second.GetHash() == inv.hash;
+    }
+
+    if(inv.type == MSG_BUDGET_FINALIZED_VOTE) {
+        std::map<uint256, CFinalizedBudgetVote>::iterator it = mapSeenFinalizedBudgetVotes.find(inv.hash);
+        if(it == mapSeenFinalizedBudgetVotes.end() || !IsSyncable(CInv(MSG_BUDGET_FINALIZED, (*it).second.nBudgetHash))) return false;
+        CFinalizedBudget* pfinalizedBudget = FindFinalizedBudget((*it).second.nBudgetHash);
+        std::map<uint256, CFinalizedBudgetVote>::iterator it2 = pfinalizedBudget->mapVotes.find((*it).second.vin.prevout.GetHash());
+        return it2 != pfinalizedBudget->mapVotes.end() && (*it2).second.fValid && (*it2).second.GetHash() == inv.hash;
+    }
+
+    return false;
+}
+
+bool CBudgetManager::SyncChanges(CNode* pfrom, const CSyncCursor& cursor)
+{
+    LOCK(cs);
+
+    std::vector<CInv> vInvChanged;
+    if(!changeLog.GetChangesSince(cursor, vInvChanged)) return false;
+
+    int nPropCount = 0;
+    int nFinCount = 0;
+    BOOST_FOREACH(const CInv& inv, vInvChanged) {
+        if(!IsSyncable(inv)) continue;
+        pfrom->PushInventory(inv);
+        if(inv.type == MSG_BUDGET_PROPOSAL || inv.type == MSG_BUDGET_VOTE)
+            nPropCount++;
+        else
+            nFinCount++;
+    }
+
+    pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_PROP, nPropCount, changeLog.GetCursor());
+    pfrom->PushMessage("ssc", STORMNODE_SYNC_BUDGET_FIN, nFinCount, changeLog.GetCursor());
+    LogPrintf("CBudgetManager::SyncChanges - sent %d of %d changed items\n", nPropCount + nFinCount, vInvChanged.size());
+    return true;
+}
+
 bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string& strError)
 {
     LOCK(cs);
@@ -1235,7 +1381,12 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    CBudgetProposal& budgetProposal = mapProposals[vote.nProposalHash];
+    if(!budgetProposal.AddOrUpdateVote(vote, strError)) return false;
+
+    UpdateProposalRank(vote.nProposalHash, budgetProposal);
+    changeLog.Changed(GetVoteSyncKey(vote.nProposalHash, vote.vin), CInv(MSG_BUDGET_VOTE, vote.GetHash()));
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1262,7 +1413,10 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
         return false;
     }
 
-    return mapFinalizedBudgets[vote.nBudgetHash].AddOrUpdateVote(vote, strError);
+    if(!mapFinalizedBudgets[vote.nBudgetHash].AddOrUpdateVote(vote, strError)) return false;
+
+    changeLog.Changed(GetVoteSyncKey(vote.nBudgetHash, vote.vin), CInv(MSG_BUDGET_FINALIZED_VOTE, vote.GetHash()));
+    return true;
 }
 
 CBudgetProposal::CBudgetProposal()
@@ -1273,6 +1427,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1286,6 +1441,13 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
+    nYesCount = other.nYesCount;
+    nNoCount = other.nNoCount;
+    nAbstainCount = other.nAbstainCount;
+    nYesTotal = other.nYesTotal;
+    nNoTotal = other.nNoTotal;
+    nCleanListVersion = other.nCleanListVersion;
+    nCleanRecheckTime = other.nCleanRecheckTime;
     fValid = true;
 }
 
@@ -1304,6 +1466,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
 
     nFeeTXHash = nFeeTXHashIn;
+    RecountVotes();
 }
 
 bool CBudgetProposal::IsValid(std::string& strError, bool fCheckCollateral)
@@ -1421,37 +1584,93 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         }
     }
 
-    mapVotes[hash] = vote;
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.find(hash);
+    if(it != mapVotes.end()) {
+        CountVote((*it).second, -1);
+        (*it).second = vote;
+    } else {
+        it = mapVotes.insert(make_pair(hash, vote)).first;
+    }
+    CountVote((*it).second, 1);
     return true;
 }
 
-// If stormnode voted for a proposal, but is now invalid -- remove the vote
-void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nWeight)
 {
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    if(vote.nVote == VOTE_YES) nYesTotal += nWeight;
+    if(vote.nVote == VOTE_NO) nNoTotal += nWeight;
+    if(!vote.fValid) return;
+
+    if(vote.nVote == VOTE_YES) nYesCount += nWeight;
+    if(vote.nVote == VOTE_NO) nNoCount += nWeight;
+    if(vote.nVote == VOTE_ABSTAIN) nAbstainCount += nWeight;
+}
+
+void CBudgetProposal::RecountVotes()
+{
+    nYesCount = nNoCount = nAbstainCount = 0;
+    nYesTotal = nNoTotal = 0;
+    nCleanListVersion = 0;
+    nCleanRecheckTime = 0;
 
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
     while(it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.IsValid(fSignatureCheck);
+        CountVote((*it).second, 1);
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio()
+void CBudgetProposal::SwapVotes(CBudgetProposal& other)
 {
-    int yeas = 0;
-    int nays = 0;
+    using std::swap;
 
+    mapVotes.swap(other.mapVotes);
+    swap(nYesCount, other.nYesCount);
+    swap(nNoCount, other.nNoCount);
+    swap(nAbstainCount, other.nAbstainCount);
+    swap(nYesTotal, other.nYesTotal);
+    swap(nNoTotal, other.nNoTotal);
+    swap(nCleanListVersion, other.nCleanListVersion);
+    swap(nCleanRecheckTime, other.nCleanRecheckTime);
+}
+
+// If stormnode voted for a proposal, but is now invalid -- remove the vote
+void CBudgetProposal::CleanAndRemove(bool fSignatureCheck, CSyncChangeLog* pchangeLog)
+{
+    // without the signatures a vote's validity only depends on its stormnode being
+    // in the list and on its time, so there is nothing to do if neither changed
+    unsigned int nListVersion = snodeman.GetListVersion();
+    int64_t nNow = GetTime();
+    if(!fSignatureCheck && nListVersion == nCleanListVersion && nNow < nCleanRecheckTime) return;
+
+    int64_t nRecheckTime = std::numeric_limits<int64_t>::max();
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while(it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES) yeas++;
-        if ((*it).second.nVote == VOTE_NO) nays++;
+        bool fVoteValid = (*it).second.IsValid(fSignatureCheck);
+        if(fVoteValid != (*it).second.fValid) {
+            CountVote((*it).second, -1);
+            (*it).second.fValid = fVoteValid;
+            CountVote((*it).second, 1);
+            if(pchangeLog) pchangeLog->Changed(GetVoteSyncKey((*it).second.nProposalHash, (*it).second.vin), CInv(MSG_BUDGET_VOTE, (*it).second.GetHash()));
+        }
+        // a vote too far ahead of the current time becomes valid later
+        if(!fVoteValid && (*it).second.nTime > nNow + (60*60))
+            nRecheckTime = std::min(nRecheckTime, (*it).second.nTime - (60*60));
         ++it;
     }
 
-    if(yeas+nays == 0) return 0.0f;
+    if(!fSignatureCheck) {
+        nCleanListVersion = nListVersion;
+        nCleanRecheckTime = nRecheckTime;
+    }
+}
 
-    return ((double)(yeas) / (double)(yeas+nays));
+double CBudgetProposal::GetRatio()
+{
+    if(nYesTotal+nNoTotal == 0) return 0.0f;
+
+    return ((double)(nYesTotal) / (double)(nYesTotal+nNoTotal));
 }
 
 int CBudgetProposal::GetAbsoluteYesCount()
@@ -1461,41 +1680,17 @@ int CBudgetProposal::GetAbsoluteYesCount()
 
 int CBudgetProposal::GetYesCount()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while(it != mapVotes.end()){
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nYesCount;
 }
 
 int CBudgetProposal::GetNoCount()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while(it != mapVotes.end()){
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nNoCount;
 }
 
 int CBudgetProposal::GetAbstainCount()
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
-    while(it != mapVotes.end()){
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nAbstainCount;
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1574,6 +1769,11 @@ void CBudgetVote::Relay()
     RelayInv(inv, MIN_BUDGET_PEER_PROTO_VERSION);
 }
 
+std::string CBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode)
 {
     // Choose coins to use
@@ -1581,7 +1781,7 @@ bool CBudgetVote::Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.SignMessage(strMessage, errorMessage, vchSig, keyStormnode)) {
         LogPrintf("CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1614,7 +1814,7 @@ bool CBudgetVote::IsValid(bool fSignatureCheck)
     if(!fSignatureCheck) return true;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.VerifyMessage(psn->pubkey2, vchSig, strMessage, errorMessage)) {
         LogPrintf("CBudgetVote::IsValid() - Verify message failed - Error: %s\n, errorMessage");
@@ -1749,12 +1949,15 @@ void CFinalizedBudget::AutoCheck()
     }
 }
 // If stormnode voted for a proposal, but is now invalid -- remove the vote
-void CFinalizedBudget::CleanAndRemove(bool fSignatureCheck)
+void CFinalizedBudget::CleanAndRemove(bool fSignatureCheck, CSyncChangeLog* pchangeLog)
 {
     std::map<uint256, CFinalizedBudgetVote>::iterator it = mapVotes.begin();
 
     while(it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.IsValid(fSignatureCheck);
+        bool fVoteValid = (*it).second.IsValid(fSignatureCheck);
+        if(fVoteValid != (*it).second.fValid && pchangeLog)
+            pchangeLog->Changed(GetVoteSyncKey((*it).second.nBudgetHash, (*it).second.vin), CInv(MSG_BUDGET_FINALIZED_VOTE, (*it).second.GetHash()));
+        (*it).second.fValid = fVoteValid;
         ++it;
     }
 }
@@ -1974,6 +2177,11 @@ void CFinalizedBudgetVote::Relay()
     RelayInv(inv, MIN_BUDGET_PEER_PROTO_VERSION);
 }
 
+std::string CFinalizedBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CFinalizedBudgetVote::Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode)
 {
     // Choose coins to use
@@ -1981,7 +2189,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.SignMessage(strMessage, errorMessage, vchSig, keyStormnode)) {
         LogPrintf("CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2014,7 +2222,7 @@ bool CFinalizedBudgetVote::IsValid(bool fSignatureCheck)
     if(!fSignatureCheck) return true;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.VerifyMessage(psn->pubkey2, vchSig, strMessage, errorMessage)) {
         LogPrintf("CFinalizedBudgetVote::IsValid() - Verify message failed\n");
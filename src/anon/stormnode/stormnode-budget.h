@@ -21,6 +21,7 @@ using namespace std;
 extern CCriticalSection cs_budget;
 
 class CBudgetManager;
+class CCacheSections;
 class CFinalizedBudgetBroadcast;
 class CFinalizedBudget;
 class CFinalizedBudgetVote;
@@ -44,6 +45,7 @@ extern std::vector<CBudgetProposalBroadcast> vecImmatureBudgetProposals;
 extern std::vector<CFinalizedBudgetBroadcast> vecImmatureFinalizedBudgets;
 
 extern CBudgetManager budget;
+void LoadBudgets();
 void DumpBudgets();
 
 // Define amount of blocks in budget payment cycle
@@ -82,6 +84,34 @@ private:
     //hold txes until they mature enough to use
     map<uint256, CTransaction> mapCollateral;
 
+    // a proposal's place in the budget: most net yes votes first, ties by fee tx hash
+    struct CProposalRank
+    {
+        int nAbsoluteYesCount;
+        uint256 nFeeTXHash;
+        uint256 nHash;
+
+        bool operator<(const CProposalRank& other) const
+        {
+            if(nAbsoluteYesCount != other.nAbsoluteYesCount) return nAbsoluteYesCount > other.nAbsoluteYesCount;
+            if(nFeeTXHash != other.nFeeTXHash) return nFeeTXHash > other.nFeeTXHash;
+            return nHash < other.nHash;
+        }
+    };
+
+    // all of mapProposals in budget order, updated whenever a proposal's tallies change
+    std::set<CProposalRank> setProposalRanks;
+    std::map<uint256, CProposalRank> mapProposalRanks;
+
+    void UpdateProposalRank(const uint256& nHash, CBudgetProposal& budgetProposal);
+    void RebuildProposalRanks();
+    void CleanProposals();
+
+    // new proposals, finalized budgets and votes, for peers asking for the changes since their last sync
+    CSyncChangeLog changeLog;
+
+    bool IsSyncable(const CInv& inv);
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -116,6 +146,8 @@ public:
     void ResetSync();
     void MarkSynced();
     void Sync(CNode* node, uint256 nProp, bool fPartial=false);
+    /// Send only what changed after cursor. False if the cursor can't be used, a full Sync is needed then.
+    bool SyncChanges(CNode* pfrom, const CSyncCursor& cursor);
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     void NewBlock();
@@ -148,6 +180,8 @@ public:
 
         LogPrintf("Budget object cleared\n");
         mapProposals.clear();
+        setProposalRanks.clear();
+        mapProposalRanks.clear();
         mapFinalizedBudgets.clear();
         mapSeenStormnodeBudgetProposals.clear();
         mapSeenStormnodeBudgetVotes.clear();
@@ -155,6 +189,7 @@ public:
         mapSeenFinalizedBudgetVotes.clear();
         mapOrphanStormnodeBudgetVotes.clear();
         mapOrphanFinalizedBudgetVotes.clear();
+        changeLog.Clear();
     }
 
     void CheckAndRemove();
@@ -173,7 +208,14 @@ public:
 
         READWRITE(mapProposals);
         READWRITE(mapFinalizedBudgets);
+        if (ser_action.ForRead()) {
+            RebuildProposalRanks();
+            changeLog.Clear();
+        }
     }
+
+    /// Same members as SerializationOp, split for the cache journal
+    void GetCacheSections(CCacheSections& sections) const;
 };
 
 class CTxBudgetPayment
@@ -221,7 +263,8 @@ public:
     CFinalizedBudget();
     CFinalizedBudget(const CFinalizedBudget& other);
 
-    void CleanAndRemove(bool fSignatureCheck);
+    /// Recheck the votes, recording the ones that turned valid or invalid in pchangeLog
+    void CleanAndRemove(bool fSignatureCheck, CSyncChangeLog* pchangeLog = NULL);
     bool AddOrUpdateVote(CFinalizedBudgetVote& vote, std::string& strError);
     double GetScore();
     bool HasMinimumRequiredSupport();
@@ -356,6 +399,7 @@ public:
     CFinalizedBudgetVote();
     CFinalizedBudgetVote(CTxIn vinIn, uint256 nBudgetHashIn);
 
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode);
     bool IsValid(bool fSignatureCheck);
     void Relay();
@@ -390,6 +434,19 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // running tallies of mapVotes, the valid votes and (for GetRatio) all of them
+    int nYesCount;
+    int nNoCount;
+    int nAbstainCount;
+    int nYesTotal;
+    int nNoTotal;
+    // the stormnode list the votes were last checked against, and when a vote dated ahead becomes valid
+    unsigned int nCleanListVersion;
+    int64_t nCleanRecheckTime;
+
+    void CountVote(const CBudgetVote& vote, int nWeight);
+    void RecountVotes();
+
 
 public:
     bool fValid;
@@ -449,7 +506,11 @@ public:
     void SetAllotted(CAmount nAllotedIn) {nAlloted = nAllotedIn;}
     CAmount GetAllotted() {return nAlloted;}
 
-    void CleanAndRemove(bool fSignatureCheck);
+    /// Recheck the votes, recording the ones that turned valid or invalid in pchangeLog
+    void CleanAndRemove(bool fSignatureCheck, CSyncChangeLog* pchangeLog = NULL);
+
+    /// Exchange the votes and their tallies with other
+    void SwapVotes(CBudgetProposal& other);
 
     uint256 GetHash(){     
         CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
@@ -481,6 +542,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -508,7 +571,7 @@ public:
         swap(first.address, second.address);
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
-        first.mapVotes.swap(second.mapVotes);
+        first.SwapVotes(second);
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
@@ -551,6 +614,7 @@ public:
     CBudgetVote();
     CBudgetVote(CTxIn vin, uint256 nProposalHash, int nVoteIn);
 
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode);
     bool IsValid(bool fSignatureCheck);
     void Relay();
@@ -0,0 +1,355 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "anon/stormnode/stormnode-cache.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "utiltime.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+CCacheSections::CSection& CCacheSections::NewSection(SectionType nType)
+{
+    vSections.push_back(CSection());
+    vSections.back().nType = nType;
+    vSections.back().fSeen = false;
+    return vSections.back();
+}
+
+bool CCacheSections::IsWritten(unsigned int nSection, const CacheKey& key) const
+{
+    return pjournal && nSection < pjournal->vWritten.size() && pjournal->vWritten[nSection].count(key);
+}
+
+// The elements of a list section in the order that was stored with them
+static void SerializeList(CDataStream& ss, const std::map<CacheKey, std::vector<unsigned char> >& mapEntries)
+{
+    std::vector<CacheKey> vOrder;
+    std::map<CacheKey, std::vector<unsigned char> >::const_iterator mi = mapEntries.find(CacheKey());
+    if (mi != mapEntries.end())
+    {
+        CDataStream ssOrder(mi->second, SER_DISK, CLIENT_VERSION);
+        ssOrder >> vOrder;
+    }
+
+    std::vector<const std::vector<unsigned char>*> vValues;
+    std::set<CacheKey> setOrdered;
+    BOOST_FOREACH(const CacheKey& key, vOrder)
+    {
+        mi = mapEntries.find(key);
+        if (!key.empty() && mi != mapEntries.end() && setOrdered.insert(key).second)
+            vValues.push_back(&mi->second);
+    }
+    // elements the order doesn't know (a flush cut short between them) go last
+    for (mi = mapEntries.begin(); mi != mapEntries.end(); ++mi)
+        if (!mi->first.empty() && !setOrdered.count(mi->first))
+            vValues.push_back(&mi->second);
+
+    WriteCompactSize(ss, vValues.size());
+    BOOST_FOREACH(const std::vector<unsigned char>* pvch, vValues)
+        if (!pvch->empty())
+            ss.write((const char*)&(*pvch)[0], pvch->size());
+}
+
+void CCacheSections::Serialize(CDataStream& ss) const
+{
+    for (std::vector<CSection>::const_iterator it = vSections.begin(); it != vSections.end(); ++it)
+    {
+        const CSection& section = *it;
+        if (section.nType == SECTION_LIST)
+        {
+            SerializeList(ss, section.mapEntries);
+            continue;
+        }
+        if (section.nType != SECTION_VALUE)
+            WriteCompactSize(ss, section.mapEntries.size());
+        for (std::map<CacheKey, std::vector<unsigned char> >::const_iterator mi = section.mapEntries.begin(); mi != section.mapEntries.end(); ++mi)
+        {
+            if (section.nType == SECTION_MAP)
+                ss.write((const char*)&mi->first[0], mi->first.size());
+            if (!mi->second.empty())
+                ss.write((const char*)&mi->second[0], mi->second.size());
+        }
+    }
+}
+
+CCacheJournal::CCacheJournal(const std::string& strFilenameIn, const std::string& strMagicMessageIn, const boost::filesystem::path& pathDirIn) :
+    strFilename(strFilenameIn), strMagicMessage(strMagicMessageIn), pathDir(pathDirIn), fLoaded(false), nFileSize(0), nLiveSize(0)
+{
+}
+
+boost::filesystem::path CCacheJournal::GetPath() const
+{
+    return (pathDir.empty() ? GetDataDir() : pathDir) / strFilename;
+}
+
+bool CCacheJournal::NeedsRewrite() const
+{
+    LOCK(cs);
+    return !fLoaded || nFileSize > 2 * nLiveSize + CACHE_JOURNAL_COMPACT_SLACK;
+}
+
+void CCacheJournal::WriteHeader(CDataStream& ss, unsigned int nSections) const
+{
+    ss << strMagicMessage; // cache file specific magic message
+    ss << FLATDATA(Params().MessageStart()); // network specific magic number
+    ss << CACHE_JOURNAL_VERSION;
+    ss << nSections;
+}
+
+// Append one record and return its size
+unsigned int CCacheJournal::WriteRecord(CDataStream& ss, RecordType nType, unsigned int nSection, const CacheKey& key, const std::vector<unsigned char>& vchValue) const
+{
+    CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+    ssRecord << (unsigned char)nType << nSection << key;
+    if (nType == RECORD_PUT)
+        ssRecord << vchValue;
+    uint32_t nChecksum = (uint32_t)Hash(ssRecord.begin(), ssRecord.end()).GetLow64();
+    ssRecord << nChecksum;
+
+    ss.write(&ssRecord[0], ssRecord.size());
+    return ssRecord.size();
+}
+
+bool CCacheJournal::Load(CCacheSections& sections)
+{
+    LOCK(cs);
+    fLoaded = false;
+
+    boost::filesystem::path path = GetPath();
+    FILE *file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+
+    std::vector<unsigned char> vchData(boost::filesystem::file_size(path));
+    try {
+        if (!vchData.empty())
+            filein.read((char *)&vchData[0], vchData.size());
+    }
+    catch (std::exception &e) {
+        return error("%s : I/O error in %s - %s", __func__, strFilename, e.what());
+    }
+    filein.fclose();
+
+    CDataStream ss(vchData, SER_DISK, CLIENT_VERSION);
+    std::string strMagicMessageTmp;
+    unsigned char pchMsgTmp[4];
+    int nVersion;
+    unsigned int nSections;
+    try {
+        ss >> strMagicMessageTmp >> FLATDATA(pchMsgTmp) >> nVersion >> nSections;
+    }
+    catch (std::exception &e) {
+        return error("%s : Invalid header in %s", __func__, strFilename);
+    }
+    if (strMagicMessageTmp != strMagicMessage || memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+        return error("%s : Invalid magic in %s", __func__, strFilename);
+    if (nVersion != CACHE_JOURNAL_VERSION || nSections != sections.vSections.size())
+        return error("%s : %s has an unknown format", __func__, strFilename);
+
+    std::vector<std::map<CacheKey, CWritten> > vWrittenNew(nSections);
+    uint64_t nGoodSize = vchData.size() - ss.size();
+    uint64_t nLive = nGoodSize;
+    unsigned int nRecords = 0;
+    while (!ss.empty())
+    {
+        unsigned char chType;
+        unsigned int nSection;
+        CacheKey key;
+        std::vector<unsigned char> vchValue;
+        uint32_t nChecksum;
+        try {
+            ss >> chType >> nSection >> key;
+            if (chType == RECORD_PUT)
+                ss >> vchValue;
+            ss >> nChecksum;
+        }
+        catch (std::exception &e) {
+            break;
+        }
+
+        if (nSection >= nSections || (chType != RECORD_PUT && chType != RECORD_ERASE))
+            break;
+        // the record must read back byte for byte as it would be written, checksum included
+        CDataStream ssCheck(SER_DISK, CLIENT_VERSION);
+        unsigned int nSize = WriteRecord(ssCheck, (RecordType)chType, nSection, key, vchValue);
+        if (nGoodSize + nSize > vchData.size() || memcmp(&vchData[nGoodSize], &ssCheck[0], nSize))
+            break;
+
+        std::map<CacheKey, std::vector<unsigned char> >& mapEntries = sections.vSections[nSection].mapEntries;
+        std::map<CacheKey, CWritten>& mapWritten = vWrittenNew[nSection];
+        if (mapWritten.count(key))
+            nLive -= mapWritten[key].nSize;
+        if (chType == RECORD_PUT)
+        {
+            CWritten& written = mapWritten[key];
+            written.hash = Hash(vchValue.begin(), vchValue.end());
+            written.nSize = nSize;
+            nLive += nSize;
+            mapEntries[key] = vchValue;
+        }
+        else
+        {
+            mapWritten.erase(key);
+            mapEntries.erase(key);
+        }
+        nGoodSize += nSize;
+        nRecords++;
+    }
+
+    // a flush was cut short, drop the torn record so appends follow good data
+    if (nGoodSize < vchData.size())
+    {
+        LogPrintf("%s : %s ends in %u bytes of incomplete data, truncating\n", __func__, strFilename, vchData.size() - nGoodSize);
+        FILE *fileTrunc = fopen(path.string().c_str(), "rb+");
+        if (!fileTrunc || !TruncateFile(fileTrunc, nGoodSize))
+        {
+            if (fileTrunc)
+                fclose(fileTrunc);
+            return error("%s : Failed to truncate %s", __func__, strFilename);
+        }
+        FileCommit(fileTrunc);
+        fclose(fileTrunc);
+    }
+
+    vWritten.swap(vWrittenNew);
+    nFileSize = nGoodSize;
+    nLiveSize = nLive;
+    fLoaded = true;
+    LogPrint("stormnode", "Replayed %u records from %s\n", nRecords, strFilename);
+    return true;
+}
+
+bool CCacheJournal::Flush(const CCacheSections& sections)
+{
+    LOCK(cs);
+
+    if (NeedsRewrite() || vWritten.size() != sections.vSections.size())
+    {
+        if (sections.IsPartial())
+        {
+            // the seen maps left out what was written, build them in full next time
+            fLoaded = false;
+            return error("%s : %s needs a rewrite, not flushing partial sections", __func__, strFilename);
+        }
+        return Compact(sections);
+    }
+
+    int64_t nStart = GetTimeMillis();
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned int nPut = 0, nErased = 0;
+    for (unsigned int i = 0; i < sections.vSections.size(); i++)
+    {
+        const CCacheSections::CSection& section = sections.vSections[i];
+        const std::map<CacheKey, std::vector<unsigned char> >& mapEntries = section.mapEntries;
+        std::map<CacheKey, CWritten>& mapWritten = vWritten[i];
+
+        for (std::map<CacheKey, std::vector<unsigned char> >::const_iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+        {
+            std::map<CacheKey, CWritten>::iterator mi = mapWritten.find(it->first);
+            // a seen entry on disk is current, the others are compared by hash
+            if (section.fSeen && mi != mapWritten.end())
+                continue;
+            uint256 hash = section.fSeen ? uint256() : Hash(it->second.begin(), it->second.end());
+            if (mi != mapWritten.end() && mi->second.hash == hash)
+                continue;
+
+            if (mi != mapWritten.end())
+                nLiveSize -= mi->second.nSize;
+            CWritten& written = mapWritten[it->first];
+            written.hash = hash;
+            written.nSize = WriteRecord(ss, RECORD_PUT, i, it->first, it->second);
+            nLiveSize += written.nSize;
+            nPut++;
+        }
+
+        std::map<CacheKey, CWritten>::iterator mi = mapWritten.begin();
+        while (mi != mapWritten.end())
+        {
+            if (mapEntries.count(mi->first) || section.setWrittenKeys.count(mi->first))
+            {
+                ++mi;
+                continue;
+            }
+            WriteRecord(ss, RECORD_ERASE, i, mi->first, std::vector<unsigned char>());
+            nLiveSize -= mi->second.nSize;
+            mapWritten.erase(mi++);
+            nErased++;
+        }
+    }
+
+    if (ss.empty())
+        return true;
+
+    FILE *file = fopen(GetPath().string().c_str(), "ab");
+    if (!file)
+    {
+        fLoaded = false;
+        return error("%s : Failed to open %s", __func__, strFilename);
+    }
+    if (fwrite(&ss[0], 1, ss.size(), file) != ss.size())
+    {
+        fclose(file);
+        // what made it to disk is unknown, start over with a full rewrite
+        fLoaded = false;
+        return error("%s : Failed to write %s", __func__, strFilename);
+    }
+    FileCommit(file);
+    fclose(file);
+    nFileSize += ss.size();
+
+    LogPrint("stormnode", "Flushed %s: %u written, %u erased, %u bytes  %dms\n", strFilename, nPut, nErased, ss.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CCacheJournal::Compact(const CCacheSections& sections)
+{
+    int64_t nStart = GetTimeMillis();
+    std::vector<std::map<CacheKey, CWritten> > vWrittenNew(sections.vSections.size());
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    WriteHeader(ss, sections.vSections.size());
+    for (unsigned int i = 0; i < sections.vSections.size(); i++)
+    {
+        const std::map<CacheKey, std::vector<unsigned char> >& mapEntries = sections.vSections[i].mapEntries;
+        for (std::map<CacheKey, std::vector<unsigned char> >::const_iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+        {
+            CWritten& written = vWrittenNew[i][it->first];
+            written.hash = Hash(it->second.begin(), it->second.end());
+            written.nSize = WriteRecord(ss, RECORD_PUT, i, it->first, it->second);
+        }
+    }
+
+    boost::filesystem::path path = GetPath();
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("%s : Failed to open %s", __func__, pathTmp.string());
+    if (fwrite(&ss[0], 1, ss.size(), file) != ss.size())
+    {
+        fclose(file);
+        return error("%s : Failed to write %s", __func__, pathTmp.string());
+    }
+    FileCommit(file);
+    fclose(file);
+    if (!RenameOver(pathTmp, path))
+        return error("%s : Failed to rename %s to %s", __func__, pathTmp.string(), strFilename);
+
+    vWritten.swap(vWrittenNew);
+    nFileSize = nLiveSize = ss.size();
+    fLoaded = true;
+
+    LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
+    return true;
+}
+
+void CCacheJournal::Reset()
+{
+    LOCK(cs);
+    fLoaded = false;
+}
@@ -0,0 +1,233 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STORMNODE_CACHE_H
+#define STORMNODE_CACHE_H
+
+#include "serialize.h"
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+/** Seconds between incremental flushes of the stormnode, budget and payment caches */
+static const int STORMNODE_CACHE_FLUSH_SECONDS = 60;
+/** A journal is rewritten once it is this much larger than twice its live data */
+static const unsigned int CACHE_JOURNAL_COMPACT_SLACK = 1024 * 1024;
+/** Bump when the record layout changes */
+static const int CACHE_JOURNAL_VERSION = 2;
+
+typedef std::vector<unsigned char> CacheKey;
+
+class CCacheJournal;
+
+/**
+ * A manager's serialized state split at its top-level containers, so that
+ * single entries can be written and erased on their own.
+ *
+ * The sections are added in the order the manager's SerializationOp reads and
+ * writes its members; Serialize() then produces exactly what serializing the
+ * manager would, so it can be read back with operator>>.
+ *
+ * Built for a journal, the sections leave out the values of seen-message maps
+ * (AddSeenMap) that the journal already holds, so a flush only serializes
+ * what is new in them.
+ */
+class CCacheSections
+{
+public:
+    enum SectionType
+    {
+        SECTION_MAP,        //! std::map: an entry is the serialized key followed by the value
+        SECTION_LIST,       //! std::vector: an entry is one element, the key only identifies it
+        SECTION_VALUE       //! anything else: a single entry with an empty key
+    };
+
+    struct CSection
+    {
+        SectionType nType;
+        bool fSeen;         //! values never change under their key, see AddSeenMap()
+        std::map<CacheKey, std::vector<unsigned char> > mapEntries;
+        //! fSeen: the keys whose values were left out because the journal has them
+        std::set<CacheKey> setWrittenKeys;
+    };
+
+    std::vector<CSection> vSections;
+
+    /** With pjournalIn, AddSeenMap() leaves out what that journal already holds */
+    CCacheSections(const CCacheJournal* pjournalIn = NULL) : pjournal(pjournalIn) {}
+
+    bool IsPartial() const { return pjournal != NULL; }
+
+    template<typename K, typename V>
+    void AddMap(const std::map<K, V>& mapIn)
+    {
+        CSection& section = NewSection(SECTION_MAP);
+        for (typename std::map<K, V>::const_iterator it = mapIn.begin(); it != mapIn.end(); ++it)
+            section.mapEntries[ToBytes(it->first)] = ToBytes(it->second);
+    }
+
+    /** A map keyed by the hash of its values, which are only ever inserted and
+     *  erased. Only its keys are compared with the journal. */
+    template<typename K, typename V>
+    void AddSeenMap(const std::map<K, V>& mapIn)
+    {
+        CSection& section = NewSection(SECTION_MAP);
+        section.fSeen = true;
+        unsigned int nSection = vSections.size() - 1;
+        for (typename std::map<K, V>::const_iterator it = mapIn.begin(); it != mapIn.end(); ++it)
+        {
+            CacheKey key = ToBytes(it->first);
+            if (IsWritten(nSection, key))
+                section.setWrittenKeys.insert(key);
+            else
+                section.mapEntries[key] = ToBytes(it->second);
+        }
+    }
+
+    template<typename T, typename K>
+    void AddList(const std::vector<T>& vIn, K (*fnKey)(const T&))
+    {
+        CSection& section = NewSection(SECTION_LIST);
+        std::vector<CacheKey> vOrder;
+        for (unsigned int i = 0; i < vIn.size(); i++)
+        {
+            CacheKey key = ToBytes(fnKey(vIn[i]));
+            // a duplicate key gets the element's position appended to keep both
+            if (section.mapEntries.count(key))
+                key = ToBytes(std::make_pair(key, i));
+            section.mapEntries[key] = ToBytes(vIn[i]);
+            vOrder.push_back(key);
+        }
+        // the elements are stored by key, their order is an entry of its own under the empty key
+        section.mapEntries[CacheKey()] = ToBytes(vOrder);
+    }
+
+    template<typename T>
+    void AddValue(const T& value)
+    {
+        NewSection(SECTION_VALUE).mapEntries[CacheKey()] = ToBytes(value);
+    }
+
+    void Serialize(CDataStream& ss) const;
+
+private:
+    const CCacheJournal* pjournal;
+
+    CSection& NewSection(SectionType nType);
+    bool IsWritten(unsigned int nSection, const CacheKey& key) const;
+
+    template<typename T>
+    static std::vector<unsigned char> ToBytes(const T& obj)
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << obj;
+        return std::vector<unsigned char>(ss.begin(), ss.end());
+    }
+};
+
+/**
+ * Append-only journal holding one manager's cache.
+ *
+ * A flush compares each entry with what was last written and appends a record
+ * for every entry that was added, changed or removed, then syncs the file. Each
+ * record carries a checksum; a torn record at the end (from a crash during a
+ * flush) is cut off on load and the journal continues from the last good one.
+ * When the file has grown well past its live data it is rewritten to a
+ * temporary file and renamed over the old one.
+ */
+class CCacheJournal
+{
+public:
+    /** The journal is kept in pathDirIn, or in the data directory if that is empty */
+    CCacheJournal(const std::string& strFilenameIn, const std::string& strMagicMessageIn, const boost::filesystem::path& pathDirIn = boost::filesystem::path());
+
+    /** Fill the entries of sections, which must already hold the manager's
+     *  (empty) layout. False if there is no usable journal. */
+    bool Load(CCacheSections& sections);
+
+    /** Write what changed since the last Load or Flush. Partial sections (see
+     *  CCacheSections) must have been built while holding cs. */
+    bool Flush(const CCacheSections& sections);
+
+    /** Forget what is on disk, the next flush rewrites the journal */
+    void Reset();
+
+    const std::string& GetFilename() const { return strFilename; }
+
+    /** True if the next flush rewrites the whole journal */
+    bool NeedsRewrite() const;
+
+    mutable CCriticalSection cs;
+
+private:
+    friend class CCacheSections;
+
+    enum RecordType
+    {
+        RECORD_PUT = 1,
+        RECORD_ERASE = 2
+    };
+
+    struct CWritten
+    {
+        uint256 hash;
+        unsigned int nSize;
+    };
+
+    std::string strFilename;
+    std::string strMagicMessage;
+    boost::filesystem::path pathDir;
+    bool fLoaded;
+    //! per section, the entries as last written
+    std::vector<std::map<CacheKey, CWritten> > vWritten;
+    uint64_t nFileSize;
+    uint64_t nLiveSize;
+
+    boost::filesystem::path GetPath() const;
+    void WriteHeader(CDataStream& ss, unsigned int nSections) const;
+    unsigned int WriteRecord(CDataStream& ss, RecordType nType, unsigned int nSection, const CacheKey& key, const std::vector<unsigned char>& vchValue) const;
+    bool Compact(const CCacheSections& sections);
+};
+
+/** Load obj (which must be empty) from its journal */
+template<typename T>
+bool LoadFromJournal(CCacheJournal& journal, T& obj)
+{
+    CCacheSections sections;
+    T().GetCacheSections(sections);
+    if (!journal.Load(sections))
+        return false;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    try {
+        sections.Serialize(ss);
+        ss >> obj;
+    }
+    catch (std::exception &e) {
+        obj.Clear();
+        journal.Reset();
+        return error("%s : Deserialize error in %s - %s", __func__, journal.GetFilename(), e.what());
+    }
+    return true;
+}
+
+template<typename T>
+bool FlushToJournal(CCacheJournal& journal, const T& obj)
+{
+    LOCK(journal.cs);
+    // a rewrite needs every value, otherwise only what the journal lacks
+    CCacheSections sections(journal.NeedsRewrite() ? NULL : &journal);
+    obj.GetCacheSections(sections);
+    return journal.Flush(sections);
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "anon/stormnode/stormnode-payments.h"
 #include "anon/stormnode/stormnode-budget.h"
+#include "anon/stormnode/stormnode-cache.h"
 #include "anon/stormnode/stormnode-sync.h"
 #include "anon/stormnode/stormnodeman.h"
 #include "anon/sandstorm/sandstorm.h"
@@ -17,6 +18,8 @@
 
 /** Object for who's going to get paid on which blocks */
 CStormnodePayments stormnodePayments;
+/** Incremental on-disk copy of stormnodePayments */
+static CCacheJournal paymentCacheJournal("snpayments.jnl", "StormnodePayments");
 
 CCriticalSection cs_vecPayments;
 CCriticalSection cs_mapStormnodeBlocks;
@@ -154,33 +157,49 @@ CStormnodePaymentDB::ReadResult CStormnodePaymentDB::Read(CStormnodePayments& ob
     return Ok;
 }
 
-void DumpStormnodePayments()
+void LoadStormnodePayments()
 {
     int64_t nStart = GetTimeMillis();
 
-    CStormnodePaymentDB paymentdb;
-    CStormnodePayments tempPayments;
+    if (LoadFromJournal(paymentCacheJournal, stormnodePayments))
+    {
+        LogPrintf("Loaded info from snpayments.jnl  %dms\n", GetTimeMillis() - nStart);
+        LogPrintf("  %s\n", stormnodePayments.ToString());
+        LogPrintf("Stormnode payments manager - cleaning....\n");
+        stormnodePayments.CleanPaymentList();
+        LogPrintf("Stormnode payments manager - result:\n");
+        LogPrintf("  %s\n", stormnodePayments.ToString());
+        return;
+    }
 
-    LogPrintf("Verifying snpayments.dat format...\n");
-    CStormnodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
+    // no journal yet, take over the cache file of older versions; the first flush starts the journal
+    CStormnodePaymentDB snpayments;
+    CStormnodePaymentDB::ReadResult readResult = snpayments.Read(stormnodePayments);
     if (readResult == CStormnodePaymentDB::FileError)
-        LogPrintf("Missing budgets file - snpayments.dat, will try to recreate\n");
+        LogPrintf("Missing Stormnode payment cache - snpayments.dat, will try to recreate\n");
     else if (readResult != CStormnodePaymentDB::Ok)
     {
         LogPrintf("Error reading snpayments.dat: ");
         if(readResult == CStormnodePaymentDB::IncorrectFormat)
             LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
         else
-        {
             LogPrintf("file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
     }
-    LogPrintf("Writting info to snpayments.dat...\n");
-    paymentdb.Write(stormnodePayments);
+}
 
-    LogPrintf("Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+void DumpStormnodePayments()
+{
+    int64_t nStart = GetTimeMillis();
+
+    if (FlushToJournal(paymentCacheJournal, stormnodePayments))
+        LogPrint("stormnode", "Stormnode payments dump finished  %dms\n", GetTimeMillis() - nStart);
+}
+
+void CStormnodePayments::GetCacheSections(CCacheSections& sections) const
+{
+    LOCK2(cs_mapStormnodeBlocks, cs_mapStormnodePayeeVotes);
+    sections.AddSeenMap(mapStormnodePayeeVotes);
+    sections.AddMap(mapStormnodeBlocks);
 }
 
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue){
@@ -418,14 +437,19 @@ void CStormnodePayments::ProcessMessageStormnodePayments(CNode* pfrom, std::stri
     }
 }
 
+std::string CStormnodePaymentWinner::GetSignatureMessage() const
+{
+    return vinStormnode.prevout.ToStringShort() +
+                boost::lexical_cast<std::string>(nBlockHeight) +
+                payee.ToString();
+}
+
 bool CStormnodePaymentWinner::Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode)
 {
     std::string errorMessage;
     std::string strStormNodeSignMessage;
 
-    std::string strMessage =  vinStormnode.prevout.ToStringShort() +
-                boost::lexical_cast<std::string>(nBlockHeight) +
-                payee.ToString();
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.SignMessage(strMessage, errorMessage, vchSig, keyStormnode)) {
         LogPrintf("CStormnodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -763,9 +787,7 @@ bool CStormnodePaymentWinner::SignatureValid()
 
     if(psn != NULL)
     {
-        std::string strMessage =  vinStormnode.prevout.ToStringShort() +
-                    boost::lexical_cast<std::string>(nBlockHeight) +
-                    payee.ToString();
+        std::string strMessage = GetSignatureMessage();
 
         std::string errorMessage = "";
         if(!sandStormSigner.VerifyMessage(psn->pubkey2, vchSig, strMessage, errorMessage)){
@@ -17,6 +17,7 @@ extern CCriticalSection cs_vecPayments;
 extern CCriticalSection cs_mapStormnodeBlocks;
 extern CCriticalSection cs_mapStormnodePayeeVotes;
 
+class CCacheSections;
 class CStormnodePayments;
 class CStormnodePaymentWinner;
 class CStormnodeBlockPayees;
@@ -33,6 +34,7 @@ std::string GetRequiredPaymentsString(int nBlockHeight);
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue);
 void FillBlockPayee(CTransaction& txNew, CAmount nFees);
 
+void LoadStormnodePayments();
 void DumpStormnodePayments();
 
 /** Save Stormnode Payment Data (snpayments.dat)
@@ -182,6 +184,7 @@ public:
         return ss.GetHash();
     }
 
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
@@ -279,6 +282,9 @@ public:
         READWRITE(mapStormnodePayeeVotes);
         READWRITE(mapStormnodeBlocks);
     }
+
+    /// Same members as SerializationOp, split for the cache journal
+    void GetCacheSections(CCacheSections& sections) const;
 };
 
 
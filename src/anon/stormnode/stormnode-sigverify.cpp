@@ -0,0 +1,331 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "anon/stormnode/stormnode-sigverify.h"
+
+#include "hash.h"
+#include "main.h"
+#include "net.h"
+#include "util.h"
+#include "utiltime.h"
+#include "anon/instantx/instantx.h"
+#include "anon/stormnode/stormnode-budget.h"
+#include "anon/stormnode/stormnode-payments.h"
+#include "anon/stormnode/stormnodeman.h"
+
+#include <boost/bind.hpp>
+
+CSigVerifyQueue sigVerifyQueue;
+
+static void ThreadSigVerify(CSigVerifyQueue* pqueue)
+{
+    RenameThread("darksilk-sigcheck");
+    pqueue->ThreadVerify();
+}
+
+CSigCheck::CSigCheck(const std::string& strMessage, const std::vector<unsigned char>& vchSigIn) : vchSig(vchSigIn)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << strMessageMagic;
+    ss << strMessage;
+    hashMessage = ss.GetHash();
+}
+
+uint256 CSigCheck::GetHash() const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << hashMessage;
+    ss << vchSig;
+    return ss.GetHash();
+}
+
+CSigVerifyQueue::CSigVerifyQueue() : nWorkers(0)
+{
+    stats.nWorkers = 0;
+    stats.nQueued = 0;
+    stats.nWaiting = 0;
+    stats.nCached = 0;
+    stats.nRecovered = 0;
+    stats.nRecoveredInline = 0;
+    stats.nCacheHits = 0;
+    stats.nDuplicates = 0;
+    stats.nDeferred = 0;
+    stats.nDropped = 0;
+    stats.nRecoverTime = 0;
+}
+
+void CSigVerifyQueue::Start(boost::thread_group& threadGroup, int nWorkersIn)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers = nWorkersIn;
+    }
+    if (nWorkersIn <= 0)
+        return;
+
+    LogPrintf("Using %d threads for stormnode signature verification\n", nWorkersIn);
+    for (int i = 0; i < nWorkersIn; i++)
+        threadGroup.create_thread(boost::bind(&ThreadSigVerify, this));
+}
+
+bool CSigVerifyQueue::IsRunning()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return nWorkers > 0;
+}
+
+// requires cs
+void CSigVerifyQueue::AddToCache(const uint256& hash, const CKeyID& keyID)
+{
+    if (!mapCache.insert(std::make_pair(hash, keyID)).second)
+        return;
+    vCacheOrder.push_back(hash);
+    while (vCacheOrder.size() > MAX_SIG_VERIFY_CACHE)
+    {
+        mapCache.erase(vCacheOrder.front());
+        vCacheOrder.pop_front();
+    }
+}
+
+bool CSigVerifyQueue::Recover(const CSigCheck& check, CKeyID& keyIDRet)
+{
+    uint256 hash = check.GetHash();
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::map<uint256, CKeyID>::const_iterator mi = mapCache.find(hash);
+        if (mi != mapCache.end())
+        {
+            stats.nCacheHits++;
+            keyIDRet = mi->second;
+            return keyIDRet != CKeyID();
+        }
+    }
+
+    CPubKey pubkey;
+    bool fRecovered = pubkey.RecoverCompact(check.hashMessage, check.vchSig);
+    keyIDRet = fRecovered ? pubkey.GetID() : CKeyID();
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    stats.nRecoveredInline++;
+    AddToCache(hash, keyIDRet);
+    return fRecovered;
+}
+
+bool CSigVerifyQueue::Defer(NodeId node, const std::string& strCommand, const CDataStream& vRecv, const std::vector<CSigCheck>& vChecks)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (nWorkers <= 0)
+        return false;
+
+    std::map<NodeId, std::deque<boost::shared_ptr<CDeferred> > >::iterator it = mapDeferred.find(node);
+    bool fBehind = (it != mapDeferred.end() && !it->second.empty());
+
+    std::vector<std::pair<uint256, const CSigCheck*> > vMissing;
+    BOOST_FOREACH(const CSigCheck& check, vChecks)
+    {
+        uint256 hash = check.GetHash();
+        if (mapCache.count(hash))
+            stats.nCacheHits++;
+        else
+            vMissing.push_back(std::make_pair(hash, &check));
+    }
+    if (vMissing.empty() && !fBehind)
+        return false;
+
+    size_t nSize = vRecv.size();
+    bool fQueueFull = !vMissing.empty() && queue.size() + vMissing.size() > MAX_SIG_VERIFY_QUEUE;
+    bool fNodeFull = fBehind && (it->second.size() >= MAX_SIG_VERIFY_DEFERRED ||
+                                 mapDeferredSize[node] + nSize > MAX_SIG_VERIFY_DEFERRED_SIZE);
+    if (fQueueFull || fNodeFull)
+    {
+        stats.nDropped++;
+        LogPrint("stormnode", "CSigVerifyQueue::Defer - dropped %s from peer=%d, %s full\n", strCommand, node, fNodeFull ? "peer's share" : "queue");
+        return true;
+    }
+
+    boost::shared_ptr<CDeferred> pdeferred(new CDeferred(strCommand, vRecv));
+    for (unsigned int i = 0; i < vMissing.size(); i++)
+    {
+        std::map<uint256, std::vector<boost::shared_ptr<CDeferred> > >::iterator mi = mapPending.find(vMissing[i].first);
+        if (mi == mapPending.end())
+        {
+            mi = mapPending.insert(std::make_pair(vMissing[i].first, std::vector<boost::shared_ptr<CDeferred> >())).first;
+            queue.push_back(*vMissing[i].second);
+        }
+        else
+            stats.nDuplicates++;
+        mi->second.push_back(pdeferred);
+        pdeferred->nPending++;
+    }
+    mapDeferred[node].push_back(pdeferred);
+    mapDeferredSize[node] += nSize;
+    stats.nDeferred++;
+    if (!vMissing.empty())
+        condWork.notify_all();
+    return true;
+}
+
+bool CSigVerifyQueue::PopReady(NodeId node, std::string& strCommand, CDataStream& vRecvRet)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    std::map<NodeId, std::deque<boost::shared_ptr<CDeferred> > >::iterator it = mapDeferred.find(node);
+    if (it == mapDeferred.end())
+        return false;
+    if (it->second.empty() || it->second.front()->nPending > 0)
+        return false;
+
+    strCommand = it->second.front()->strCommand;
+    vRecvRet = it->second.front()->vRecv;
+    mapDeferredSize[node] -= vRecvRet.size();
+    it->second.pop_front();
+    if (it->second.empty())
+    {
+        mapDeferred.erase(it);
+        mapDeferredSize.erase(node);
+    }
+    return true;
+}
+
+void CSigVerifyQueue::ForgetNode(NodeId node)
+{
+    // signatures already queued are still recovered, the keys may be asked for again
+    boost::unique_lock<boost::mutex> lock(cs);
+    mapDeferred.erase(node);
+    mapDeferredSize.erase(node);
+}
+
+void CSigVerifyQueue::ThreadVerify()
+{
+    while (true)
+    {
+        std::vector<CSigCheck> vBatch;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (queue.empty())
+                condWork.wait(lock);
+            while (!queue.empty() && vBatch.size() < SIG_VERIFY_BATCH_SIZE)
+            {
+                vBatch.push_back(queue.front());
+                queue.pop_front();
+            }
+        }
+
+        int64_t nStart = GetTimeMicros();
+        std::vector<CKeyID> vKeys(vBatch.size());
+        for (unsigned int i = 0; i < vBatch.size(); i++)
+        {
+            CPubKey pubkey;
+            if (pubkey.RecoverCompact(vBatch[i].hashMessage, vBatch[i].vchSig))
+                vKeys[i] = pubkey.GetID();
+        }
+        int64_t nTime = GetTimeMicros() - nStart;
+
+        bool fReady = false;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            stats.nRecovered += vBatch.size();
+            stats.nRecoverTime += nTime;
+            for (unsigned int i = 0; i < vBatch.size(); i++)
+            {
+                uint256 hash = vBatch[i].GetHash();
+                AddToCache(hash, vKeys[i]);
+
+                std::map<uint256, std::vector<boost::shared_ptr<CDeferred> > >::iterator mi = mapPending.find(hash);
+                if (mi == mapPending.end())
+                    continue;
+                BOOST_FOREACH(boost::shared_ptr<CDeferred>& pdeferred, mi->second)
+                    if (--pdeferred->nPending == 0)
+                        fReady = true;
+                mapPending.erase(mi);
+            }
+        }
+        // held back messages are only popped by the message handler, don't let them wait for its idle timeout
+        if (fReady)
+            WakeMessageHandler();
+    }
+}
+
+CSigVerifyQueue::Stats CSigVerifyQueue::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    Stats ret = stats;
+    ret.nWorkers = nWorkers;
+    ret.nQueued = queue.size();
+    ret.nWaiting = 0;
+    for (std::map<NodeId, std::deque<boost::shared_ptr<CDeferred> > >::const_iterator it = mapDeferred.begin(); it != mapDeferred.end(); ++it)
+        ret.nWaiting += it->second.size();
+    ret.nCached = mapCache.size();
+    return ret;
+}
+
+void GetStormnodeSigChecks(const std::string& strCommand, const CDataStream& vRecv, std::vector<CSigCheck>& vChecksRet)
+{
+    if (fLiteMode) return;
+
+    // read a copy, the message is processed from the start later on
+    CDataStream ss(vRecv);
+    try {
+        if (strCommand == "snb") {
+            CStormnodeBroadcast snb;
+            ss >> snb;
+            if (snodeman.mapSeenStormnodeBroadcast.count(snb.GetHash())) return;
+            vChecksRet.push_back(CSigCheck(snb.GetSignatureMessage(), snb.vchSig));
+            if (snb.lastPing != CStormnodePing())
+                vChecksRet.push_back(CSigCheck(snb.lastPing.GetSignatureMessage(), snb.lastPing.vchSig));
+        }
+        else if (strCommand == "snp") {
+            CStormnodePing snp;
+            ss >> snp;
+            if (snodeman.mapSeenStormnodePing.count(snp.GetHash())) return;
+            vChecksRet.push_back(CSigCheck(snp.GetSignatureMessage(), snp.vchSig));
+        }
+        else if (strCommand == "snw") {
+            CStormnodePaymentWinner winner;
+            ss >> winner;
+            if (stormnodePayments.mapStormnodePayeeVotes.count(winner.GetHash())) return;
+            vChecksRet.push_back(CSigCheck(winner.GetSignatureMessage(), winner.vchSig));
+        }
+        else if (strCommand == "svote") {
+            CBudgetVote vote;
+            ss >> vote;
+            if (budget.mapSeenStormnodeBudgetVotes.count(vote.GetHash())) return;
+            vChecksRet.push_back(CSigCheck(vote.GetSignatureMessage(), vote.vchSig));
+        }
+        else if (strCommand == "fbvote") {
+            CFinalizedBudgetVote vote;
+            ss >> vote;
+            if (budget.mapSeenFinalizedBudgetVotes.count(vote.GetHash())) return;
+            vChecksRet.push_back(CSigCheck(vote.GetSignatureMessage(), vote.vchSig));
+        }
+        else if (strCommand == "txlvote") {
+            CConsensusVote ctx;
+            ss >> ctx;
+            if (txLockManager.HasVote(ctx.GetHash())) return;
+            vChecksRet.push_back(CSigCheck(ctx.GetSignatureMessage(), ctx.vchStormNodeSignature));
+        }
+        else if (strCommand == "txlproof") {
+            CTxLockProof proof;
+            ss >> proof;
+            if (proof.vecVotes.size() > INSTANTX_SIGNATURES_TOTAL) return;
+            BOOST_FOREACH(const CConsensusVote& ctx, proof.vecVotes) {
+                if (txLockManager.HasVote(ctx.GetHash())) continue;
+                vChecksRet.push_back(CSigCheck(ctx.GetSignatureMessage(), ctx.vchStormNodeSignature));
+            }
+        }
+    }
+    catch (std::exception &e) {
+        // a malformed message is rejected by its handler
+        vChecksRet.clear();
+    }
+}
+
+bool DeferStormnodeMessage(NodeId node, const std::string& strCommand, const CDataStream& vRecv)
+{
+    if (!sigVerifyQueue.IsRunning())
+        return false;
+
+    std::vector<CSigCheck> vChecks;
+    GetStormnodeSigChecks(strCommand, vRecv, vChecks);
+    return sigVerifyQueue.Defer(node, strCommand, vRecv, vChecks);
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STORMNODE_SIGVERIFY_H
+#define STORMNODE_SIGVERIFY_H
+
+#include "pubkey.h"
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+typedef int NodeId;
+
+/** Default for -sigverifythreads, 0 = half the cores (at least one) */
+static const int DEFAULT_SIG_VERIFY_THREADS = 0;
+/** Maximum number of signature verification threads */
+static const int MAX_SIG_VERIFY_THREADS = 16;
+/** Signatures that may wait for a thread, Defer() drops messages that would add more */
+static const unsigned int MAX_SIG_VERIFY_QUEUE = 20000;
+/** Messages of one peer that may be held back, later ones are dropped */
+static const unsigned int MAX_SIG_VERIFY_DEFERRED = 5000;
+/** Bytes of messages of one peer that may be held back */
+static const size_t MAX_SIG_VERIFY_DEFERRED_SIZE = 4 * 1000 * 1000;
+/** Signatures a thread takes from the queue at once */
+static const unsigned int SIG_VERIFY_BATCH_SIZE = 64;
+/** Recovered keys remembered, the oldest are forgotten first */
+static const unsigned int MAX_SIG_VERIFY_CACHE = 50000;
+
+/** A compact signature over a message signed with CSandStormSigner::SignMessage */
+class CSigCheck
+{
+public:
+    uint256 hashMessage;            //! hash of strMessageMagic and the message
+    std::vector<unsigned char> vchSig;
+
+    CSigCheck(const std::string& strMessage, const std::vector<unsigned char>& vchSigIn);
+
+    /** Identifies the signature: the same message and signature always recover the same key */
+    uint256 GetHash() const;
+};
+
+/**
+ * Recovers the keys of stormnode, budget, payment and InstantX signatures on
+ * worker threads.
+ *
+ * Recovery is the expensive part of CSandStormSigner::VerifyMessage, and a
+ * list sync brings thousands of signed messages in a burst. The message handler
+ * pulls the signatures out of those messages with GetStormnodeSigChecks() and
+ * holds each message back with Defer(); the workers recover the keys in batches,
+ * each distinct signature once, and remember them. The handler then gives the
+ * messages to the managers in the order they arrived (PopReady), where
+ * VerifyMessage only has to look up the key and compare it.
+ *
+ * Only the recovered key is cached, never a verdict, so the managers still make
+ * every decision themselves. All of a peer's stormnode messages queue up behind
+ * one that waits, which keeps a ping from overtaking the broadcast it refers to.
+ *
+ * Defer() never waits: it runs under cs_extensionMessages, so blocking there on
+ * one peer would stall the others. A message that would overflow the queue or
+ * the peer's share of held back messages is dropped instead.
+ */
+class CSigVerifyQueue
+{
+public:
+    struct Stats
+    {
+        int nWorkers;
+        unsigned int nQueued;           //! signatures waiting for a thread
+        unsigned int nWaiting;          //! messages held back
+        unsigned int nCached;
+        uint64_t nRecovered;            //! by the workers
+        uint64_t nRecoveredInline;      //! by VerifyMessage, on a cache miss
+        uint64_t nCacheHits;
+        uint64_t nDuplicates;           //! signatures already queued when another message brought them
+        uint64_t nDeferred;             //! messages held back since startup
+        uint64_t nDropped;              //! messages dropped because the queue or the peer's share was full
+        int64_t nRecoverTime;           //! microseconds, all threads
+    };
+
+    CSigVerifyQueue();
+
+    /** Start nWorkers verification threads in threadGroup. With none, Defer() never holds a message back. */
+    void Start(boost::thread_group& threadGroup, int nWorkers);
+
+    /** True if verification threads were started */
+    bool IsRunning();
+
+    /** Recover the key of a signature, from the cache if possible. False if there is none. */
+    bool Recover(const CSigCheck& check, CKeyID& keyIDRet);
+
+    /** Hold back a message of node until the signatures in vChecks are recovered.
+     *  False if it can be processed right away, true if it was held back or dropped. */
+    bool Defer(NodeId node, const std::string& strCommand, const CDataStream& vRecv, const std::vector<CSigCheck>& vChecks);
+
+    /** Take the next held back message of node if its signatures are done */
+    bool PopReady(NodeId node, std::string& strCommand, CDataStream& vRecvRet);
+
+    /** Drop the messages held back for a disconnected node */
+    void ForgetNode(NodeId node);
+
+    Stats GetStats();
+
+    void ThreadVerify();
+
+private:
+    struct CDeferred
+    {
+        std::string strCommand;
+        CDataStream vRecv;
+        unsigned int nPending;
+
+        CDeferred(const std::string& strCommandIn, const CDataStream& vRecvIn) : strCommand(strCommandIn), vRecv(vRecvIn), nPending(0) {}
+    };
+
+    CWaitableCriticalSection cs;
+    CConditionVariable condWork;        //! new signature to recover
+    std::deque<CSigCheck> queue;
+    //! queued or being recovered, with the messages waiting for each
+    std::map<uint256, std::vector<boost::shared_ptr<CDeferred> > > mapPending;
+    std::map<NodeId, std::deque<boost::shared_ptr<CDeferred> > > mapDeferred;
+    std::map<NodeId, size_t> mapDeferredSize; //! bytes held back per node
+    //! recovered keys, a null key if recovery failed
+    std::map<uint256, CKeyID> mapCache;
+    std::deque<uint256> vCacheOrder;
+    int nWorkers;
+    Stats stats;
+
+    void AddToCache(const uint256& hash, const CKeyID& keyID);
+};
+
+extern CSigVerifyQueue sigVerifyQueue;
+
+/** The signatures a stormnode, budget, payment or InstantX message carries, if any */
+void GetStormnodeSigChecks(const std::string& strCommand, const CDataStream& vRecv, std::vector<CSigCheck>& vChecksRet);
+
+/** Hand the signatures of a message to sigVerifyQueue and hold the message back if needed.
+ *  Called by the message handler before the managers' ProcessMessage. */
+bool DeferStormnodeMessage(NodeId node, const std::string& strCommand, const CDataStream& vRecv);
+
+#endif
@@ -64,6 +64,8 @@ void CStormnodeSync::Reset()
     mapSeenSyncSNB.clear();
     mapSeenSyncSNW.clear();
     mapSeenSyncBudget.clear();
+    mapListCursorsPending.clear();
+    mapBudgetCursorsPending.clear();
     lastFailure = 0;
     nCountFailures = 0;
     sumStormnodeList = 0;
@@ -143,6 +145,10 @@ void CStormnodeSync::GetNextAsset()
             RequestedStormnodeAssets = STORMNODE_SYNC_LIST;
             break;
         case(STORMNODE_SYNC_LIST):
+            // the entries these cursors cover have been fetched by now
+            BOOST_FOREACH(const PAIRTYPE(CNetAddr, CSyncCursor)& item, mapListCursorsPending)
+                mapListCursors[item.first] = item.second;
+            mapListCursorsPending.clear();
             lastStormnodeWinner = GetTime();
             RequestedStormnodeAssets = STORMNODE_SYNC_SNW;
             break;
@@ -151,6 +157,9 @@ void CStormnodeSync::GetNextAsset()
             RequestedStormnodeAssets = STORMNODE_SYNC_BUDGET;
             break;
         case(STORMNODE_SYNC_BUDGET):
+            BOOST_FOREACH(const PAIRTYPE(CNetAddr, CSyncCursor)& item, mapBudgetCursorsPending)
+                mapBudgetCursors[item.first] = item.second;
+            mapBudgetCursorsPending.clear();
             LogPrintf("CStormnodeSync::GetNextAsset - Sync has finished\n");
             RequestedStormnodeAssets = STORMNODE_SYNC_FINISHED;
             //uiInterface.NotifyAdditionalDataSyncProgressChanged(1);
@@ -208,10 +217,45 @@ void CStormnodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
                 break;
         }
         
+        // peers that keep a change log add the cursor their reply brings us to
+        if(!vRecv.empty()) {
+            CSyncCursor cursor;
+            vRecv >> cursor;
+            if(nItemID == STORMNODE_SYNC_LIST)
+                mapListCursorsPending[pfrom->addr] = cursor;
+            else if(nItemID == STORMNODE_SYNC_BUDGET_PROP || nItemID == STORMNODE_SYNC_BUDGET_FIN)
+                mapBudgetCursorsPending[pfrom->addr] = cursor;
+        }
+
         LogPrintf("CStormnodeSync:ProcessMessage - ssc - got inventory count %d %d\n", nItemID, nCount);
     }
 }
 
+void CStormnodeSync::ClearCursors()
+{
+    mapListCursors.clear();
+    mapBudgetCursors.clear();
+    mapListCursorsPending.clear();
+    mapBudgetCursorsPending.clear();
+}
+
+CSyncCursor CStormnodeSync::GetListCursor(const CNetAddr& addr)
+{
+    // without a list of our own there is nothing to apply changes to
+    if(snodeman.size() == 0) return CSyncCursor();
+
+    std::map<CNetAddr, CSyncCursor>::iterator it = mapListCursors.find(addr);
+    return it == mapListCursors.end() ? CSyncCursor() : (*it).second;
+}
+
+CSyncCursor CStormnodeSync::GetBudgetCursor(const CNetAddr& addr)
+{
+    if(budget.sizeProposals() == 0 && budget.sizeFinalized() == 0) return CSyncCursor();
+
+    std::map<CNetAddr, CSyncCursor>::iterator it = mapBudgetCursors.find(addr);
+    return it == mapBudgetCursors.end() ? CSyncCursor() : (*it).second;
+}
+
 void CStormnodeSync::ClearFulfilledRequest()
 {
     TRY_LOCK(cs_vNodes, lockRecv);
@@ -240,6 +284,7 @@ void CStormnodeSync::Process()
             Resync if we lose all stormnodes from sleep/wake or failure to sync originally
         */
         if(nSnCount == 0) {
+            ClearCursors();
             Reset();
         } else
             return;
@@ -323,7 +368,7 @@ void CStormnodeSync::Process()
 
                 if(RequestedStormnodeAttempt >= STORMNODE_SYNC_THRESHOLD * 3) return;
 
-                snodeman.SsegUpdate(pnode);
+                snodeman.SsegUpdate(pnode, GetListCursor(pnode->addr));
                 RequestedStormnodeAttempt++;
                 return;
             }
@@ -401,7 +446,11 @@ void CStormnodeSync::Process()
                 if(RequestedStormnodeAttempt >= STORMNODE_SYNC_THRESHOLD * 3) return;
 
                 uint256 n = 0;
-                pnode->PushMessage("snvs", n); //sync stormnode votes
+                CSyncCursor cursor = GetBudgetCursor(pnode->addr);
+                if(cursor.IsNull())
+                    pnode->PushMessage("snvs", n); //sync stormnode votes
+                else
+                    pnode->PushMessage("snvs", n, cursor); //only the votes changed since our last sync
                 RequestedStormnodeAttempt++;
                 
                 return;
@@ -59,6 +59,14 @@ public:
     // Time when current stormnode asset sync started
     int64_t nAssetSyncStarted;
 
+    // Where our last finished list and budget syncs with each peer ended. Kept
+    // across Reset() so reconnecting peers only send what changed since.
+    std::map<CNetAddr, CSyncCursor> mapListCursors;
+    std::map<CNetAddr, CSyncCursor> mapBudgetCursors;
+    // cursors of the sync in progress, kept once its stage completes
+    std::map<CNetAddr, CSyncCursor> mapListCursorsPending;
+    std::map<CNetAddr, CSyncCursor> mapBudgetCursorsPending;
+
     CStormnodeSync();
 
     void AddedStormnodeList(uint256 hash);
@@ -75,6 +83,10 @@ public:
     bool IsSynced();
     bool IsBlockchainSynced();
     void ClearFulfilledRequest();
+    /// Forget where earlier syncs ended, the next ones send everything
+    void ClearCursors();
+    CSyncCursor GetListCursor(const CNetAddr& addr);
+    CSyncCursor GetBudgetCursor(const CNetAddr& addr);
 };
 
 #endif
@@ -16,46 +16,75 @@
 
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenStormnodeScanningErrors;
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
 
 //Get the last hash that matches the modulus given. Processed in reverse order
 bool GetBlockHash(uint256& hash, int nBlockHeight)
-{   
+{
     LOCK(cs_main);
     if (pindexBest == NULL) return false;
 
     if(nBlockHeight == 0)
         nBlockHeight = pindexBest->nHeight;
 
-    if(mapCacheBlockHashes.count(nBlockHeight)){
-        hash = mapCacheBlockHashes[nBlockHeight];
-        return true;
-    }
+    if (pindexBest->nHeight == 0 || pindexBest->nHeight+1 < nBlockHeight) return false;
 
-    const CBlockIndex *BlockLastSolved = pindexBest;
-    const CBlockIndex *BlockReading = pindexBest;
+    // the block one below nBlockHeight, straight out of the height-indexed active chain
+    int nTargetHeight = nBlockHeight > 0 ? nBlockHeight - 1 : pindexBest->nHeight;
+    const CBlockIndex* pindex = chainActive[nTargetHeight];
+    if (pindex == NULL || pindex->nHeight == 0) return false;
 
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || pindexBest->nHeight+1 < nBlockHeight) return false;
+    hash = pindex->GetBlockHash();
+    return true;
+}
 
-    int nBlocksAgo = 0;
-    if(nBlockHeight > 0) nBlocksAgo = (pindexBest->nHeight+1)-nBlockHeight;
-    assert(nBlocksAgo >= 0);
+CSyncChangeLog::CSyncChangeLog()
+{
+    // only has to differ from earlier runs and epochs of this node
+    nEpoch = GetTimeMicros();
+    nSeq = 0;
+}
 
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nBlocksAgo){
-            hash = BlockReading->GetBlockHash();
-            mapCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
+void CSyncChangeLog::Changed(const uint256& key, const CInv& inv)
+{
+    std::map<uint256, uint64_t>::iterator it = mapSeq.find(key);
+    if(it != mapSeq.end()) {
+        mapChanges.erase((*it).second);
+        (*it).second = ++nSeq;
+    } else {
+        mapSeq.insert(make_pair(key, ++nSeq));
+    }
+    mapChanges.insert(make_pair(nSeq, make_pair(key, inv)));
+}
 
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
-    }
+void CSyncChangeLog::Forget(const uint256& key)
+{
+    std::map<uint256, uint64_t>::iterator it = mapSeq.find(key);
+    if(it == mapSeq.end()) return;
+    mapChanges.erase((*it).second);
+    mapSeq.erase(it);
+}
 
-    return false;
+void CSyncChangeLog::Clear()
+{
+    mapChanges.clear();
+    mapSeq.clear();
+    nEpoch = std::max(GetTimeMicros(), (int64_t)nEpoch + 1);
+}
+
+bool CSyncChangeLog::GetChangesSince(const CSyncCursor& cursor, std::vector<CInv>& vInvRet) const
+{
+    vInvRet.clear();
+    if(cursor.nEpoch != nEpoch || cursor.nSeq > nSeq) return false;
+
+    // past this a delta saves little over sending everything
+    unsigned int nMax = std::max(size() / 2, 50U);
+    std::map<uint64_t, std::pair<uint256, CInv> >::const_iterator it = mapChanges.upper_bound(cursor.nSeq);
+    while(it != mapChanges.end()) {
+        if(vInvRet.size() >= nMax) return false;
+        vInvRet.push_back((*it).second.second);
+        ++it;
+    }
+    return true;
 }
 
 CStormnode::CStormnode()
@@ -364,9 +393,7 @@ bool CStormnodeBroadcast::CheckAndUpdate(int& nDos)
         return false;
     }
 
-    std::string vchPubKey(pubkey.begin(), pubkey.end());
-    std::string vchPubKey2(pubkey2.begin(), pubkey2.end());
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetSignatureMessage();
 
     if(protocolVersion < stormnodePayments.GetMinStormnodePaymentsProto()) {
         LogPrintf("CStormnodeBroadcast::CheckAndUpdate - ignoring outdated Stormnode %s protocol version %d\n", vin.ToString(), protocolVersion);
@@ -432,6 +459,7 @@ bool CStormnodeBroadcast::CheckAndUpdate(int& nDos)
         //take the newest entry
         LogPrintf("CStormnodeBroadcast::CheckAndUpdate - Got updated entry for %s\n", addr.ToString());
         if(psn->UpdateFromNewBroadcast((*this))){
+            snodeman.MarkChanged(*psn);
             psn->Check();
             if(psn->IsEnabled()) Relay();
         }
@@ -540,16 +568,21 @@ void CStormnodeBroadcast::Relay()
     RelayInv(inv);
 }
 
-bool CStormnodeBroadcast::Sign(CKey& keyCollateralAddress)
+std::string CStormnodeBroadcast::GetSignatureMessage() const
 {
-    std::string errorMessage;
-
     std::string vchPubKey(pubkey.begin(), pubkey.end());
     std::string vchPubKey2(pubkey2.begin(), pubkey2.end());
 
+    return addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+}
+
+bool CStormnodeBroadcast::Sign(CKey& keyCollateralAddress)
+{
+    std::string errorMessage;
+
     sigTime = GetAdjustedTime();
 
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.SignMessage(strMessage, errorMessage, vchSig, keyCollateralAddress)) {
         LogPrintf("CStormnodeBroadcast::Sign() - Error: %s\n", errorMessage);
@@ -562,11 +595,7 @@ bool CStormnodeBroadcast::Sign(CKey& keyCollateralAddress)
 bool CStormnodeBroadcast::VerifySignature()
 {
     std::string errorMessage;
-
-    std::string vchPubKey(pubkey.begin(), pubkey.end());
-    std::string vchPubKey2(pubkey2.begin(), pubkey2.end());
-
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.VerifyMessage(pubkey, vchSig, strMessage, errorMessage)) {
         LogPrintf("CMasternodeBroadcast::VerifySignature() - Error: %s\n", errorMessage);
@@ -600,13 +629,18 @@ CStormnodePing::CStormnodePing(CTxIn& newVin)
 }
 
 
+std::string CStormnodePing::GetSignatureMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
 bool CStormnodePing::Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode)
 {
     std::string errorMessage;
     std::string strStormNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!sandStormSigner.SignMessage(strMessage, errorMessage, vchSig, keyStormnode)) {
         LogPrintf("CStormnodePing::Sign() - Error: %s\n", errorMessage);
@@ -622,7 +656,7 @@ bool CStormnodePing::Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode)
 }
 
 bool CStormnodePing::VerifySignature(CPubKey& pubKeyStormnode, int &nDos) {
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
     std::string errorMessage = "";
 
     if(!sandStormSigner.VerifyMessage(pubKeyStormnode, vchSig, strMessage, errorMessage))
@@ -707,7 +741,7 @@ bool CStormnodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fCheck
                 snodeman.mapSeenStormnodeBroadcast[hash].lastPing = *this;
             }
 
-            psn->Check(true);
+            snodeman.CheckAndMark(*psn, true);
             if(!psn->IsEnabled()) return false;
 
             LogPrint("stormnode", "CStormnodePing::CheckAndUpdate -Stormnode ping accepted, vin: %s\n", vin.ToString());
@@ -26,10 +26,67 @@ using namespace std;
 class CStormnode;
 class CStormnodeBroadcast;
 class CStormnodePing;
-extern map<int64_t, uint256> mapCacheBlockHashes;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
+//
+// Where a peer's last list or budget sync with us ended
+//
+
+class CSyncCursor
+{
+public:
+    uint64_t nEpoch; // the run of the peer's change log the sequence belongs to, 0 = none
+    uint64_t nSeq;
+
+    CSyncCursor() : nEpoch(0), nSeq(0) {}
+    CSyncCursor(uint64_t nEpochIn, uint64_t nSeqIn) : nEpoch(nEpochIn), nSeq(nSeqIn) {}
+
+    bool IsNull() const { return nEpoch == 0; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nEpoch);
+        READWRITE(nSeq);
+    }
+};
+
+/**
+ * Numbers the changes to a set of synced objects, so that a peer which synced
+ * with us before only gets the objects changed after its cursor.
+ *
+ * Every object has a key that stays the same across its versions (the outpoint
+ * of a stormnode, the hash of a proposal, ...) and the inventory of its current
+ * version; a change moves it to the end of the sequence. Sequences only live in
+ * memory, a restart or Clear() begins a new epoch that older cursors don't match.
+ */
+class CSyncChangeLog
+{
+public:
+    CSyncChangeLog();
+
+    void Changed(const uint256& key, const CInv& inv);
+    void Forget(const uint256& key);
+    void Clear();
+
+    /// The cursor a peer gets after syncing everything up to now
+    CSyncCursor GetCursor() const { return CSyncCursor(nEpoch, nSeq); }
+
+    /// The objects changed after cursor, oldest first. False if the cursor isn't
+    /// one of ours or so many objects changed that a full sync costs the same.
+    bool GetChangesSince(const CSyncCursor& cursor, std::vector<CInv>& vInvRet) const;
+
+    unsigned int size() const { return mapSeq.size(); }
+
+private:
+    uint64_t nEpoch;
+    uint64_t nSeq;
+    std::map<uint64_t, std::pair<uint256, CInv> > mapChanges;
+    std::map<uint256, uint64_t> mapSeq;
+};
+
 
 //
 // The Stormnode Ping Class : Contains a different serialize method for sending pings from stormnodes throughout the network
@@ -59,6 +116,7 @@ public:
     }
 
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true, bool fCheckSigTimeOnly = false);
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyStormnode, CPubKey& pubKeyStormnode);
     bool VerifySignature(CPubKey& pubKeyStormnode, int &nDos);
     void Relay();
@@ -294,6 +352,7 @@ public:
 
     bool CheckAndUpdate(int& nDoS);
     bool CheckInputsAndAdd(int& nDos);
+    std::string GetSignatureMessage() const;
     bool Sign(CKey& keyCollateralAddress);
     bool VerifySignature();
     void Relay();
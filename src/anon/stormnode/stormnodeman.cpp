@@ -7,6 +7,7 @@
 
 #include "anon/stormnode/stormnodeman.h"
 #include "anon/stormnode/activestormnode.h"
+#include "anon/stormnode/stormnode-cache.h"
 #include "anon/sandstorm/sandstorm.h"
 #include "anon/stormnode/stormnode.h"
 #include "anon/stormnode/stormnode-payments.h"
@@ -17,6 +18,8 @@
 
 /** Stormnode manager */
 CStormnodeMan snodeman;
+/** Incremental on-disk copy of snodeman */
+static CCacheJournal snCacheJournal("sncache.jnl", "StormnodeCache");
 
 struct CompareLastPaid
 {
@@ -176,37 +179,65 @@ CStormnodeDB::ReadResult CStormnodeDB::Read(CStormnodeMan& snodemanToLoad, bool
     return Ok;
 }
 
-void DumpStormnodes()
+void LoadStormnodes()
 {
     int64_t nStart = GetTimeMillis();
 
-    CStormnodeDB sndb;
-    CStormnodeMan tempSnodeman;
+    if (LoadFromJournal(snCacheJournal, snodeman))
+    {
+        LogPrintf("Loaded info from sncache.jnl  %dms\n", GetTimeMillis() - nStart);
+        LogPrintf("  %s\n", snodeman.ToString());
+        LogPrintf("Stormnode manager - cleaning....\n");
+        snodeman.CheckAndRemove(true);
+        LogPrintf("Stormnode manager - result:\n");
+        LogPrintf("  %s\n", snodeman.ToString());
+        return;
+    }
 
-    LogPrintf("Verifying sncache.dat format...\n");
-    CStormnodeDB::ReadResult readResult = sndb.Read(tempSnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
+    // no journal yet, take over the cache file of older versions; the first flush starts the journal
+    CStormnodeDB sndb;
+    CStormnodeDB::ReadResult readResult = sndb.Read(snodeman);
     if (readResult == CStormnodeDB::FileError)
-        LogPrintf("Missing stormnode cache file - sncache.dat, will try to recreate\n");
+        LogPrintf("Missing Stormnode cache file - sncache.dat, will try to recreate\n");
     else if (readResult != CStormnodeDB::Ok)
     {
         LogPrintf("Error reading sncache.dat: ");
         if(readResult == CStormnodeDB::IncorrectFormat)
             LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
         else
-        {
             LogPrintf("file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
     }
-    LogPrintf("Writting info to sncache.dat...\n");
-    sndb.Write(snodeman);
+}
+
+void DumpStormnodes()
+{
+    int64_t nStart = GetTimeMillis();
+
+    if (FlushToJournal(snCacheJournal, snodeman))
+        LogPrint("stormnode", "Stormnode dump finished  %dms\n", GetTimeMillis() - nStart);
+}
+
+static COutPoint StormnodeCacheKey(const CStormnode& sn)
+{
+    return sn.vin.prevout;
+}
 
-    LogPrintf("Stormnode dump finished  %dms\n", GetTimeMillis() - nStart);
+void CStormnodeMan::GetCacheSections(CCacheSections& sections) const
+{
+    LOCK(cs);
+    sections.AddList(vStormnodes, &StormnodeCacheKey);
+    sections.AddMap(mAskedUsForStormnodeList);
+    sections.AddMap(mWeAskedForStormnodeList);
+    sections.AddMap(mWeAskedForStormnodeListEntry);
+    sections.AddValue(nSsqCount);
+
+    sections.AddMap(mapSeenStormnodeBroadcast);
+    sections.AddSeenMap(mapSeenStormnodePing);
 }
 
 CStormnodeMan::CStormnodeMan() {
     nSsqCount = 0;
+    nListVersion = 0;
 }
 
 bool CStormnodeMan::Add(CStormnode &sn)
@@ -221,6 +252,8 @@ bool CStormnodeMan::Add(CStormnode &sn)
     {
         LogPrint("stormnode", "CStormnodeMan: Adding new Stormnode %s - %i now\n", sn.addr.ToString(), size() + 1);
         vStormnodes.push_back(sn);
+        nListVersion++;
+        MarkChanged(sn);
         return true;
     }
 
@@ -249,7 +282,7 @@ void CStormnodeMan::Check()
     LOCK(cs);
 
     BOOST_FOREACH(CStormnode& sn, vStormnodes) {
-        sn.Check();
+        CheckAndMark(sn);
     }
 }
 
@@ -291,7 +324,9 @@ void CStormnodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            changeLog.Forget((*it).vin.prevout.GetHash());
             it = vStormnodes.erase(it);
+            nListVersion++;
         } else {
             ++it;
         }
@@ -356,6 +391,8 @@ void CStormnodeMan::Clear()
 {
     LOCK(cs);
     vStormnodes.clear();
+    nListVersion++;
+    changeLog.Clear();
     mAskedUsForStormnodeList.clear();
     mWeAskedForStormnodeList.clear();
     mWeAskedForStormnodeListEntry.clear();
@@ -370,7 +407,7 @@ int CStormnodeMan::CountEnabled(int protocolVersion)
     protocolVersion = protocolVersion == -1 ? stormnodePayments.GetMinStormnodePaymentsProto() : protocolVersion;
 
     BOOST_FOREACH(CStormnode& sn, vStormnodes) {
-        sn.Check();
+        CheckAndMark(sn);
         if(sn.protocolVersion < protocolVersion || !sn.IsEnabled()) continue;
         i++;
     }
@@ -378,10 +415,12 @@ int CStormnodeMan::CountEnabled(int protocolVersion)
     return i;
 }
 
-void CStormnodeMan::SsegUpdate(CNode* pnode)
+void CStormnodeMan::SsegUpdate(CNode* pnode, const CSyncCursor& cursor)
 {
     LOCK(cs);
 
+    // the peer answers a request for the changes since our last sync with it
+    // at the same rate as one for the whole list
     if(Params().NetworkID() == CChainParams::MAIN) {
         if(!(pnode->addr.IsRFC1918() || pnode->addr.IsLocal())){
             std::map<CNetAddr, int64_t>::iterator it = mWeAskedForStormnodeList.find(pnode->addr);
@@ -395,11 +434,29 @@ void CStormnodeMan::SsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("sseg", CTxIn());
+    if(cursor.IsNull())
+        pnode->PushMessage("sseg", CTxIn());
+    else
+        pnode->PushMessage("sseg", CTxIn(), cursor);
     int64_t askAgain = GetTime() + STORMNODES_SSEG_SECONDS;
     mWeAskedForStormnodeList[pnode->addr] = askAgain;
 }
 
+void CStormnodeMan::MarkChanged(const CStormnode& sn)
+{
+    LOCK(cs);
+    changeLog.Changed(sn.vin.prevout.GetHash(), CInv(MSG_STORMNODE_ANNOUNCE, CStormnodeBroadcast(sn).GetHash()));
+}
+
+void CStormnodeMan::CheckAndMark(CStormnode& sn, bool forceCheck)
+{
+    LOCK(cs);
+    // peers skip disabled entries when syncing, so one enabled later has to show up in their next delta
+    bool fWasEnabled = sn.IsEnabled();
+    sn.Check(forceCheck);
+    if(sn.IsEnabled() != fWasEnabled) MarkChanged(sn);
+}
+
 CStormnode *CStormnodeMan::Find(const CScript &payee)
 {
     LOCK(cs);
@@ -456,7 +513,7 @@ CStormnode* CStormnodeMan::GetNextStormnodeInQueueForPayment(int nBlockHeight, b
     int nSnCount = CountEnabled();
     BOOST_FOREACH(CStormnode &sn, vStormnodes)
     {
-        sn.Check();
+        CheckAndMark(sn);
         if(!sn.IsEnabled()) continue;
 
         // check protocol version
@@ -543,7 +600,7 @@ CStormnode* CStormnodeMan::GetCurrentStormNode(int mod, int64_t nBlockHeight, in
 
     // scan for winner
     BOOST_FOREACH(CStormnode& sn, vStormnodes) {
-        sn.Check();
+        CheckAndMark(sn);
         if(sn.protocolVersion < minProtocol || !sn.IsEnabled()) continue;
 
         // calculate the score for each Stormnode
@@ -572,7 +629,7 @@ int CStormnodeMan::GetStormnodeRank(const CTxIn& vin, int64_t nBlockHeight, int
     BOOST_FOREACH(CStormnode& sn, vStormnodes) {
         if(sn.protocolVersion < minProtocol) continue;
         if(fOnlyActive) {
-            sn.Check();
+            CheckAndMark(sn);
             if(!sn.IsEnabled()) continue;
         }
         uint256 n = sn.CalculateScore(1, nBlockHeight);
@@ -606,7 +663,7 @@ std::vector<pair<int, CStormnode> > CStormnodeMan::GetStormnodeRanks(int64_t nBl
     // scan for winner
     BOOST_FOREACH(CStormnode& sn, vStormnodes) {
 
-        sn.Check();
+        CheckAndMark(sn);
 
         if(sn.protocolVersion < minProtocol) continue;
         if(!sn.IsEnabled()) {
@@ -639,7 +696,7 @@ CStormnode* CStormnodeMan::GetStormnodeByRank(int nRank, int64_t nBlockHeight, i
 
         if(sn.protocolVersion < minProtocol) continue;
         if(fOnlyActive) {
-            sn.Check();
+            CheckAndMark(sn);
             if(!sn.IsEnabled()) continue;
         }
 
@@ -727,8 +784,11 @@ void CStormnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataS
 
         CTxIn vin;
         vRecv >> vin;
+        // peers that synced the list with us before add the cursor they got back then
+        CSyncCursor cursor;
+        if(!vRecv.empty()) vRecv >> cursor;
 
-        if(vin == CTxIn()) { //only should ask for this once
+        if(vin == CTxIn()) { //only should ask for this once, whether for the whole list or the changes
             //local network
             bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
 
@@ -747,6 +807,31 @@ void CStormnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataS
             }
         } //else, asking for a specific node which is ok
 
+        std::vector<CInv> vInvChanged;
+        std::vector<CInv> vInvSend;
+        CSyncCursor cursorNow;
+        bool fDelta = false;
+        if(vin == CTxIn()) {
+            // only the change log is read under cs, Misbehaving() takes cs_vNodes,
+            // which the sync thread holds while calling SsegUpdate()
+            LOCK(cs);
+            fDelta = changeLog.GetChangesSince(cursor, vInvChanged);
+            BOOST_FOREACH(const CInv& inv, vInvChanged) {
+                std::map<uint256, CStormnodeBroadcast>::iterator mi = mapSeenStormnodeBroadcast.find(inv.hash);
+                if(mi == mapSeenStormnodeBroadcast.end()) continue;
+                CStormnode* psn = Find((*mi).second.vin);
+                if(psn == NULL || psn->addr.IsRFC1918() || psn->addr.IsLocal() || !psn->IsEnabled()) continue;
+                vInvSend.push_back(inv);
+            }
+            cursorNow = changeLog.GetCursor();
+        }
+        if(fDelta) {
+            BOOST_FOREACH(const CInv& inv, vInvSend)
+                pfrom->PushInventory(inv);
+            pfrom->PushMessage("ssc", STORMNODE_SYNC_LIST, (int)vInvSend.size(), cursorNow);
+            LogPrintf("sseg - Sent %d changed Stormnode entries to %s\n", vInvSend.size(), pfrom->addr.ToString());
+            return;
+        }
 
         int nInvCount = 0;
 
@@ -772,7 +857,7 @@ void CStormnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataS
         }
 
         if(vin == CTxIn()) {
-            pfrom->PushMessage("ssc", STORMNODE_SYNC_LIST, nInvCount);
+            pfrom->PushMessage("ssc", STORMNODE_SYNC_LIST, nInvCount, changeLog.GetCursor());
             LogPrintf("sseg - Sent %d Stormnode entries to %s\n", nInvCount, pfrom->addr.ToString());
         }
     }
@@ -786,7 +871,9 @@ void CStormnodeMan::Remove(CTxIn vin)
     while(it != vStormnodes.end()){
         if((*it).vin == vin){
             LogPrint("stormnode", "CStormnodeMan: Removing Stormnode %s - %i now\n", (*it).addr.ToString(), size() - 1);
+            changeLog.Forget((*it).vin.prevout.GetHash());
             vStormnodes.erase(it);
+            nListVersion++;
             break;
         }
         ++it;
@@ -818,8 +905,8 @@ void CStormnodeMan::UpdateStormnodeList(CStormnodeBroadcast snb) {
     {
         CStormnode sn(snb);
         Add(sn);
-    } else {
-        psn->UpdateFromNewBroadcast(snb);
+    } else if(psn->UpdateFromNewBroadcast(snb)) {
+        MarkChanged(*psn);
     }
 }
 
@@ -18,9 +18,11 @@ static const unsigned int STORMNODES_SSEG_SECONDS = (1*60*60);// 1 Hour
 
 using namespace std;
 
+class CCacheSections;
 class CStormnodeMan;
 
 extern CStormnodeMan snodeman;
+void LoadStormnodes();
 void DumpStormnodes();
 
 /** Access to the SN database (sncache.dat)
@@ -63,6 +65,10 @@ private:
     std::map<CNetAddr, int64_t> mWeAskedForStormnodeList;
     // which Stormnodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForStormnodeListEntry;
+    // bumped whenever an entry is added or removed
+    unsigned int nListVersion;
+    // new and updated entries, for peers asking for the changes since their last sync
+    CSyncChangeLog changeLog;
 
 public:
     // Keep track of all broadcasts I've seen
@@ -86,8 +92,15 @@ public:
 
         READWRITE(mapSeenStormnodeBroadcast);
         READWRITE(mapSeenStormnodePing);
+        if (ser_action.ForRead()) {
+            nListVersion++;
+            changeLog.Clear();
+        }
     }
 
+    /// Same members as SerializationOp, split for the cache journal
+    void GetCacheSections(CCacheSections& sections) const;
+
     CStormnodeMan();
     CStormnodeMan(CStormnodeMan& other);
 
@@ -108,7 +121,14 @@ public:
 
     int CountEnabled(int protocolVersion = -1);
 
-    void SsegUpdate(CNode* pnode);
+    /// Ask pnode for the list, or for the changes after cursor if we synced with it before
+    void SsegUpdate(CNode* pnode, const CSyncCursor& cursor = CSyncCursor());
+
+    /// Record a new or updated entry for the peers that sync changes only
+    void MarkChanged(const CStormnode& sn);
+
+    /// Check an entry, recording it as changed if it got enabled or disabled
+    void CheckAndMark(CStormnode& sn, bool forceCheck = false);
 
     /// Find an entry
     CStormnode* Find(const CScript &payee);
@@ -137,6 +157,9 @@ public:
     /// Return the number of (unique) Stormnodes
     int size() { return vStormnodes.size(); }
 
+    /// Changes whenever a Stormnode is added or removed, so Find(vin) results can be cached
+    unsigned int GetListVersion() const { return nListVersion; }
+
     std::string ToString() const;
 
     void Remove(CTxIn vin);
@@ -0,0 +1,18 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "util.h"
+
+int
+main(int argc, char** argv)
+{
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SHA256AutoDetect();
+
+    benchmark::BenchRunner::RunAll();
+}
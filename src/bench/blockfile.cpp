@@ -0,0 +1,83 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockfile.h"
+#include "main.h"
+#include "random.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+// Previous-output fetches as FetchInputs does them: one transaction at a random
+// position in a block file per input. Reported items/sec are inputs/sec.
+
+static const unsigned int BENCH_TXS = 20000;
+static const unsigned int BENCH_INPUTS = 1000;
+
+static std::vector<unsigned int> WriteBenchBlockFile()
+{
+    if (!mapArgs.count("-datadir"))
+        mapArgs["-datadir"] = (boost::filesystem::temp_directory_path() / strprintf("bench_darksilk_%lu", (unsigned long)GetTime())).string();
+    boost::filesystem::create_directories(mapArgs["-datadir"]);
+    boost::filesystem::create_directories(GetDataDir());
+
+    std::vector<unsigned int> vTxPos;
+    CAutoFile fileout(fopen(BlockFilePath(1).string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    for (unsigned int i = 0; i < BENCH_TXS; i++)
+    {
+        CMutableTransaction tx;
+        for (int j = 0; j < 2; j++)
+        {
+            tx.vin.push_back(CTxIn(GetRandHash(), j, CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2)));
+            tx.vout.push_back(CTxOut(i * 1000 + j, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG));
+        }
+        vTxPos.push_back(ftell(fileout));
+        fileout << CTransaction(tx);
+    }
+    fflush(fileout);
+
+    // Look the inputs up in random order, like spends of old outputs do
+    std::vector<unsigned int> vLookups;
+    for (unsigned int i = 0; i < BENCH_INPUTS; i++)
+        vLookups.push_back(vTxPos[GetRand(vTxPos.size())]);
+    return vLookups;
+}
+
+static void FetchInputsStdio(benchmark::State& state)
+{
+    std::vector<unsigned int> vLookups = WriteBenchBlockFile();
+    state.SetItemsPerIteration(vLookups.size());
+    while (state.KeepRunning())
+    {
+        BOOST_FOREACH(unsigned int nTxPos, vLookups)
+        {
+            CTransaction tx;
+            CAutoFile filein(OpenBlockFile(1, 0, "rb"), SER_DISK, CLIENT_VERSION);
+            fseek(filein, nTxPos, SEEK_SET);
+            filein >> tx;
+        }
+    }
+    boost::filesystem::remove_all(mapArgs["-datadir"]);
+}
+
+static void FetchInputsMapped(benchmark::State& state)
+{
+    std::vector<unsigned int> vLookups = WriteBenchBlockFile();
+    state.SetItemsPerIteration(vLookups.size());
+    while (state.KeepRunning())
+    {
+        BOOST_FOREACH(unsigned int nTxPos, vLookups)
+        {
+            CTransaction tx;
+            ReadFromBlockFile(1, nTxPos, tx);
+        }
+    }
+    blockFileCache.Clear();
+    boost::filesystem::remove_all(mapArgs["-datadir"]);
+}
+
+BENCHMARK(FetchInputsStdio);
+BENCHMARK(FetchInputsMapped);
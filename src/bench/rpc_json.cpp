@@ -0,0 +1,189 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "rpc/rpcprotocol.h"
+#include "tinyformat.h"
+
+using namespace json_spirit;
+
+// Replies shaped like the heavy RPC workloads indexers replay against us, built without
+// a node so the numbers only measure JSON parsing and serialization.
+
+static std::string FakeHash(int n)
+{
+    return strprintf("%064x", n);
+}
+
+/** getblock <hash> true: header fields plus one verbose object per transaction */
+static Value GetBlockVerboseReply()
+{
+    Object block;
+    block.push_back(Pair("hash", FakeHash(1)));
+    block.push_back(Pair("confirmations", 12));
+    block.push_back(Pair("size", 512000));
+    block.push_back(Pair("height", 250000));
+    block.push_back(Pair("version", 7));
+    block.push_back(Pair("merkleroot", FakeHash(2)));
+    block.push_back(Pair("mint", 1.5));
+    block.push_back(Pair("time", (int64_t)1466000000));
+    block.push_back(Pair("nonce", (uint64_t)0));
+    block.push_back(Pair("bits", "1d00ffff"));
+    block.push_back(Pair("difficulty", 1234.5678));
+    block.push_back(Pair("previousblockhash", FakeHash(3)));
+    block.push_back(Pair("flags", "proof-of-stake"));
+    Array txinfo;
+    for (int i = 0; i < 2000; i++)
+    {
+        Object tx;
+        tx.push_back(Pair("txid", FakeHash(i)));
+        tx.push_back(Pair("version", 1));
+        tx.push_back(Pair("time", (int64_t)1466000000));
+        tx.push_back(Pair("locktime", 0));
+        Array vin, vout;
+        for (int j = 0; j < 2; j++)
+        {
+            Object in;
+            in.push_back(Pair("txid", FakeHash(i * 2 + j)));
+            in.push_back(Pair("vout", j));
+            Object sig;
+            sig.push_back(Pair("asm", "3045022100ab 02cd"));
+            sig.push_back(Pair("hex", std::string(212, 'a')));
+            in.push_back(Pair("scriptSig", sig));
+            in.push_back(Pair("sequence", (int64_t)4294967295LL));
+            vin.push_back(in);
+
+            Object out;
+            out.push_back(Pair("value", 12.3456789));
+            out.push_back(Pair("n", j));
+            Object pk;
+            pk.push_back(Pair("asm", "OP_DUP OP_HASH160 00ab OP_EQUALVERIFY OP_CHECKSIG"));
+            pk.push_back(Pair("hex", std::string(50, 'b')));
+            pk.push_back(Pair("reqSigs", 1));
+            pk.push_back(Pair("type", "pubkeyhash"));
+            Array addresses;
+            addresses.push_back("DNxLvDh7jKdfTnq9pwfVKArZKdVcmvhA2h");
+            pk.push_back(Pair("addresses", addresses));
+            out.push_back(Pair("scriptPubKey", pk));
+            vout.push_back(out);
+        }
+        tx.push_back(Pair("vin", vin));
+        tx.push_back(Pair("vout", vout));
+        txinfo.push_back(tx);
+    }
+    block.push_back(Pair("tx", txinfo));
+    return block;
+}
+
+/** listtransactions "*" 1000 */
+static Value ListTransactionsReply()
+{
+    Array ret;
+    for (int i = 0; i < 1000; i++)
+    {
+        Object entry;
+        entry.push_back(Pair("account", ""));
+        entry.push_back(Pair("address", "DNxLvDh7jKdfTnq9pwfVKArZKdVcmvhA2h"));
+        entry.push_back(Pair("category", i % 3 ? "receive" : "send"));
+        entry.push_back(Pair("amount", 0.25 * i));
+        entry.push_back(Pair("confirmations", 100 + i));
+        entry.push_back(Pair("bcconfirmations", 100 + i));
+        entry.push_back(Pair("blockhash", FakeHash(i)));
+        entry.push_back(Pair("blockindex", 1));
+        entry.push_back(Pair("blocktime", (int64_t)1466000000 + i));
+        entry.push_back(Pair("txid", FakeHash(i + 1000000)));
+        entry.push_back(Pair("walletconflicts", Array()));
+        entry.push_back(Pair("time", (int64_t)1466000000 + i));
+        entry.push_back(Pair("timereceived", (int64_t)1466000000 + i));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+/** getrawmempool true */
+static Value GetRawMempoolVerboseReply()
+{
+    Object ret;
+    for (int i = 0; i < 5000; i++)
+    {
+        Object info;
+        info.push_back(Pair("size", 226));
+        info.push_back(Pair("fee", 0.0001));
+        info.push_back(Pair("time", (int64_t)1466000000 + i));
+        info.push_back(Pair("height", 250000));
+        info.push_back(Pair("startingpriority", 12345.678));
+        info.push_back(Pair("currentpriority", 23456.789));
+        Array depends;
+        if (i % 4 == 0)
+            depends.push_back(FakeHash(i + 1));
+        info.push_back(Pair("depends", depends));
+        ret.push_back(Pair(FakeHash(i), info));
+    }
+    return ret;
+}
+
+static void WriteReply(benchmark::State& state, const Value& reply)
+{
+    state.SetBytesPerIteration(WriteJSON(reply).size());
+    while (state.KeepRunning())
+        WriteJSON(reply);
+}
+
+static void ReadReply(benchmark::State& state, const Value& reply)
+{
+    std::string strReply = WriteJSON(reply);
+    state.SetBytesPerIteration(strReply.size());
+    while (state.KeepRunning())
+    {
+        Value value;
+        ReadJSON(strReply, value);
+    }
+}
+
+static void SpiritWriteReply(benchmark::State& state, const Value& reply)
+{
+    state.SetBytesPerIteration(WriteJSON(reply).size());
+    while (state.KeepRunning())
+        write_string(reply, false);
+}
+
+static void SpiritReadReply(benchmark::State& state, const Value& reply)
+{
+    std::string strReply = WriteJSON(reply);
+    state.SetBytesPerIteration(strReply.size());
+    while (state.KeepRunning())
+    {
+        Value value;
+        read_string(strReply, value);
+    }
+}
+
+static void RPCWriteGetBlockVerbose(benchmark::State& state) { WriteReply(state, GetBlockVerboseReply()); }
+static void RPCWriteListTransactions(benchmark::State& state) { WriteReply(state, ListTransactionsReply()); }
+static void RPCWriteGetRawMempoolVerbose(benchmark::State& state) { WriteReply(state, GetRawMempoolVerboseReply()); }
+static void RPCReadGetBlockVerbose(benchmark::State& state) { ReadReply(state, GetBlockVerboseReply()); }
+static void RPCReadListTransactions(benchmark::State& state) { ReadReply(state, ListTransactionsReply()); }
+static void RPCReadGetRawMempoolVerbose(benchmark::State& state) { ReadReply(state, GetRawMempoolVerboseReply()); }
+
+// The json_spirit grammar this replaced, for comparison
+static void SpiritWriteGetBlockVerbose(benchmark::State& state) { SpiritWriteReply(state, GetBlockVerboseReply()); }
+static void SpiritWriteListTransactions(benchmark::State& state) { SpiritWriteReply(state, ListTransactionsReply()); }
+static void SpiritWriteGetRawMempoolVerbose(benchmark::State& state) { SpiritWriteReply(state, GetRawMempoolVerboseReply()); }
+static void SpiritReadGetBlockVerbose(benchmark::State& state) { SpiritReadReply(state, GetBlockVerboseReply()); }
+static void SpiritReadListTransactions(benchmark::State& state) { SpiritReadReply(state, ListTransactionsReply()); }
+static void SpiritReadGetRawMempoolVerbose(benchmark::State& state) { SpiritReadReply(state, GetRawMempoolVerboseReply()); }
+
+BENCHMARK(RPCWriteGetBlockVerbose);
+BENCHMARK(RPCWriteListTransactions);
+BENCHMARK(RPCWriteGetRawMempoolVerbose);
+BENCHMARK(RPCReadGetBlockVerbose);
+BENCHMARK(RPCReadListTransactions);
+BENCHMARK(RPCReadGetRawMempoolVerbose);
+BENCHMARK(SpiritWriteGetBlockVerbose);
+BENCHMARK(SpiritWriteListTransactions);
+BENCHMARK(SpiritWriteGetRawMempoolVerbose);
+BENCHMARK(SpiritReadGetBlockVerbose);
+BENCHMARK(SpiritReadListTransactions);
+BENCHMARK(SpiritReadGetRawMempoolVerbose);
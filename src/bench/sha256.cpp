@@ -0,0 +1,127 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+
+#include <openssl/sha.h>
+
+#include <vector>
+
+// The *OpenSSL variants replay what Hash() and CHashWriter did before they moved
+// onto CSHA256, so the two columns compare the old and the dispatched code paths.
+
+static void OpenSSLHash(const unsigned char* in, size_t len, unsigned char* out)
+{
+    unsigned char hash1[32];
+    SHA256(in, len, hash1);
+    SHA256(hash1, sizeof(hash1), out);
+}
+
+/** Double-SHA256 of 32 bytes: merkle branches and small message checksums */
+static void SHA256D_32b(benchmark::State& state)
+{
+    std::vector<unsigned char> in(32, 0);
+    state.SetItemsPerIteration(1000);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            CHash256().Write(&in[0], in.size()).Finalize(&in[0]);
+    }
+}
+
+static void SHA256D_32b_OpenSSL(benchmark::State& state)
+{
+    std::vector<unsigned char> in(32, 0);
+    state.SetItemsPerIteration(1000);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+            OpenSSLHash(&in[0], in.size(), &in[0]);
+    }
+}
+
+/** Double-SHA256 of a typical 250-byte transaction, the txid path */
+static void SHA256D_250b(benchmark::State& state)
+{
+    std::vector<unsigned char> in(250, 0);
+    uint256 hash;
+    state.SetItemsPerIteration(1000);
+    state.SetBytesPerIteration(1000 * 250);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            hash = Hash(in.begin(), in.end());
+            in[i % 250] ^= hash.begin()[0];
+        }
+    }
+}
+
+static void SHA256D_250b_OpenSSL(benchmark::State& state)
+{
+    std::vector<unsigned char> in(250, 0);
+    uint256 hash;
+    state.SetItemsPerIteration(1000);
+    state.SetBytesPerIteration(1000 * 250);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            OpenSSLHash(&in[0], in.size(), hash.begin());
+            in[i % 250] ^= hash.begin()[0];
+        }
+    }
+}
+
+/** Single SHA256 over 1MB, bulk throughput of the block transform */
+static void SHA256_1M(benchmark::State& state)
+{
+    std::vector<unsigned char> in(1000 * 1000, 0);
+    unsigned char hash[32];
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning())
+        CSHA256().Write(&in[0], in.size()).Finalize(hash);
+}
+
+static void SHA256_1M_OpenSSL(benchmark::State& state)
+{
+    std::vector<unsigned char> in(1000 * 1000, 0);
+    unsigned char hash[32];
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning())
+        SHA256(&in[0], in.size(), hash);
+}
+
+/** One merkle level of 1024 pairs: batched SHA256D64 against a Hash() per pair */
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<unsigned char> in(64 * 1024, 0);
+    state.SetItemsPerIteration(1024);
+    while (state.KeepRunning())
+        SHA256D64(&in[0], &in[0], 1024);
+}
+
+static void SHA256D64_1024_OpenSSL(benchmark::State& state)
+{
+    std::vector<unsigned char> in(64 * 1024, 0);
+    state.SetItemsPerIteration(1024);
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < 1024; i++)
+            OpenSSLHash(&in[64 * i], 64, &in[32 * i]);
+    }
+}
+
+BENCHMARK(SHA256D_32b);
+BENCHMARK(SHA256D_32b_OpenSSL);
+BENCHMARK(SHA256D_250b);
+BENCHMARK(SHA256D_250b_OpenSSL);
+BENCHMARK(SHA256_1M);
+BENCHMARK(SHA256_1M_OpenSSL);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(SHA256D64_1024_OpenSSL);
@@ -0,0 +1,199 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "random.h"
+#include "wallet/wallet.h"
+#include "wallet/wallet_ismine.h"
+
+#include <assert.h>
+#include <set>
+#include <vector>
+
+// IsMine over the outputs of a block's worth of transactions during sync, against a
+// keystore the size of a deposit service's keypool. Reported items/sec are outputs/sec,
+// for the IsInvolved benchmarks on a synced wallet they are transactions/sec.
+
+static const unsigned int BENCH_KEYS = 20000;
+static const unsigned int BENCH_OUTPUTS = 2000;
+static const unsigned int BENCH_WALLET_TXS = 10000;
+static const unsigned int BENCH_BLOCK_TXS = 500;
+
+static const CBasicKeyStore& BenchKeyStore()
+{
+    static CBasicKeyStore keystore;
+    static bool fInit = false;
+    if (!fInit)
+    {
+        for (unsigned int i = 0; i < BENCH_KEYS; i++)
+        {
+            CKey key;
+            key.MakeNewKey(true);
+            keystore.AddKey(key);
+        }
+        fInit = true;
+    }
+    return keystore;
+}
+
+static std::vector<CScript> ForeignScripts()
+{
+    std::vector<CScript> vScripts;
+    for (unsigned int i = 0; i < BENCH_OUTPUTS; i++)
+    {
+        uint256 hash = GetRandHash();
+        vScripts.push_back(CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUALVERIFY << OP_CHECKSIG);
+    }
+    return vScripts;
+}
+
+// What IsMine did for a P2PKH output before the script filter
+static isminetype SolverIsMine(const CKeyStore& keystore, const CScript& scriptPubKey)
+{
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return keystore.HaveWatchOnly(scriptPubKey) ? ISMINE_WATCH_ONLY : ISMINE_NO;
+    if (whichType == TX_PUBKEYHASH && keystore.HaveKey(CKeyID(uint160(vSolutions[0]))))
+        return ISMINE_SPENDABLE;
+    return ISMINE_NO;
+}
+
+static void IsMine_Foreign(benchmark::State& state)
+{
+    const CBasicKeyStore& keystore = BenchKeyStore();
+    std::vector<CScript> vScripts = ForeignScripts();
+    unsigned int nMine = 0;
+    state.SetItemsPerIteration(vScripts.size());
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < vScripts.size(); i++)
+            nMine += IsMine(keystore, vScripts[i]) != ISMINE_NO;
+    }
+    assert(nMine == 0);
+}
+
+static void IsMine_Foreign_Solver(benchmark::State& state)
+{
+    const CBasicKeyStore& keystore = BenchKeyStore();
+    std::vector<CScript> vScripts = ForeignScripts();
+    unsigned int nMine = 0;
+    state.SetItemsPerIteration(vScripts.size());
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < vScripts.size(); i++)
+            nMine += SolverIsMine(keystore, vScripts[i]) != ISMINE_NO;
+    }
+    assert(nMine == 0);
+}
+
+/** Outputs paying the keystore still take the full IsMine path after the filter */
+static void IsMine_Own(benchmark::State& state)
+{
+    const CBasicKeyStore& keystore = BenchKeyStore();
+    std::set<CKeyID> setKeys;
+    keystore.GetKeys(setKeys);
+    std::vector<CScript> vScripts;
+    for (std::set<CKeyID>::const_iterator it = setKeys.begin(); it != setKeys.end() && vScripts.size() < BENCH_OUTPUTS; ++it)
+        vScripts.push_back(GetScriptForDestination(*it));
+    unsigned int nMine = 0;
+    state.SetItemsPerIteration(vScripts.size());
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < vScripts.size(); i++)
+            nMine += IsMine(keystore, vScripts[i]) == ISMINE_SPENDABLE;
+    }
+    assert(nMine > 0);
+}
+
+// A wallet after sync: the keystore's keys and a history of transactions paying them
+static const CWallet& BenchWallet()
+{
+    static CWallet wallet;
+    static bool fInit = false;
+    if (!fInit)
+    {
+        LOCK(wallet.cs_wallet);
+        std::vector<CKeyID> vKeys;
+        for (unsigned int i = 0; i < BENCH_KEYS; i++)
+        {
+            CKey key;
+            key.MakeNewKey(true);
+            wallet.AddKeyPubKey(key, key.GetPubKey());
+            vKeys.push_back(key.GetPubKey().GetID());
+        }
+        for (unsigned int i = 0; i < BENCH_WALLET_TXS; i++)
+        {
+            CMutableTransaction mtx;
+            mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+            mtx.vout.push_back(CTxOut(COIN, GetScriptForDestination(vKeys[i % vKeys.size()])));
+            CTransaction tx(mtx);
+            wallet.mapWallet[tx.GetHash()] = CWalletTx(&wallet, tx);
+        }
+        fInit = true;
+    }
+    return wallet;
+}
+
+// A block's worth of transactions with two inputs and two outputs each, spending
+// prevouts from vPrevouts when given and random ones otherwise
+static std::vector<CTransaction> BlockTransactions(const std::vector<COutPoint>& vPrevouts)
+{
+    std::vector<CScript> vScripts = ForeignScripts();
+    std::vector<CTransaction> vTx;
+    for (unsigned int i = 0; i < BENCH_BLOCK_TXS; i++)
+    {
+        CMutableTransaction mtx;
+        for (unsigned int j = 0; j < 2; j++)
+        {
+            unsigned int n = 2 * i + j;
+            mtx.vin.push_back(CTxIn(n < vPrevouts.size() ? vPrevouts[n] : COutPoint(GetRandHash(), 0)));
+            mtx.vout.push_back(CTxOut(COIN, vScripts[n % vScripts.size()]));
+        }
+        vTx.push_back(CTransaction(mtx));
+    }
+    return vTx;
+}
+
+// The involvement check AddToWalletIfInvolvingMe runs on every transaction of a block
+static void IsInvolved(benchmark::State& state, const std::vector<CTransaction>& vTx, bool fExpectMine)
+{
+    const CWallet& wallet = BenchWallet();
+    unsigned int nMine = 0;
+    state.SetItemsPerIteration(vTx.size());
+    while (state.KeepRunning())
+    {
+        for (unsigned int i = 0; i < vTx.size(); i++)
+            nMine += wallet.IsMine(vTx[i]) || wallet.IsFromMe(vTx[i]);
+    }
+    assert((nMine > 0) == fExpectMine);
+}
+
+/** Transactions that neither pay nor spend the synced wallet, the common case during sync */
+static void IsInvolved_Synced_Foreign(benchmark::State& state)
+{
+    IsInvolved(state, BlockTransactions(std::vector<COutPoint>()), false);
+}
+
+/** Transactions spending the synced wallet's coins, found through the inputs */
+static void IsInvolved_Synced_Spend(benchmark::State& state)
+{
+    const CWallet& wallet = BenchWallet();
+    std::vector<COutPoint> vPrevouts;
+    {
+        LOCK(wallet.cs_wallet);
+        for (std::map<uint256, CWalletTx>::const_iterator it = wallet.mapWallet.begin(); it != wallet.mapWallet.end() && vPrevouts.size() < 2 * BENCH_BLOCK_TXS; ++it)
+            vPrevouts.push_back(COutPoint(it->first, 0));
+    }
+    IsInvolved(state, BlockTransactions(vPrevouts), true);
+}
+
+BENCHMARK(IsMine_Foreign);
+BENCHMARK(IsMine_Foreign_Solver);
+BENCHMARK(IsMine_Own);
+BENCHMARK(IsInvolved_Synced_Foreign);
+BENCHMARK(IsInvolved_Synced_Spend);
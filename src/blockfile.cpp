@@ -0,0 +1,133 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfile.h"
+
+#include "main.h"
+#include "util.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+CBlockFileCache blockFileCache;
+
+CBlockFileMapping::~CBlockFileMapping()
+{
+#ifndef WIN32
+    if (pdata != NULL)
+        munmap((void*)pdata, nSize);
+#endif
+}
+
+void CBlockFileCache::Touch(unsigned int nFile)
+{
+    list<unsigned int>::iterator it = std::find(listRecent.begin(), listRecent.end(), nFile);
+    if (it != listRecent.begin())
+    {
+        if (it != listRecent.end())
+            listRecent.erase(it);
+        listRecent.push_front(nFile);
+    }
+}
+
+bool CBlockFileCache::MapFile(unsigned int nFile, CEntry& entry, size_t nSize)
+{
+#ifndef WIN32
+    void* pdata = NULL;
+    if (nSize > 0)
+    {
+        pdata = mmap(NULL, nSize, PROT_READ, MAP_SHARED, entry.fd, 0);
+        if (pdata == MAP_FAILED)
+            return error("CBlockFileCache::MapFile() : mmap of blk%04u.dat failed: %s", nFile, strerror(errno));
+        // Transactions are fetched one at a time from all over the file
+        madvise(pdata, nSize, MADV_RANDOM);
+    }
+    entry.mapping.reset(new CBlockFileMapping((const char*)pdata, nSize));
+    LogPrint("blockfile", "CBlockFileCache : mapped blk%04u.dat, %u bytes\n", nFile, nSize);
+
+    // A full file never changes again, so the mapping is all we need
+    if (nSize >= MAX_BLOCKFILE_APPEND_POS)
+    {
+        close(entry.fd);
+        entry.fd = -1;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+CBlockFileMappingRef CBlockFileCache::Get(unsigned int nFile, size_t nNeed)
+{
+#ifndef WIN32
+    // Whole-file mappings need a 64-bit address space
+    if (sizeof(void*) < 8 || nFile < 1 || nFile == (unsigned int)-1)
+        return CBlockFileMappingRef();
+
+    LOCK(cs);
+    map<unsigned int, CEntry>::iterator mi = mapEntries.find(nFile);
+    if (mi != mapEntries.end())
+    {
+        CEntry& entry = mi->second;
+        Touch(nFile);
+        if (entry.mapping->nSize >= nNeed || entry.fd < 0)
+            return entry.mapping;
+
+        // The file is still being appended to; map the part written since
+        struct stat st;
+        if (fstat(entry.fd, &st) != 0 || (size_t)st.st_size <= entry.mapping->nSize)
+            return entry.mapping;
+        MapFile(nFile, entry, st.st_size);
+        return entry.mapping;
+    }
+
+    CEntry entry;
+    entry.fd = open(BlockFilePath(nFile).string().c_str(), O_RDONLY);
+    if (entry.fd < 0)
+        return CBlockFileMappingRef();
+    struct stat st;
+    if (fstat(entry.fd, &st) != 0 || !MapFile(nFile, entry, st.st_size))
+    {
+        if (entry.fd >= 0)
+            close(entry.fd);
+        return CBlockFileMappingRef();
+    }
+
+    mapEntries[nFile] = entry;
+    Touch(nFile);
+    while (listRecent.size() > MAX_MAPPED_BLOCKFILES)
+    {
+        map<unsigned int, CEntry>::iterator it = mapEntries.find(listRecent.back());
+        if (it->second.fd >= 0)
+            close(it->second.fd);
+        mapEntries.erase(it);
+        listRecent.pop_back();
+    }
+    return entry.mapping;
+#else
+    return CBlockFileMappingRef();
+#endif
+}
+
+void CBlockFileCache::Clear()
+{
+    LOCK(cs);
+#ifndef WIN32
+    for (map<unsigned int, CEntry>::iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+        if (it->second.fd >= 0)
+            close(it->second.fd);
+#endif
+    mapEntries.clear();
+    listRecent.clear();
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_BLOCKFILE_H
+#define DARKSILK_BLOCKFILE_H
+
+#include "serialize.h"
+#include "streams.h"
+#include "sync.h"
+#include "version.h"
+
+#include <list>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+/** Block files are never appended to once they reach this size, see AppendBlockFile() */
+static const unsigned int MAX_BLOCKFILE_APPEND_POS = 0x7F000000 - MAX_SIZE;
+/** Number of blkNNNN.dat files kept mapped at once */
+static const unsigned int MAX_MAPPED_BLOCKFILES = 16;
+
+/** A read-only memory mapping of (a prefix of) one block file */
+class CBlockFileMapping
+{
+public:
+    const char* pdata;
+    size_t nSize;
+
+    CBlockFileMapping(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CBlockFileMapping();
+
+private:
+    CBlockFileMapping(const CBlockFileMapping&);
+    CBlockFileMapping& operator=(const CBlockFileMapping&);
+};
+
+typedef boost::shared_ptr<const CBlockFileMapping> CBlockFileMappingRef;
+
+/**
+ * Random read access to blkNNNN.dat without an fopen/fseek/fclose per read.
+ *
+ * Files are memory mapped and kept in a small LRU. Full files, which are never written
+ * again, give up their descriptor as soon as they are mapped. The file still being
+ * appended to keeps its descriptor open so the mapping can be extended cheaply when a
+ * read needs bytes written after it was mapped. Readers hold a reference to the
+ * mapping they use, so remapping or eviction never pulls memory out from under them.
+ */
+class CBlockFileCache
+{
+private:
+    struct CEntry
+    {
+        CBlockFileMappingRef mapping;
+        int fd; // -1 once the file is full
+    };
+
+    CCriticalSection cs;
+    std::map<unsigned int, CEntry> mapEntries;
+    std::list<unsigned int> listRecent; // most recently used first
+
+    bool MapFile(unsigned int nFile, CEntry& entry, size_t nSize);
+    void Touch(unsigned int nFile);
+
+public:
+    /**
+     * Get a mapping of nFile covering at least nNeed bytes if the file is that long,
+     * otherwise whatever the file holds. NULL if the file can't be mapped at all.
+     */
+    CBlockFileMappingRef Get(unsigned int nFile, size_t nNeed);
+
+    /** Unmap everything and close all descriptors */
+    void Clear();
+};
+
+extern CBlockFileCache blockFileCache;
+
+/**
+ * Deserialize obj straight out of the mapped block file. Returns false when the file
+ * can't be mapped or the data doesn't parse; callers fall back to the stdio path, which
+ * reports the error.
+ */
+template<typename T>
+bool ReadFromBlockFile(unsigned int nFile, unsigned int nPos, T& obj, int nType = SER_DISK)
+{
+    CBlockFileMappingRef mapping = blockFileCache.Get(nFile, (size_t)nPos + 1);
+    for (int nTry = 0; nTry < 2 && mapping; nTry++)
+    {
+        if (nPos < mapping->nSize)
+        {
+            try {
+                CMemoryStream stream(mapping->pdata + nPos, mapping->pdata + mapping->nSize, nType, CLIENT_VERSION);
+                stream >> obj;
+                return true;
+            }
+            catch (std::exception &e) {
+            }
+        }
+
+        // The object may extend past what was mapped; extend the mapping once and retry
+        size_t nMapped = mapping->nSize;
+        mapping = blockFileCache.Get(nFile, nMapped + 1);
+        if (mapping && mapping->nSize <= nMapped)
+            break;
+    }
+    return false;
+}
+
+#endif // DARKSILK_BLOCKFILE_H
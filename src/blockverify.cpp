@@ -0,0 +1,212 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockverify.h"
+
+#include "main.h"
+#include "net.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+
+CBlockVerifyQueue blockVerifyQueue;
+
+static void ThreadBlockCheck(CBlockVerifyQueue* pqueue)
+{
+    RenameThread("darksilk-blkcheck");
+    pqueue->ThreadCheck();
+}
+
+static void ThreadBlockConnect(CBlockVerifyQueue* pqueue)
+{
+    RenameThread("darksilk-blkconn");
+    pqueue->ThreadConnect();
+}
+
+CBlockVerifyQueue::CBlockVerifyQueue() : nNextCheck(0), nWorkers(0), nConnecting(0)
+{
+    stats.nWorkers = 0;
+    stats.nQueued = 0;
+    stats.nChecked = 0;
+    stats.nProcessed = 0;
+    stats.nRejected = 0;
+    stats.nWaitTime = 0;
+    stats.nCheckTime = 0;
+    stats.nConnectWaitTime = 0;
+    stats.nConnectTime = 0;
+}
+
+void CBlockVerifyQueue::Start(boost::thread_group& threadGroup, int nWorkersIn)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers = nWorkersIn;
+    }
+    if (nWorkersIn <= 0)
+        return;
+
+    LogPrintf("Using %d threads for block verification\n", nWorkersIn);
+    for (int i = 0; i < nWorkersIn; i++)
+        threadGroup.create_thread(boost::bind(&ThreadBlockCheck, this));
+    threadGroup.create_thread(boost::bind(&ThreadBlockConnect, this));
+}
+
+void CBlockVerifyQueue::Check(CEntry& entry)
+{
+    CValidationState state;
+    entry.fValid = entry.pblock->CheckBlockContextFree(state);
+}
+
+void CBlockVerifyQueue::Connect(CEntry& entry)
+{
+    try {
+        entry.fnConnect(*entry.pblock, entry.pfrom, entry.fValid);
+    }
+    catch (std::exception& e) {
+        PrintExceptionContinue(&e, "CBlockVerifyQueue::Connect()");
+    }
+    if (entry.pfrom)
+        entry.pfrom->Release();
+}
+
+void CBlockVerifyQueue::Push(const boost::shared_ptr<CBlock>& pblock, CNode* pfrom, const BlockConnectFn& fnConnect, bool fWait)
+{
+    boost::shared_ptr<CEntry> pentry(new CEntry());
+    pentry->pblock = pblock;
+    pentry->hash = pblock->GetHash();
+    pentry->pfrom = pfrom ? pfrom->AddRef() : NULL;
+    pentry->fnConnect = fnConnect;
+    pentry->fDone = false;
+    pentry->fValid = false;
+    pentry->nTimePushed = GetTimeMicros();
+    pentry->nTimeChecked = 0;
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (nWorkers > 0)
+        {
+            while (fWait && queue.size() >= MAX_BLOCK_VERIFY_QUEUE)
+                condDone.wait(lock);
+            queue.push_back(pentry);
+            setHashes.insert(pentry->hash);
+            condWork.notify_one();
+            return;
+        }
+    }
+
+    // No verification threads: check and connect on the caller's thread
+    int64_t nStart = GetTimeMicros();
+    Check(*pentry);
+    int64_t nChecked = GetTimeMicros();
+    Connect(*pentry);
+    int64_t nEnd = GetTimeMicros();
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    stats.nProcessed++;
+    if (!pentry->fValid)
+        stats.nRejected++;
+    stats.nCheckTime += nChecked - nStart;
+    stats.nConnectTime += nEnd - nChecked;
+}
+
+bool CBlockVerifyQueue::IsFull()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return nWorkers > 0 && queue.size() >= MAX_BLOCK_VERIFY_QUEUE;
+}
+
+bool CBlockVerifyQueue::Contains(const uint256& hash)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return setHashes.count(hash) > 0;
+}
+
+void CBlockVerifyQueue::Drain()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (!queue.empty() || nConnecting > 0)
+        condDone.wait(lock);
+}
+
+CBlockVerifyQueue::Stats CBlockVerifyQueue::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    Stats ret = stats;
+    ret.nWorkers = nWorkers;
+    ret.nQueued = 0;
+    ret.nChecked = 0;
+    for (std::deque<boost::shared_ptr<CEntry> >::const_iterator it = queue.begin(); it != queue.end(); ++it)
+    {
+        if ((*it)->fDone)
+            ret.nChecked++;
+        else
+            ret.nQueued++;
+    }
+    return ret;
+}
+
+void CBlockVerifyQueue::ThreadCheck()
+{
+    while (true)
+    {
+        boost::shared_ptr<CEntry> pentry;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (nNextCheck >= queue.size())
+                condWork.wait(lock);
+            pentry = queue[nNextCheck++];
+        }
+
+        int64_t nStart = GetTimeMicros();
+        Check(*pentry);
+        int64_t nEnd = GetTimeMicros();
+
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            pentry->fDone = true;
+            pentry->nTimeChecked = nEnd;
+            if (!pentry->fValid)
+                stats.nRejected++;
+            stats.nWaitTime += nStart - pentry->nTimePushed;
+            stats.nCheckTime += nEnd - nStart;
+        }
+        condDone.notify_all();
+    }
+}
+
+void CBlockVerifyQueue::ThreadConnect()
+{
+    while (true)
+    {
+        boost::shared_ptr<CEntry> pentry;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (queue.empty() || !queue.front()->fDone)
+                condDone.wait(lock);
+            pentry = queue.front();
+            queue.pop_front();
+            // the front entry was handed out already, so nNextCheck > 0
+            nNextCheck--;
+            nConnecting++;
+        }
+        // room for Push()
+        condDone.notify_all();
+
+        int64_t nStart = GetTimeMicros();
+        Connect(*pentry);
+        int64_t nEnd = GetTimeMicros();
+
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            setHashes.erase(setHashes.find(pentry->hash));
+            nConnecting--;
+            stats.nProcessed++;
+            stats.nConnectWaitTime += nStart - pentry->nTimeChecked;
+            stats.nConnectTime += nEnd - nStart;
+        }
+        // wakes Drain()
+        condDone.notify_all();
+    }
+}
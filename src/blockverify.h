@@ -0,0 +1,118 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_BLOCKVERIFY_H
+#define DARKSILK_BLOCKVERIFY_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <set>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+class CBlock;
+class CNode;
+
+/** Default for -blockverifythreads, 0 = one per core (minus one, at least one) */
+static const int DEFAULT_BLOCK_VERIFY_THREADS = 0;
+/** Maximum number of block verification threads */
+static const int MAX_BLOCK_VERIFY_THREADS = 16;
+/** Blocks that may wait in the queue before Push() blocks the caller, see IsFull() */
+static const unsigned int MAX_BLOCK_VERIFY_QUEUE = 64;
+
+/** Called under no lock once a block reaches the front of the queue; fValid tells
+ *  whether CheckBlockContextFree() passed. */
+typedef boost::function<void(CBlock& block, CNode* pfrom, bool fValid)> BlockConnectFn;
+
+/**
+ * Pipeline that runs the context-free block checks (proof-of-work hash, block
+ * signature, CheckTransaction, merkle root) on worker threads as blocks arrive,
+ * so that only the contextual part of ProcessBlock runs under cs_main.
+ *
+ * Blocks leave the queue in the order they were pushed: a single connect
+ * thread hands each one to its BlockConnectFn once it and all blocks before it
+ * have been checked.
+ *
+ * Unlike the single CheckBlock() this replaces, all context-free checks run
+ * before the InstantX conflict scan, which stays in CheckBlock() under
+ * cs_main. A block that conflicts with a transaction lock and also fails one
+ * of the transaction, sigop or merkle checks is now rejected for the latter,
+ * with its DoS score, rather than with the scan's DoS(0).
+ */
+class CBlockVerifyQueue
+{
+public:
+    struct Stats
+    {
+        int nWorkers;
+        unsigned int nQueued;           //! pushed, not yet checked
+        unsigned int nChecked;          //! checked, waiting for the connect thread
+        uint64_t nProcessed;
+        uint64_t nRejected;             //! failed the context-free checks
+        int64_t nWaitTime;              //! push -> start of checking, microseconds
+        int64_t nCheckTime;             //! CheckBlockContextFree, microseconds
+        int64_t nConnectWaitTime;       //! checked -> start of connect
+        int64_t nConnectTime;           //! BlockConnectFn, mostly spent under cs_main
+    };
+
+    CBlockVerifyQueue();
+
+    /** Start nWorkers checking threads and the connect thread in threadGroup */
+    void Start(boost::thread_group& threadGroup, int nWorkers);
+
+    /** Queue a block. Holds a reference on pfrom (may be NULL) until fnConnect has run.
+     *  When no workers were started the block is checked and connected inline.
+     *  With fWait it waits while the queue is full; without, the queue may go past
+     *  MAX_BLOCK_VERIFY_QUEUE by the blocks of callers that raced past IsFull(). */
+    void Push(const boost::shared_ptr<CBlock>& pblock, CNode* pfrom, const BlockConnectFn& fnConnect, bool fWait = true);
+
+    /** True if the queue is full. The message handler leaves further blocks in the peers'
+     *  receive buffers then, rather than waiting in Push() */
+    bool IsFull();
+
+    /** True if a block with this hash is queued and not yet connected */
+    bool Contains(const uint256& hash);
+
+    /** Wait until every block pushed so far has been connected */
+    void Drain();
+
+    Stats GetStats();
+
+    void ThreadCheck();
+    void ThreadConnect();
+
+private:
+    struct CEntry
+    {
+        boost::shared_ptr<CBlock> pblock;
+        uint256 hash;
+        CNode* pfrom;
+        BlockConnectFn fnConnect;
+        bool fDone;
+        bool fValid;
+        int64_t nTimePushed;
+        int64_t nTimeChecked;
+    };
+
+    CWaitableCriticalSection cs;
+    CConditionVariable condWork;        //! new entry to check
+    CConditionVariable condDone;        //! an entry was checked or connected
+    std::deque<boost::shared_ptr<CEntry> > queue;
+    std::multiset<uint256> setHashes;
+    size_t nNextCheck;                  //! index in queue of the first entry not yet started
+    int nWorkers;
+    uint64_t nConnecting;               //! popped but fnConnect still running
+    Stats stats;
+
+    void Check(CEntry& entry);
+    void Connect(CEntry& entry);
+};
+
+extern CBlockVerifyQueue blockVerifyQueue;
+
+#endif // DARKSILK_BLOCKVERIFY_H
@@ -6,37 +6,25 @@
 #include <boost/algorithm/string/replace.hpp>
 
 #include "chain.h"
+#include "blockfile.h"
 #include "wallet/wallet.h"
 #include "checkpoints.h"
+#include "anon/instantx/instantx.h"
 #include "anon/stormnode/spork.h"
 #include "kernel.h"
 #include "txdb-leveldb.h"
 
-#ifdef ENABLE_WALLET
-
-extern std::map<COutPoint, uint256> mapLockedInputs;
-CBlockIndex* pblockindexFBBHLast;
 
 static unsigned int nCurrentBlockFile = 1;
 
 
 CBlockIndex* FindBlockByHeight(int nHeight)
 {
-    CBlockIndex *pblockindex;
-    if (nHeight < nBestHeight / 2)
-        pblockindex = pindexGenesisBlock;
-    else
-        pblockindex = pindexBest;
-    if (pblockindexFBBHLast && abs(nHeight - pblockindex->nHeight) > abs(nHeight - pblockindexFBBHLast->nHeight))
-        pblockindex = pblockindexFBBHLast;
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-    while (pblockindex->nHeight < nHeight)
-        pblockindex = pblockindex->pnext;
-    pblockindexFBBHLast = pblockindex;
-    return pblockindex;
+    // chainActive is indexed by height and kept in step with pindexBest by SetBestChain
+    return chainActive[nHeight];
 }
 
+#ifdef ENABLE_WALLET
 // darksilk: attempt to generate suitable proof-of-stake
 bool CBlock::SignBlock(CWallet& wallet, CAmount nFees)
 {
@@ -623,6 +611,57 @@ uint256 CBlockIndex::GetBlockTrust() const
     return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
 }
 
+/** Turn the lowest '1' bit in the binary representation of a number into a '0'. */
+static inline int InvertLowestOne(int n) { return n & (n - 1); }
+
+/** Compute what height to jump back to with the CBlockIndex::pskip pointer. */
+static inline int GetSkipHeight(int height) {
+    if (height < 2)
+        return 0;
+
+    // Determine which height to jump back to. Any number strictly lower than height is acceptable,
+    // but the following expression seems to perform well in simulations (max 110 steps to go back
+    // up to 2**18 blocks).
+    return (height & 1) ? InvertLowestOne(InvertLowestOne(height - 1)) + 1 : InvertLowestOne(height);
+}
+
+CBlockIndex* CBlockIndex::GetAncestor(int height)
+{
+    if (height > nHeight || height < 0)
+        return NULL;
+
+    CBlockIndex* pindexWalk = this;
+    int heightWalk = nHeight;
+    while (heightWalk > height) {
+        int heightSkip = GetSkipHeight(heightWalk);
+        int heightSkipPrev = GetSkipHeight(heightWalk - 1);
+        if (pindexWalk->pskip != NULL &&
+            (heightSkip == height ||
+             (heightSkip > height && !(heightSkipPrev < heightSkip - 2 &&
+                                       heightSkipPrev >= height)))) {
+            // Only follow pskip if pprev->pskip isn't better than pskip->pprev.
+            pindexWalk = pindexWalk->pskip;
+            heightWalk = heightSkip;
+        } else {
+            assert(pindexWalk->pprev);
+            pindexWalk = pindexWalk->pprev;
+            heightWalk--;
+        }
+    }
+    return pindexWalk;
+}
+
+const CBlockIndex* CBlockIndex::GetAncestor(int height) const
+{
+    return const_cast<CBlockIndex*>(this)->GetAncestor(height);
+}
+
+void CBlockIndex::BuildSkip()
+{
+    if (pprev)
+        pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+}
+
 /// CChain implementation
 void CChain::SetTip(CBlockIndex *pindex) {
     if (pindex == NULL) {
@@ -636,6 +675,44 @@ void CChain::SetTip(CBlockIndex *pindex) {
     }
 }
 
+CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const {
+    int nStep = 1;
+    std::vector<uint256> vHave;
+    vHave.reserve(32);
+
+    if (!pindex)
+        pindex = Tip();
+    while (pindex) {
+        vHave.push_back(pindex->GetBlockHash());
+        // Stop when we have added the genesis block.
+        if (pindex->nHeight == 0)
+            break;
+        // Exponentially larger steps back, plus the genesis block.
+        int nHeight = std::max(pindex->nHeight - nStep, 0);
+        if (Contains(pindex)) {
+            // Use O(1) CChain index if possible.
+            pindex = (*this)[nHeight];
+        } else {
+            // Otherwise, use O(log n) skiplist.
+            pindex = pindex->GetAncestor(nHeight);
+        }
+        if (vHave.size() > 10)
+            nStep *= 2;
+    }
+
+    return CBlockLocator(vHave);
+}
+
+const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
+    if (pindex == NULL)
+        return NULL;
+    if (pindex->nHeight > Height())
+        pindex = pindex->GetAncestor(Height());
+    while (pindex && !Contains(pindex))
+        pindex = pindex->pprev;
+    return pindex;
+}
+
 FILE* AppendBlockFile(unsigned int& nFileRet)
 {
     nFileRet = 0;
@@ -647,7 +724,7 @@ FILE* AppendBlockFile(unsigned int& nFileRet)
         if (fseek(file, 0, SEEK_END) != 0)
             return NULL;
         // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
-        if (ftell(file) < (long)(0x7F000000 - MAX_SIZE))
+        if (ftell(file) < (long)MAX_BLOCKFILE_APPEND_POS)
         {
             nFileRet = nCurrentBlockFile;
             return file;
@@ -675,7 +752,7 @@ bool IsInitialBlockDownload()
             pindexBest->GetBlockTime() < GetTime() - 8 * 60 * 60);
 }
 
-bool CBlock::CheckBlock(CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+bool CBlock::CheckBlockContextFree(CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
 {
     // These are checks that are independent of context
     // that can be verified before saving an orphan block.
@@ -717,41 +794,6 @@ bool CBlock::CheckBlock(CValidationState& state, bool fCheckPOW, bool fCheckMerk
     if (fCheckSig && !CheckBlockSignature())
         return DoS(100, error("CheckBlock() : bad proof-of-stake block signature"));
 
-
-// ----------- instantX transaction scanning -----------
-
-    if(IsSporkActive(SPORK_3_INSTANTX_BLOCK_FILTERING)){
-        BOOST_FOREACH(const CTransaction& tx, vtx){
-            if (!tx.IsCoinBase()){
-                //only reject blocks when it's based on complete consensus
-                BOOST_FOREACH(const CTxIn& in, tx.vin){
-                    if(mapLockedInputs.count(in.prevout)){
-                        if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                            if(fDebug) { LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", mapLockedInputs[in.prevout].ToString().c_str(), tx.GetHash().ToString().c_str()); }
-                            return DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"));
-                        }
-                    }
-                }
-            }
-        }
-    } else {
-        LogPrintf("CheckBlock() : skipping transaction locking checks\n");
-    }
-
-
-    // ----------- stormnode payments -----------
-
-    CBlockIndex *pindexPrev = pindexBest;
-
-    if(pindexPrev == NULL)
-    {
-        //TODO (AA): Put these back once primitives are completed
-        //if(IsBlockPayeeValid(block.vtx[0], pindexPrev->nHeight+1))
-        //{
-        //    return DoS(100, error("CheckBlock() : Couldn't find stormnode payment or payee"));
-        //}
-    }
-
     // Check transactions
     BOOST_FOREACH(CTransaction& tx, vtx){
         if (!tx.CheckTransaction(state))
@@ -784,6 +826,49 @@ bool CBlock::CheckBlock(CValidationState& state, bool fCheckPOW, bool fCheckMerk
     if (fCheckMerkleRoot && hashMerkleRoot != BuildMerkleTree())
         return DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"));
 
+    if (fCheckPOW && fCheckMerkleRoot && fCheckSig)
+        fChecked = true;
+    return true;
+}
+
+bool CBlock::CheckBlock(CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+{
+    // The context-free checks may already have run on a block verification thread.
+    // They all come before the InstantX scan below, so a block failing both is
+    // rejected for the context-free check (see CBlockVerifyQueue)
+    if (!fChecked && !CheckBlockContextFree(state, fCheckPOW, fCheckMerkleRoot, fCheckSig))
+        return false;
+
+// ----------- instantX transaction scanning -----------
+
+    if(IsSporkActive(SPORK_3_INSTANTX_BLOCK_FILTERING)){
+        BOOST_FOREACH(const CTransaction& tx, vtx){
+            if (!tx.IsCoinBase()){
+                //only reject blocks when it's based on complete consensus
+                uint256 txHashLock;
+                if(txLockManager.HasConflictingLock(tx, txHashLock)){
+                    if(fDebug) { LogPrintf("CheckBlock() : found conflicting transaction with transaction lock %s %s\n", txHashLock.ToString().c_str(), tx.GetHash().ToString().c_str()); }
+                    return DoS(0, error("CheckBlock() : found conflicting transaction with transaction lock"));
+                }
+            }
+        }
+    } else {
+        LogPrintf("CheckBlock() : skipping transaction locking checks\n");
+    }
+
+
+    // ----------- stormnode payments -----------
+
+    CBlockIndex *pindexPrev = pindexBest;
+
+    if(pindexPrev == NULL)
+    {
+        //TODO (AA): Put these back once primitives are completed
+        //if(IsBlockPayeeValid(block.vtx[0], pindexPrev->nHeight+1))
+        //{
+        //    return DoS(100, error("CheckBlock() : Couldn't find stormnode payment or payee"));
+        //}
+    }
 
     return true;
 }
@@ -813,17 +898,30 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
     return true;
 }
 
-bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
+bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions, bool fVerify)
 {
     if (!fReadTransactions)
     {
         *this = pindex->GetBlockHeader();
         return true;
     }
-    if (!ReadFromDisk(pindex->nFile, pindex->nBlockPos, fReadTransactions))
+    if (!ReadFromDisk(pindex->nFile, pindex->nBlockPos, fReadTransactions, fVerify))
         return false;
-    if (GetHash() != pindex->GetBlockHash())
-        return error("CBlock::ReadFromDisk() : GetHash() doesn't match index");
+    if (fVerify)
+    {
+        if (GetHash() != pindex->GetBlockHash())
+            return error("CBlock::ReadFromDisk() : GetHash() doesn't match index");
+        return true;
+    }
+
+    // Same header as the index entry means same block hash, without hashing
+    if (nVersion != pindex->nVersion || hashMerkleRoot != pindex->hashMerkleRoot ||
+        nTime != pindex->nTime || nBits != pindex->nBits || nNonce != pindex->nNonce ||
+        hashPrevBlock != (pindex->pprev ? pindex->pprev->GetBlockHash() : 0))
+        return error("CBlock::ReadFromDisk() : header doesn't match index for block %s", pindex->GetBlockHash().ToString());
+    // and the transactions must still be the ones the header commits to
+    if (BuildMerkleTree() != hashMerkleRoot)
+        return error("CBlock::ReadFromDisk() : merkle root mismatch for block %s", pindex->GetBlockHash().ToString());
     return true;
 }
 
@@ -853,28 +951,34 @@ bool CBlock::WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet)
     return true;
 }
 
-bool CBlock::ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions)
+bool CBlock::ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions, bool fCheckPoW)
 {
     SetNull();
 
-    // Open history file to read
-    CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
-    if (!filein)
-        return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
-    if (!fReadTransactions)
-        filein.nType |= SER_BLOCKHEADERONLY;
-
-    // Read block
-    try {
-        filein >> *this;
-    }
-    catch (std::exception &e) {
-        return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+    if (!ReadFromBlockFile(nFile, nBlockPos, *this, fReadTransactions ? SER_DISK : SER_DISK | SER_BLOCKHEADERONLY))
+    {
+        SetNull();
+
+        // Open history file to read
+        CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
+        if (!filein)
+            return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
+        if (!fReadTransactions)
+            filein.nType |= SER_BLOCKHEADERONLY;
+
+        // Read block
+        try {
+            filein >> *this;
+        }
+        catch (std::exception &e) {
+            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+        }
     }
 
     // Check the header
-    if (fReadTransactions && IsProofOfWork() && !CheckProofOfWork(GetPoWHash(), nBits))
+    if (fCheckPoW && fReadTransactions && IsProofOfWork() && !CheckProofOfWork(GetPoWHash(), nBits))
         return error("CBlock::ReadFromDisk() : errors in block header");
 
+    CacheTransactionHashes();
     return true;
 }
@@ -19,7 +19,6 @@ extern std::map<uint256, CBlockIndex*> mapBlockIndex;
 extern CBlockIndex* pindexBest;
 extern bool fUseFastIndex;
 extern CBlockIndex* pindexGenesisBlock;
-extern CBlockIndex* pblockindexFBBHLast;
 
 bool IsInitialBlockDownload();
 CBlockIndex* FindBlockByHeight(int nHeight);
@@ -265,6 +264,13 @@ public:
 
     uint256 GetBlockTrust() const;
 
+    //! Build the skiplist pointer for this entry.
+    void BuildSkip();
+
+    //! Efficiently find an ancestor of this block.
+    CBlockIndex* GetAncestor(int height);
+    const CBlockIndex* GetAncestor(int height) const;
+
     bool IsInMainChain() const
     {
         return (pnext || this == pindexBest);
@@ -511,14 +517,16 @@ public:
     void Set(const CBlockIndex* pindex)
     {
         vHave.clear();
+        vHave.reserve(32);
         int nStep = 1;
         while (pindex)
         {
             vHave.push_back(pindex->GetBlockHash());
+            if (pindex->nHeight == 0)
+                return;
 
-            // Exponentially larger steps back
-            for (int i = 0; pindex && i < nStep; i++)
-                pindex = pindex->pprev;
+            // Exponentially larger steps back, using the skiplist
+            pindex = pindex->GetAncestor(std::max(pindex->nHeight - nStep, 0));
             if (vHave.size() > 10)
                 nStep *= 2;
         }
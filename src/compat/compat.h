@@ -85,6 +85,11 @@ typedef u_int SOCKET;
 
 size_t strnlen_int( const char *start, size_t max_len);
 
+// The socket handler can use edge-triggered epoll instead of select(), see -epoll
+#ifdef __linux__
+#define HAVE_EPOLL 1
+#endif
+
 bool static inline IsSelectableSocket(SOCKET s) {
 #ifdef WIN32
     return true;
@@ -7,6 +7,12 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__amd64__)) && defined(__GNUC__)
+/** Build the SSE4.1, AVX2 and SHA-NI transforms; which one is used is decided at runtime. */
+#define DARKSILK_SHA256_X86
+#endif
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +31,16 @@ public:
     CSHA256& Reset();
 };
 
+/** Autodetect the best available SHA256 implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SHA256AutoDetect();
+
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // DARKSILK_CRYPTO_SHA256_H
@@ -0,0 +1,141 @@
+// Copyright (c) 2016 The Bitcoin Developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 8-way SHA-256 using AVX2, computing the double hash of eight 64-byte
+// inputs at once. Only the functions below are built for AVX2; the caller
+// must check the CPU before using them (see SHA256AutoDetect).
+
+#include "crypto/sha256.h"
+
+#if defined(DARKSILK_SHA256_X86)
+
+#include "crypto/common.h"
+
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+namespace sha256_avx2
+{
+namespace
+{
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t INIT[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+AVX2 inline __m256i K8(uint32_t x) { return _mm256_set1_epi32(x); }
+AVX2 inline __m256i Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+AVX2 inline __m256i Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+AVX2 inline __m256i Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+AVX2 inline __m256i And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+AVX2 inline __m256i Rot(__m256i x, int n) { return Or(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n)); }
+
+AVX2 inline __m256i Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+AVX2 inline __m256i Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+AVX2 inline __m256i Sigma0(__m256i x) { return Xor(Xor(Rot(x, 2), Rot(x, 13)), Rot(x, 22)); }
+AVX2 inline __m256i Sigma1(__m256i x) { return Xor(Xor(Rot(x, 6), Rot(x, 11)), Rot(x, 25)); }
+AVX2 inline __m256i sigma0(__m256i x) { return Xor(Xor(Rot(x, 7), Rot(x, 18)), _mm256_srli_epi32(x, 3)); }
+AVX2 inline __m256i sigma1(__m256i x) { return Xor(Xor(Rot(x, 17), Rot(x, 19)), _mm256_srli_epi32(x, 10)); }
+
+/** One round of SHA-256 on eight independent states. */
+AVX2 inline void Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, __m256i k)
+{
+    __m256i t1 = Add(Add(Add(h, Sigma1(e)), Ch(e, f, g)), k);
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Process one block per lane, given the 16 message words of each lane. */
+AVX2 void Transform(__m256i* s, __m256i* w)
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i += 8) {
+        if (i >= 16) {
+            for (int j = 0; j < 8; j++)
+                w[(i + j) & 15] = Add(Add(w[(i + j) & 15], sigma1(w[(i + j + 14) & 15])), Add(w[(i + j + 9) & 15], sigma0(w[(i + j + 1) & 15])));
+        }
+        Round(a, b, c, d, e, f, g, h, Add(K8(K[i + 0]), w[(i + 0) & 15]));
+        Round(h, a, b, c, d, e, f, g, Add(K8(K[i + 1]), w[(i + 1) & 15]));
+        Round(g, h, a, b, c, d, e, f, Add(K8(K[i + 2]), w[(i + 2) & 15]));
+        Round(f, g, h, a, b, c, d, e, Add(K8(K[i + 3]), w[(i + 3) & 15]));
+        Round(e, f, g, h, a, b, c, d, Add(K8(K[i + 4]), w[(i + 4) & 15]));
+        Round(d, e, f, g, h, a, b, c, Add(K8(K[i + 5]), w[(i + 5) & 15]));
+        Round(c, d, e, f, g, h, a, b, Add(K8(K[i + 6]), w[(i + 6) & 15]));
+        Round(b, c, d, e, f, g, h, a, Add(K8(K[i + 7]), w[(i + 7) & 15]));
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Gather big-endian word number n of each of the eight 64-byte inputs. */
+AVX2 inline __m256i Read8(const unsigned char* in, int n)
+{
+    return _mm256_set_epi32(ReadBE32(in + 448 + 4 * n), ReadBE32(in + 384 + 4 * n), ReadBE32(in + 320 + 4 * n), ReadBE32(in + 256 + 4 * n),
+                            ReadBE32(in + 192 + 4 * n), ReadBE32(in + 128 + 4 * n), ReadBE32(in + 64 + 4 * n), ReadBE32(in + 4 * n));
+}
+
+/** Scatter word n of each lane as big-endian into the eight 32-byte outputs. */
+AVX2 inline void Write8(unsigned char* out, int n, __m256i v)
+{
+    uint32_t x[8];
+    _mm256_storeu_si256((__m256i*)x, v);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 32 * i + 4 * n, x[i]);
+}
+
+AVX2 inline void Init(__m256i* s)
+{
+    for (int i = 0; i < 8; i++)
+        s[i] = K8(INIT[i]);
+}
+} // namespace
+
+AVX2 void TransformD64_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], t[8], w[16];
+
+    // First hash: the 64-byte input, then its padding block.
+    Init(s);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read8(in, i);
+    Transform(s, w);
+    w[0] = K8(0x80000000ul);
+    for (int i = 1; i < 15; i++)
+        w[i] = _mm256_setzero_si256();
+    w[15] = K8(512);
+    Transform(s, w);
+
+    // Second hash: the 32-byte digest plus padding, in a single block.
+    Init(t);
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = K8(0x80000000ul);
+    for (int i = 9; i < 15; i++)
+        w[i] = _mm256_setzero_si256();
+    w[15] = K8(256);
+    Transform(t, w);
+
+    for (int i = 0; i < 8; i++)
+        Write8(out, i, t[i]);
+}
+} // namespace sha256_avx2
+
+#endif
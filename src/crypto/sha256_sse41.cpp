@@ -0,0 +1,140 @@
+// Copyright (c) 2016 The Bitcoin Developers
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way SHA-256 using SSE4.1, computing the double hash of four 64-byte
+// inputs at once. Only the functions below are built for SSE4.1; the caller
+// must check the CPU before using them (see SHA256AutoDetect).
+
+#include "crypto/sha256.h"
+
+#if defined(DARKSILK_SHA256_X86)
+
+#include "crypto/common.h"
+
+#include <immintrin.h>
+
+#define SSE41 __attribute__((target("sse4.1")))
+
+namespace sha256_sse41
+{
+namespace
+{
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t INIT[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+SSE41 inline __m128i K4(uint32_t x) { return _mm_set1_epi32(x); }
+SSE41 inline __m128i Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+SSE41 inline __m128i Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+SSE41 inline __m128i Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+SSE41 inline __m128i And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+SSE41 inline __m128i Rot(__m128i x, int n) { return Or(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n)); }
+
+SSE41 inline __m128i Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+SSE41 inline __m128i Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+SSE41 inline __m128i Sigma0(__m128i x) { return Xor(Xor(Rot(x, 2), Rot(x, 13)), Rot(x, 22)); }
+SSE41 inline __m128i Sigma1(__m128i x) { return Xor(Xor(Rot(x, 6), Rot(x, 11)), Rot(x, 25)); }
+SSE41 inline __m128i sigma0(__m128i x) { return Xor(Xor(Rot(x, 7), Rot(x, 18)), _mm_srli_epi32(x, 3)); }
+SSE41 inline __m128i sigma1(__m128i x) { return Xor(Xor(Rot(x, 17), Rot(x, 19)), _mm_srli_epi32(x, 10)); }
+
+/** One round of SHA-256 on four independent states. */
+SSE41 inline void Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i k)
+{
+    __m128i t1 = Add(Add(Add(h, Sigma1(e)), Ch(e, f, g)), k);
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Process one block per lane, given the 16 message words of each lane. */
+SSE41 void Transform(__m128i* s, __m128i* w)
+{
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i += 8) {
+        if (i >= 16) {
+            for (int j = 0; j < 8; j++)
+                w[(i + j) & 15] = Add(Add(w[(i + j) & 15], sigma1(w[(i + j + 14) & 15])), Add(w[(i + j + 9) & 15], sigma0(w[(i + j + 1) & 15])));
+        }
+        Round(a, b, c, d, e, f, g, h, Add(K4(K[i + 0]), w[(i + 0) & 15]));
+        Round(h, a, b, c, d, e, f, g, Add(K4(K[i + 1]), w[(i + 1) & 15]));
+        Round(g, h, a, b, c, d, e, f, Add(K4(K[i + 2]), w[(i + 2) & 15]));
+        Round(f, g, h, a, b, c, d, e, Add(K4(K[i + 3]), w[(i + 3) & 15]));
+        Round(e, f, g, h, a, b, c, d, Add(K4(K[i + 4]), w[(i + 4) & 15]));
+        Round(d, e, f, g, h, a, b, c, Add(K4(K[i + 5]), w[(i + 5) & 15]));
+        Round(c, d, e, f, g, h, a, b, Add(K4(K[i + 6]), w[(i + 6) & 15]));
+        Round(b, c, d, e, f, g, h, a, Add(K4(K[i + 7]), w[(i + 7) & 15]));
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Gather big-endian word number n of each of the four 64-byte inputs. */
+SSE41 inline __m128i Read4(const unsigned char* in, int n)
+{
+    return _mm_set_epi32(ReadBE32(in + 192 + 4 * n), ReadBE32(in + 128 + 4 * n), ReadBE32(in + 64 + 4 * n), ReadBE32(in + 4 * n));
+}
+
+/** Scatter word n of each lane as big-endian into the four 32-byte outputs. */
+SSE41 inline void Write4(unsigned char* out, int n, __m128i v)
+{
+    uint32_t x[4];
+    _mm_storeu_si128((__m128i*)x, v);
+    for (int i = 0; i < 4; i++)
+        WriteBE32(out + 32 * i + 4 * n, x[i]);
+}
+
+SSE41 inline void Init(__m128i* s)
+{
+    for (int i = 0; i < 8; i++)
+        s[i] = K4(INIT[i]);
+}
+} // namespace
+
+SSE41 void TransformD64_4way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s[8], t[8], w[16];
+
+    // First hash: the 64-byte input, then its padding block.
+    Init(s);
+    for (int i = 0; i < 16; i++)
+        w[i] = Read4(in, i);
+    Transform(s, w);
+    w[0] = K4(0x80000000ul);
+    for (int i = 1; i < 15; i++)
+        w[i] = _mm_setzero_si128();
+    w[15] = K4(512);
+    Transform(s, w);
+
+    // Second hash: the 32-byte digest plus padding, in a single block.
+    Init(t);
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = K4(0x80000000ul);
+    for (int i = 9; i < 15; i++)
+        w[i] = _mm_setzero_si128();
+    w[15] = K4(256);
+    Transform(t, w);
+
+    for (int i = 0; i < 8; i++)
+        Write4(out, i, t[i]);
+}
+} // namespace sha256_sse41
+
+#endif
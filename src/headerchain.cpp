@@ -0,0 +1,324 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "headerchain.h"
+
+#include "bignum.h"
+#include "chainparams.h"
+#include "checkpoints.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "timedata.h"
+#include "util.h"
+
+#include <set>
+
+extern CBigNum bnProofOfStakeLimit;
+
+CHeaderChain headerChain;
+
+CHeaderChain::CHeaderChain() : nBase(-1)
+{
+}
+
+// Same as CBlockIndex::GetBlockTrust()
+static uint256 GetHeaderTrust(unsigned int nBits)
+{
+    CBigNum bnTarget;
+    bnTarget.SetCompact(nBits);
+    if (bnTarget <= 0)
+        return 0;
+    return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
+}
+
+bool CHeaderChain::GetParent(const uint256& hashPrev, CBlockHeader& parent, int& nParentHeight, const CBlockIndex*& pindexParent,
+                             uint256& nParentBlockTrust, uint256& nParentChainTrust) const
+{
+    std::map<uint256, CEntry>::const_iterator it = mapHeaders.find(hashPrev);
+    if (it != mapHeaders.end())
+    {
+        parent = it->second.header;
+        nParentHeight = it->second.nHeight;
+        pindexParent = NULL;
+        nParentBlockTrust = it->second.nBlockTrust;
+        nParentChainTrust = it->second.nChainTrust;
+        return true;
+    }
+
+    std::map<uint256, CBlockIndex*>::const_iterator mi = mapBlockIndex.find(hashPrev);
+    if (mi != mapBlockIndex.end())
+    {
+        parent = mi->second->GetBlockHeader();
+        nParentHeight = mi->second->nHeight;
+        pindexParent = mi->second;
+        nParentBlockTrust = mi->second->GetBlockTrust();
+        nParentChainTrust = mi->second->nChainTrust;
+        return true;
+    }
+    return false;
+}
+
+uint256 CHeaderChain::GetBestTrust() const
+{
+    if (vChain.size() < 2)
+        return nBestChainTrust;
+    return mapHeaders.find(vChain.back())->second.nChainTrust;
+}
+
+bool CHeaderChain::AcceptHeader(const CBlockHeader& header, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+
+    uint256 hash = header.GetHash();
+    if (mapHeaders.count(hash) || mapBlockIndex.count(hash))
+        return true;
+
+    if (mapHeaders.size() >= 2 * (size_t)MAX_HEADERS_AHEAD)
+        EvictStale(header.hashPrevBlock);
+
+    CBlockHeader parent;
+    int nParentHeight;
+    const CBlockIndex* pindexParent;
+    uint256 nParentBlockTrust, nParentChainTrust;
+    if (!GetParent(header.hashPrevBlock, parent, nParentHeight, pindexParent, nParentBlockTrust, nParentChainTrust))
+        return state.DoS(10, error("AcceptHeader() : prev block of %s not found", hash.ToString()));
+    int nHeight = nParentHeight + 1;
+    bool fProofOfWorkOnly = nHeight < Params().FirstPOSBlock();
+
+    if (nHeight > chainActive.Height() + MAX_HEADERS_AHEAD || mapHeaders.size() >= 2 * (size_t)MAX_HEADERS_AHEAD)
+        return state.Invalid(error("AcceptHeader() : header %s at height %d is too far ahead", hash.ToString(), nHeight));
+
+    if (!Checkpoints::CheckHardened(nHeight, hash))
+        return state.DoS(100, error("AcceptHeader() : rejected by hardened checkpoint lock-in at %d", nHeight),
+                         REJECT_CHECKPOINT, "checkpoint mismatch");
+
+    // Same timestamp rules as CheckBlock() and AcceptBlock()
+    if (header.GetBlockTime() > FutureDrift(GetAdjustedTime(), !fProofOfWorkOnly))
+        return state.Invalid(error("AcceptHeader() : header %s timestamp too far in the future", hash.ToString()));
+    int64_t nPastTimeLimit = pindexParent ? pindexParent->GetPastTimeLimit() : parent.GetBlockTime();
+    if (header.GetBlockTime() <= nPastTimeLimit || FutureDrift(header.GetBlockTime(), !fProofOfWorkOnly) < parent.GetBlockTime())
+        return state.Invalid(error("AcceptHeader() : header %s timestamp is too early", hash.ToString()),
+                             REJECT_INVALID, "time-too-old");
+
+    CBigNum bnTarget;
+    bnTarget.SetCompact(header.nBits);
+    CBigNum bnLimit = Params().ProofOfWorkLimit();
+    if (!fProofOfWorkOnly && bnProofOfStakeLimit > bnLimit)
+        bnLimit = bnProofOfStakeLimit;
+    if (bnTarget <= 0 || bnTarget > bnLimit)
+        return state.DoS(100, error("AcceptHeader() : header %s nBits below minimum work", hash.ToString()),
+                         REJECT_INVALID, "bad-diffbits");
+
+    // The retarget needs the previous block of the same kind, which is only known for blocks we have
+    if (pindexParent &&
+        header.nBits != GetNextTargetRequired(pindexParent, false) &&
+        (fProofOfWorkOnly || header.nBits != GetNextTargetRequired(pindexParent, true)))
+        return state.DoS(100, error("AcceptHeader() : header %s has incorrect nBits", hash.ToString()),
+                         REJECT_INVALID, "bad-diffbits");
+
+    if (fProofOfWorkOnly && !CheckProofOfWork(header.GetPoWHash(), header.nBits))
+        return state.DoS(50, error("AcceptHeader() : header %s proof of work failed", hash.ToString()),
+                         REJECT_INVALID, "high-hash");
+
+    // Made-up difficulty must not buy a branch the lead: without the parent block to
+    // check nBits against, a proof-of-stake header counts no more than its parent
+    uint256 nBlockTrust = GetHeaderTrust(header.nBits);
+    if (!pindexParent && !fProofOfWorkOnly && nBlockTrust > nParentBlockTrust)
+        nBlockTrust = nParentBlockTrust;
+
+    CEntry& entry = mapHeaders[hash];
+    entry.header = header;
+    entry.nHeight = nHeight;
+    entry.nBlockTrust = nBlockTrust;
+    entry.nChainTrust = nParentChainTrust + nBlockTrust;
+    mapHeights.insert(std::make_pair(nHeight, hash));
+
+    if (entry.nChainTrust > GetBestTrust())
+        SetBest(hash);
+    return true;
+}
+
+void CHeaderChain::SetBest(const uint256& hash)
+{
+    const CEntry& entry = mapHeaders[hash];
+    if (!vChain.empty() && entry.header.hashPrevBlock == vChain.back())
+    {
+        vChain.push_back(hash);
+        return;
+    }
+
+    // Switched to another branch: walk back to the block it forks from
+    vChain.clear();
+    uint256 hashWalk = hash;
+    std::map<uint256, CEntry>::const_iterator it;
+    while ((it = mapHeaders.find(hashWalk)) != mapHeaders.end())
+    {
+        vChain.push_front(hashWalk);
+        nBase = it->second.nHeight - 1;
+        hashWalk = it->second.header.hashPrevBlock;
+    }
+    vChain.push_front(hashWalk);
+}
+
+// Pick the best header chain again after entries were removed from under it
+void CHeaderChain::FindBest()
+{
+    vChain.clear();
+    nBase = -1;
+
+    uint256 hashBest = 0;
+    uint256 nBestTrust = nBestChainTrust;
+    for (std::map<uint256, CEntry>::const_iterator it = mapHeaders.begin(); it != mapHeaders.end(); ++it)
+    {
+        if (it->second.nChainTrust > nBestTrust)
+        {
+            hashBest = it->first;
+            nBestTrust = it->second.nChainTrust;
+        }
+    }
+    if (hashBest != 0)
+        SetBest(hashBest);
+}
+
+// Make room by dropping every branch but the best one and the one hashKeep is on
+void CHeaderChain::EvictStale(const uint256& hashKeep)
+{
+    std::set<uint256> setKeep(vChain.begin(), vChain.end());
+    uint256 hashWalk = hashKeep;
+    std::map<uint256, CEntry>::const_iterator it;
+    while ((it = mapHeaders.find(hashWalk)) != mapHeaders.end() && setKeep.insert(hashWalk).second)
+        hashWalk = it->second.header.hashPrevBlock;
+
+    size_t nBefore = mapHeaders.size();
+    std::multimap<int, uint256>::iterator mi = mapHeights.begin();
+    while (mi != mapHeights.end())
+    {
+        if (setKeep.count(mi->second))
+        {
+            ++mi;
+            continue;
+        }
+        mapHeaders.erase(mi->second);
+        mapHeights.erase(mi++);
+    }
+    LogPrint("net", "EvictStale() : dropped %u headers off the best chain\n", nBefore - mapHeaders.size());
+}
+
+void CHeaderChain::Invalidate(const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+
+    std::map<uint256, CEntry>::const_iterator it = mapHeaders.find(hash);
+    if (it == mapHeaders.end())
+        return;
+
+    // Descendants are higher, so walking up by height meets every parent before its children
+    std::set<uint256> setRemoved;
+    setRemoved.insert(hash);
+    std::multimap<int, uint256>::iterator mi = mapHeights.lower_bound(it->second.nHeight);
+    while (mi != mapHeights.end())
+    {
+        std::map<uint256, CEntry>::iterator ei = mapHeaders.find(mi->second);
+        if (mi->second != hash && !setRemoved.count(ei->second.header.hashPrevBlock))
+        {
+            ++mi;
+            continue;
+        }
+        setRemoved.insert(mi->second);
+        mapHeaders.erase(ei);
+        mapHeights.erase(mi++);
+    }
+    LogPrintf("Invalidate() : dropped header %s and %u built on it\n", hash.ToString(), setRemoved.size() - 1);
+
+    if (vChain.size() > 1 && !mapHeaders.count(vChain.back()))
+        FindBest();
+}
+
+int CHeaderChain::GetHeight(const uint256& hash) const
+{
+    std::map<uint256, CEntry>::const_iterator it = mapHeaders.find(hash);
+    return it == mapHeaders.end() ? -1 : it->second.nHeight;
+}
+
+int CHeaderChain::Height() const
+{
+    if (vChain.empty())
+        return chainActive.Height();
+    return nBase + (int)vChain.size() - 1;
+}
+
+uint256 CHeaderChain::GetHash(int nHeight) const
+{
+    if (vChain.empty() || nHeight < nBase || nHeight > Height())
+        return 0;
+    return vChain[nHeight - nBase];
+}
+
+bool CHeaderChain::IsOnBestChain(const uint256& hash) const
+{
+    int nHeight = GetHeight(hash);
+    return nHeight > nBase && GetHash(nHeight) == hash;
+}
+
+CBlockLocator CHeaderChain::GetLocator() const
+{
+    if (vChain.empty())
+        return chainActive.GetLocator();
+
+    std::vector<uint256> vHave;
+    vHave.reserve(32);
+    int nStep = 1;
+    int nHeight = Height();
+    while (nHeight > nBase)
+    {
+        vHave.push_back(vChain[nHeight - nBase]);
+        nHeight -= nStep;
+        if (vHave.size() > 10)
+            nStep *= 2;
+    }
+
+    // Continue through the blocks the best header chain builds on
+    const CBlockIndex* pindex = mapBlockIndex.find(vChain[0])->second;
+    pindex = pindex->GetAncestor(std::max(std::min(nHeight, nBase), 0));
+    while (pindex)
+    {
+        vHave.push_back(pindex->GetBlockHash());
+        if (pindex->nHeight == 0)
+            break;
+        pindex = pindex->GetAncestor(std::max(pindex->nHeight - nStep, 0));
+        if (vHave.size() > 10)
+            nStep *= 2;
+    }
+    return CBlockLocator(vHave);
+}
+
+void CHeaderChain::Prune()
+{
+    AssertLockHeld(cs_main);
+
+    if (vChain.empty())
+        return;
+    while (vChain.size() > 1 && mapBlockIndex.count(vChain[1]))
+    {
+        vChain.pop_front();
+        nBase++;
+    }
+
+    if (vChain.size() == 1)
+    {
+        // Every block of the best header chain arrived, anything left is a stale branch
+        vChain.clear();
+        mapHeaders.clear();
+        mapHeights.clear();
+        nBase = -1;
+        return;
+    }
+
+    std::multimap<int, uint256>::iterator it = mapHeights.begin();
+    while (it != mapHeights.end() && it->first <= nBase)
+    {
+        mapHeaders.erase(it->second);
+        mapHeights.erase(it++);
+    }
+}
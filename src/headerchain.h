@@ -0,0 +1,100 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_HEADERCHAIN_H
+#define DARKSILK_HEADERCHAIN_H
+
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+
+class CBlockIndex;
+class CBlockLocator;
+class CValidationState;
+
+/** Headers are not accepted more than this many blocks ahead of the best block */
+static const int MAX_HEADERS_AHEAD = 50000;
+
+/**
+ * Block headers received during headers-first sync whose blocks we do not have yet.
+ *
+ * The best header chain, the one with the most trust, is kept as a height-indexed
+ * list starting at the last block we have on it, so the block download can walk it
+ * by height from any number of peers. Entries are dropped as soon as their blocks
+ * are in mapBlockIndex. All methods require cs_main.
+ *
+ * A header's proof-of-stake can only be checked with its block, so the checks here
+ * are the ones that need nothing but headers: linkage, timestamps, checkpoints,
+ * nBits within the limits (and exact when the parent block is known), and real
+ * proof-of-work for the heights before proof-of-stake starts. AcceptBlock repeats
+ * all of them once the block arrives. A proof-of-stake header whose nBits could
+ * not be checked counts no more trust than its parent, and a branch whose block
+ * fails AcceptBlock or never comes is dropped with Invalidate(). A body that fails
+ * CheckBlock does not drop it, a peer can send a broken copy of any good header.
+ */
+class CHeaderChain
+{
+public:
+    CHeaderChain();
+
+    /** Check a header and add it unless its block is already known. */
+    bool AcceptHeader(const CBlockHeader& header, CValidationState& state);
+
+    /** True if hash is a header-only entry */
+    bool Contains(const uint256& hash) const { return mapHeaders.count(hash) > 0; }
+
+    /** Height of a header-only entry, -1 if unknown */
+    int GetHeight(const uint256& hash) const;
+
+    /** Height of the best header, or of the best block if there are no headers ahead of it */
+    int Height() const;
+
+    /** First height of the best header chain whose block we do not have */
+    int FirstMissing() const { return nBase + 1; }
+
+    /** Hash at nHeight on the best header chain, 0 if outside of it */
+    uint256 GetHash(int nHeight) const;
+
+    /** True if hash is on the best header chain */
+    bool IsOnBestChain(const uint256& hash) const;
+
+    /** Locator starting at the best header, for getheaders */
+    CBlockLocator GetLocator() const;
+
+    /** Forget headers whose blocks have been accepted */
+    void Prune();
+
+    /** Forget a header-only entry and everything built on it */
+    void Invalidate(const uint256& hash);
+
+    size_t size() const { return mapHeaders.size(); }
+
+private:
+    struct CEntry
+    {
+        CBlockHeader header;
+        int nHeight;
+        uint256 nBlockTrust;
+        uint256 nChainTrust;
+    };
+
+    std::map<uint256, CEntry> mapHeaders;
+    std::multimap<int, uint256> mapHeights;
+    //! best header chain: vChain[0] is a block in mapBlockIndex at height nBase, the rest header-only entries
+    std::deque<uint256> vChain;
+    int nBase;
+
+    bool GetParent(const uint256& hashPrev, CBlockHeader& parent, int& nParentHeight, const CBlockIndex*& pindexParent,
+                   uint256& nParentBlockTrust, uint256& nParentChainTrust) const;
+    uint256 GetBestTrust() const;
+    void SetBest(const uint256& hash);
+    void FindBest();
+    void EvictStale(const uint256& hashKeep);
+};
+
+extern CHeaderChain headerChain;
+
+#endif // DARKSILK_HEADERCHAIN_H
@@ -15,7 +15,11 @@
 
 #include "init.h"
 #include "main.h"
+#include "blockfile.h"
+#include "blockverify.h"
+#include "txverify.h"
 #include "chainparams.h"
+#include "crypto/sha256.h"
 #include "sanity.h"
 #include "net.h"
 #include "key.h"
@@ -30,6 +34,7 @@
 #include "anon/stormnode/activestormnode.h"
 #include "anon/stormnode/stormnode-budget.h"
 #include "anon/stormnode/stormnode-payments.h"
+#include "anon/stormnode/stormnode-sigverify.h"
 // #include "anon/stormnode/stormnode-sync.h" //include after chainactive.Tip is active
 #include "anon/stormnode/stormnodeman.h"
 #include "anon/stormnode/stormnodeconfig.h"
@@ -205,6 +210,7 @@ void Shutdown()
         delete pblocktree;
         pblocktree = NULL;
     }
+    blockFileCache.Clear();
     {
         LOCK(cs_main);
 #ifdef ENABLE_WALLET
@@ -277,6 +283,18 @@ std::string HelpMessage()
     strUsage += "  -wallet=<dir>          " + _("Specify wallet file (within data directory)") + "\n";
     strUsage += "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n";
     strUsage += "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n";
+    strUsage += "  -dbwritebuffer=<n>     " + _("Set transaction database write buffer size in megabytes (default: 4)") + "\n";
+    strUsage += "  -dbmaxopenfiles=<n>    " + _("Maximum number of files the transaction database keeps open (default: 1000)") + "\n";
+    strUsage += "  -dbblocksize=<n>       " + _("Set transaction database block size in kilobytes (default: 4)") + "\n";
+    strUsage += "  -dbcompression         " + _("Compress transaction database blocks (default: 1)") + "\n";
+    strUsage += "  -dbsync                " + _("Sync every transaction database write to disk (default: 0)") + "\n";
+    strUsage += "  -blockverifythreads=<n> " + strprintf(_("Set the number of block verification threads (up to %d, 0 = auto, <0 = verify on the receiving thread, default: %d)"), MAX_BLOCK_VERIFY_THREADS, DEFAULT_BLOCK_VERIFY_THREADS) + "\n";
+    strUsage += "  -txverifythreads=<n>   " + strprintf(_("Set the number of threads verifying relayed transactions (up to %d, 0 = auto, <0 = verify on the receiving thread, default: %d)"), MAX_TX_VERIFY_THREADS, DEFAULT_TX_VERIFY_THREADS) + "\n";
+    strUsage += "  -sigverifythreads=<n>  " + strprintf(_("Set the number of threads verifying stormnode, budget and InstantX signatures (up to %d, 0 = auto, <0 = verify on the receiving thread, default: %d)"), MAX_SIG_VERIFY_THREADS, DEFAULT_SIG_VERIFY_THREADS) + "\n";
+    strUsage += "  -msghandlerthreads=<n> " + strprintf(_("Set the number of threads processing peer messages (1 to %d, default: %d)"), MAX_MSG_HANDLER_THREADS, DEFAULT_MSG_HANDLER_THREADS) + "\n";
+#ifdef HAVE_EPOLL
+    strUsage += "  -epoll                 " + _("Use epoll instead of select() for peer sockets, not limited to 1024 connections (default: 1)") + "\n";
+#endif
     strUsage += "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n";
     strUsage += "  -proxy=<ip:port>       " + _("Connect through SOCKS5 proxy") + "\n";
     strUsage += "  -tor=<ip:port>         " + _("Use proxy to reach tor hidden services (default: same as -proxy)") + "\n";
@@ -340,7 +358,7 @@ std::string HelpMessage()
     strUsage += "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n";
     strUsage += "  -rpcconnect=<ip>       " + _("Send commands to node running on <ip> (default: 127.0.0.1)") + "\n";
     strUsage += "  -rpcwait               " + _("Wait for RPC server to start") + "\n";
-    strUsage += "  -rpcthreads=<n>        " + _("Set the number of threads to service RPC calls (default: 4)") + "\n";
+    strUsage += "  -rpcthreads=<n>        " + _("Set the number of threads to service RPC calls and batch entries (default: 4)") + "\n";
     strUsage += "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n";
     strUsage += "  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n";
     strUsage += "  -confchange            " + _("Require a confirmations for change (default: 0)") + "\n";
@@ -615,6 +633,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             nConnectTimeout = nNewTimeout;
     }
 
+#ifdef HAVE_EPOLL
+    fUseEpoll = GetBoolArg("-epoll", true);
+#endif
+
+    // Make sure enough file descriptors are available
+    int nBind = std::max((int)(mapMultiArgs["-bind"].size() + mapMultiArgs["-whitebind"].size()), 1);
+    nMaxConnections = GetArg("-maxconnections", 200);
+    // select() only takes sockets below FD_SETSIZE
+    if (!fUseEpoll)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS), 0);
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + nBind + MIN_CORE_FILEDESCRIPTORS);
+    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+        return InitError(_("Not enough file descriptors available."));
+    if (nFD - nBind - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
+        nMaxConnections = std::max(nFD - nBind - MIN_CORE_FILEDESCRIPTORS, 0);
+    if (nMaxConnections < GetArg("-maxconnections", 200))
+        LogPrintf("Reducing -maxconnections to %d, because of system limitations\n", nMaxConnections);
+
 #ifdef ENABLE_WALLET
     if (mapArgs.count("-paytxfee"))
     {
@@ -669,6 +705,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("\n\n\n"); //A bit excessive???
     LogPrintf("DarkSilk version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using SHA256 implementation: %s\n", SHA256AutoDetect());
     if (!fLogTimestamps)
         LogPrintf("Startup time: %s\n", DateTimeStrFormat("%x %H:%M:%S", GetTime()));
     LogPrintf("Default data directory %s\n", GetDefaultDataDir().string());
@@ -1142,6 +1179,27 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         BOOST_FOREACH(string strFile, mapMultiArgs["-loadblock"])
             vImportFiles.push_back(strFile);
     }
+    int nBlockVerifyThreads = GetArg("-blockverifythreads", DEFAULT_BLOCK_VERIFY_THREADS);
+    if (nBlockVerifyThreads == 0)
+        nBlockVerifyThreads = std::max((int)boost::thread::hardware_concurrency() - 1, 1);
+    if (nBlockVerifyThreads > MAX_BLOCK_VERIFY_THREADS)
+        nBlockVerifyThreads = MAX_BLOCK_VERIFY_THREADS;
+    blockVerifyQueue.Start(threadGroup, nBlockVerifyThreads);
+
+    int nTxVerifyThreads = GetArg("-txverifythreads", DEFAULT_TX_VERIFY_THREADS);
+    if (nTxVerifyThreads == 0)
+        nTxVerifyThreads = std::max((int)boost::thread::hardware_concurrency() / 2, 1);
+    if (nTxVerifyThreads > MAX_TX_VERIFY_THREADS)
+        nTxVerifyThreads = MAX_TX_VERIFY_THREADS;
+    txVerifyQueue.Start(threadGroup, nTxVerifyThreads);
+
+    int nSigVerifyThreads = GetArg("-sigverifythreads", DEFAULT_SIG_VERIFY_THREADS);
+    if (nSigVerifyThreads == 0)
+        nSigVerifyThreads = std::max((int)boost::thread::hardware_concurrency() / 2, 1);
+    if (nSigVerifyThreads > MAX_SIG_VERIFY_THREADS)
+        nSigVerifyThreads = MAX_SIG_VERIFY_THREADS;
+    sigVerifyQueue.Start(threadGroup, nSigVerifyThreads);
+
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
     if (pindexBest == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
@@ -1182,34 +1240,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     nStart = GetTimeMillis();
 
-    CStormnodeDB sndb;
-    CStormnodeDB::ReadResult readResult = sndb.Read(snodeman);
-    if (readResult == CStormnodeDB::FileError)
-        LogPrintf("Missing Stormnode cache file - sncache.dat, will try to recreate\n");
-    else if (readResult != CStormnodeDB::Ok)
-    {
-        LogPrintf("Error reading sncache.dat: ");
-        if(readResult == CStormnodeDB::IncorrectFormat)
-            LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
-        else
-            LogPrintf("file format is unknown or invalid, please fix it manually\n");
-    }
+    LoadStormnodes();
 
     uiInterface.InitMessage(_("Loading budget cache..."));
 
-    CBudgetDB budgetdb;
-    CBudgetDB::ReadResult readResult2 = budgetdb.Read(budget);
-
-    if (readResult2 == CBudgetDB::FileError)
-        LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
-    else if (readResult2 != CBudgetDB::Ok)
-    {
-        LogPrintf("Error reading budget.dat: ");
-        if(readResult2 == CBudgetDB::IncorrectFormat)
-            LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
-        else
-            LogPrintf("file format is unknown or invalid, please fix it manually\n");
-    }
+    LoadBudgets();
 
     //flag our cached items so we send them to our peers
     budget.ResetSync();
@@ -1218,19 +1253,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     uiInterface.InitMessage(_("Loading stormnode payment cache..."));
 
-    CStormnodePaymentDB snpayments;
-    CStormnodePaymentDB::ReadResult readResult3 = snpayments.Read(stormnodePayments);
-    
-    if (readResult3 == CStormnodePaymentDB::FileError)
-        LogPrintf("Missing Stormnode payment cache - snpayments.dat, will try to recreate\n");
-    else if (readResult3 != CStormnodePaymentDB::Ok)
-    {
-        LogPrintf("Error reading mnpayments.dat: ");
-        if(readResult3 == CStormnodePaymentDB::IncorrectFormat)
-            LogPrintf("magic is ok but data has invalid format, will try to recreate\n");
-        else
-            LogPrintf("file format is unknown or invalid, please fix it manually\n");
-    }
+    LoadStormnodePayments();
 
     fStormNode = GetBoolArg("-stormnode", false);
 
@@ -19,10 +19,18 @@ bool CKeyStore::AddKey(const CKey &key) {
     return AddKeyPubKey(key, key.GetPubKey());
 }
 
+void CBasicKeyStore::AddToScriptFilter(const CPubKey& pubkey)
+{
+    AssertLockHeld(cs_KeyStore);
+    setScriptFilter.insert(GetScriptForDestination(pubkey.GetID()));
+    setScriptFilter.insert(CScript() << pubkey << OP_CHECKSIG);
+}
+
 bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    AddToScriptFilter(pubkey);
     return true;
 }
 
@@ -33,6 +41,7 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[redeemScript.GetID()] = redeemScript;
+    setScriptFilter.insert(GetScriptForDestination(redeemScript.GetID()));
     return true;
 }
 
@@ -58,6 +67,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    setScriptFilter.insert(dest);
     return true;
 }
 
@@ -79,3 +89,13 @@ bool CBasicKeyStore::HaveWatchOnly() const
     LOCK(cs_KeyStore);
     return (!setWatchOnly.empty());
 }
+
+bool CBasicKeyStore::MightBeMine(const CScript& scriptPubKey) const
+{
+    // bare multisig outputs can't be listed in advance, IsMine has to look at the keys
+    if (!scriptPubKey.empty() && scriptPubKey.back() == OP_CHECKMULTISIG)
+        return true;
+
+    LOCK(cs_KeyStore);
+    return setScriptFilter.count(scriptPubKey) > 0;
+}
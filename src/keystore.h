@@ -6,7 +6,9 @@
 #ifndef DARKSILK_KEYSTORE_H
 #define DARKSILK_KEYSTORE_H
 
+#include <boost/functional/hash.hpp>
 #include <boost/signals2/signal.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/variant.hpp>
 
 #include "key.h"
@@ -51,12 +53,24 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest) =0;
     virtual bool HaveWatchOnly(const CScript &dest) const =0;
     virtual bool HaveWatchOnly() const =0;
+
+    // Cheap pre-check for IsMine: false means scriptPubKey is certainly not ours
+    virtual bool MightBeMine(const CScript& scriptPubKey) const =0;
 };
 
 typedef std::map<CKeyID, CKey> KeyMap;
 typedef std::map<CScriptID, CScript > ScriptMap;
 typedef std::set<CScript> WatchOnlySet;
 
+struct CScriptHasher
+{
+    size_t operator()(const CScript& script) const
+    {
+        return boost::hash_range(script.begin(), script.end());
+    }
+};
+typedef boost::unordered_set<CScript, CScriptHasher> ScriptFilterSet;
+
 /** Basic key store, that keeps keys in an address->secret map */
 class CBasicKeyStore : public CKeyStore
 {
@@ -64,6 +78,11 @@ protected:
     KeyMap mapKeys;
     ScriptMap mapScripts;
     WatchOnlySet setWatchOnly;
+    //! every scriptPubKey IsMine could accept (P2PK/P2PKH of each key, P2SH of each
+    //! script, watch-only scripts), bare multisig aside; only ever grows
+    ScriptFilterSet setScriptFilter;
+
+    void AddToScriptFilter(const CPubKey& pubkey);
 
 public:
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
@@ -110,6 +129,8 @@ public:
     virtual bool RemoveWatchOnly(const CScript &dest);
     virtual bool HaveWatchOnly(const CScript &dest) const;
     virtual bool HaveWatchOnly() const;
+
+    virtual bool MightBeMine(const CScript& scriptPubKey) const;
 };
 
 typedef std::map<CKeyID, std::pair<CPubKey, std::vector<unsigned char> > > CryptedKeyMap;
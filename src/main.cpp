@@ -13,6 +13,10 @@
 #include "main.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockfile.h"
+#include "blockverify.h"
+#include "headerchain.h"
+#include "txverify.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "consensus/params.h"
@@ -31,6 +35,7 @@
 #include "anon/stormnode/stormnodeman.h"
 #include "anon/stormnode/stormnode-budget.h"
 #include "anon/stormnode/stormnode-payments.h"
+#include "anon/stormnode/stormnode-sigverify.h"
 #include "anon/stormnode/stormnode-sync.h"
 #include "anon/stormnode/spork.h"
 #include "smessage.h"
@@ -80,6 +85,8 @@ uint256 nBestInvalidTrust = 0;
 uint256 hashBestChain = 0;
 
 CBlockIndex* pindexBest = NULL;
+static CCriticalSection cs_chainSnapshot; // guards the pointer swap only
+static CChainSnapshotRef chainSnapshot(new CChainSnapshot());
 
 int64_t nTimeBestReceived = 0;
 CConditionVariable cvBlockChange;
@@ -202,6 +209,37 @@ namespace {
 
 } // anon namespace
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// chain snapshot for lock-free readers
+//
+
+void PublishChainSnapshot()
+{
+    AssertLockHeld(cs_main);
+
+    CChainSnapshot* psnapshot = new CChainSnapshot();
+    psnapshot->pindexTip = pindexBest;
+    psnapshot->hashBestChain = hashBestChain;
+    psnapshot->nHeight = nBestHeight;
+    psnapshot->nChainTrust = nBestChainTrust;
+    if (pindexBest)
+    {
+        psnapshot->nTime = pindexBest->GetBlockTime();
+        psnapshot->nMoneySupply = pindexBest->nMoneySupply;
+    }
+
+    CChainSnapshotRef snapshot(psnapshot);
+    LOCK(cs_chainSnapshot);
+    chainSnapshot.swap(snapshot);
+}
+
+CChainSnapshotRef GetChainSnapshot()
+{
+    LOCK(cs_chainSnapshot);
+    return chainSnapshot;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // dispatching functions
@@ -320,6 +358,14 @@ struct CNodeState {
     int nBlocksToDownload;
     int64_t nLastBlockReceive;
     int64_t nLastBlockProcess;
+    //! The best header chain entry this peer is known to have the block of.
+    uint256 hashBestKnownHeader;
+    //! When our outstanding getheaders was sent (in microseconds), or 0.
+    int64_t nHeadersRequestTime;
+    //! Whether the header sync peer has sent all the headers it has.
+    bool fHeadersComplete;
+    //! Earliest time (in microseconds) to ask this peer whether it has blocks further up the header chain.
+    int64_t nNextHeadersProbe;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -335,6 +381,10 @@ struct CNodeState {
         nBlocksToDownload = 0;
         nLastBlockReceive = 0;
         nLastBlockProcess = 0;
+        hashBestKnownHeader = 0;
+        nHeadersRequestTime = 0;
+        fHeadersComplete = false;
+        nNextHeadersProbe = 0;
     }
 };
 
@@ -398,6 +448,7 @@ void FinalizeNode(NodeId nodeid) {
         mapBlocksToDownload.erase(hash);
 
     EraseOrphansFor(nodeid);
+    sigVerifyQueue.ForgetNode(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
     mapNodeState.erase(nodeid);
@@ -456,6 +507,85 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, CBlockIndex *pindex
     state->nBlocksInFlight++;
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
+
+// Requires cs_main. Height of the best header chain entry the peer has, -1 if none.
+int GetBestKnownHeight(const CNodeState* state) {
+    if (!headerChain.IsOnBestChain(state->hashBestKnownHeader))
+        return -1;
+    return headerChain.GetHeight(state->hashBestKnownHeader);
+}
+
+// Requires cs_main. A peer dropped for not delivering blocks of the best header chain
+// takes that branch with it if no other peer has it: it may be made up, and nobody
+// else could fill the download window.
+void ForgetUndeliveredHeaders(NodeId nodeid, CNodeState* state) {
+    BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight) {
+        if (!headerChain.IsOnBestChain(entry.hash))
+            continue;
+        int nHeight = headerChain.GetHeight(entry.hash);
+        bool fElsewhere = false;
+        for (map<NodeId, CNodeState>::iterator it = mapNodeState.begin(); it != mapNodeState.end() && !fElsewhere; ++it)
+            fElsewhere = it->first != nodeid && GetBestKnownHeight(&it->second) >= nHeight;
+        if (!fElsewhere) {
+            headerChain.Invalidate(entry.hash);
+            return;
+        }
+    }
+}
+
+// Requires cs_main.
+void UpdateBestKnownHeader(CNodeState* state, const uint256& hash) {
+    if (headerChain.IsOnBestChain(hash) && headerChain.GetHeight(hash) > GetBestKnownHeight(state))
+        state->hashBestKnownHeader = hash;
+}
+
+// Requires cs_main.
+void PushGetHeaders(CNode* pnode, CNodeState* state) {
+    state->nHeadersRequestTime = GetTimeMicros();
+    LogPrint("net", "getheaders (%d) to peer=%d (startheight:%d)\n", headerChain.Height(), pnode->id, pnode->nStartingHeight);
+    pnode->PushMessage("getheaders", headerChain.GetLocator(), uint256(0));
+}
+
+// Requires cs_main. Picks up to count blocks of the best header chain to request from nodeid,
+// staying within BLOCK_DOWNLOAD_WINDOW of the first missing block. If nothing can be requested
+// because the window is full, nodeStaller is set to the peer holding it up.
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, vector<uint256>& vBlocks, NodeId& nodeStaller) {
+    if (count == 0)
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != NULL);
+
+    headerChain.Prune();
+    int nFirst = headerChain.FirstMissing();
+    int nKnown = GetBestKnownHeight(state);
+    if (nKnown < nFirst)
+        return;
+
+    int nWindowEnd = nFirst + BLOCK_DOWNLOAD_WINDOW - 1;
+    int nMaxHeight = std::min(nKnown, nWindowEnd + 1);
+    NodeId waitingfor = -1;
+    for (int nHeight = nFirst; nHeight <= nMaxHeight; nHeight++) {
+        uint256 hash = headerChain.GetHash(nHeight);
+        if (mapBlockIndex.count(hash) || mapOrphanBlocks.count(hash) || mapBlocksToDownload.count(hash) || blockVerifyQueue.Contains(hash))
+            continue;
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+        if (itInFlight != mapBlocksInFlight.end()) {
+            if (waitingfor == -1)
+                waitingfor = itInFlight->second.first;
+            continue;
+        }
+        if (nHeight > nWindowEnd) {
+            // We reached the end of the window.
+            if (vBlocks.size() == 0 && waitingfor != nodeid)
+                nodeStaller = waitingfor;
+            return;
+        }
+        vBlocks.push_back(hash);
+        if (vBlocks.size() == count)
+            return;
+    }
+}
 } // anon namespace
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
@@ -464,11 +594,13 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     if (state == NULL)
         return false;
     stats.nMisbehavior = state->nMisbehavior;
-    stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
+    stats.nSyncHeight = GetBestKnownHeight(state);
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
     BOOST_FOREACH(const QueuedBlock& queue, state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
+        else if (headerChain.Contains(queue.hash))
+            stats.vHeightInFlight.push_back(headerChain.GetHeight(queue.hash));
     }
     return true;
 }
@@ -818,7 +950,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
         CTxIndex txindex;
         if (!CTxDB("r").ReadTxIndex(GetHash(), txindex))
             return 0;
-        if (!blockTmp.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos))
+        if (!blockTmp.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, true, false))
             return 0;
         pblock = &blockTmp;
     }
@@ -887,6 +1019,73 @@ CAmount GetMinFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree,
 }
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction &tx, bool fLimitFree, bool* pfMissingInputs, bool ignoreFees)
+{
+    AssertLockHeld(cs_main);
+    CMemPoolInputs inputs;
+    if (!PreAcceptToMemoryPool(pool, state, tx, fLimitFree, pfMissingInputs, ignoreFees, inputs))
+        return false;
+    if (!CheckInputScripts(tx, inputs))
+        return false;
+    return FinishAcceptToMemoryPool(pool, state, tx, pfMissingInputs, inputs);
+}
+
+/** Inputs of tx that conflict with an InstantX lock or a pool transaction. Requires cs_main. */
+static bool HasMemPoolConflict(CTxMemPool& pool, const CTransaction& tx)
+{
+    uint256 txHashLock;
+    if(txLockManager.HasConflictingLock(tx, txHashLock)){
+        error("AcceptToMemoryPool : %s conflicts with existing transaction lock", tx.GetHash().ToString());
+        return true;
+    }
+
+    LOCK(pool.cs); // protect pool.mapNextTx
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        COutPoint outpoint = tx.vin[i].prevout;
+        if (pool.mapNextTx.count(outpoint))
+        {
+            // Disable replacement feature for now
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Fetch the inputs of tx and check everything about them except the scripts. Requires cs_main. */
+static bool FetchMemPoolInputs(CTransaction& tx, CTxDB& txdb, bool* pfMissingInputs, CMemPoolInputs& inputs)
+{
+    uint256 hash = tx.GetHash();
+
+    // do all inputs exist?
+    // Note that this does not check for the presence of actual outputs (see the next check for that),
+    // only helps filling in pfMissingInputs (to determine missing vs spent).
+    BOOST_FOREACH(const CTxIn txin, tx.vin) {
+        if (!txdb.ContainsTx(txin.prevout.hash)) {
+            if (pfMissingInputs)
+                *pfMissingInputs = true;
+            return false;
+        }
+    }
+
+    map<uint256, CTxIndex> mapUnused;
+    bool fInvalid = false;
+    CTransactionPoS txPoS;
+    inputs.mapInputs.clear();
+    inputs.hashBestChain = hashBestChain;
+    if (!txPoS.FetchInputs(tx, txdb, mapUnused, false, false, inputs.mapInputs, fInvalid))
+    {
+        if (fInvalid)
+            return error("AcceptToMemoryPool : FetchInputs found invalid tx %s", hash.ToString());
+        return false;
+    }
+
+    // Maturity, timestamps, values and double spends, without the signatures
+    if (!txPoS.ConnectInputs(tx, txdb, inputs.mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, STANDARD_SCRIPT_VERIFY_FLAGS, false))
+        return error("AcceptToMemoryPool : ConnectInputs failed %s", hash.ToString());
+    return true;
+}
+
+bool PreAcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction &tx, bool fLimitFree, bool* pfMissingInputs, bool ignoreFees, CMemPoolInputs& inputs)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -914,54 +1113,17 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction
     if (pool.exists(hash))
         return false;
 
-    // ----------- instantX transaction scanning -----------
-
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                return tx.DoS(0, error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason));
-            }
-        }
-    }
-
-    // Check for conflicts with in-memory transactions
-    {
-    LOCK(pool.cs); // protect pool.mapNextTx
-    for (unsigned int i = 0; i < tx.vin.size(); i++)
-    {
-        COutPoint outpoint = tx.vin[i].prevout;
-        if (pool.mapNextTx.count(outpoint))
-        {
-            // Disable replacement feature for now
-            return false;
-        }
-    }
-    }
+    // instantX locks and conflicts with in-memory transactions
+    if (HasMemPoolConflict(pool, tx))
+        return false;
 
     {
         CTxDB txdb("r");
 
-        // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // only helps filling in pfMissingInputs (to determine missing vs spent).
-        BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!txdb.ContainsTx(txin.prevout.hash)) {
-                if (pfMissingInputs)
-                    *pfMissingInputs = true;
-                return false;
-            }
-        }
-
-        MapPrevTx mapInputs;
-        map<uint256, CTxIndex> mapUnused;
-        bool fInvalid = false;
-        CTransactionPoS txPoS;
-        if (!txPoS.FetchInputs(tx, txdb, mapUnused, false, false, mapInputs, fInvalid))
-        {
-            if (fInvalid)
-                return error("AcceptToMemoryPool : FetchInputs found invalid tx %s", hash.ToString());
+        if (!FetchMemPoolInputs(tx, txdb, pfMissingInputs, inputs))
             return false;
-        }
+        const MapPrevTx& mapInputs = inputs.mapInputs;
+        CTransactionPoS txPoS;
 
         // Check for non-standard pay-to-script-hash in inputs
         if (!TestNet() && !AreInputsStandard(tx, mapInputs))
@@ -1012,28 +1174,63 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction
             dFreeCount += nSize;
             }
         }
-        // Check against previous transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!txPoS.ConnectInputs(tx, txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, STANDARD_SCRIPT_VERIFY_FLAGS))
-        {
-            return error("AcceptToMemoryPool : ConnectInputs failed %s", hash.ToString());
-        }
+    }
+    return true;
+}
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-        if (!txPoS.ConnectInputs(tx, txdb, mapInputs, mapUnused, CDiskTxPos(1,1,1), pindexBest, false, false, MANDATORY_SCRIPT_VERIFY_FLAGS))
+bool CheckInputScripts(const CTransaction& tx, const CMemPoolInputs& inputs)
+{
+    // Check against previous transactions
+    // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        const CTransaction& txPrev = inputs.mapInputs.find(tx.vin[i].prevout.hash)->second.second;
+        if (!VerifySignature(txPrev, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, 0))
         {
-            return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
+            // Same distinction as ConnectInputs(): failing only a non-mandatory flag is not punished
+            if (VerifySignature(txPrev, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, 0))
+                return error("AcceptToMemoryPool : ConnectInputs failed %s, non-mandatory VerifySignature failed", tx.GetHash().ToString());
+            return tx.DoS(100, error("AcceptToMemoryPool : ConnectInputs failed %s, VerifySignature failed", tx.GetHash().ToString()));
         }
     }
 
+    // Check again against just the consensus-critical mandatory script
+    // verification flags, in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain
+    // CHECKSIG NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks, however allowing such transactions into the mempool
+    // can be exploited as a DoS attack.
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        const CTransaction& txPrev = inputs.mapInputs.find(tx.vin[i].prevout.hash)->second.second;
+        if (!VerifySignature(txPrev, tx, i, MANDATORY_SCRIPT_VERIFY_FLAGS, 0))
+            return tx.DoS(100, error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", tx.GetHash().ToString()));
+    }
+    return true;
+}
+
+bool FinishAcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction &tx, bool* pfMissingInputs, const CMemPoolInputs& inputs)
+{
+    AssertLockHeld(cs_main);
+
+    // Another transaction may have been accepted, or a block connected, since the inputs were fetched
+    uint256 hash = tx.GetHash();
+    if (pool.exists(hash))
+        return false;
+    if (HasMemPoolConflict(pool, tx))
+        return false;
+    if (inputs.hashBestChain != hashBestChain)
+    {
+        // The scripts only depend on the previous transactions, which cannot have changed
+        CTxDB txdb("r");
+        CMemPoolInputs inputsNow;
+        if (!FetchMemPoolInputs(tx, txdb, pfMissingInputs, inputsNow))
+            return false;
+    }
+
     // Store transaction in memory
     pool.addUnchecked(hash, tx);
     setValidatedTx.insert(hash);
@@ -1075,13 +1272,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction
 
     // ----------- instantX transaction scanning -----------
 
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                return error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                                 REJECT_INVALID, "tx-lock-conflict";
-            }
-        }
+    uint256 txHashLock;
+    if(txLockManager.HasConflictingLock(tx, txHashLock)){
+        return error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+                         REJECT_INVALID, "tx-lock-conflict";
     }
 
     // Check for conflicts with in-memory transactions
@@ -1280,14 +1474,11 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState &state, CTransaction &t
 
     // ----------- InstantX transaction scanning -----------
 
-    BOOST_FOREACH(const CTxIn& in, tx.vin){
-        if(mapLockedInputs.count(in.prevout)){
-            if(mapLockedInputs[in.prevout] != tx.GetHash()){
-                return state.DoS(0,
-                                 error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
-                                 REJECT_INVALID, "tx-lock-conflict");
-            }
-        }
+    uint256 txHashLock;
+    if(txLockManager.HasConflictingLock(tx, txHashLock)){
+        return state.DoS(0,
+                         error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
+                         REJECT_INVALID, "tx-lock-conflict");
     }
 
     // Check for conflicts with in-memory transactions
@@ -1430,25 +1621,14 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if(!fEnableInstantX) return -1;
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()){
-        return (*i).second.CountSignatures();
-    }
-
-    return -1;
+    return txLockManager.GetLockSignatures(GetHash());
 }
 
 bool CMerkleTx::IsTransactionLockTimedOut() const
 {
     if(!fEnableInstantX) return 0;
 
-    //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()){
-        return GetTime() > (*i).second.nTimeout;
-    }
-
-    return false;
+    return txLockManager.IsLockTimedOut(GetHash());
 }
 
 int CMerkleTx::GetDepthInMainChain(CBlockIndex* &pindexRet, bool enableIX) const
@@ -1534,10 +1714,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
     if(nResult < 0) nResult = 0;
 
     if (nResult < 6){
-        std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-        if (i != mapTxLocks.end()){
-            sigs = (*i).second.CountSignatures();
-        }
+        sigs = txLockManager.GetLockSignatures(nTXHash);
         if(sigs >= INSTANTX_SIGNATURES_REQUIRED){
             return nInstantXDepth+nResult;
         }
@@ -1548,12 +1725,7 @@ int GetInputAgeIX(uint256 nTXHash, CTxIn& vin)
 
 int GetIXConfirmations(uint256 nTXHash)
 {
-    int sigs = 0;
-
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()){
-        sigs = (*i).second.CountSignatures();
-    }
+    int sigs = txLockManager.GetLockSignatures(nTXHash);
     if(sigs >= INSTANTX_SIGNATURES_REQUIRED){
         return nInstantXDepth;
     }
@@ -1980,12 +2152,15 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
             if (pblock->IsProofOfStake())
                 setStakeSeenOrphan.insert(pblock->GetProofOfStake());
 
-            // Ask this guy to fill in what we're missing
-            PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(hash));
-            // ppcoin: getblocks may not obtain the ancestor block rejected
-            // earlier by duplicate-stake check so we ask for it again directly
-            if (!IsInitialBlockDownload())
-                pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(pblock2)));
+            // Ask this guy to fill in what we're missing, unless the block came from
+            // the headers-first download, which requests its parents anyway
+            if (!headerChain.Contains(hash)) {
+                PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(hash));
+                // ppcoin: getblocks may not obtain the ancestor block rejected
+                // earlier by duplicate-stake check so we ask for it again directly
+                if (!IsInitialBlockDownload())
+                    pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(pblock2)));
+            }
         }
         return true;
     }
@@ -2009,6 +2184,7 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
                 CDataStream ss(mi->second->vchBlock, SER_DISK, CLIENT_VERSION);
                 ss >> block;
             }
+            block.CacheTransactionHashes();
             block.BuildMerkleTree();
             if (block.AcceptBlock())
                 vWorkQueue.push_back(mi->second->hashBlock);
@@ -2119,6 +2295,8 @@ bool LoadBlockIndex(bool fAllowNew)
             return error("LoadBlockIndex() : genesis block not accepted");
     }
 
+    PublishChainSnapshot();
+
     return true;
 }
 
@@ -2235,11 +2413,22 @@ void PrintBlockTree()
     }
 }
 
+/** Second half of importing a block, run by the block verification queue */
+static void ConnectImportedBlock(boost::shared_ptr<int> pnLoaded, CBlock& block, CNode* pfrom, bool fValid)
+{
+    LOCK(cs_main);
+    if (!fValid)
+        error("LoadExternalBlockFile() : CheckBlock FAILED for block %s", block.GetHash().ToString());
+    else if (ProcessBlock(NULL, &block))
+        (*pnLoaded)++;
+}
+
 bool LoadExternalBlockFile(FILE* fileIn)
 {
     int64_t nStart = GetTimeMillis();
 
-    int nLoaded = 0;
+    // Written by the block verification queue's connect thread, read after Drain()
+    boost::shared_ptr<int> pnLoaded(new int(0));
     {
         try {
             CAutoFile blkdat(fileIn, SER_DISK, CLIENT_VERSION);
@@ -2277,14 +2466,12 @@ bool LoadExternalBlockFile(FILE* fileIn)
                 blkdat >> nSize;
                 if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
                 {
-                    CBlock block;
-                    blkdat >> block;
-                    LOCK(cs_main);
-                    if (ProcessBlock(NULL,&block))
-                    {
-                        nLoaded++;
-                        nPos += 4 + nSize;
-                    }
+                    // Blocks are checked in parallel and connected in file order
+                    boost::shared_ptr<CBlock> pblock(new CBlock());
+                    blkdat >> *pblock;
+                    pblock->CacheTransactionHashes();
+                    blockVerifyQueue.Push(pblock, NULL, boost::bind(&ConnectImportedBlock, pnLoaded, _1, _2, _3));
+                    nPos += 4 + nSize;
                 }
             }
         }
@@ -2293,6 +2480,8 @@ bool LoadExternalBlockFile(FILE* fileIn)
                    __PRETTY_FUNCTION__);
         }
     }
+    blockVerifyQueue.Drain();
+    int nLoaded = *pnLoaded;
     LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
 }
@@ -2391,6 +2580,138 @@ string GetWarnings(string strFor)
 // Messages
 //
 
+/** Second half of handling a "tx" or "sstx" message, run under cs_main by the transaction verification queue */
+static void TransactionAccepted(std::string strCommand, CInv inv, CTransaction& tx, CNode* pfrom, CValidationState& state, bool fAccepted, bool fMissingInputs)
+{
+    vector<uint256> vWorkQueue;
+    vector<uint256> vEraseQueue;
+
+    if (fAccepted)
+    {
+        RelayTransaction(tx);
+        vWorkQueue.push_back(inv.hash);
+        vEraseQueue.push_back(inv.hash);
+
+        // Recursively process any orphan transactions that depended on this one
+        for (unsigned int i = 0; i < vWorkQueue.size(); i++)
+        {
+            map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
+            if (itByPrev == mapOrphanTransactionsByPrev.end())
+                continue;
+            for (set<uint256>::iterator mi = itByPrev->second.begin();
+                 mi != itByPrev->second.end();
+                 ++mi)
+            {
+                const uint256& orphanTxHash = *mi;
+                COrphanTx& orphanTx = mapOrphanTransactions[orphanTxHash];
+                bool fMissingInputs2 = false;
+
+                if (AcceptToMemoryPool(mempool, state, orphanTx.tx, true, &fMissingInputs2))
+                {
+                    LogPrint("mempool", "   accepted orphan tx %s\n", orphanTxHash.ToString());
+                    RelayTransaction(orphanTx.tx);
+                    vWorkQueue.push_back(orphanTxHash);
+                    vEraseQueue.push_back(orphanTxHash);
+                }
+                else if (!fMissingInputs2)
+                {
+                    // invalid or too-little-fee orphan
+                    vEraseQueue.push_back(orphanTxHash);
+                    LogPrint("mempool", "   removed orphan tx %s\n", orphanTxHash.ToString());
+                }
+            }
+        }
+
+        BOOST_FOREACH(uint256 hash, vEraseQueue)
+            EraseOrphanTx(hash);
+    }
+    else if (fMissingInputs)
+    {
+        AddOrphanTx(tx, pfrom->GetId());
+
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+        unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
+        if (nEvicted > 0)
+            LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+    } else if (pfrom->fWhitelisted) {
+        // Always relay transactions received from whitelisted peers, even
+        // if they are already in the mempool (allowing the node to function
+        // as a gateway for nodes hidden behind it).
+
+        RelayTransaction(tx);
+    }
+
+    if(strCommand == "sstx"){
+        CInv inv(MSG_SSTX, tx.GetHash());
+        RelayInv(inv);
+    }
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS))
+    {
+        LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+            pfrom->id, pfrom->cleanSubVer,
+            state.GetRejectReason());
+        pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+         if (tx.nDoS) pfrom->Misbehaving(tx.nDoS);
+    }
+}
+
+/** Second half of handling a "block" message, run by the block verification queue */
+static void ConnectReceivedBlock(uint64_t nTxHashesStart, CBlock& block, CNode* pfrom, bool fValid)
+{
+    uint256 hashBlock = block.GetHash();
+
+    LOCK(cs_main);
+    // A body that fails CheckBlock (merkle root, transactions, signature) may just be a bad
+    // copy of a good header, only the peer is punished for it. What AcceptBlock rejects
+    // after that is part of what the header commits to, and takes its branch with it.
+    bool fHeaderInvalid = false;
+    if (!fValid)
+        error("ProcessBlock() : CheckBlock FAILED for block %s", hashBlock.ToString());
+    else
+    {
+        int nDoSChecked = block.nDoS;
+        if (ProcessBlock(pfrom, &block))//TODO (Amir): Change ProcessBlock?
+            mapAlreadyAskedFor.erase(CInv(MSG_BLOCK, hashBlock)); //TODO (Amir): Not needed?
+        else
+            fHeaderInvalid = block.nDoS > nDoSChecked;
+    }
+    // Should equal the transaction count: one txid per transaction from receipt to connect
+    LogPrint("bench", "  - %u transaction hashes for %u transactions in block %s\n",
+        GetTransactionHashCount() - nTxHashesStart, block.vtx.size(), hashBlock.ToString());
+    if (block.nDoS) pfrom->Misbehaving(block.nDoS);
+    if (fHeaderInvalid && headerChain.Contains(hashBlock))
+        headerChain.Invalidate(hashBlock);
+    if (fSecMsgEnabled)
+        SecureMsgScanBlock(block);
+}
+
+// Serializes the stormnode, budget, sandstorm and spork state of the extension message
+// handlers across message handler threads. The handlers take cs_main themselves where
+// they need chain state, so this is taken before cs_main, never while holding it.
+static CCriticalSection cs_extensionMessages;
+
+// The inventory types whose state belongs to the extension message handlers
+static bool IsExtensionInv(const CInv& inv)
+{
+    switch (inv.type)
+    {
+    case MSG_SPORK:
+    case MSG_STORMNODE_WINNER:
+    case MSG_BUDGET_VOTE:
+    case MSG_BUDGET_PROPOSAL:
+    case MSG_BUDGET_FINALIZED_VOTE:
+    case MSG_BUDGET_FINALIZED:
+    case MSG_STORMNODE_ANNOUNCE:
+    case MSG_STORMNODE_PING:
+        return true;
+    }
+    return false;
+}
+
+// Requires cs_main. The extension types are looked up by AlreadyHaveExtension.
 bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
 {
     switch (inv.type)
@@ -2401,17 +2722,31 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
         txInMap = mempool.exists(inv.hash);
         return txInMap ||
                mapOrphanTransactions.count(inv.hash) ||
+               txVerifyQueue.Contains(inv.hash) ||
                txdb.ContainsTx(inv.hash);
         }
 
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash) ||
-               mapOrphanBlocks.count(inv.hash);
+               mapOrphanBlocks.count(inv.hash) ||
+               blockVerifyQueue.Contains(inv.hash);
     case MSG_TXLOCK_REQUEST:
-        return mapTxLockReq.count(inv.hash) ||
-               mapTxLockReqRejected.count(inv.hash);
+        return txLockManager.HasRequest(inv.hash) ||
+               txLockManager.IsRejected(inv.hash);
     case MSG_TXLOCK_VOTE:
-        return mapTxLockVote.count(inv.hash);
+        return txLockManager.HasVote(inv.hash);
+    case MSG_TXLOCK_PROOF:
+        return txLockManager.GetLockSignatures(inv.hash) >= INSTANTX_SIGNATURES_REQUIRED;
+    }
+    // Don't know what it is, just say we already got one
+    return true;
+}
+
+// Requires cs_extensionMessages.
+bool static AlreadyHaveExtension(const CInv& inv)
+{
+    switch (inv.type)
+    {
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_STORMNODE_WINNER:
@@ -2457,14 +2792,24 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
     return true;
 }
 
+// Serialized "block" message of the best block, see ProcessGetData. Requires cs_main.
+static CSharedMessage msgBestBlock;
+static uint256 hashMsgBestBlock;
+
+/** Send a relayed object and keep the message in relay memory for the next peers asking for it */
+void static PushRelayMessage(CNode* pfrom, const CInv& inv, const char* pszCommand, const CDataStream& ss)
+{
+    CSharedMessage msg = MakeSharedMessage(pszCommand, ss);
+    AddRelayMessage(inv, msg);
+    pfrom->PushSharedMessage(msg);
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -2477,13 +2822,30 @@ void static ProcessGetData(CNode* pfrom)
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
             {
+                LOCK(cs_main);
                 // Send block from disk
                 map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
+                    if (inv.hash == hashBestChain)
+                    {
+                        // Most peers ask for a new block right after it was announced,
+                        // serialize it once for all of them
+                        if (hashMsgBestBlock != inv.hash)
+                        {
+                            CBlock block;
+                            block.ReadFromDisk((*mi).second);
+                            msgBestBlock = MakeSharedMessage("block", block);
+                            hashMsgBestBlock = inv.hash;
+                        }
+                        pfrom->PushSharedMessage(msgBestBlock);
+                    }
+                    else
+                    {
+                        CBlock block;
+                        block.ReadFromDisk((*mi).second);
+                        pfrom->PushMessage("block", block);
+                    }
 
                     // Trigger them to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
@@ -2500,20 +2862,21 @@ void static ProcessGetData(CNode* pfrom)
             }
             else if (inv.IsKnownType())
             {
+                // sandstorm transactions and the stormnode, budget and spork maps, the rest has locks of its own
+                LOCK(cs_extensionMessages);
                 if(fDebug) LogPrintf("ProcessGetData -- Starting \n");
                 // Send stream from relay memory
                 bool pushed = false;
 
-                /*
-                    {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                // Sandstorm broadcast transactions go out as "sstx", not as the relayed "tx"
+                if (!(inv.type == MSG_TX && mapSandstormBroadcastTxes.count(inv.hash)))
+                {
+                    CSharedMessage msg = FindRelayMessage(inv);
+                    if (msg) {
+                        pfrom->PushSharedMessage(msg);
                         pushed = true;
                     }
                 }
-                */
 
                 if (!pushed && inv.type == MSG_TX) {
                    string txHash = inv.hash.ToString().c_str();
@@ -2536,26 +2899,38 @@ void static ProcessGetData(CNode* pfrom)
                             CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                             ss.reserve(1000);
                             ss << tx;
-                            pfrom->PushMessage("tx", ss);
+                            PushRelayMessage(pfrom, inv, "tx", ss);
                             pushed = true;
                         }
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if(mapTxLockVote.count(inv.hash)){
+                    CConsensusVote vote;
+                    if(txLockManager.GetVote(inv.hash, vote)){
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
+                        ss << vote;
+                        PushRelayMessage(pfrom, inv, "txlvote", ss);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if(mapTxLockReq.count(inv.hash)){
+                    CTransaction txLockReq;
+                    if(txLockManager.GetRequest(inv.hash, txLockReq)){
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("txlreq", ss);
+                        ss << txLockReq;
+                        PushRelayMessage(pfrom, inv, "txlreq", ss);
+                        pushed = true;
+                    }
+                }
+                if (!pushed && inv.type == MSG_TXLOCK_PROOF) {
+                    CTxLockProof proof;
+                    if(txLockManager.GetLockProof(inv.hash, proof)){
+                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                        ss.reserve(INSTANTX_SIGNATURES_TOTAL * 250);
+                        ss << proof;
+                        PushRelayMessage(pfrom, inv, "txlproof", ss);
                         pushed = true;
                     }
                 }
@@ -2564,7 +2939,7 @@ void static ProcessGetData(CNode* pfrom)
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
+                        PushRelayMessage(pfrom, inv, "spork", ss);
                         pushed = true;
                     }
                 }
@@ -2573,7 +2948,7 @@ void static ProcessGetData(CNode* pfrom)
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         ss << stormnodePayments.mapStormnodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("snw", ss);
+                        PushRelayMessage(pfrom, inv, "snw", ss);
                         pushed = true;
                     }
                 }
@@ -2582,7 +2957,7 @@ void static ProcessGetData(CNode* pfrom)
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         ss << budget.mapSeenStormnodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("svote", ss);
+                        PushRelayMessage(pfrom, inv, "svote", ss);
                         pushed = true;
                     }
                 }
@@ -2591,7 +2966,7 @@ void static ProcessGetData(CNode* pfrom)
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         ss << budget.mapSeenStormnodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("sprop", ss);
+                        PushRelayMessage(pfrom, inv, "sprop", ss);
                         pushed = true;
                     }
                 }
@@ -2601,7 +2976,7 @@ void static ProcessGetData(CNode* pfrom)
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
+                        PushRelayMessage(pfrom, inv, "fbvote", ss);
                         pushed = true;
                     }
                 }
@@ -2611,7 +2986,7 @@ void static ProcessGetData(CNode* pfrom)
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
+                        PushRelayMessage(pfrom, inv, "fbs", ss);
                         pushed = true;
                     }
                 }
@@ -2635,7 +3010,7 @@ void static ProcessGetData(CNode* pfrom)
                         ss.reserve(1000);
                         ss << snodeman.mapSeenStormnodePing[inv.hash];
                         ss << fRequested;
-                        pfrom->PushMessage("snp", ss);
+                        PushRelayMessage(pfrom, inv, "snp", ss);
                         pushed = true;
                     }
                 }
@@ -2646,7 +3021,10 @@ void static ProcessGetData(CNode* pfrom)
             }
 
             // Track requests for our stuff.
-            g_signals.Inventory(inv.hash);
+            {
+                LOCK(cs_main);
+                g_signals.Inventory(inv.hash);
+            }
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK )
                 break;
@@ -2667,6 +3045,41 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+// requires cs_extensionMessages
+static void ProcessExtensionMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
+{
+    sandStormPool.ProcessMessageSandstorm(pfrom, strCommand, vRecv);
+    snodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    budget.ProcessMessage(pfrom, strCommand, vRecv);
+    stormnodePayments.ProcessMessageStormnodePayments(pfrom, strCommand, vRecv);
+    ProcessMessageInstantX(pfrom, strCommand, vRecv);
+    ProcessSpork(pfrom, strCommand, vRecv);
+    if (fSecMsgEnabled)
+        SecureMsgReceiveData(pfrom, strCommand, vRecv);
+    // Ignore unknown commands for extensibility
+}
+
+// Messages held back until sigVerifyQueue recovered the keys of their signatures
+static void ProcessVerifiedMessages(CNode* pfrom)
+{
+    string strCommand;
+    CDataStream vRecv(SER_NETWORK, PROTOCOL_VERSION);
+    while (!pfrom->fDisconnect && sigVerifyQueue.PopReady(pfrom->GetId(), strCommand, vRecv))
+    {
+        try
+        {
+            LOCK(cs_extensionMessages);
+            ProcessExtensionMessage(pfrom, strCommand, vRecv);
+        }
+        catch (boost::thread_interrupted) {
+            throw;
+        }
+        catch (std::exception& e) {
+            PrintExceptionContinue(&e, "ProcessVerifiedMessages()");
+        }
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -2879,6 +3292,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             return error("message inv size() = %u", vInv.size());
         }
 
+        // The extension handlers' maps are looked up first, cs_extensionMessages is never taken under cs_main
+        vector<bool> vHaveExtension(vInv.size(), false);
+        {
+            LOCK(cs_extensionMessages);
+            for (unsigned int nInv = 0; nInv < vInv.size(); nInv++)
+                if (IsExtensionInv(vInv[nInv]))
+                    vHaveExtension[nInv] = AlreadyHaveExtension(vInv[nInv]);
+        }
+
         LOCK(cs_main);
         CTxDB txdb("r");
 
@@ -2889,17 +3311,19 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             boost::this_thread::interruption_point();
             pfrom->AddInventoryKnown(inv);
 
-            bool fAlreadyHave = AlreadyHave(txdb, inv);
+            bool fAlreadyHave = IsExtensionInv(inv) ? vHaveExtension[nInv] : AlreadyHave(txdb, inv);
             LogPrint("net", "  got inventory: %s  %s\n", inv.ToString(), fAlreadyHave ? "have" : "new");
 
             if (!fAlreadyHave) {
                if (!fImporting && !fReindex) {
-                   if (inv.type == MSG_BLOCK)
+                   if (inv.type == MSG_BLOCK && headerChain.Contains(inv.hash))
+                       UpdateBestKnownHeader(State(pfrom->GetId()), inv.hash); // fetched by the header chain download
+                   else if (inv.type == MSG_BLOCK)
                        AddBlockToQueue(pfrom->GetId(), inv.hash);
                    else
                        pfrom->AskFor(inv);
                }
-            } else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
+            } else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash) && !headerChain.Contains(inv.hash)) {
                PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(inv.hash));
                // In case we are on a very long side-chain, it is possible that we already have
                // the last block in an inv bundle sent in response to getblocks. Try to detect
@@ -2996,7 +3420,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
 
         vector<CBlock> vHeaders;
-        int nLimit = 2000;
+        int nLimit = MAX_HEADERS_RESULTS;
         LogPrint("net", "getheaders %d to %s\n", (pindex ? pindex->nHeight : -1), hashStop.ToString());
         for (; pindex; pindex = pindex->pnext)
         {
@@ -3008,10 +3432,51 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == "headers" && !fImporting && !fReindex) // Ignore headers received while importing
+    {
+        vector<CBlock> vHeaders;
+        vRecv >> vHeaders;
+        if (vHeaders.size() > MAX_HEADERS_RESULTS)
+        {
+            pfrom->Misbehaving(20);
+            return error("headers message size = %u", vHeaders.size());
+        }
+
+        LOCK(cs_main);
+        CNodeState *state = State(pfrom->GetId());
+        state->nHeadersRequestTime = 0;
+
+        // The reply starts right after the last block of our locator the peer has
+        if (!vHeaders.empty())
+            UpdateBestKnownHeader(state, vHeaders[0].hashPrevBlock);
+
+        BOOST_FOREACH(const CBlock& header, vHeaders)
+        {
+            CValidationState stateHeader;
+            if (!headerChain.AcceptHeader(header, stateHeader))
+            {
+                int nDoS;
+                if (stateHeader.IsInvalid(nDoS) && nDoS > 0)
+                {
+                    pfrom->Misbehaving(nDoS);
+                    return error("invalid header received");
+                }
+                // Too far ahead of our blocks, continue once they caught up
+                break;
+            }
+            UpdateBestKnownHeader(state, header.GetHash());
+        }
+
+        if (state->fSyncStarted && vHeaders.size() < MAX_HEADERS_RESULTS)
+        {
+            state->fHeadersComplete = true;
+            LogPrint("net", "header sync with peer=%d complete at height %d\n", pfrom->id, headerChain.Height());
+        }
+    }
+
+
     else if (strCommand == "tx"|| strCommand == "sstx")
     {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
 
         //stormnode signed transaction
@@ -3023,19 +3488,30 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         CTxDB txdb("r");
 
         if(strCommand == "tx") {
-               CInv inv(MSG_TX, tx.GetHash());
-            // Check for recently rejected (and do other quick existence checks)
-            if (AlreadyHave(txdb, inv))
-                return true;
-
             vRecv >> tx;
+            tx.CacheHash();
+            inv = CInv(MSG_TX, tx.GetHash());
+            // Check for recently rejected (and do other quick existence checks),
+            // the transaction verification threads change the mempool and orphans under cs_main
+            {
+                LOCK(cs_main);
+                if (AlreadyHave(txdb, inv))
+                    return true;
+            }
         } else if (strCommand == "sstx") {
-               CInv inv(MSG_SSTX, tx.GetHash());
-            // Check for recently rejected (and do other quick existence checks)
-            if (AlreadyHave(txdb, inv))
-                return true;
             //these allow sasternodes to publish a limited amount of free transactions
             vRecv >> tx >> vin >> vchSig >> sigTime;
+            tx.CacheHash();
+            inv = CInv(MSG_SSTX, tx.GetHash());
+            // Check for recently rejected (and do other quick existence checks)
+            {
+                LOCK(cs_main);
+                if (AlreadyHave(txdb, inv))
+                    return true;
+            }
+
+            // The stormnode list and the sandstorm broadcasts belong to the extension message handlers
+            LOCK(cs_extensionMessages);
 
             CStormnode* psn = snodeman.Find(vin);
                 if(psn != NULL)
@@ -3074,107 +3550,41 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        mapAlreadyAskedFor.erase(inv); 
-
-        if (AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, allowFree))
         {
-            RelayTransaction(tx);
-            vWorkQueue.push_back(inv.hash);
-            vEraseQueue.push_back(inv.hash);
-
-            // Recursively process any orphan transactions that depended on this one
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const uint256& orphanTxHash = *mi;
-                    COrphanTx& orphanTx = mapOrphanTransactions[orphanTxHash];
-                    bool fMissingInputs2 = false;
-
-                    if (AcceptToMemoryPool(mempool, state, orphanTx.tx, true, &fMissingInputs2))
-                    {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanTxHash.ToString());
-                        RelayTransaction(orphanTx.tx);
-                        vWorkQueue.push_back(orphanTxHash);
-                        vEraseQueue.push_back(orphanTxHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        // invalid or too-little-fee orphan
-                        vEraseQueue.push_back(orphanTxHash);
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanTxHash.ToString());
-                    }
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
-        }
-        else if (fMissingInputs)
-        {
-            AddOrphanTx(tx, pfrom->GetId());
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
-            if (nEvicted > 0)
-                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
-        } else if (pfrom->fWhitelisted) {
-            // Always relay transactions received from whitelisted peers, even
-            // if they are already in the mempool (allowing the node to function
-            // as a gateway for nodes hidden behind it).
-
-            RelayTransaction(tx);
-        }
-
-        if(strCommand == "sstx"){
-            CInv inv(MSG_SSTX, tx.GetHash());
-            RelayInv(inv);
+            LOCK(cs_main);
+            mapAlreadyAskedFor.erase(inv);
         }
 
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS))
-        {
-            LogPrint("mempool", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                pfrom->id, pfrom->cleanSubVer,
-                state.GetRejectReason());
-            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-             if (tx.nDoS) pfrom->Misbehaving(tx.nDoS);
-        }
-    }        
+        // Scripts are verified on the transaction verification threads, TransactionAccepted
+        // relays the transaction and handles orphans under cs_main afterwards
+        txVerifyQueue.Push(tx, pfrom, true, allowFree, boost::bind(&TransactionAccepted, strCommand, inv, _1, _2, _3, _4, _5));
+    }
 
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
-        CBlock block;
-        vRecv >> block;
-        uint256 hashBlock = block.GetHash();
+        boost::shared_ptr<CBlock> pblock(new CBlock());
+        vRecv >> *pblock;
+        uint256 hashBlock = pblock->GetHash();
+        uint64_t nTxHashesStart = GetTransactionHashCount();
+        pblock->CacheTransactionHashes();
 
         LogPrint("net", "received block %s\n", hashBlock.ToString());
 
         CInv inv(MSG_BLOCK, hashBlock);
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-        // Remember who we got this block from.
-        mapBlockSource[inv.hash] = pfrom->GetId();
-        MarkBlockAsReceived(inv.hash, pfrom->GetId());
+        {
+            LOCK(cs_main);
+            // Remember who we got this block from.
+            mapBlockSource[inv.hash] = pfrom->GetId();
+            MarkBlockAsReceived(inv.hash, pfrom->GetId());
+            State(pfrom->GetId())->nLastBlockReceive = GetTimeMicros();
+        }
 
-        if (ProcessBlock(pfrom, &block))//TODO (Amir): Change ProcessBlock?
-            mapAlreadyAskedFor.erase(inv); //TODO (Amir): Not needed?
-        if (block.nDoS) pfrom->Misbehaving(block.nDoS);
-        if (fSecMsgEnabled)
-            SecureMsgScanBlock(block);
+        // Context-free checks run on the block verification threads,
+        // ConnectReceivedBlock does the rest under cs_main in arrival order
+        blockVerifyQueue.Push(pblock, pfrom, boost::bind(&ConnectReceivedBlock, nTxHashesStart, _1, _2, _3), false);
     }
 
     // This asymmetric behavior for inbound and outbound connections was introduced
@@ -3391,15 +3801,11 @@ else if (strCommand == "filterload")
     }
     else
     {
-        sandStormPool.ProcessMessageSandstorm(pfrom, strCommand, vRecv);
-        snodeman.ProcessMessage(pfrom, strCommand, vRecv);
-        budget.ProcessMessage(pfrom, strCommand, vRecv);
-        stormnodePayments.ProcessMessageStormnodePayments(pfrom, strCommand, vRecv);
-        ProcessMessageInstantX(pfrom, strCommand, vRecv);
-        ProcessSpork(pfrom, strCommand, vRecv);
-    if (fSecMsgEnabled)
-        SecureMsgReceiveData(pfrom, strCommand, vRecv);
-        // Ignore unknown commands for extensibility
+        // These handlers keep state of their own that assumes a single message
+        // handler thread, so they don't run for several peers at once
+        LOCK(cs_extensionMessages);
+        if (!DeferStormnodeMessage(pfrom->GetId(), strCommand, vRecv))
+            ProcessExtensionMessage(pfrom, strCommand, vRecv);
     }
 
 
@@ -3434,12 +3840,18 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    ProcessVerifiedMessages(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
             break;
 
+        // Leave the rest to the next message handler pass once the budget is spent
+        if (pfrom->nMsgBudget <= 0)
+            break;
+
         // get next message
         CNetMessage& msg = *it;
 
@@ -3452,6 +3864,11 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // Leave a block to a later pass while the verification queue is full, rather than
+        // wait for room with the peer's other messages and the handler thread held up
+        if (strncmp(msg.hdr.pchCommand, "block", CMessageHeader::COMMAND_SIZE) == 0 && blockVerifyQueue.IsFull())
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -3483,11 +3900,13 @@ bool ProcessMessages(CNode* pfrom)
         {
             LogPrintf("ProcessMessages(%s, %u bytes) : CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n",
                strCommand, nMessageSize, nChecksum, hdr.nChecksum);
+            pfrom->nMsgBudget -= GetMessageCost(strCommand, nMessageSize);
             continue;
         }
 
         // Process message
         bool fRet = false;
+        int64_t nTimeStart = GetTimeMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
@@ -3519,10 +3938,15 @@ bool ProcessMessages(CNode* pfrom)
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        pfrom->RecordMessageTime(strCommand, GetTimeMicros() - nTimeStart);
+        pfrom->nMsgBudget -= GetMessageCost(strCommand, nMessageSize);
+
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED\n", strCommand, nMessageSize);
 
-        break;
+        // this maintains the order of responses
+        if (!pfrom->vRecvGetData.empty())
+            break;
     }
 
     // In case the connection got shut down, its receive buffer was wiped
@@ -3567,10 +3991,16 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!lockMain)
             return true;
 
-        // Start block sync
+        // Start block sync: headers from the sync node, blocks from everyone who has them
         if (pto->fStartSync && !fImporting && !fReindex) {
             pto->fStartSync = false;
-            PushGetBlocks(pto, pindexBest, uint256(0));
+            CNodeState *state = State(pto->GetId());
+            if (!state->fSyncStarted) {
+                state->fSyncStarted = true;
+                nSyncStarted++;
+            }
+            state->fHeadersComplete = false;
+            PushGetHeaders(pto, state);
         }
 
         // Resend wallet transactions that haven't gotten in a block yet
@@ -3730,6 +4160,41 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             state.vBlocksInFlight.front().nTime < state.nLastBlockProcess - 2*BLOCK_DOWNLOAD_TIMEOUT*1000000) {
             LogPrintf("Peer %s is stalling block download, disconnecting\n", state.name.c_str());
             pto->fDisconnect = true;
+            ForgetUndeliveredHeaders(pto->GetId(), &state);
+        }
+        // Peers holding up the download window for too long make room for others.
+        if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
+            LogPrintf("Peer=%d is stalling the block download window, disconnecting\n", pto->id);
+            pto->fDisconnect = true;
+            ForgetUndeliveredHeaders(pto->GetId(), &state);
+        }
+
+        //
+        // Message: getheaders
+        //
+        if (state.nHeadersRequestTime && state.nHeadersRequestTime < nNow - 1000000 * HEADERS_RESPONSE_TIMEOUT) {
+            state.nHeadersRequestTime = 0;
+            if (state.fSyncStarted && !state.fHeadersComplete) {
+                LogPrintf("Peer=%d did not answer getheaders, requesting block inventory instead\n", pto->id);
+                state.fHeadersComplete = true;
+                PushGetBlocks(pto, pindexBest, uint256(0));
+            }
+        }
+        if (!pto->fDisconnect && !fImporting && !fReindex && state.nHeadersRequestTime == 0) {
+            if (state.fSyncStarted && !state.fHeadersComplete) {
+                // Keep going while the headers stay within reach of our blocks
+                if (headerChain.Height() + (int)MAX_HEADERS_RESULTS <= chainActive.Height() + MAX_HEADERS_AHEAD)
+                    PushGetHeaders(pto, &state);
+            } else if (!pto->fClient && nNow >= state.nNextHeadersProbe &&
+                       pto->nStartingHeight >= headerChain.FirstMissing() &&
+                       GetBestKnownHeight(&state) < std::min(headerChain.Height(), headerChain.FirstMissing() + BLOCK_DOWNLOAD_WINDOW)) {
+                // Ask for a single header a couple of windows ahead: the peer only has it
+                // (and answers) if it has that block and all blocks before it
+                int nProbe = std::min(headerChain.Height(), headerChain.FirstMissing() + 2 * BLOCK_DOWNLOAD_WINDOW - 1);
+                state.nHeadersRequestTime = nNow;
+                state.nNextHeadersProbe = nNow + 1000000 * HEADERS_RESPONSE_TIMEOUT;
+                pto->PushMessage("getheaders", CBlockLocator(), headerChain.GetHash(nProbe));
+            }
         }
 
         //
@@ -3747,6 +4212,23 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 vGetData.clear();
             }
         }
+        if (!pto->fDisconnect && !pto->fClient && !fImporting && !fReindex && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            vector<uint256> vToDownload;
+            NodeId staller = -1;
+            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            BOOST_FOREACH(const uint256& hash, vToDownload) {
+                vGetData.push_back(CInv(MSG_BLOCK, hash));
+                MarkBlockAsInFlight(pto->GetId(), hash);
+                LogPrint("net", "Requesting block %s (%d) peer=%d\n", hash.ToString(), headerChain.GetHeight(hash), pto->id);
+            }
+            if (state.nBlocksInFlight == 0 && staller != -1) {
+                if (State(staller)->nStallingSince == 0) {
+                    State(staller)->nStallingSince = nNow;
+                    LogPrint("net", "Stall started peer=%d\n", staller);
+                }
+            }
+        }
+
         //
         // Message: getdata (non-blocks)
         //
@@ -3797,6 +4279,9 @@ CAmount CTransactionPoS::GetValueOut(CTransaction& tx) const
 
 bool CTransactionPoS::ReadFromDisk(CTransaction& tx, CDiskTxPos pos, FILE** pfileRet)
 {
+    if (!pfileRet && ReadFromBlockFile(pos.nFile, pos.nTxPos, tx))
+        return true;
+
     CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK, CLIENT_VERSION);
     if (!filein)
         return error("CTransactionPoS::ReadFromDisk() : OpenBlockFile failed");
@@ -4148,7 +4633,7 @@ enum FlushStateMode {
     FLUSH_STATE_ALWAYS
 };
 
-static filesystem::path BlockFilePath(unsigned int nFile)
+filesystem::path BlockFilePath(unsigned int nFile)
 {
     string strBlockFn = strprintf("blk%04u.dat", nFile);
     return GetDataDir() / strBlockFn;
@@ -4693,11 +5178,12 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     // New best block
     hashBestChain = hash;
     pindexBest = pindexNew;
-    pblockindexFBBHLast = NULL;
+    chainActive.SetTip(pindexNew);
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexNew->nChainTrust;
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
+    PublishChainSnapshot();
 
     uint256 nBestBlockTrust = pindexBest->nHeight != 0 ? (pindexBest->nChainTrust - pindexBest->pprev->nChainTrust) : pindexBest->nChainTrust;
 
@@ -4755,6 +5241,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
     {
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+        pindexNew->BuildSkip();
     }
 
     // ppcoin: compute chain trust score
@@ -6,6 +6,7 @@
 #ifndef DARKSILK_MAIN_H
 #define DARKSILK_MAIN_H
 
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 #include <list>
@@ -35,6 +36,14 @@ static const int COINBASE_MATURITY = 10;
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 128;
 // Timeout in seconds before considering a block download peer unresponsive.
 static const unsigned int BLOCK_DOWNLOAD_TIMEOUT = 60;
+// How far past the first missing block of the best header chain blocks are requested.
+static const int BLOCK_DOWNLOAD_WINDOW = 1024;
+// Timeout in seconds during which a peer must stall the block download window before being disconnected.
+static const unsigned int BLOCK_STALLING_TIMEOUT = 10;
+// Number of headers sent in one "headers" message.
+static const unsigned int MAX_HEADERS_RESULTS = 2000;
+// Timeout in seconds for a "headers" reply before the sync peer is asked for block inventory instead.
+static const unsigned int HEADERS_RESPONSE_TIMEOUT = 60;
 // The maximum size for mined blocks (50% OF MAX_BLOCK_SIZE)
 static const unsigned int MAX_BLOCK_SIZE_GEN = MAX_BLOCK_SIZE/2;
 // Default for -blockprioritysize, maximum space for zero/low-fee transactions
@@ -108,6 +117,36 @@ class CTxDB;
 class CTxIndex;
 class CWalletInterface;
 
+/** Immutable view of the chain tip, republished on every tip
+ *  change. Read-only RPCs answer from it without taking cs_main. */
+struct CChainSnapshot
+{
+    //! block index entries are never freed while the node runs, so the tip and
+    //! its ancestors (pprev/pskip) can be read without cs_main
+    const CBlockIndex* pindexTip;
+    uint256 hashBestChain;
+    int nHeight;
+    int64_t nTime;
+    uint256 nChainTrust;
+    int64_t nMoneySupply;
+
+    CChainSnapshot() : pindexTip(NULL), hashBestChain(0), nHeight(-1), nTime(0),
+                       nChainTrust(0), nMoneySupply(0) {}
+
+    /** Whether pindex is on the chain ending at this snapshot's tip */
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return pindexTip && pindex && pindexTip->GetAncestor(pindex->nHeight) == pindex;
+    }
+};
+
+typedef boost::shared_ptr<const CChainSnapshot> CChainSnapshotRef;
+
+/** Publish a snapshot of the current tip (requires cs_main) */
+void PublishChainSnapshot();
+/** Latest published chain snapshot; never NULL. Does not take cs_main. */
+CChainSnapshotRef GetChainSnapshot();
+
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 
@@ -181,6 +220,7 @@ bool DisconnectBlocksAndReprocess(int blocks);
 void FlushStateToDisk();
 
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
+boost::filesystem::path BlockFilePath(unsigned int nFile);
 FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode);
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false); //TODO (Amir): Is is okay to use without nFile?
 FILE* OpenDiskFile(const CDiskBlockPos &pos, const char *prefix, bool fReadOnly = false);
@@ -257,6 +297,21 @@ typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
 
 CAmount GetMinFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree, enum GetMinFee_mode mode);
 
+/** Inputs fetched by PreAcceptToMemoryPool(), used by the script checks and FinishAcceptToMemoryPool() */
+struct CMemPoolInputs
+{
+    MapPrevTx mapInputs;
+    uint256 hashBestChain; //! best block when the inputs were fetched
+};
+
+/** AcceptToMemoryPool() in three steps, so that the script checks can run without cs_main:
+ *  every check but the scripts (requires cs_main) ... */
+bool PreAcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction &tx, bool fLimitFree, bool* pfMissingInputs, bool ignoreFees, CMemPoolInputs& inputs);
+/** ... the script checks (no lock needed) ... */
+bool CheckInputScripts(const CTransaction& tx, const CMemPoolInputs& inputs);
+/** ... and re-checking the inputs against the current pool and chain, then adding the transaction (requires cs_main) */
+bool FinishAcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, CTransaction &tx, bool* pfMissingInputs, const CMemPoolInputs& inputs);
+
 class CTransactionPoS
 {
 public:
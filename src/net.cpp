@@ -36,6 +36,10 @@
 #include "i2p/i2p.h"
 #endif
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #define TOR_NET_STRING "tor"
 
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
@@ -99,6 +103,7 @@ uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
 int nMaxConnections = 200;
+bool fUseEpoll = false;
 bool fAddressesInitialized = false;
 
 #ifdef USE_NATIVE_I2P
@@ -108,7 +113,7 @@ int nI2PNodeCount = 0;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSharedMessage> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
@@ -765,9 +770,93 @@ void CNode::copyStats(CNodeStats &stats)
     
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
+
+    {
+        LOCK(cs_msgTime);
+        X(mapMsgTime);
+    }
 }
 #undef X
 
+void CNode::RecordMessageTime(const std::string& strCommand, int64_t nTime)
+{
+    LOCK(cs_msgTime);
+    std::map<std::string, CMessageTimeHistogram>::iterator it = mapMsgTime.find(strCommand);
+    if (it == mapMsgTime.end())
+    {
+        // Commands come from the peer, don't let unknown ones grow the map without bound
+        if (mapMsgTime.size() >= MAX_MSG_TIME_COMMANDS)
+            it = mapMsgTime.insert(std::make_pair(std::string("other"), CMessageTimeHistogram())).first;
+        else
+            it = mapMsgTime.insert(std::make_pair(strCommand, CMessageTimeHistogram())).first;
+    }
+    it->second.Add(nTime);
+}
+
+CMessageTimeHistogram::CMessageTimeHistogram() : nCount(0), nTotalTime(0), nMaxTime(0)
+{
+    memset(vBuckets, 0, sizeof(vBuckets));
+}
+
+int CMessageTimeHistogram::Bucket(int64_t nTime)
+{
+    int nBucket = 0;
+    while (nTime >= 2 && nBucket < MSG_TIME_BUCKETS - 1)
+    {
+        nTime >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+void CMessageTimeHistogram::Add(int64_t nTime)
+{
+    nCount++;
+    nTotalTime += nTime;
+    nMaxTime = std::max(nMaxTime, nTime);
+    vBuckets[Bucket(nTime)]++;
+}
+
+int64_t GetMessageCost(const std::string& strCommand, unsigned int nMessageSize)
+{
+    // Commands that walk the chain, the mempool or the stormnode and budget lists,
+    // or that queue a lot of data to send back
+    static const struct {
+        const char* pszCommand;
+        int64_t nCost;
+    } costs[] = {
+        { "block",      20 },
+        { "headers",    10 },
+        { "getdata",    10 },
+        { "getblocks",  20 },
+        { "getheaders", 20 },
+        { "getaddr",    10 },
+        { "mempool",    50 },
+        { "filterload", 10 },
+        { "sseg",       50 },
+        { "snget",      50 },
+        { "snvs",       50 },
+    };
+
+    int64_t nCost = 1;
+    for (unsigned int i = 0; i < ARRAYLEN(costs); i++)
+    {
+        if (strCommand == costs[i].pszCommand)
+        {
+            nCost = costs[i].nCost;
+            break;
+        }
+    }
+    return nCost + nMessageSize / MSG_COST_BYTES;
+}
+
+bool IsPriorityMessage(const std::string& strCommand)
+{
+    return strCommand == "block" || strCommand == "headers" ||
+           strCommand == "ix" || strCommand == "txlvote" ||
+           strCommand == "txlproof" || strCommand == "snp";
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 {
@@ -828,7 +917,7 @@ void AddIncomingConnection(SOCKET hSocket, const CAddress& addr)
         if (nErr != WSAEWOULDBLOCK)
             printf("socket error accept failed: %d\n", nErr);
     }
-    else if (nInbound >= GetArg("-maxconnections", 200) - MAX_OUTBOUND_CONNECTIONS)
+    else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS)
     {
         {
             LOCK(cs_setservAddNodeAddresses);
@@ -906,10 +995,10 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSharedMessage>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        const CSerializeData &data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
@@ -923,6 +1012,7 @@ void SocketSendData(CNode *pnode)
                 it++;
             } else {
                 // could not send full message; stop sending more
+                pnode->fSendBlocked = true;
                 break;
             }
         } else {
@@ -934,6 +1024,8 @@ void SocketSendData(CNode *pnode)
                     LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
                     pnode->CloseSocketDisconnect();
                 }
+                else if (nErr == WSAEWOULDBLOCK)
+                    pnode->fSendBlocked = true;
             }
             // couldn't send anything at all
             break;
@@ -949,12 +1041,194 @@ void SocketSendData(CNode *pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+/** Receive calls per node and socket handler loop, the rest waits for the next loop */
+static const int MAX_RECV_BATCH = 4;
+/** Connections accepted per listening socket and socket handler loop */
+static const int MAX_ACCEPT_BATCH = 16;
+
+#ifdef HAVE_EPOLL
+/** Events taken by one epoll_wait() */
+static const int MAX_EPOLL_EVENTS = 256;
+/** Set in the epoll data of listening sockets, the data of peer sockets is their NodeId */
+static const uint64_t EPOLL_LISTEN_TAG = 1ULL << 63;
+
+static int hEpoll = -1;
+
+static bool EpollAdd(SOCKET hSocket, uint64_t nData, uint32_t nEvents)
+{
+    struct epoll_event event;
+    event.events = nEvents;
+    event.data.u64 = nData;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hSocket, &event) == 0)
+        return true;
+    // a listening I2P socket that became a peer connection
+    if (errno == EEXIST && epoll_ctl(hEpoll, EPOLL_CTL_MOD, hSocket, &event) == 0)
+        return true;
+    LogPrintf("epoll_ctl add failed: %s\n", NetworkErrorString(errno));
+    return false;
+}
+#endif
+
+// requires LOCK(cs_vRecvMsg)
+static bool CanReceive(CNode* pnode)
+{
+    // Read more unless the buffer already holds a complete message and is over the flood limit;
+    // the message handler has to catch up first
+    return pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+           pnode->GetTotalRecvSize() <= ReceiveFloodSize();
+}
+
+/** Read once from the socket of pnode, returns false if there was nothing to read or the socket is gone.
+ *  Requires cs_vRecvMsg. */
+static bool ReceiveNodeData(CNode* pnode)
+{
+    // only the socket handler thread receives, so one buffer serves all peers
+    // typical socket buffer is 8K-64K
+    static char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        pnode->RecordBytesRecv(nBytes);
+        return pnode->hSocket != INVALID_SOCKET;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+/** Accept one connection on a listening socket, returns false if there was none */
+static bool AcceptConnection(const ListenSocket& hListenSocket)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
+
+    if (hSocket != INVALID_SOCKET)
+        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+            LogPrintf("Warning: Unknown socket family\n");
+
+    bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (hSocket == INVALID_SOCKET)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %d\n", nErr);
+        return false;
+    }
+    else if (!fUseEpoll && !IsSelectableSocket(hSocket))
+    {
+        LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
+        CloseSocket(hSocket);
+    }
+    else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS)
+    {
+        LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
+        CloseSocket(hSocket);
+    }
+    else if (CNode::IsBanned(addr) && !whitelisted)
+    {
+        LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
+        CloseSocket(hSocket);
+    }
+    else
+    {
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        pnode->fWhitelisted = whitelisted;
+
+        {
+            LOCK(cs_vNodes);
+            vNodes.push_back(pnode);
+        }
+    }
+    return true;
+}
+
+static void InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %ds\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
 #ifdef USE_NATIVE_I2P
     int nPrevI2PNodeCount = 0;
-#endif    
+#endif
+
+#ifdef HAVE_EPOLL
+    // Nodes whose sockets are registered, by the NodeId in their epoll data
+    std::map<NodeId, CNode*> mapEpollNodes;
+    // Nodes to service in the next loop: events, new sockets and work left over
+    std::set<NodeId> setEpollActive;
+    int64_t nEpollLastSweep = 0;
+    std::set<SOCKET> setEpollI2PListen;
+
+    if (fUseEpoll)
+    {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1)
+        {
+            LogPrintf("epoll_create1 failed: %s, using select()\n", NetworkErrorString(errno));
+            fUseEpoll = false;
+        }
+        else
+        {
+            LogPrintf("Using epoll for the socket handler\n");
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+                EpollAdd(hListenSocket.socket, EPOLL_LISTEN_TAG | hListenSocket.socket, EPOLLIN);
+        }
+    }
+#endif
+    // Some node was left with data in its socket by MAX_RECV_BATCH, don't wait for events
+    bool fRecvPending = false;
 
     //
     // Disconnect nodes
@@ -980,6 +1254,11 @@ void ThreadSocketHandler()
 
                 // close socket and cleanup
                 pnode->CloseSocketDisconnect();
+#ifdef HAVE_EPOLL
+                // closing the socket unregistered it
+                mapEpollNodes.erase(pnode->GetId());
+                setEpollActive.erase(pnode->GetId());
+#endif
 
                 // hold in disconnected pool until all refs are released
                 if (pnode->fNetworkNode || pnode->fInbound)
@@ -1046,6 +1325,59 @@ void ThreadSocketHandler()
         FD_ZERO(&fdsetRecv);
         FD_ZERO(&fdsetSend);
         FD_ZERO(&fdsetError);
+        std::set<SOCKET> setListenReady;
+
+#ifdef HAVE_EPOLL
+        if (fUseEpoll)
+        {
+            // Sockets are registered once, peer sockets by the service loop below.
+            // Peer events only set flags, the service loop acts on them.
+#ifdef USE_NATIVE_I2P
+            BOOST_FOREACH(const I2PListenSocket& hI2PListenSocket, vhI2PListenSocket) {
+                if (hI2PListenSocket.socket != INVALID_SOCKET && !setEpollI2PListen.count(hI2PListenSocket.socket))
+                {
+                    if (EpollAdd(hI2PListenSocket.socket, EPOLL_LISTEN_TAG | hI2PListenSocket.socket, EPOLLIN))
+                        setEpollI2PListen.insert(hI2PListenSocket.socket);
+                }
+            }
+#endif
+            struct epoll_event events[MAX_EPOLL_EVENTS];
+            int nEvents = epoll_wait(hEpoll, events, MAX_EPOLL_EVENTS, fRecvPending ? 0 : timeout.tv_usec / 1000);
+            boost::this_thread::interruption_point();
+
+            if (nEvents == SOCKET_ERROR)
+            {
+                int nErr = WSAGetLastError();
+                if (nErr != WSAEINTR)
+                {
+                    LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                    MilliSleep(timeout.tv_usec/1000);
+                }
+                nEvents = 0;
+            }
+
+            for (int i = 0; i < nEvents; i++)
+            {
+                uint64_t nData = events[i].data.u64;
+                if (nData & EPOLL_LISTEN_TAG)
+                {
+                    setListenReady.insert((SOCKET)(nData & ~EPOLL_LISTEN_TAG));
+                    continue;
+                }
+                std::map<NodeId, CNode*>::iterator it = mapEpollNodes.find((NodeId)nData);
+                if (it == mapEpollNodes.end())
+                    continue;
+                CNode* pnode = it->second;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    pnode->fRecvReady = true;
+                if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                    pnode->fSendEvent = true;
+                setEpollActive.insert(pnode->GetId());
+            }
+        }
+        else
+#endif
+        {
         SOCKET hSocketMax = 0;
         bool have_fds = false;
 
@@ -1099,9 +1431,7 @@ void ThreadSocketHandler()
                 }
                 {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    if (lockRecv && CanReceive(pnode))
                         FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
@@ -1125,62 +1455,27 @@ void ThreadSocketHandler()
             MilliSleep(timeout.tv_usec/1000);
         }
 
+#ifdef USE_NATIVE_I2P
+        BOOST_FOREACH(const I2PListenSocket& hI2PListenSocket, vhI2PListenSocket)
+            if (hI2PListenSocket.socket != INVALID_SOCKET && FD_ISSET(hI2PListenSocket.socket, &fdsetRecv))
+                setListenReady.insert(hI2PListenSocket.socket);
+#endif
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+                setListenReady.insert(hListenSocket.socket);
+        }
+
 
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
-        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
         {
-            struct sockaddr_storage sockaddr;
-            socklen_t len = sizeof(sockaddr);
-            SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
-            CAddress addr;
-            int nInbound = 0;
-
-            if (hSocket != INVALID_SOCKET)
-                if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                    LogPrintf("Warning: Unknown socket family\n");
-
-            bool whitelisted = hListenSocket.whitelisted || CNode::IsWhitelistedRange(addr);
-            {
-                LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                    if (pnode->fInbound)
-                        nInbound++;
-            }
-
-            if (hSocket == INVALID_SOCKET)
-            {
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK)
-                    LogPrintf("socket error accept failed: %d\n", nErr);
-            }
-            else if (!IsSelectableSocket(hSocket))
-            {
-                LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
-                CloseSocket(hSocket);
-            }
-            else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS)
-            {
-                LogPrint("net", "connection from %s dropped (full)\n", addr.ToString());
-                CloseSocket(hSocket);
-            }
-            else if (CNode::IsBanned(addr) && !whitelisted)
+            if (hListenSocket.socket != INVALID_SOCKET && setListenReady.count(hListenSocket.socket))
             {
-                LogPrintf("connection from %s dropped (banned)\n", addr.ToString());
-                CloseSocket(hSocket);
-            }
-            else
-            {
-                CNode* pnode = new CNode(hSocket, addr, "", true);
-                pnode->AddRef();
-                pnode->fWhitelisted = whitelisted;
-
-                {
-                    LOCK(cs_vNodes);
-                    vNodes.push_back(pnode);
-                }
+                for (int i = 0; i < MAX_ACCEPT_BATCH; i++)
+                    if (!AcceptConnection(hListenSocket))
+                        break;
             }
         }
 
@@ -1202,7 +1497,7 @@ void ThreadSocketHandler()
                     BindListenNativeI2P(I2PSocket);
                 haveInvalids = true;
             }
-            else if (FD_ISSET(I2PSocket, &fdsetRecv))
+            else if (setListenReady.count(I2PSocket))
             {
                 const size_t bufSize = NATIVE_I2P_DESTINATION_SIZE + 1;
                 char pchBuf[bufSize];
@@ -1246,11 +1541,15 @@ void ThreadSocketHandler()
                     printf("I2P listen socket recv error %d\n", nErr);
                     CloseSocket(I2PSocket);
                 }
+#ifdef HAVE_EPOLL
+                // no longer listening: closed above, or registered again as a peer socket
+                setEpollI2PListen.erase(I2PSocket);
+#endif
                 I2PSocket = INVALID_SOCKET;  // we've saved this socket in a CNode or closed it, so we can safety reset it anyway
                 BindListenNativeI2P(I2PSocket);
             }
         }
-    
+
 
 #endif
 
@@ -1260,60 +1559,137 @@ void ThreadSocketHandler()
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
+#ifdef HAVE_EPOLL
+            if (fUseEpoll)
+            {
+                // Only the nodes in setEpollActive are serviced, all of them once a second
+                // for the inactivity checks and for sends that nobody got an event for
+                bool fSweep = (GetTime() != nEpollLastSweep);
+                if (fSweep)
+                    nEpollLastSweep = GetTime();
+
+                // Register the sockets of new nodes
+                if (fSweep || vNodes.size() != mapEpollNodes.size())
+                {
+                    BOOST_FOREACH(CNode* pnode, vNodes)
+                    {
+                        if (pnode->fEpollAdded || pnode->hSocket == INVALID_SOCKET)
+                            continue;
+                        pnode->fEpollAdded = true;
+                        if (!EpollAdd(pnode->hSocket, pnode->GetId(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET))
+                        {
+                            pnode->CloseSocketDisconnect();
+                            continue;
+                        }
+                        mapEpollNodes[pnode->GetId()] = pnode;
+                        // data may have arrived before the socket was registered
+                        pnode->fRecvReady = true;
+                        setEpollActive.insert(pnode->GetId());
+                    }
+                }
+
+                if (fSweep)
+                    vNodesCopy = vNodes;
+                else
+                {
+                    BOOST_FOREACH(NodeId id, setEpollActive)
+                    {
+                        std::map<NodeId, CNode*>::iterator it = mapEpollNodes.find(id);
+                        if (it != mapEpollNodes.end())
+                            vNodesCopy.push_back(it->second);
+                    }
+                }
+                setEpollActive.clear();
+            }
+            else
+#endif
             vNodesCopy = vNodes;
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->AddRef();
         }
+        fRecvPending = false;
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             boost::this_thread::interruption_point();
 
-            //
-            // Receive
-            //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+
+#ifdef HAVE_EPOLL
+            if (fUseEpoll)
             {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (!pnode->fEpollAdded)
+                    continue;
+
+                //
+                // Send first: like with select(), don't receive more from a peer
+                // that does not take what we have for it
+                //
+                bool fSendPending = false;
                 {
-                    if (pnode->GetTotalRecvSize() > ReceiveFloodSize()) {
-                        if (!pnode->fDisconnect)
-                            LogPrintf("socket recv flood control disconnect (%u bytes)\n", pnode->GetTotalRecvSize());
-                        pnode->CloseSocketDisconnect();
-                    }
-                    else {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            pnode->RecordBytesRecv(nBytes);
-                        }
-                        else if (nBytes == 0)
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend)
+                    {
+                        if (pnode->fSendEvent)
                         {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
+                            pnode->fSendBlocked = false;
+                            pnode->fSendEvent = false;
                         }
-                        else if (nBytes < 0)
+                        if (!pnode->fSendBlocked && !pnode->vSendMsg.empty())
+                            SocketSendData(pnode);
+                        fSendPending = !pnode->vSendMsg.empty();
+                    }
+                }
+
+                //
+                // Receive until the socket would block, for at most MAX_RECV_BATCH reads
+                //
+                if (pnode->fRecvReady && !fSendPending)
+                {
+                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                    if (lockRecv)
+                    {
+                        for (int i = 0; i < MAX_RECV_BATCH && pnode->fRecvReady && CanReceive(pnode); i++)
                         {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                            pnode->fRecvReady = ReceiveNodeData(pnode);
+                            // same flood control as with select(): a message still incomplete past the limit ends the connection
+                            if (CanReceive(pnode) && pnode->GetTotalRecvSize() > ReceiveFloodSize())
                             {
                                 if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+                                    LogPrintf("socket recv flood control disconnect (%u bytes)\n", pnode->GetTotalRecvSize());
                                 pnode->CloseSocketDisconnect();
+                                pnode->fRecvReady = false;
                             }
                         }
+                        if (pnode->fRecvReady && CanReceive(pnode))
+                            fRecvPending = true;
+                    }
+                }
+
+                // come back to what is left: unread data, also while the handler drains a full buffer, and unsent data
+                if (pnode->hSocket != INVALID_SOCKET && (pnode->fRecvReady || fSendPending))
+                    setEpollActive.insert(pnode->GetId());
+
+                InactivityCheck(pnode);
+                continue;
+            }
+#endif
+
+            //
+            // Receive
+            //
+            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv)
+                {
+                    if (pnode->GetTotalRecvSize() > ReceiveFloodSize()) {
+                        if (!pnode->fDisconnect)
+                            LogPrintf("socket recv flood control disconnect (%u bytes)\n", pnode->GetTotalRecvSize());
+                        pnode->CloseSocketDisconnect();
                     }
+                    else
+                        ReceiveNodeData(pnode);
                 }
             }
 
@@ -1332,25 +1708,7 @@ void ThreadSocketHandler()
             //
             // Inactivity checking
             //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %ds\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-            }
+            InactivityCheck(pnode);
         }
         {
             LOCK(cs_vNodes);
@@ -1789,78 +2147,181 @@ void static StartSync(const vector<CNode*> &vNodes) {
     }
 }
 
-void ThreadMessageHandler()
+//
+// The message handler threads work through the nodes in passes. A pass hands each
+// node to one thread at a time, so a peer's messages are processed in order and
+// never concurrently, while different peers are processed in parallel. Nodes whose
+// next message is in the priority lane (see IsPriorityMessage) are handed out first.
+// Within a pass ProcessMessages handles messages of a node until its budget is spent,
+// see GetMessageCost. The thread that has handed out the last node of a pass starts
+// the next one right away instead of waiting for the others; a node another thread
+// is still working on is skipped in the new pass.
+//
+static boost::mutex cs_msgHandler;
+static boost::condition_variable condMsgHandler;
+//! holds a reference to each node, handed out nodes are set to NULL and released by their thread
+static std::vector<CNode*> vMsgHandlerPass;
+static size_t nMsgHandlerNext = 0;      //! next node of the pass to hand out
+static std::set<CNode*> setMsgHandlerBusy;  //! handed out and still being processed
+static bool fMsgHandlerStarting = false;
+static bool fMsgHandlerSleep = true;
+static CNode* pnodeMsgHandlerTrickle = NULL;
+
+void WakeMessageHandler()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_msgHandler);
+        fMsgHandlerSleep = false;
+    }
+    messageHandlerCondition.notify_one();
+}
+
+static bool HasPriorityMessage(CNode* pnode)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+    if (!lockRecv || pnode->vRecvMsg.empty() || !pnode->vRecvGetData.empty())
+        return false;
+    const CNetMessage& msg = pnode->vRecvMsg.front();
+    return msg.complete() && IsPriorityMessage(msg.hdr.GetCommand());
+}
 
-    SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
-    while (true)
+// requires cs_msgHandler, which is released while sleeping
+static void StartMessageHandlerPass(boost::unique_lock<boost::mutex>& lock)
+{
     {
-        bool fHaveSyncNode = false;
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vMsgHandlerPass)
+            if (pnode)
+                pnode->Release();
+    }
+    vMsgHandlerPass.clear();
+    nMsgHandlerNext = 0;
 
-        vector<CNode*> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
-                pnode->AddRef();
-                if (pnode == pnodeSync)
-                    fHaveSyncNode = true;
-            }
+    if (fMsgHandlerSleep)
+        messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+    fMsgHandlerSleep = true;
+
+    bool fHaveSyncNode = false;
+
+    vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+            pnode->AddRef();
+            if (pnode == pnodeSync)
+                fHaveSyncNode = true;
         }
+    }
 
-        if (!fHaveSyncNode)
-            StartSync(vNodesCopy);
+    if (!fHaveSyncNode)
+        StartSync(vNodesCopy);
 
-        // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
+    pnodeMsgHandlerTrickle = NULL;
+    if (!vNodesCopy.empty())
+        pnodeMsgHandlerTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
-        bool fSleep = true;
+    vector<CNode*> vNormal;
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        if (HasPriorityMessage(pnode))
+            vMsgHandlerPass.push_back(pnode);
+        else
+            vNormal.push_back(pnode);
+    }
+    vMsgHandlerPass.insert(vMsgHandlerPass.end(), vNormal.begin(), vNormal.end());
+}
 
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+/** Receive and send messages of one node, returns true if it has more work waiting */
+static bool HandleNodeMessages(CNode* pnode, bool fSendTrickle)
+{
+    bool fMore = false;
+
+    if (pnode->fDisconnect)
+        return false;
+
+    // Receive messages
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv)
         {
-            if (pnode->fDisconnect)
-                continue;
+            pnode->nMsgBudget = std::min(pnode->nMsgBudget + MSG_BUDGET_QUANTUM, MSG_BUDGET_QUANTUM);
+
+            if (!n_signals.ProcessMessages(pnode))
+                pnode->CloseSocketDisconnect();
 
-            // Receive messages
+            if (pnode->nSendSize < SendBufferSize())
             {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                 {
-                    if (!n_signals.ProcessMessages(pnode))
-                        pnode->CloseSocketDisconnect();
-
-                    if (pnode->nSendSize < SendBufferSize())
-                    {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
-                        {
-                            fSleep = false;
-                        }
-                    }
+                    fMore = true;
                 }
             }
-            boost::this_thread::interruption_point();
+        }
+    }
+    boost::this_thread::interruption_point();
+
+    // Send messages
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend)
+            n_signals.SendMessages(pnode, fSendTrickle);
+    }
+    boost::this_thread::interruption_point();
+
+    return fMore;
+}
 
-            // Send messages
+void ThreadMessageHandler()
+{
+    SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    while (true)
+    {
+        CNode* pnode = NULL;
+        bool fTrickle = false;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_msgHandler);
+            while (pnode == NULL)
             {
-                TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
-                    n_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
+                if (nMsgHandlerNext >= vMsgHandlerPass.size())
+                {
+                    if (fMsgHandlerStarting)
+                    {
+                        condMsgHandler.wait(lock);
+                        continue;
+                    }
+                    fMsgHandlerStarting = true;
+                    StartMessageHandlerPass(lock);
+                    fMsgHandlerStarting = false;
+                    condMsgHandler.notify_all();
+                    continue;
+                }
+                CNode* pnodeNext = vMsgHandlerPass[nMsgHandlerNext++];
+                if (setMsgHandlerBusy.count(pnodeNext))
+                    continue;
+                // the reference of the pass goes with the node
+                vMsgHandlerPass[nMsgHandlerNext - 1] = NULL;
+                setMsgHandlerBusy.insert(pnodeNext);
+                pnode = pnodeNext;
             }
-            boost::this_thread::interruption_point();
+            fTrickle = (pnode == pnodeMsgHandlerTrickle);
         }
 
+        bool fMore = HandleNodeMessages(pnode, fTrickle || pnode->fWhitelisted);
+
+        {
+            boost::unique_lock<boost::mutex> lock(cs_msgHandler);
+            setMsgHandlerBusy.erase(pnode);
+            if (fMore)
+                fMsgHandlerSleep = false;
+        }
+        // a pass started meanwhile may be waiting for work
+        if (fMore)
+            messageHandlerCondition.notify_one();
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->Release();
+            pnode->Release();
         }
-
-        if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
     }
 }
 
@@ -2133,7 +2594,12 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMsgHandlerThreads = GetArg("-msghandlerthreads", DEFAULT_MSG_HANDLER_THREADS);
+    nMsgHandlerThreads = std::max(1, std::min(nMsgHandlerThreads, MAX_MSG_HANDLER_THREADS));
+    if (nMsgHandlerThreads > 1)
+        LogPrintf("Using %d message handler threads\n", nMsgHandlerThreads);
+    for (int i = 0; i < nMsgHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
@@ -2209,30 +2675,36 @@ void CExplicitNetCleanup::callCleanup()
     delete tmp; // Stroustrup's gonna kill me for that
 }
 
-void RelayTransaction(const CTransaction& tx)
+void AddRelayMessage(const CInv& inv, const CSharedMessage& msg)
+{
+    LOCK(cs_mapRelay);
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
+    {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
+    }
+
+    // Save original serialized message so newer versions are preserved
+    if (mapRelay.insert(std::make_pair(inv, msg)).second)
+        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+}
+
+CSharedMessage FindRelayMessage(const CInv& inv)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << tx;
-    RelayTransaction(tx, ss);
+    LOCK(cs_mapRelay);
+    map<CInv, CSharedMessage>::iterator mi = mapRelay.find(inv);
+    if (mi == mapRelay.end())
+        return CSharedMessage();
+    return mi->second;
 }
 
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
+void RelayTransaction(const CTransaction& tx)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    {
-        LOCK(cs_mapRelay);
-        // Expire old relay messages
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
-        {
-            mapRelay.erase(vRelayExpiration.front().second);
-            vRelayExpiration.pop_front();
-        }
+    // Serialized once, getdata requests of all peers are answered with this copy
+    AddRelayMessage(inv, MakeSharedMessage("tx", tx));
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
-    }
     LOCK(cs_vNodes);
     BOOST_FOREACH(CNode* pnode, vNodes)
     {
@@ -2251,6 +2723,7 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll)
 {
     CInv inv(MSG_TXLOCK_REQUEST, tx.GetHash());
+    CSharedMessage msg = MakeSharedMessage("ix", tx);
 
     //broadcast the new lock
     LOCK(cs_vNodes);
@@ -2259,7 +2732,7 @@ void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll)
         if(!relayToAll && !pnode->fRelayTxes)
             continue;
 
-        pnode->PushMessage("ix", tx);
+        pnode->PushSharedMessage(msg);
     }
 }
 
@@ -2474,6 +2947,11 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nPingUsecTime = 0;
     fPingQueued = false;
     fSandStormMaster = false;
+    nMsgBudget = MSG_BUDGET_QUANTUM;
+    fSendBlocked = false;
+    fEpollAdded = false;
+    fRecvReady = false;
+    fSendEvent = false;
 
     {
         LOCK(cs_nLastNodeId);
@@ -2532,6 +3010,23 @@ void CNode::AskFor(const CInv& inv)
     mapAskFor.insert(std::make_pair(nRequestTime, inv));
 }
 
+/** Fill in the size and checksum fields of the header at the start of ss, returns the payload size */
+static unsigned int SetMessageSizeAndChecksum(CDataStream& ss)
+{
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    memcpy((char*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    assert(ss.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    return nSize;
+}
+
 void CNode::BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend)
 {
     ENTER_CRITICAL_SECTION(cs_vSend);
@@ -2569,28 +3064,49 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     if (ssSend.size() == 0)
         return;
 
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
-
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    unsigned int nChecksum = 0;
-    memcpy(&nChecksum, &hash, sizeof(nChecksum));
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    unsigned int nSize = SetMessageSizeAndChecksum(ssSend);
 
     LogPrint("net", "(%d bytes)\n", nSize);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    CSerializeData* pdata = new CSerializeData();
+    ssSend.GetAndClear(*pdata);
+    QueueSendMessage(CSharedMessage(pdata));
+
+    LEAVE_CRITICAL_SECTION(cs_vSend);
+}
+
+// requires LOCK(cs_vSend)
+void CNode::QueueSendMessage(const CSharedMessage& msg)
+{
+    vSendMsg.push_back(msg);
+    nSendSize += msg->size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
+}
 
-    LEAVE_CRITICAL_SECTION(cs_vSend);
+void CNode::PushSharedMessage(const CSharedMessage& msg)
+{
+    LOCK(cs_vSend);
+    const char* pszCommand = &(*msg)[MESSAGE_START_SIZE];
+    LogPrint("net", "sending: %s (%d bytes, shared)\n", SanitizeString(std::string(pszCommand, pszCommand + strnlen_int(pszCommand, CMessageHeader::COMMAND_SIZE))), msg->size() - CMessageHeader::HEADER_SIZE);
+
+    if (mapArgs.count("-dropmessagestest") && GetRand(GetArg("-dropmessagestest", 2)) == 0)
+    {
+        LogPrint("net", "dropmessages DROPPING SEND MESSAGE\n");
+        return;
+    }
+
+    QueueSendMessage(msg);
+}
+
+CSharedMessage FinishSharedMessage(CDataStream& ss)
+{
+    SetMessageSizeAndChecksum(ss);
+    CSerializeData* pdata = new CSerializeData();
+    ss.GetAndClear(*pdata);
+    return CSharedMessage(pdata);
 }
 
 //
@@ -9,9 +9,11 @@
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 
 #include <deque>
+#include <map>
 
 #include <stdint.h>
 
@@ -65,6 +67,19 @@ static const bool DEFAULT_UPNP = false;
 #endif
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
+/** Default for -msghandlerthreads */
+static const int DEFAULT_MSG_HANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSG_HANDLER_THREADS = 16;
+/** Cost units a peer may spend per message handler pass. Unspent budget is not carried over,
+ *  overspending (one expensive message) is paid back in the following passes. */
+static const int64_t MSG_BUDGET_QUANTUM = 100;
+/** Message bytes per cost unit, on top of the per-command cost */
+static const unsigned int MSG_COST_BYTES = 10000;
+/** Distinct commands with time histograms per peer, further commands are counted as "other" */
+static const size_t MAX_MSG_TIME_COMMANDS = 64;
+/** Buckets of the message processing time histograms */
+static const int MSG_TIME_BUCKETS = 24;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -84,8 +99,32 @@ bool StopNode();
 void SocketSendData(CNode *pnode);
 void RelayInv(CInv &inv, const int minProtoVersion = MIN_PEER_PROTO_VERSION);
 
+/** Cost charged to a peer's message budget for processing one message */
+int64_t GetMessageCost(const std::string& strCommand, unsigned int nMessageSize);
+/** True for the commands of the priority lane: blocks, headers, InstantX locks, votes and proofs, stormnode pings */
+bool IsPriorityMessage(const std::string& strCommand);
+/** Start the next message handler pass without the idle wait, for work that did not arrive from a socket */
+void WakeMessageHandler();
+
 typedef int NodeId;
 
+/** A complete message ready to send (header with size and checksum, then payload), immutable
+ *  so that one copy can sit in the send queues of any number of peers */
+typedef boost::shared_ptr<const CSerializeData> CSharedMessage;
+
+/** Fill in size and checksum of the message in ss (header first) and move it into a CSharedMessage */
+CSharedMessage FinishSharedMessage(CDataStream& ss);
+
+/** Serialize a message once, for sending it to many peers with PushSharedMessage */
+template<typename T>
+CSharedMessage MakeSharedMessage(const char* pszCommand, const T& obj)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(1000);
+    ss << CMessageHeader(pszCommand, 0) << obj;
+    return FinishSharedMessage(ss);
+}
+
 // Signals for message handling
 struct CNodeSignals
 {
@@ -141,10 +180,11 @@ extern uint64_t nLocalServices;
 extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
+extern bool fUseEpoll;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSharedMessage> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -163,6 +203,22 @@ struct LocalServiceInfo {
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 
+/** Processing times of one message command */
+class CMessageTimeHistogram
+{
+public:
+    uint64_t nCount;
+    int64_t nTotalTime;                 //! microseconds
+    int64_t nMaxTime;
+    //! vBuckets[0] counts times below 2 microseconds, vBuckets[i] times in [2^i, 2^(i+1)),
+    //! the last bucket everything longer
+    uint64_t vBuckets[MSG_TIME_BUCKETS];
+
+    CMessageTimeHistogram();
+    void Add(int64_t nTime);
+    static int Bucket(int64_t nTime);
+};
+
 class CNodeStats
 {
 public:
@@ -186,6 +242,7 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    std::map<std::string, CMessageTimeHistogram> mapMsgTime;
 };
 
 class CNetMessage {
@@ -323,8 +380,14 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSharedMessage> vSendMsg;
     CCriticalSection cs_vSend;
+    bool fSendBlocked; // requires cs_vSend: the last send found the socket buffer full
+
+    // Edge-triggered epoll state, socket handler thread only
+    bool fEpollAdded;
+    bool fRecvReady; // set by EPOLLIN, cleared once recv would block
+    bool fSendEvent; // EPOLLOUT seen, clears fSendBlocked
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -381,6 +444,9 @@ protected:
     // Basic fuzz-testing
     void Fuzz(int nChance); // modifies ssSend
 
+    // requires LOCK(cs_vSend)
+    void QueueSendMessage(const CSharedMessage& msg);
+
 public:
     uint256 hashContinue;
     bool fStartSync;
@@ -414,6 +480,12 @@ public:
     // Whether a ping is requested.
     bool fPingQueued;
 
+    // Cost units left for this message handler pass, see GetMessageCost(). Requires cs_vRecvMsg.
+    int64_t nMsgBudget;
+    // Processing time per command
+    CCriticalSection cs_msgTime;
+    std::map<std::string, CMessageTimeHistogram> mapMsgTime;
+
 CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn = false);
 ~CNode();
 
@@ -483,6 +555,8 @@ public:
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
 
+    void RecordMessageTime(const std::string& strCommand, int64_t nTime);
+
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
     {
@@ -551,6 +625,9 @@ public:
 
     void PushVersion();
 
+    /** Queue a message made with MakeSharedMessage, without copying it */
+    void PushSharedMessage(const CSharedMessage& msg);
+
     void PushMessage(const char* pszCommand)
     {
         try
@@ -853,7 +930,10 @@ public:
 
 class CTransaction;
 void RelayTransaction(const CTransaction& tx);
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+/** Keep msg for answering getdata requests for inv during the next 15 minutes */
+void AddRelayMessage(const CInv& inv, const CSharedMessage& msg);
+/** Message kept by AddRelayMessage for inv, empty if there is none */
+CSharedMessage FindRelayMessage(const CInv& inv);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll=false);    
 
 /** Access to the (IP) address database (peers.dat) */
@@ -116,6 +116,8 @@ public:
     // memory only
     mutable CScript payee;
     mutable std::vector<uint256> vMerkleTree;
+    // set once CheckBlockContextFree() has passed, so CheckBlock() under cs_main can skip it
+    bool fChecked;
 
     CBlock()
     {
@@ -141,12 +143,15 @@ public:
         vMerkleTree.clear();
         payee = CScript();
         nDoS = 0;
+        fChecked = false;
     }
 
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        if (ser_action.ForRead())
+            const_cast<CBlock*>(this)->fChecked = false;
         // ConnectBlock depends on vtx following header to generate CDiskTxPos
         if (!(nType & (SER_GETHASH|SER_BLOCKHEADERONLY)))
         {
@@ -205,17 +210,27 @@ public:
         int j = 0;
         for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
         {
-            for (int i = 0; i < nSize; i += 2)
-            {
-                int i2 = std::min(i+1, nSize-1);
-                vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                           BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
-            }
+            // Adjacent hashes of a level are contiguous, so all full pairs
+            // go through the batched double-SHA256 in one call.
+            int nPairs = nSize / 2;
+            size_t nOut = vMerkleTree.size();
+            vMerkleTree.resize(nOut + (nSize + 1) / 2);
+            SHA256D64(vMerkleTree[nOut].begin(), vMerkleTree[j].begin(), nPairs);
+            if (nSize & 1)
+                vMerkleTree.back() = Hash(BEGIN(vMerkleTree[j+nSize-1]), END(vMerkleTree[j+nSize-1]),
+                                          BEGIN(vMerkleTree[j+nSize-1]), END(vMerkleTree[j+nSize-1]));
             j += nSize;
         }
         return (vMerkleTree.empty() ? 0 : vMerkleTree.back());
     }
 
+    // Freeze the txids of a block that will not be edited again (received or read from disk)
+    void CacheTransactionHashes()
+    {
+        BOOST_FOREACH(CTransaction& tx, vtx)
+            tx.CacheHash();
+    }
+
     std::vector<uint256> GetMerkleBranch(int nIndex) const
     {
         if (vMerkleTree.empty())
@@ -249,16 +264,25 @@ public:
 
     bool WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet);
 
-    bool ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions=true);
+    bool ReadFromDisk(unsigned int nFile, unsigned int nBlockPos, bool fReadTransactions=true, bool fCheckPoW=true);
 
     std::string ToString() const;
 
     bool DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex);
     bool ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck=false);
-    bool ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions=true);
+    /** Read an indexed block. Unless fVerify is set the block is trusted to have passed
+     *  CheckBlock when it was accepted, and only its header fields and merkle root are
+     *  compared against the index instead of re-hashing the proof-of-work.
+     */
+    bool ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions=true, bool fVerify=false);
     bool SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew);
     bool AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const uint256& hashProof);
     bool CheckBlock(CValidationState& state, bool fCheckPOW=true, bool fCheckMerkleRoot=true, bool fCheckSig=true);
+    /** The part of CheckBlock that needs neither cs_main nor chain state: size, proof-of-work,
+     *  block signature, CheckTransaction, sigops and merkle root. Safe to run on any thread
+     *  for a block nobody else is touching; sets fChecked when everything passed.
+     */
+    bool CheckBlockContextFree(CValidationState& state, bool fCheckPOW=true, bool fCheckMerkleRoot=true, bool fCheckSig=true);
     bool AcceptBlock();
     bool SignBlock(CWallet& keystore, CAmount nFees);
     bool CheckBlockSignature() const;
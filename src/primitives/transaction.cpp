@@ -6,10 +6,25 @@
 #include "primitives/transaction.h"
 #include "consensus/consensus.h"
 
-CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), nTime(tx.nTime), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime)
+#include <atomic>
+
+static std::atomic<uint64_t> nTransactionHashes(0);
+
+uint64_t GetTransactionHashCount()
+{
+    return nTransactionHashes.load(std::memory_order_relaxed);
+}
+
+CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), nTime(tx.nTime), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), nDoS(tx.nDoS), fHashCached(false)
 {
 }
 
+uint256 CTransaction::ComputeHash() const
+{
+    nTransactionHashes.fetch_add(1, std::memory_order_relaxed);
+    return SerializeHash(*this);
+}
+
 std::string CTransaction::ToString() const
 {
     std::string str;
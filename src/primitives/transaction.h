@@ -249,8 +249,20 @@ public:
 
 /// The basic transaction that is broadcasted on the network and contained in
 /// blocks.  A transaction can contain multiple inputs and outputs.
+///
+/// Once a transaction has reached the point where it is no longer edited
+/// (received from a peer, read from disk, stored in the mempool) CacheHash()
+/// freezes its txid, and GetHash() returns that instead of re-serializing.
+/// Copies carry the cached hash along, so nothing may modify vin/vout or
+/// the header fields of a cached transaction or of a copy of one.
 class CTransaction
 {
+private:
+    uint256 hashCached;
+    bool fHashCached;
+
+    uint256 ComputeHash() const;
+
 public:
     static const int CURRENT_VERSION=1;
     int nVersion;
@@ -269,7 +281,7 @@ public:
     }
 
     CTransaction(int nVersion, unsigned int nTime, const std::vector<CTxIn>& vin, const std::vector<CTxOut>& vout, unsigned int nLockTime)
-        : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0)
+        : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0), fHashCached(false)
     {
     }
 
@@ -280,6 +292,8 @@ public:
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        if (ser_action.ForRead())
+            fHashCached = false;
         READWRITE(this->nVersion);
         nVersion = this->nVersion;
         READWRITE(nTime);
@@ -296,6 +310,7 @@ public:
         vout.clear();
         nLockTime = 0;
         nDoS = 0;  // Denial-of-service prevention
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -305,9 +320,20 @@ public:
 
     uint256 GetHash() const
     {
-        return SerializeHash(*this); //TODO (Amir): Use a cached result (need member variables to const).
+        return fHashCached ? hashCached : ComputeHash();
     }
 
+    /// Freeze the txid; see the class comment for when this is allowed.
+    void CacheHash()
+    {
+        if (!fHashCached) {
+            hashCached = ComputeHash();
+            fHashCached = true;
+        }
+    }
+
+    bool HasCachedHash() const { return fHashCached; }
+
     // Compute modified tx size for priority calculation (optionally given tx size)
     unsigned int CalculateModifiedSize(unsigned int nTxSize=0) const;
 
@@ -329,7 +355,8 @@ public:
 
     friend bool operator==(const CTransaction& a, const CTransaction& b)
     {
-        //TODO (Amir): Use a cached hash (need member variables to const).
+        if (a.fHashCached && b.fHashCached)
+            return a.hashCached == b.hashCached;
         return (a.nVersion  == b.nVersion &&
                 a.nTime     == b.nTime &&
                 a.vin       == b.vin &&
@@ -408,6 +435,9 @@ struct CMutableTransaction
 
 };
 
+/** Number of transaction hashes computed since startup; cached lookups are not counted. */
+uint64_t GetTransactionHashCount();
+
 class TransactionSignatureChecker : public BaseSignatureChecker
 {
 private:
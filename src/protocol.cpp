@@ -30,7 +30,8 @@ static const char* ppszTypeName[] =
     "sn quorum",
     "sn announce",
     "sn ping",
-    "sstx"
+    "sstx",
+    "tx lock proof"
 };
 
 CMessageHeader::CMessageHeader()
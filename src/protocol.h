@@ -158,7 +158,8 @@ enum {
     MSG_STORMNODE_QUORUM,
     MSG_STORMNODE_ANNOUNCE,
     MSG_STORMNODE_PING,
-    MSG_SSTX
+    MSG_SSTX,
+    MSG_TXLOCK_PROOF
 };
 
 
@@ -132,7 +132,7 @@ static bool rest_block(AcceptedConnection* conn,
 
     case RF_JSON: {
         Object objBlock = blockToJSON(block, pblockindex, false);
-        string strJSON = write_string(Value(objBlock), false) + "\n";
+        string strJSON = WriteJSON(Value(objBlock)) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
         return true;
     }
@@ -183,7 +183,7 @@ static bool rest_tx(AcceptedConnection* conn,
     case RF_JSON: {
         Object objTx;
         TxToJSON(tx, hashBlock, objTx);
-        string strJSON = write_string(Value(objTx), false) + "\n";
+        string strJSON = WriteJSON(Value(objTx)) + "\n";
         conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
         return true;
     }
@@ -6,8 +6,12 @@
 
 #include "rpc/rpcserver.h"
 #include "main.h"
+#include "blockverify.h"
+#include "txverify.h"
+#include "anon/stormnode/stormnode-sigverify.h"
 #include "kernel.h"
 #include "checkpoints.h"
+#include "txdb-leveldb.h"
 #include "utiltime.h"
 
 using namespace json_spirit;
@@ -21,10 +25,11 @@ double GetDifficulty(const CBlockIndex* blockindex)
     // minimum difficulty = 1.0.
     if (blockindex == NULL)
     {
-        if (pindexBest == NULL)
+        CChainSnapshotRef snapshot = GetChainSnapshot();
+        if (snapshot->pindexTip == NULL)
             return 1.0;
         else
-            blockindex = GetLastBlockIndex(pindexBest, false);
+            blockindex = GetLastBlockIndex(snapshot->pindexTip, false);
     }
 
     int nShift = (blockindex->nBits >> 24) & 0xff;
@@ -110,10 +115,14 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPri
 {
     Object result;
     result.push_back(Pair("hash", block.GetHash().GetHex()));
+    // Judge main chain membership against one snapshot of the tip, so this
+    // is consistent without cs_main
+    CChainSnapshotRef snapshot = GetChainSnapshot();
+    bool fInMainChain = snapshot->Contains(blockindex);
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (blockindex->IsInMainChain())
-        confirmations = nBestHeight - blockindex->nHeight + 1;
+    if (fInMainChain)
+        confirmations = snapshot->nHeight - blockindex->nHeight + 1;
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
     result.push_back(Pair("height", blockindex->nHeight));
@@ -128,8 +137,8 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPri
     result.push_back(Pair("chaintrust", leftTrim(blockindex->nChainTrust.GetHex(), '0')));
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    if (blockindex->pnext)
-        result.push_back(Pair("nextblockhash", blockindex->pnext->GetBlockHash().GetHex()));
+    if (fInMainChain && blockindex->nHeight < snapshot->nHeight)
+        result.push_back(Pair("nextblockhash", snapshot->pindexTip->GetAncestor(blockindex->nHeight + 1)->GetBlockHash().GetHex()));
 
     result.push_back(Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": "")));
     result.push_back(Pair("proofhash", blockindex->hashProof.GetHex()));
@@ -173,7 +182,7 @@ Value getbestblockhash(const Array& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    return hashBestChain.GetHex();
+    return GetChainSnapshot()->hashBestChain.GetHex();
 }
 
 Value getblockcount(const Array& params, bool fHelp)
@@ -189,7 +198,7 @@ Value getblockcount(const Array& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    return nBestHeight;
+    return GetChainSnapshot()->nHeight;
 }
 
 
@@ -202,7 +211,7 @@ Value getdifficulty(const Array& params, bool fHelp)
 
     Object obj;
     obj.push_back(Pair("proof-of-work",        GetDifficulty()));
-    obj.push_back(Pair("proof-of-stake",       GetDifficulty(GetLastBlockIndex(pindexBest, true))));
+    obj.push_back(Pair("proof-of-stake",       GetDifficulty(GetLastBlockIndex(GetChainSnapshot()->pindexTip, true))));
     return obj;
 }
 
@@ -315,11 +324,18 @@ Value getblock(const Array& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    // Only the index lookup needs cs_main; the disk read and JSON building
+    // work from the immutable index entry and the chain snapshot.
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = (*mi).second;
+    }
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
     block.ReadFromDisk(pblockindex, true);
 
     if (!fVerbose)
@@ -346,18 +362,238 @@ Value getblockbynumber(const Array& params, bool fHelp)
         throw runtime_error("Block number out of range.");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-
-    uint256 hash = *pblockindex->phashBlock;
-
-    pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex = FindBlockByHeight(nHeight);
     block.ReadFromDisk(pblockindex, true);
 
     return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
 }
 
+Value getdbstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns LevelDB statistics for the transaction database (txleveldb).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"options\" : {                (json object) options the database was opened with\n"
+            "    \"writebuffer\" : n,         (numeric) write buffer size in bytes (-dbwritebuffer)\n"
+            "    \"maxopenfiles\" : n,        (numeric) maximum number of open files (-dbmaxopenfiles)\n"
+            "    \"blocksize\" : n,           (numeric) uncompressed block size in bytes (-dbblocksize)\n"
+            "    \"compression\" : true|false, (boolean) whether blocks are compressed (-dbcompression)\n"
+            "    \"sync\" : true|false         (boolean) whether writes are fsync'd (-dbsync)\n"
+            "  },\n"
+            "  \"filesatlevel\" : [ n,... ],   (array) number of table files at each level\n"
+            "  \"approximatesize\" : {        (json object) approximate on-disk bytes per record type\n"
+            "    \"tx\" : n,\n"
+            "    ...\n"
+            "  },\n"
+            "  \"stats\" : \"...\",            (string) leveldb.stats: per-level sizes, compaction time and bytes read/written\n"
+            "  \"sstables\" : \"...\"          (string) leveldb.sstables: table files with their key ranges\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    CTxDB txdb("r");
+    const leveldb::Options& options = CTxDB::GetOpenOptions();
+
+    Object obj;
+    Object optionsObj;
+    optionsObj.push_back(Pair("writebuffer",  (uint64_t)options.write_buffer_size));
+    optionsObj.push_back(Pair("maxopenfiles", options.max_open_files));
+    optionsObj.push_back(Pair("blocksize",    (uint64_t)options.block_size));
+    optionsObj.push_back(Pair("compression",  options.compression != leveldb::kNoCompression));
+    optionsObj.push_back(Pair("sync",         GetBoolArg("-dbsync", DEFAULT_TXDB_SYNC)));
+    obj.push_back(Pair("options", optionsObj));
+
+    Array levels;
+    for (int nLevel = 0; ; nLevel++)
+    {
+        std::string strFiles;
+        if (!txdb.GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strFiles))
+            break;
+        levels.push_back(atoi(strFiles));
+    }
+    obj.push_back(Pair("filesatlevel", levels));
+
+    Object sizes;
+    const char* pszTypes[] = { "tx", "blockindex", "adr" };
+    BOOST_FOREACH(const char* pszType, pszTypes)
+        sizes.push_back(Pair(pszType, (uint64_t)txdb.GetApproximateSize(pszType)));
+    obj.push_back(Pair("approximatesize", sizes));
+
+    std::string strStats, strTables;
+    txdb.GetProperty("leveldb.stats", strStats);
+    txdb.GetProperty("leveldb.sstables", strTables);
+    obj.push_back(Pair("stats", strStats));
+    obj.push_back(Pair("sstables", strTables));
+
+    return obj;
+}
+
+Value compactdb(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "compactdb\n"
+            "\nCompacts the transaction database (txleveldb) while the node keeps running.\n"
+            "This can take a long time on a large database.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"sizebefore\" : n,   (numeric) approximate database size in bytes before compaction\n"
+            "  \"sizeafter\" : n,    (numeric) approximate database size in bytes after compaction\n"
+            "  \"time\" : n          (numeric) time spent compacting in milliseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("compactdb", "")
+            + HelpExampleRpc("compactdb", "")
+        );
+
+    CTxDB txdb("r");
+    const char* pszTypes[] = { "tx", "blockindex", "adr" };
+
+    uint64_t nSizeBefore = 0;
+    BOOST_FOREACH(const char* pszType, pszTypes)
+        nSizeBefore += txdb.GetApproximateSize(pszType);
+
+    int64_t nStart = GetTimeMillis();
+    txdb.Compact();
+    int64_t nElapsed = GetTimeMillis() - nStart;
+
+    uint64_t nSizeAfter = 0;
+    BOOST_FOREACH(const char* pszType, pszTypes)
+        nSizeAfter += txdb.GetApproximateSize(pszType);
+
+    LogPrintf("compactdb: txleveldb compacted in %dms, approximate size %d -> %d bytes\n", nElapsed, nSizeBefore, nSizeAfter);
+
+    Object obj;
+    obj.push_back(Pair("sizebefore", nSizeBefore));
+    obj.push_back(Pair("sizeafter",  nSizeAfter));
+    obj.push_back(Pair("time",       nElapsed));
+    return obj;
+}
+
+Value getblockverifystats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getblockverifystats\n"
+            "\nReturns the state of the block verification queue and the time spent in each stage.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workers\" : n,           (numeric) number of verification threads (-blockverifythreads), 0 if blocks are verified inline\n"
+            "  \"queued\" : n,            (numeric) blocks waiting to be checked\n"
+            "  \"checked\" : n,           (numeric) blocks checked and waiting to be connected\n"
+            "  \"processed\" : n,         (numeric) blocks handed to ProcessBlock since startup\n"
+            "  \"rejected\" : n,          (numeric) blocks that failed the context-free checks\n"
+            "  \"waitms\" : x.xxx,        (numeric) average time from receipt until a thread started checking\n"
+            "  \"checkms\" : x.xxx,       (numeric) average time spent in the context-free checks\n"
+            "  \"connectwaitms\" : x.xxx, (numeric) average time between the check finishing and connecting\n"
+            "  \"connectms\" : x.xxx      (numeric) average time spent connecting, mostly under cs_main\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockverifystats", "")
+            + HelpExampleRpc("getblockverifystats", "")
+        );
+
+    CBlockVerifyQueue::Stats stats = blockVerifyQueue.GetStats();
+    double nCount = std::max(stats.nProcessed, (uint64_t)1);
+
+    Object obj;
+    obj.push_back(Pair("workers",       std::max(stats.nWorkers, 0)));
+    obj.push_back(Pair("queued",        (uint64_t)stats.nQueued));
+    obj.push_back(Pair("checked",       (uint64_t)stats.nChecked));
+    obj.push_back(Pair("processed",     stats.nProcessed));
+    obj.push_back(Pair("rejected",      stats.nRejected));
+    obj.push_back(Pair("waitms",        stats.nWaitTime * 0.001 / nCount));
+    obj.push_back(Pair("checkms",       stats.nCheckTime * 0.001 / nCount));
+    obj.push_back(Pair("connectwaitms", stats.nConnectWaitTime * 0.001 / nCount));
+    obj.push_back(Pair("connectms",     stats.nConnectTime * 0.001 / nCount));
+    return obj;
+}
+
+Value gettxverifystats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gettxverifystats\n"
+            "\nReturns the state of the queue admitting relayed transactions to the memory pool.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workers\" : n,           (numeric) number of verification threads (-txverifythreads), 0 if transactions are verified inline\n"
+            "  \"queued\" : n,            (numeric) transactions waiting for a thread\n"
+            "  \"processed\" : n,         (numeric) transactions handled since startup\n"
+            "  \"accepted\" : n,          (numeric) transactions accepted to the memory pool since startup\n"
+            "  \"acceptedpersec\" : x.xx, (numeric) transactions accepted per second, averaged over about a minute\n"
+            "  \"lockwaitms\" : x.xxx,    (numeric) average time spent waiting for cs_main per transaction\n"
+            "  \"lockholdms\" : x.xxx,    (numeric) average time cs_main was held per transaction\n"
+            "  \"scriptms\" : x.xxx       (numeric) average time spent verifying scripts, without holding cs_main\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettxverifystats", "")
+            + HelpExampleRpc("gettxverifystats", "")
+        );
+
+    CTxVerifyQueue::Stats stats = txVerifyQueue.GetStats();
+    double nCount = std::max(stats.nProcessed, (uint64_t)1);
+
+    Object obj;
+    obj.push_back(Pair("workers",        std::max(stats.nWorkers, 0)));
+    obj.push_back(Pair("queued",         (uint64_t)stats.nQueued));
+    obj.push_back(Pair("processed",      stats.nProcessed));
+    obj.push_back(Pair("accepted",       stats.nAccepted));
+    obj.push_back(Pair("acceptedpersec", stats.dAcceptRate));
+    obj.push_back(Pair("lockwaitms",     stats.nLockWaitTime * 0.001 / nCount));
+    obj.push_back(Pair("lockholdms",     stats.nLockHoldTime * 0.001 / nCount));
+    obj.push_back(Pair("scriptms",       stats.nScriptTime * 0.001 / nCount));
+    return obj;
+}
+
+Value getsigverifystats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigverifystats\n"
+            "\nReturns the state of the threads verifying stormnode, budget, payment and InstantX signatures.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"workers\" : n,           (numeric) number of verification threads (-sigverifythreads), 0 if signatures are verified inline\n"
+            "  \"queued\" : n,            (numeric) signatures waiting for a thread\n"
+            "  \"waiting\" : n,           (numeric) messages held back until their signatures are verified\n"
+            "  \"cached\" : n,            (numeric) recovered keys remembered\n"
+            "  \"recovered\" : n,         (numeric) signatures verified by the threads since startup\n"
+            "  \"recoveredinline\" : n,   (numeric) signatures verified on the message handler thread\n"
+            "  \"cachehits\" : n,         (numeric) signatures found already verified\n"
+            "  \"duplicates\" : n,        (numeric) signatures that were already queued for another message\n"
+            "  \"deferred\" : n,          (numeric) messages held back since startup\n"
+            "  \"dropped\" : n,           (numeric) messages dropped because the queue or the peer's share was full\n"
+            "  \"recoverms\" : x.xxx      (numeric) average time a thread spent per signature\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsigverifystats", "")
+            + HelpExampleRpc("getsigverifystats", "")
+        );
+
+    CSigVerifyQueue::Stats stats = sigVerifyQueue.GetStats();
+    double nCount = std::max(stats.nRecovered, (uint64_t)1);
+
+    Object obj;
+    obj.push_back(Pair("workers",         std::max(stats.nWorkers, 0)));
+    obj.push_back(Pair("queued",          (uint64_t)stats.nQueued));
+    obj.push_back(Pair("waiting",         (uint64_t)stats.nWaiting));
+    obj.push_back(Pair("cached",          (uint64_t)stats.nCached));
+    obj.push_back(Pair("recovered",       stats.nRecovered));
+    obj.push_back(Pair("recoveredinline", stats.nRecoveredInline));
+    obj.push_back(Pair("cachehits",       stats.nCacheHits));
+    obj.push_back(Pair("duplicates",      stats.nDuplicates));
+    obj.push_back(Pair("deferred",        stats.nDeferred));
+    obj.push_back(Pair("dropped",         stats.nDropped));
+    obj.push_back(Pair("recoverms",       stats.nRecoverTime * 0.001 / nCount));
+    return obj;
+}
+
 // ppcoin: get information of sync-checkpoint
 Value getcheckpoint(const Array& params, bool fHelp)
 {
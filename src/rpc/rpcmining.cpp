@@ -801,6 +801,7 @@ Value submitblock(const Array& params, bool fHelp)
     catch (std::exception &e) {
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
     }
+    block.CacheTransactionHashes();
 
     bool fAccepted = ProcessBlock(NULL, &block);
     if (!fAccepted)
@@ -16,6 +16,7 @@
 #include "clientversion.h"
 #include "init.h"
 #include "main.h"
+#include "headerchain.h"
 #include "net.h"
 #include "netbase.h"
 #include "timedata.h"
@@ -59,6 +60,10 @@ Value getinfo(const Array& params, bool fHelp)
     }
 #endif
     obj.push_back(Pair("blocks",        (int)nBestHeight));
+    {
+        LOCK(cs_main);
+        obj.push_back(Pair("headers",   headerChain.Height()));
+    }
     obj.push_back(Pair("timeoffset",    (int64_t)GetTimeOffset()));
     obj.push_back(Pair("moneysupply",   ValueFromAmount(pindexBest->nMoneySupply)));
     obj.push_back(Pair("connections",   (int)vNodes.size()));
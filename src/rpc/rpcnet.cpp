@@ -78,7 +78,10 @@ Value getpeerinfo(const Array& params, bool fHelp)
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "getpeerinfo\n"
-            "Returns data about each connected network node.");
+            "Returns data about each connected network node.\n"
+            "\"msgtime\" holds per received command: \"count\", \"total\" and \"max\" processing time\n"
+            "in microseconds, and \"histogram\", where entry 0 counts times below 2us, entry i times\n"
+            "from 2^i to 2^(i+1)us and the last entry everything longer.");
 
     vector<CNodeStats> vstats;
     CopyNodeStats(vstats);
@@ -107,7 +110,34 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         obj.push_back(Pair("banscore", stats.nMisbehavior));
         obj.push_back(Pair("syncnode", stats.fSyncNode));
+        CNodeStateStats statestats;
+        if (GetNodeStateStats(stats.nodeid, statestats)) {
+            obj.push_back(Pair("synced_headers", statestats.nSyncHeight));
+            Array heights;
+            BOOST_FOREACH(int height, statestats.vHeightInFlight)
+                heights.push_back(height);
+            obj.push_back(Pair("inflight", heights));
+        }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        Object msgtime;
+        for (std::map<std::string, CMessageTimeHistogram>::const_iterator it = stats.mapMsgTime.begin(); it != stats.mapMsgTime.end(); ++it)
+        {
+            const CMessageTimeHistogram& hist = it->second;
+            Object cmd;
+            cmd.push_back(Pair("count", hist.nCount));
+            cmd.push_back(Pair("total", hist.nTotalTime));
+            cmd.push_back(Pair("max", hist.nMaxTime));
+            // trailing empty buckets are left out
+            int nBuckets = MSG_TIME_BUCKETS;
+            while (nBuckets > 0 && hist.vBuckets[nBuckets - 1] == 0)
+                nBuckets--;
+            Array histogram;
+            for (int i = 0; i < nBuckets; i++)
+                histogram.push_back(hist.vBuckets[i]);
+            cmd.push_back(Pair("histogram", histogram));
+            msgtime.push_back(Pair(it->first, cmd));
+        }
+        obj.push_back(Pair("msgtime", msgtime));
         ret.push_back(obj);
     }
 
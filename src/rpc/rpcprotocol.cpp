@@ -15,7 +15,13 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <errno.h>
+#include <limits>
+#include <locale>
+#include <sstream>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "rpc/rpcprotocol.h"
 #include "util.h"
@@ -115,6 +121,37 @@ string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength, const
         FormatFullVersion());
 }
 
+string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char *contentType)
+{
+    return strprintf(
+            "HTTP/1.1 %d %s\r\n"
+            "Date: %s\r\n"
+            "Connection: %s\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Content-Type: %s\r\n"
+            "Server: darksilk-json-rpc/%s\r\n"
+            "\r\n",
+        nStatus,
+        httpStatusDescription(nStatus),
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        contentType,
+        FormatFullVersion());
+}
+
+string HTTPChunk(const string& strData)
+{
+    // An empty chunk terminates the body, so never emit one by accident
+    if (strData.empty())
+        return "";
+    return strprintf("%x\r\n", strData.size()) + strData + "\r\n";
+}
+
+string HTTPLastChunk()
+{
+    return "0\r\n\r\n";
+}
+
 string HTTPReply(int nStatus, const string& strMsg, bool keepalive,
                  bool headersOnly, const char *contentType)
 {
@@ -260,7 +297,7 @@ string JSONRPCRequest(const string& strMethod, const Array& params, const Value&
     request.push_back(Pair("method", strMethod));
     request.push_back(Pair("params", params));
     request.push_back(Pair("id", id));
-    return write_string(Value(request), false) + "\n";
+    return WriteJSON(Value(request)) + "\n";
 }
 
 Object JSONRPCReplyObj(const Value& result, const Value& error, const Value& id)
@@ -278,7 +315,7 @@ Object JSONRPCReplyObj(const Value& result, const Value& error, const Value& id)
 string JSONRPCReply(const Value& result, const Value& error, const Value& id)
 {
     Object reply = JSONRPCReplyObj(result, error, id);
-    return write_string(Value(reply), false) + "\n";
+    return WriteJSON(Value(reply)) + "\n";
 }
 
 Object JSONRPCError(int code, const string& message)
@@ -288,3 +325,430 @@ Object JSONRPCError(int code, const string& message)
     error.push_back(Pair("message", message));
     return error;
 }
+
+//
+// JSON text on the RPC path. Requests are parsed and replies written by hand instead
+// of through the Boost Spirit grammar behind read_string/write_string, which is slow
+// to parse and goes through an ostream for every token. Output is byte-for-byte what
+// write_string(value, false) produces, including the 8-digit fixed reals, except that
+// valid UTF-8 is passed through instead of escaped byte by byte. Numbers are written
+// and read the same whatever the process locale.
+//
+
+static const char* const pszHexUpper = "0123456789ABCDEF";
+
+/** Length of the well-formed UTF-8 sequence starting at p, 0 if there is none */
+static size_t UTF8SequenceLength(const char* p, const char* pend)
+{
+    unsigned char c = *p;
+    size_t nLen;
+    unsigned char nMin = 0x80, nMax = 0xbf; // allowed range of the second byte
+    if (c >= 0xc2 && c <= 0xdf)
+        nLen = 2;
+    else if (c >= 0xe0 && c <= 0xef) {
+        nLen = 3;
+        if (c == 0xe0) nMin = 0xa0;      // overlong
+        else if (c == 0xed) nMax = 0x9f; // surrogates
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        nLen = 4;
+        if (c == 0xf0) nMin = 0x90;      // overlong
+        else if (c == 0xf4) nMax = 0x8f; // above U+10FFFF
+    } else
+        return 0;
+
+    if ((size_t)(pend - p) < nLen)
+        return 0;
+    if ((unsigned char)p[1] < nMin || (unsigned char)p[1] > nMax)
+        return 0;
+    for (size_t i = 2; i < nLen; i++)
+        if ((unsigned char)p[i] < 0x80 || (unsigned char)p[i] > 0xbf)
+            return 0;
+    return nLen;
+}
+
+static void AppendJSONString(string& strOut, const string& str)
+{
+    strOut += '"';
+    const char* p = str.data();
+    const char* pend = p + str.size();
+    while (p < pend)
+    {
+        // Copy runs of characters that need no escaping in one go
+        const char* pstart = p;
+        while (p < pend && (unsigned char)*p >= 0x20 && (unsigned char)*p < 0x7f && *p != '"' && *p != '\\')
+            p++;
+        strOut.append(pstart, p);
+        if (p == pend)
+            break;
+
+        if ((unsigned char)*p >= 0x80)
+        {
+            size_t nLen = UTF8SequenceLength(p, pend);
+            if (nLen > 0) {
+                strOut.append(p, nLen);
+                p += nLen;
+                continue;
+            }
+        }
+
+        unsigned char c = *p++;
+        switch (c)
+        {
+            case '"':  strOut += "\\\""; break;
+            case '\\': strOut += "\\\\"; break;
+            case '\b': strOut += "\\b"; break;
+            case '\f': strOut += "\\f"; break;
+            case '\n': strOut += "\\n"; break;
+            case '\r': strOut += "\\r"; break;
+            case '\t': strOut += "\\t"; break;
+            default:
+                strOut += "\\u00";
+                strOut += pszHexUpper[c >> 4];
+                strOut += pszHexUpper[c & 0x0f];
+        }
+    }
+    strOut += '"';
+}
+
+void AppendJSON(string& strOut, const Value& value)
+{
+    char buf[64];
+    switch (value.type())
+    {
+        case obj_type:
+        {
+            const Object& obj = value.get_obj();
+            strOut += '{';
+            for (Object::const_iterator it = obj.begin(); it != obj.end(); ++it)
+            {
+                if (it != obj.begin())
+                    strOut += ',';
+                AppendJSONString(strOut, it->name_);
+                strOut += ':';
+                AppendJSON(strOut, it->value_);
+            }
+            strOut += '}';
+            break;
+        }
+        case array_type:
+        {
+            const Array& arr = value.get_array();
+            strOut += '[';
+            for (Array::const_iterator it = arr.begin(); it != arr.end(); ++it)
+            {
+                if (it != arr.begin())
+                    strOut += ',';
+                AppendJSON(strOut, *it);
+            }
+            strOut += ']';
+            break;
+        }
+        case str_type:
+            AppendJSONString(strOut, value.get_str());
+            break;
+        case bool_type:
+            strOut += value.get_bool() ? "true" : "false";
+            break;
+        case int_type:
+            if (value.is_uint64())
+                snprintf(buf, sizeof(buf), "%llu", (unsigned long long)value.get_uint64());
+            else
+                snprintf(buf, sizeof(buf), "%lld", (long long)value.get_int64());
+            strOut += buf;
+            break;
+        case real_type:
+        {
+            // %.8f only differs between locales in the decimal point, which may be more than one byte
+            int n = snprintf(buf, sizeof(buf), "%.8f", value.get_real());
+            const char* pbuf = buf;
+            const char* pbufend = buf + std::min(std::max(n, 0), (int)sizeof(buf) - 1);
+            while (pbuf < pbufend && (*pbuf == '-' || isdigit((unsigned char)*pbuf)))
+                strOut += *pbuf++;
+            if (pbuf < pbufend && pbuf > buf && isdigit((unsigned char)pbuf[-1]))
+            {
+                strOut += '.';
+                while (pbuf < pbufend && !isdigit((unsigned char)*pbuf))
+                    pbuf++;
+            }
+            strOut.append(pbuf, pbufend); // rest of the digits, or inf/nan as printf spells them
+            break;
+        }
+        case null_type:
+            strOut += "null";
+            break;
+    }
+}
+
+string WriteJSON(const Value& value)
+{
+    string strOut;
+    strOut.reserve(256);
+    AppendJSON(strOut, value);
+    return strOut;
+}
+
+/** Recursive descent parser building json_spirit values in place, without copying subtrees */
+class CJSONReader
+{
+public:
+    CJSONReader(const string& str) : p(str.data()), pend(str.data() + str.size()) {}
+
+    bool Read(Value& valueRet)
+    {
+        if (!ReadValue(valueRet, 0))
+            return false;
+        SkipSpace();
+        return p == pend;
+    }
+
+private:
+    static const int MAX_DEPTH = 512;
+
+    const char* p;
+    const char* pend;
+
+    void SkipSpace()
+    {
+        while (p < pend && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool Consume(char c)
+    {
+        SkipSpace();
+        if (p < pend && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool ReadLiteral(const char* psz)
+    {
+        size_t nLen = strlen(psz);
+        if ((size_t)(pend - p) < nLen || memcmp(p, psz, nLen) != 0)
+            return false;
+        p += nLen;
+        return true;
+    }
+
+    bool ReadHex4(unsigned int& nRet)
+    {
+        if (pend - p < 4)
+            return false;
+        nRet = 0;
+        for (int i = 0; i < 4; i++, p++)
+        {
+            int n = HexDigit(*p);
+            if (n < 0)
+                return false;
+            nRet = (nRet << 4) | n;
+        }
+        return true;
+    }
+
+    static void AppendUTF8(string& str, unsigned int c)
+    {
+        if (c < 0x80) {
+            str += (char)c;
+        } else if (c < 0x800) {
+            str += (char)(0xc0 | (c >> 6));
+            str += (char)(0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            str += (char)(0xe0 | (c >> 12));
+            str += (char)(0x80 | ((c >> 6) & 0x3f));
+            str += (char)(0x80 | (c & 0x3f));
+        } else {
+            str += (char)(0xf0 | (c >> 18));
+            str += (char)(0x80 | ((c >> 12) & 0x3f));
+            str += (char)(0x80 | ((c >> 6) & 0x3f));
+            str += (char)(0x80 | (c & 0x3f));
+        }
+    }
+
+    bool ReadString(string& strRet)
+    {
+        // Opening quote already consumed
+        while (p < pend)
+        {
+            const char* pstart = p;
+            while (p < pend && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20)
+                p++;
+            strRet.append(pstart, p);
+            if (p == pend || (unsigned char)*p < 0x20)
+                return false;
+            if (*p++ == '"')
+                return true;
+            if (p == pend)
+                return false;
+            switch (*p++)
+            {
+                case '"':  strRet += '"'; break;
+                case '\\': strRet += '\\'; break;
+                case '/':  strRet += '/'; break;
+                case 'b':  strRet += '\b'; break;
+                case 'f':  strRet += '\f'; break;
+                case 'n':  strRet += '\n'; break;
+                case 'r':  strRet += '\r'; break;
+                case 't':  strRet += '\t'; break;
+                case 'u':
+                {
+                    unsigned int c;
+                    if (!ReadHex4(c))
+                        return false;
+                    // Combine a UTF-16 surrogate pair
+                    if (c >= 0xd800 && c < 0xdc00 && pend - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        const char* psave = p;
+                        unsigned int c2;
+                        p += 2;
+                        if (ReadHex4(c2) && c2 >= 0xdc00 && c2 < 0xe000)
+                            c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+                        else
+                            p = psave;
+                    }
+                    AppendUTF8(strRet, c);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool ReadNumber(Value& valueRet)
+    {
+        const char* pstart = p;
+        bool fReal = false;
+        if (p < pend && *p == '-')
+            p++;
+        if (p == pend || !isdigit((unsigned char)*p))
+            return false;
+        if (*p == '0')
+            p++;
+        else
+            while (p < pend && isdigit((unsigned char)*p))
+                p++;
+        if (p < pend && *p == '.')
+        {
+            fReal = true;
+            p++;
+            if (p == pend || !isdigit((unsigned char)*p))
+                return false;
+            while (p < pend && isdigit((unsigned char)*p))
+                p++;
+        }
+        if (p < pend && (*p == 'e' || *p == 'E'))
+        {
+            fReal = true;
+            p++;
+            if (p < pend && (*p == '+' || *p == '-'))
+                p++;
+            if (p == pend || !isdigit((unsigned char)*p))
+                return false;
+            while (p < pend && isdigit((unsigned char)*p))
+                p++;
+        }
+
+        string strNum(pstart, p);
+        if (!fReal)
+        {
+            errno = 0;
+            if (strNum[0] == '-') {
+                long long n = strtoll(strNum.c_str(), NULL, 10);
+                if (errno == 0) {
+                    valueRet = (int64_t)n;
+                    return true;
+                }
+            } else {
+                unsigned long long n = strtoull(strNum.c_str(), NULL, 10);
+                if (errno == 0) {
+                    if (n > (unsigned long long)std::numeric_limits<int64_t>::max())
+                        valueRet = (uint64_t)n;
+                    else
+                        valueRet = (int64_t)n;
+                    return true;
+                }
+            }
+            // Out of range integers are read as reals, like json_spirit does
+        }
+        // strtod would expect the decimal point of the process locale
+        std::istringstream ss(strNum);
+        ss.imbue(std::locale::classic());
+        double d = 0;
+        ss >> d;
+        valueRet = d;
+        return true;
+    }
+
+    bool ReadValue(Value& valueRet, int nDepth)
+    {
+        if (nDepth > MAX_DEPTH)
+            return false;
+        SkipSpace();
+        if (p == pend)
+            return false;
+
+        switch (*p)
+        {
+            case '{':
+            {
+                p++;
+                valueRet = Object();
+                Object& obj = valueRet.get_obj();
+                if (Consume('}'))
+                    return true;
+                do {
+                    if (!Consume('"'))
+                        return false;
+                    obj.push_back(Pair(string(), Value()));
+                    if (!ReadString(obj.back().name_) || !Consume(':') ||
+                        !ReadValue(obj.back().value_, nDepth + 1))
+                        return false;
+                } while (Consume(','));
+                return Consume('}');
+            }
+            case '[':
+            {
+                p++;
+                valueRet = Array();
+                Array& arr = valueRet.get_array();
+                if (Consume(']'))
+                    return true;
+                do {
+                    arr.push_back(Value());
+                    if (!ReadValue(arr.back(), nDepth + 1))
+                        return false;
+                } while (Consume(','));
+                return Consume(']');
+            }
+            case '"':
+            {
+                p++;
+                string str;
+                if (!ReadString(str))
+                    return false;
+                valueRet = str;
+                return true;
+            }
+            case 't':
+                valueRet = true;
+                return ReadLiteral("true");
+            case 'f':
+                valueRet = false;
+                return ReadLiteral("false");
+            case 'n':
+                valueRet = Value::null;
+                return ReadLiteral("null");
+            default:
+                return ReadNumber(valueRet);
+        }
+    }
+};
+
+bool ReadJSON(const string& strJSON, Value& valueRet)
+{
+    CJSONReader reader(strJSON);
+    return reader.Read(valueRet);
+}
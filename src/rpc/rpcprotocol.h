@@ -141,6 +141,11 @@ std::string HTTPError(int nStatus, bool keepalive,
                       bool headerOnly = false);
 std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength,
                       const char *contentType = "application/json");
+/** Header for a reply whose body follows as HTTPChunk()s ended by HTTPLastChunk() (HTTP/1.1 only) */
+std::string HTTPReplyHeaderChunked(int nStatus, bool keepalive,
+                      const char *contentType = "application/json");
+std::string HTTPChunk(const std::string& strData);
+std::string HTTPLastChunk();
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive,
                       bool headerOnly = false,
                       const char *contentType = "application/json");
@@ -155,4 +160,9 @@ json_spirit::Object JSONRPCReplyObj(const json_spirit::Value& result, const json
 std::string JSONRPCReply(const json_spirit::Value& result, const json_spirit::Value& error, const json_spirit::Value& id);
 json_spirit::Object JSONRPCError(int code, const std::string& message);
 
+/** Fast replacements for read_string/write_string(value, false) on the RPC path */
+bool ReadJSON(const std::string& strJSON, json_spirit::Value& valueRet);
+void AppendJSON(std::string& strOut, const json_spirit::Value& value);
+std::string WriteJSON(const json_spirit::Value& value);
+
 #endif // DARKSILKRPC_PROTOCOL_H
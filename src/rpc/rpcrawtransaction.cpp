@@ -274,7 +274,16 @@ Value listunspent(const Array& params, bool fHelp)
     Array results;
     vector<COutput> vecOutputs;
     assert(pwalletMain != NULL);
-    pwalletMain->AvailableCoins(vecOutputs, false);
+    if(setAddress.size())
+    {
+        // only the outputs of these addresses, from the wallet's address index
+        set<CTxDestination> setDest;
+        BOOST_FOREACH(const CDarkSilkAddress& address, setAddress)
+            setDest.insert(address.Get());
+        pwalletMain->AvailableCoinsByAddress(setDest, vecOutputs, false);
+    }
+    else
+        pwalletMain->AvailableCoins(vecOutputs, false);
     BOOST_FOREACH(const COutput& out, vecOutputs)
     {
         if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
@@ -54,6 +54,50 @@ static ssl::context* rpc_ssl_context = NULL;
 static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work *rpc_dummy_work = NULL;
 static std::vector< boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+
+/** Per-command counters behind getrpcstats. Times are in microseconds. */
+struct CRPCCommandStats
+{
+    uint64_t nCalls;
+    int64_t nLockWaitTotal;
+    int64_t nLockWaitMax;
+    int64_t nTimeTotal;
+    int64_t nTimeMax;
+
+    CRPCCommandStats() : nCalls(0), nLockWaitTotal(0), nLockWaitMax(0), nTimeTotal(0), nTimeMax(0) {}
+};
+
+static CCriticalSection cs_rpcStats;
+static map<string, CRPCCommandStats> mapRPCStats;
+
+/** Records lock wait and total latency of one command when it goes out of scope */
+class CRPCStatsRecorder
+{
+private:
+    const std::string& strMethod;
+    int64_t nStart;
+    int64_t nLockWait;
+
+public:
+    CRPCStatsRecorder(const std::string& strMethodIn) : strMethod(strMethodIn), nStart(GetTimeMicros()), nLockWait(0) {}
+
+    void LocksAcquired(int64_t nWaitStart)
+    {
+        nLockWait = GetTimeMicros() - nWaitStart;
+    }
+
+    ~CRPCStatsRecorder()
+    {
+        int64_t nTime = GetTimeMicros() - nStart;
+        LOCK(cs_rpcStats);
+        CRPCCommandStats& stats = mapRPCStats[strMethod];
+        stats.nCalls++;
+        stats.nLockWaitTotal += nLockWait;
+        stats.nLockWaitMax = std::max(stats.nLockWaitMax, nLockWait);
+        stats.nTimeTotal += nTime;
+        stats.nTimeMax = std::max(stats.nTimeMax, nTime);
+    }
+};
  
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
@@ -226,6 +270,46 @@ Value stop(const Array& params, bool fHelp)
     return "DarkSilk server stopping";
 }
 
+Value getrpcstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcstats\n"
+            "\nReturns per-command call counts, lock wait and latency since startup.\n"
+            "Commands marked lockfree are answered without cs_main, from the chain snapshot.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\" : {\n"
+            "    \"calls\" : n,         (numeric) number of calls\n"
+            "    \"lockfree\" : true|false, (boolean) whether the command runs without cs_main\n"
+            "    \"avglockwait\" : n,   (numeric) average microseconds waiting for cs_main/cs_wallet\n"
+            "    \"maxlockwait\" : n,   (numeric) longest wait in microseconds\n"
+            "    \"avgtime\" : n,       (numeric) average microseconds per call, including lock wait\n"
+            "    \"maxtime\" : n        (numeric) slowest call in microseconds\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcstats", "")
+            + HelpExampleRpc("getrpcstats", "")
+        );
+
+    Object ret;
+    LOCK(cs_rpcStats);
+    BOOST_FOREACH(const PAIRTYPE(string, CRPCCommandStats)& item, mapRPCStats)
+    {
+        const CRPCCommandStats& stats = item.second;
+        const CRPCCommand* pcmd = tableRPC[item.first];
+        Object obj;
+        obj.push_back(Pair("calls",       (uint64_t)stats.nCalls));
+        obj.push_back(Pair("lockfree",    pcmd && pcmd->threadSafe));
+        obj.push_back(Pair("avglockwait", stats.nLockWaitTotal / (int64_t)stats.nCalls));
+        obj.push_back(Pair("maxlockwait", stats.nLockWaitMax));
+        obj.push_back(Pair("avgtime",     stats.nTimeTotal / (int64_t)stats.nCalls));
+        obj.push_back(Pair("maxtime",     stats.nTimeMax));
+        ret.push_back(Pair(item.first, obj));
+    }
+    return ret;
+}
 
 
 //
@@ -234,122 +318,130 @@ Value stop(const Array& params, bool fHelp)
 
 
 static const CRPCCommand vRPCCommands[] =
-{ //  name                      actor (function)         okSafeMode threadSafe reqWallet
-  //  ------------------------  -----------------------  ---------- ---------- ---------
-    { "help",                   &help,                   true,      true,      false },
-    { "stop",                   &stop,                   true,      true,      false },
-    { "getbestblockhash",       &getbestblockhash,       true,      false,     false },
-    { "getblockcount",          &getblockcount,          true,      false,     false },
-    { "getconnectioncount",     &getconnectioncount,     true,      false,     false },
-    { "getpeerinfo",            &getpeerinfo,            true,      false,     false },
-    { "addnode",                &addnode,                true,      true,      false },
-    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,      false },
-    { "ping",                   &ping,                   true,      false,     false },
-    { "getnettotals",           &getnettotals,           true,      true,      false },
-    { "getdifficulty",          &getdifficulty,          true,      false,     false },
-    { "getinfo",                &getinfo,                true,      false,     false },
-    { "getrawmempool",          &getrawmempool,          true,      false,     false },
-    { "getblock",               &getblock,               false,     false,     false },
-    { "getblockbynumber",       &getblockbynumber,       false,     false,     false },
-    { "getblockhash",           &getblockhash,           false,     false,     false },
-    { "getrawtransaction",      &getrawtransaction,      false,     false,     false },
-    { "createrawtransaction",   &createrawtransaction,   false,     false,     false },
-    { "decoderawtransaction",   &decoderawtransaction,   false,     false,     false },
-    { "decodescript",           &decodescript,           false,     false,     false },
-    { "signrawtransaction",     &signrawtransaction,     false,     false,     false },
-    { "sendrawtransaction",     &sendrawtransaction,     false,     false,     false },
-    { "getcheckpoint",          &getcheckpoint,          true,      false,     false },
-    { "sendalert",              &sendalert,              false,     false,     false },
-    { "validateaddress",        &validateaddress,        true,      false,     false },
-    { "validatepubkey",         &validatepubkey,         true,      false,     false },
-    { "verifymessage",          &verifymessage,          false,     false,     false },
-    { "searchrawtransactions",  &searchrawtransactions,  false,     false,     false },
-    { "encryptdata",  		&encryptdata,  	false,     false,     false },
-    { "decryptdata",  		&decryptdata,  	false,     false,     false },
-    { "decryptsend",            &decryptsend,   false,     false,     false },
+{ //  name                      actor (function)         okSafeMode threadSafe reqWallet batchBarrier
+  //  ------------------------  -----------------------  ---------- ---------- --------- ------------
+    { "help",                   &help,                   true,      true,      false,     false },
+    { "stop",                   &stop,                   true,      true,      false,     true },
+    { "getrpcstats",            &getrpcstats,            true,      true,      false,     false },
+    { "getbestblockhash",       &getbestblockhash,       true,      true,      false,     false },
+    { "getblockcount",          &getblockcount,          true,      true,      false,     false },
+    { "getconnectioncount",     &getconnectioncount,     true,      false,     false,     false },
+    { "getpeerinfo",            &getpeerinfo,            true,      false,     false,     false },
+    { "addnode",                &addnode,                true,      true,      false,     false },
+    { "getaddednodeinfo",       &getaddednodeinfo,       true,      true,      false,     false },
+    { "ping",                   &ping,                   true,      false,     false,     false },
+    { "getnettotals",           &getnettotals,           true,      true,      false,     false },
+    { "getdifficulty",          &getdifficulty,          true,      true,      false,     false },
+    { "getinfo",                &getinfo,                true,      false,     false,     false },
+    { "getrawmempool",          &getrawmempool,          true,      true,      false,     false },
+    { "getblock",               &getblock,               false,     true,      false,     false },
+    { "getblockbynumber",       &getblockbynumber,       false,     false,     false,     false },
+    { "getblockhash",           &getblockhash,           false,     false,     false,     false },
+    { "getrawtransaction",      &getrawtransaction,      false,     false,     false,     false },
+    { "createrawtransaction",   &createrawtransaction,   false,     false,     false,     false },
+    { "decoderawtransaction",   &decoderawtransaction,   false,     false,     false,     false },
+    { "decodescript",           &decodescript,           false,     false,     false,     false },
+    { "signrawtransaction",     &signrawtransaction,     false,     false,     false,     false },
+    { "sendrawtransaction",     &sendrawtransaction,     false,     false,     false,     true },
+    { "getcheckpoint",          &getcheckpoint,          true,      false,     false,     false },
+    { "getdbstats",             &getdbstats,             true,      true,      false,     false },
+    { "compactdb",              &compactdb,              true,      true,      false,     false },
+    { "getblockverifystats",    &getblockverifystats,    true,      true,      false,     false },
+    { "gettxverifystats",       &gettxverifystats,       true,      true,      false,     false },
+    { "getsigverifystats",      &getsigverifystats,      true,      true,      false,     false },
+    { "sendalert",              &sendalert,              false,     false,     false,     false },
+    { "validateaddress",        &validateaddress,        true,      false,     false,     false },
+    { "validatepubkey",         &validatepubkey,         true,      false,     false,     false },
+    { "verifymessage",          &verifymessage,          false,     false,     false,     false },
+    { "searchrawtransactions",  &searchrawtransactions,  false,     false,     false,     false },
+    { "encryptdata",  		&encryptdata,  	false,     false,     false,     false },
+    { "decryptdata",  		&decryptdata,  	false,     false,     false,     false },
+    { "decryptsend",            &decryptsend,   false,     false,     false,     false },
 
 /* Dark features */
-    { "snsync",                 &snsync,                 true,      true,      false },
-    { "spork",                  &spork,                  true,      true,      false },
-    { "getpoolinfo",            &getpoolinfo,            true,      true,      false },
-    { "stormnode",              &stormnode,              true,      true,      false },
-    { "stormnodebroadcast",     &stormnodebroadcast,     true,      true,      false },
-    { "snbudget",               &snbudget,               true,      true,      false },
-    { "snbudgetvoteraw",        &snbudgetvoteraw,        true,      true,      false },
-    { "snfinalbudget",          &snfinalbudget,          true,      true,      false }, 
-    { "stormnodelist",          &stormnodelist,          true,      true,      false },
+    { "snsync",                 &snsync,                 true,      true,      false,     false },
+    { "spork",                  &spork,                  true,      true,      false,     true },
+    { "getpoolinfo",            &getpoolinfo,            true,      true,      false,     false },
+    { "getinstantxstats",       &getinstantxstats,       true,      true,      false,     false },
+    { "stormnode",              &stormnode,              true,      true,      false,     false },
+    { "stormnodebroadcast",     &stormnodebroadcast,     true,      true,      false,     false },
+    { "snbudget",               &snbudget,               true,      true,      false,     false },
+    { "snbudgetvoteraw",        &snbudgetvoteraw,        true,      true,      false,     false },
+    { "snfinalbudget",          &snfinalbudget,          true,      true,      false,     false }, 
+    { "stormnodelist",          &stormnodelist,          true,      true,      false,     false },
 #ifdef ENABLE_WALLET
-    { "setgenerate",		    &setgenerate,			 true,		 false,	   true },
-    { "sandstorm",              &sandstorm,              false,     false,     true },
-    { "getmininginfo",          &getmininginfo,          true,      false,     false },
-    { "getstakinginfo",         &getstakinginfo,         true,      false,     false },
-    { "getnewaddress",          &getnewaddress,          true,      false,     true },
-    { "getnewpubkey",           &getnewpubkey,           true,      false,     true },
-    { "getaccountaddress",      &getaccountaddress,      true,      false,     true },
-    { "setaccount",             &setaccount,             true,      false,     true },
-    { "getaccount",             &getaccount,             false,     false,     true },
-    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,     true },
-    { "sendtoaddress",          &sendtoaddress,          false,     false,     true },
-    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,     true },
-    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,     true },
-    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,     true },
-    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,     true },
-    { "backupwallet",           &backupwallet,           true,      false,     true },
-    { "keypoolrefill",          &keypoolrefill,          true,      false,     true },
-    { "walletpassphrase",       &walletpassphrase,       true,      false,     true },
-    { "walletpassphrasechange", &walletpassphrasechange, false,     false,     true },
-    { "walletlock",             &walletlock,             true,      false,     true },
-    { "encryptwallet",          &encryptwallet,          false,     false,     true },
-    { "getbalance",             &getbalance,             false,     false,     true },
-    { "move",                   &movecmd,                false,     false,     true },
-    { "sendfrom",               &sendfrom,               false,     false,     true },
-    { "sendmany",               &sendmany,               false,     false,     true },
-    { "addmultisigaddress",     &addmultisigaddress,     false,     false,     true },
-    { "addredeemscript",        &addredeemscript,        false,     false,     true },
-    { "gettransaction",         &gettransaction,         false,     false,     true },
-    { "listtransactions",       &listtransactions,       false,     false,     true },
-    { "listaddressgroupings",   &listaddressgroupings,   false,     false,     true },
-    { "signmessage",            &signmessage,            false,     false,     true },
-    { "getwork",                &getwork,                true,      false,     true },
-    { "getworkex",              &getworkex,              true,      false,     true },
-    { "listaccounts",           &listaccounts,           false,     false,     true },
-    { "getblocktemplate",       &getblocktemplate,       true,      false,     false },
-    { "submitblock",            &submitblock,            false,     false,     false },
-    { "listsinceblock",         &listsinceblock,         false,     false,     true },
-    { "dumpprivkey",            &dumpprivkey,            false,     false,     true },
-    { "dumpwallet",             &dumpwallet,             true,      false,     true },
-    { "importprivkey",          &importprivkey,          false,     false,     true },
-    { "importwallet",           &importwallet,           false,     false,     true },
-    { "importaddress",          &importaddress,          false,     false,     true },
-    { "listunspent",            &listunspent,            false,     false,     true },
-    { "settxfee",               &settxfee,               false,     false,     true },
-    { "getsubsidy",             &getsubsidy,             true,      true,      false },
-    { "getstakesubsidy",        &getstakesubsidy,        true,      true,      false },
-    { "reservebalance",         &reservebalance,         false,     true,      true },
-    { "createmultisig",         &createmultisig,         true,      true,      false },
-    { "checkwallet",            &checkwallet,            false,     true,      true },
-    { "repairwallet",           &repairwallet,           false,     true,      true },
-    { "resendtx",               &resendtx,               false,     true,      true },
-    { "makekeypair",            &makekeypair,            false,     true,      false },
-    { "checkkernel",            &checkkernel,            true,      false,     true },
-    { "getnewstealthaddress",   &getnewstealthaddress,   false,     false,     true},
-    { "liststealthaddresses",   &liststealthaddresses,   false,     false,     true},
-    { "importstealthaddress",   &importstealthaddress,   false,      false,    true},
-    { "sendtostealthaddress",   &sendtostealthaddress,   false,      false,    true},
-    { "scanforalltxns",         &scanforalltxns,         false,      false,    true},
-    { "smsgenable",             &smsgenable,             false,     false,     false },
-    { "smsgdisable",            &smsgdisable,            false,     false,     false },
-    { "smsglocalkeys",          &smsglocalkeys,          false,     false,     false },
-    { "smsgoptions",            &smsgoptions,            false,     false,     false },
-    { "smsgscanchain",          &smsgscanchain,          false,     false,     false },
-    { "smsgscanbuckets",        &smsgscanbuckets,        false,     false,     false },
-    { "smsgaddkey",             &smsgaddkey,             false,     false,     false },
-    { "smsggetpubkey",          &smsggetpubkey,          false,     false,     false },
-    { "smsgsend",               &smsgsend,               false,     false,     false },
-    { "smsgsendanon",           &smsgsendanon,           false,     false,     false },
-    { "smsginbox",              &smsginbox,              false,     false,     false },
-    { "smsgoutbox",             &smsgoutbox,             false,     false,     false },
-    { "smsgbuckets",            &smsgbuckets,            false,     false,     false },
+    { "setgenerate",		    &setgenerate,			 true,		 false,	   true,      true },
+    { "sandstorm",              &sandstorm,              false,     false,     true,      true },
+    { "getmininginfo",          &getmininginfo,          true,      false,     false,     false },
+    { "getstakinginfo",         &getstakinginfo,         true,      false,     false,     false },
+    { "getnewaddress",          &getnewaddress,          true,      false,     true,      true },
+    { "getnewpubkey",           &getnewpubkey,           true,      false,     true,      true },
+    { "getaccountaddress",      &getaccountaddress,      true,      false,     true,      true },
+    { "setaccount",             &setaccount,             true,      false,     true,      true },
+    { "getaccount",             &getaccount,             false,     false,     true,      true },
+    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,      false,     true,      true },
+    { "sendtoaddress",          &sendtoaddress,          false,     false,     true,      true },
+    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,     false,     true,      true },
+    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,     false,     true,      true },
+    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,     false,     true,      true },
+    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,     false,     true,      true },
+    { "backupwallet",           &backupwallet,           true,      false,     true,      true },
+    { "keypoolrefill",          &keypoolrefill,          true,      false,     true,      true },
+    { "walletpassphrase",       &walletpassphrase,       true,      false,     true,      true },
+    { "walletpassphrasechange", &walletpassphrasechange, false,     false,     true,      true },
+    { "walletlock",             &walletlock,             true,      false,     true,      true },
+    { "encryptwallet",          &encryptwallet,          false,     false,     true,      true },
+    { "getbalance",             &getbalance,             false,     false,     true,      true },
+    { "move",                   &movecmd,                false,     false,     true,      true },
+    { "sendfrom",               &sendfrom,               false,     false,     true,      true },
+    { "sendmany",               &sendmany,               false,     false,     true,      true },
+    { "addmultisigaddress",     &addmultisigaddress,     false,     false,     true,      true },
+    { "addredeemscript",        &addredeemscript,        false,     false,     true,      true },
+    { "gettransaction",         &gettransaction,         false,     false,     true,      true },
+    { "listtransactions",       &listtransactions,       false,     false,     true,      true },
+    { "listaddressgroupings",   &listaddressgroupings,   false,     false,     true,      true },
+    { "getaddressbalance",      &getaddressbalance,      false,     false,     true,      true },
+    { "signmessage",            &signmessage,            false,     false,     true,      true },
+    { "getwork",                &getwork,                true,      false,     true,      true },
+    { "getworkex",              &getworkex,              true,      false,     true,      true },
+    { "listaccounts",           &listaccounts,           false,     false,     true,      true },
+    { "getblocktemplate",       &getblocktemplate,       true,      false,     false,     false },
+    { "submitblock",            &submitblock,            false,     false,     false,     true },
+    { "listsinceblock",         &listsinceblock,         false,     false,     true,      true },
+    { "dumpprivkey",            &dumpprivkey,            false,     false,     true,      true },
+    { "dumpwallet",             &dumpwallet,             true,      false,     true,      true },
+    { "importprivkey",          &importprivkey,          false,     false,     true,      true },
+    { "importwallet",           &importwallet,           false,     false,     true,      true },
+    { "importaddress",          &importaddress,          false,     false,     true,      true },
+    { "listunspent",            &listunspent,            false,     false,     true,      true },
+    { "settxfee",               &settxfee,               false,     false,     true,      true },
+    { "getsubsidy",             &getsubsidy,             true,      true,      false,     false },
+    { "getstakesubsidy",        &getstakesubsidy,        true,      true,      false,     false },
+    { "reservebalance",         &reservebalance,         false,     true,      true,      true },
+    { "createmultisig",         &createmultisig,         true,      true,      false,     false },
+    { "checkwallet",            &checkwallet,            false,     true,      true,      true },
+    { "repairwallet",           &repairwallet,           false,     true,      true,      true },
+    { "resendtx",               &resendtx,               false,     true,      true,      true },
+    { "makekeypair",            &makekeypair,            false,     true,      false,     false },
+    { "checkkernel",            &checkkernel,            true,      false,     true,      true },
+    { "getnewstealthaddress",   &getnewstealthaddress,   false,     false,     true,      true},
+    { "liststealthaddresses",   &liststealthaddresses,   false,     false,     true,      true},
+    { "importstealthaddress",   &importstealthaddress,   false,      false,    true,      true},
+    { "sendtostealthaddress",   &sendtostealthaddress,   false,      false,    true,      true},
+    { "scanforalltxns",         &scanforalltxns,         false,      false,    true,      true},
+    { "smsgenable",             &smsgenable,             false,     false,     false,     false },
+    { "smsgdisable",            &smsgdisable,            false,     false,     false,     false },
+    { "smsglocalkeys",          &smsglocalkeys,          false,     false,     false,     false },
+    { "smsgoptions",            &smsgoptions,            false,     false,     false,     false },
+    { "smsgscanchain",          &smsgscanchain,          false,     false,     false,     false },
+    { "smsgscanbuckets",        &smsgscanbuckets,        false,     false,     false,     false },
+    { "smsgaddkey",             &smsgaddkey,             false,     false,     false,     false },
+    { "smsggetpubkey",          &smsggetpubkey,          false,     false,     false,     false },
+    { "smsgsend",               &smsgsend,               false,     false,     false,     false },
+    { "smsgsendanon",           &smsgsendanon,           false,     false,     false,     false },
+    { "smsginbox",              &smsginbox,              false,     false,     false,     false },
+    { "smsgoutbox",             &smsgoutbox,             false,     false,     false,     false },
+    { "smsgbuckets",            &smsgbuckets,            false,     false,     false,     false },
 #endif
 };
 
@@ -814,13 +906,153 @@ static Object JSONRPCExecOne(const Value& req)
     return rpc_result;
 }
 
-static string JSONRPCExecBatch(const Array& vReq)
+/** Bytes of serialized batch replies collected before they are handed to the writer */
+static const size_t BATCH_FLUSH_SIZE = 64 * 1024;
+
+/**
+ * Execution state of one JSON-RPC batch, shared between the connection thread and the
+ * helpers it posts onto the rpc_io_service pool. Entries are claimed in order through
+ * nNext; a helper that gets to run after the batch is finished simply finds nothing to do.
+ */
+class CRPCBatch
 {
-    Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+public:
+    const Array& vReq;
+    std::vector<std::string> vResult;
+    std::vector<bool> vDone;
+    unsigned int nNext;
+    unsigned int nEnd;
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+
+    CRPCBatch(const Array& vReqIn) : vReq(vReqIn), vResult(vReqIn.size()), vDone(vReqIn.size(), false), nNext(0), nEnd(0) {}
+
+    /** Claim and run the next entry of the current parallel range, false if none is left */
+    bool RunNext()
+    {
+        unsigned int nIdx;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (nNext >= nEnd)
+                return false;
+            nIdx = nNext++;
+        }
+        Run(nIdx);
+        return true;
+    }
+
+    void Run(unsigned int nIdx)
+    {
+        std::string strResult = WriteJSON(Value(JSONRPCExecOne(vReq[nIdx])));
+        boost::unique_lock<boost::mutex> lock(cs);
+        vResult[nIdx].swap(strResult);
+        vDone[nIdx] = true;
+        cond.notify_all();
+    }
+
+};
 
-    return write_string(Value(ret), false) + "\n";
+static void RPCBatchHelper(boost::shared_ptr<CRPCBatch> batch)
+{
+    while (batch->RunNext());
+}
+
+/** Move finished replies up to nEnd into strOut in request order, handing full buffers to fnWrite */
+static void FlushBatchReplies(CRPCBatch& batch, unsigned int& nWritten, unsigned int nEnd, bool fWait,
+                              string& strOut, const boost::function<void(const string&)>& fnWrite)
+{
+    while (nWritten < nEnd)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(batch.cs);
+            if (!batch.vDone[nWritten] && !fWait)
+                return;
+            while (!batch.vDone[nWritten])
+                batch.cond.wait(lock);
+            if (nWritten > 0)
+                strOut += ",";
+            strOut += batch.vResult[nWritten];
+            string().swap(batch.vResult[nWritten]);
+        }
+        nWritten++;
+        if (strOut.size() >= BATCH_FLUSH_SIZE)
+        {
+            fnWrite(strOut);
+            strOut.clear();
+        }
+    }
+}
+
+/**
+ * Entries that change wallet or chain state run on their own, after everything before
+ * them has finished, so a batch like [sendtoaddress, gettransaction] keeps its meaning.
+ */
+static bool IsBatchBarrier(const Value& req)
+{
+    if (req.type() != obj_type)
+        return false;
+    const Value& valMethod = find_value(req.get_obj(), "method");
+    if (valMethod.type() != str_type)
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    if (!pcmd)
+        return false;
+    return pcmd->batchBarrier;
+}
+
+/**
+ * Execute a batch, spreading runs of independent entries over the -rpcthreads workers.
+ * The calling thread takes part in the work, so the batch still completes when every
+ * worker is busy. Replies are passed to fnWrite in request order, a few at a time,
+ * as a JSON array.
+ */
+static void JSONRPCExecBatch(const Array& vReq, const boost::function<void(const string&)>& fnWrite)
+{
+    boost::shared_ptr<CRPCBatch> batch(new CRPCBatch(vReq));
+    int nWorkers = std::max((int)GetArg("-rpcthreads", 4), 1);
+    string strOut = "[";
+    unsigned int nWritten = 0;
+    unsigned int nPos = 0;
+
+    while (nPos < vReq.size())
+    {
+        // Everything before nPos has been written out, so a barrier runs alone
+        if (IsBatchBarrier(vReq[nPos]))
+        {
+            batch->Run(nPos++);
+        }
+        else
+        {
+            unsigned int nEnd = nPos;
+            while (nEnd < vReq.size() && !IsBatchBarrier(vReq[nEnd]))
+                nEnd++;
+            {
+                boost::unique_lock<boost::mutex> lock(batch->cs);
+                batch->nNext = nPos;
+                batch->nEnd = nEnd;
+            }
+            int nHelpers = std::min(nWorkers - 1, (int)(nEnd - nPos) - 1);
+            for (int i = 0; i < nHelpers && rpc_io_service != NULL; i++)
+                rpc_io_service->post(boost::bind(&RPCBatchHelper, batch));
+            while (batch->RunNext())
+                FlushBatchReplies(*batch, nWritten, nEnd, false, strOut, fnWrite);
+            nPos = nEnd;
+        }
+        FlushBatchReplies(*batch, nWritten, nPos, true, strOut, fnWrite);
+    }
+
+    strOut += "]\n";
+    fnWrite(strOut);
+}
+
+static void AppendString(string* pstrOut, const string& str)
+{
+    *pstrOut += str;
+}
+
+static void WriteChunk(std::iostream* pstream, const string& str)
+{
+    *pstream << HTTPChunk(str) << std::flush;
 }
 
 void ServiceConnection(AcceptedConnection *conn)
@@ -874,11 +1106,9 @@ void ServiceConnection(AcceptedConnection *conn)
         {
             // Parse request
             Value valRequest;
-            if (!read_string(strRequest, valRequest))
+            if (!ReadJSON(strRequest, valRequest))
                 throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-            string strReply;
-
             // singleton request
             if (valRequest.type() == obj_type) {
                 jreq.parse(valRequest);
@@ -886,15 +1116,23 @@ void ServiceConnection(AcceptedConnection *conn)
                 Value result = tableRPC.execute(jreq.strMethod, jreq.params);
 
                 // Send reply
-                strReply = JSONRPCReply(result, Value::null, jreq.id);
+                string strReply = JSONRPCReply(result, Value::null, jreq.id);
+                conn->stream() << HTTPReply(HTTP_OK, strReply, fRun) << std::flush;
 
             // array of requests
-            } else if (valRequest.type() == array_type)
-                strReply = JSONRPCExecBatch(valRequest.get_array());
-            else
+            } else if (valRequest.type() == array_type) {
+                if (nProto >= 1) {
+                    // HTTP/1.1: stream the replies as they complete
+                    conn->stream() << HTTPReplyHeaderChunked(HTTP_OK, fRun) << std::flush;
+                    JSONRPCExecBatch(valRequest.get_array(), boost::bind(&WriteChunk, &conn->stream(), _1));
+                    conn->stream() << HTTPLastChunk() << std::flush;
+                } else {
+                    string strReply;
+                    JSONRPCExecBatch(valRequest.get_array(), boost::bind(&AppendString, &strReply, _1));
+                    conn->stream() << HTTPReply(HTTP_OK, strReply, fRun) << std::flush;
+                }
+            } else
                 throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
-
-            conn->stream() << HTTPReply(HTTP_OK, strReply, fRun) << std::flush;
         }
         catch (Object& objError)
         {
@@ -926,6 +1164,7 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         !pcmd->okSafeMode)
         throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
 
+    CRPCStatsRecorder statsRecorder(strMethod);
     try
     {
         // Execute
@@ -935,15 +1174,21 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
                 result = pcmd->actor(params, false);
 #ifdef ENABLE_WALLET
             else if (!pwalletMain) {
+                int64_t nWaitStart = GetTimeMicros();
                 LOCK(cs_main);
+                statsRecorder.LocksAcquired(nWaitStart);
                 result = pcmd->actor(params, false);
             } else {
+                int64_t nWaitStart = GetTimeMicros();
                 LOCK2(cs_main, pwalletMain->cs_wallet);
+                statsRecorder.LocksAcquired(nWaitStart);
                 result = pcmd->actor(params, false);
             }
 #else // ENABLE_WALLET
             else {
+                int64_t nWaitStart = GetTimeMicros();
                 LOCK(cs_main);
+                statsRecorder.LocksAcquired(nWaitStart);
                 result = pcmd->actor(params, false);
             }
 #endif // !ENABLE_WALLET
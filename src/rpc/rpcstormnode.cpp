@@ -9,6 +9,7 @@
 #include "wallet/db.h"
 #include "init.h"
 #include "wallet/wallet.h"
+#include "anon/instantx/instantx.h"
 #include "anon/stormnode/activestormnode.h"
 #include "anon/stormnode/stormnode-budget.h"
 #include "anon/stormnode/stormnode-payments.h"
@@ -82,6 +83,61 @@ Value getpoolinfo(const Array& params, bool fHelp)
     return obj;
 }
 
+Value getinstantxstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getinstantxstats\n"
+            "\nReturns the InstantX locks being tracked and how long locks took to complete.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"requests\" : n,          (numeric) lock requests accepted\n"
+            "  \"rejected\" : n,          (numeric) lock requests rejected\n"
+            "  \"votes\" : n,             (numeric) stormnode votes\n"
+            "  \"locks\" : n,             (numeric) transaction locks\n"
+            "  \"lockedinputs\" : n,      (numeric) inputs locked\n"
+            "  \"completed\" : n,         (numeric) locks that got enough signatures since startup\n"
+            "  \"averagems\" : n,         (numeric) average time from the first sight of a lock to enough signatures\n"
+            "  \"p50ms\" : n,             (numeric) half of the locks completed within this time, by bucket\n"
+            "  \"p90ms\" : n,\n"
+            "  \"p99ms\" : n,\n"
+            "  \"maxms\" : n,\n"
+            "  \"latency\" : {           (object) locks completed within each bucket, in milliseconds\n"
+            "    \"250\" : n,\n"
+            "    ...\n"
+            "    \"more\" : n\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getinstantxstats", "")
+            + HelpExampleRpc("getinstantxstats", "")
+        );
+
+    CTxLockManager::Stats stats = txLockManager.GetStats();
+
+    Object latency;
+    for (unsigned int i = 0; i < stats.vLatency.size(); i++)
+    {
+        std::string strBucket = stats.vLatency[i].first >= 0 ? strprintf("%d", stats.vLatency[i].first) : "more";
+        latency.push_back(Pair(strBucket, stats.vLatency[i].second));
+    }
+
+    Object obj;
+    obj.push_back(Pair("requests",     (uint64_t)stats.nRequests));
+    obj.push_back(Pair("rejected",     (uint64_t)stats.nRejected));
+    obj.push_back(Pair("votes",        (uint64_t)stats.nVotes));
+    obj.push_back(Pair("locks",        (uint64_t)stats.nLocks));
+    obj.push_back(Pair("lockedinputs", (uint64_t)stats.nLockedInputs));
+    obj.push_back(Pair("completed",    stats.nCompleted));
+    obj.push_back(Pair("averagems",    stats.nCompleted ? stats.nCompleteTime / (int64_t)stats.nCompleted : 0));
+    obj.push_back(Pair("p50ms",        stats.GetLatencyPercentile(0.5)));
+    obj.push_back(Pair("p90ms",        stats.GetLatencyPercentile(0.9)));
+    obj.push_back(Pair("p99ms",        stats.GetLatencyPercentile(0.99)));
+    obj.push_back(Pair("maxms",        stats.nMaxCompleteTime));
+    obj.push_back(Pair("latency",      latency));
+    return obj;
+}
+
 
 Value stormnode(const Array& params, bool fHelp)
 {
@@ -0,0 +1,144 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include "blockverify.h"
+#include "main.h"
+#include "util.h"
+#include "test/queuetest_util.h"
+
+BOOST_AUTO_TEST_SUITE(blockverify_tests)
+
+struct CConnectResult
+{
+    uint256 hash;
+    bool fValid;
+};
+
+static void RecordConnect(CCallbackRecorder<CConnectResult>* precorder, CBlock& block, CNode* pfrom, bool fValid)
+{
+    CConnectResult result;
+    result.hash = block.GetHash();
+    result.fValid = fValid;
+    precorder->Add(result);
+}
+
+// Holds up the connect thread until Open()
+class CGate
+{
+public:
+    CGate() : fOpen(false) {}
+
+    void Pass()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (!fOpen)
+            cond.wait(lock);
+    }
+
+    void Open()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fOpen = true;
+        cond.notify_all();
+    }
+
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    bool fOpen;
+};
+
+static void WaitAtGate(CGate* pgate, CBlock& block, CNode* pfrom, bool fValid)
+{
+    pgate->Pass();
+}
+
+static boost::shared_ptr<CBlock> EmptyBlock(unsigned int nNonce)
+{
+    boost::shared_ptr<CBlock> pblock(new CBlock());
+    pblock->nNonce = nNonce;
+    return pblock;
+}
+
+// Pushes blocks, waits for all of them and checks they were connected in order and rejected
+static void PushBlocks(CBlockVerifyQueue& queue)
+{
+    CCallbackRecorder<CConnectResult> recorder;
+    std::vector<uint256> vPushed;
+    for (unsigned int i = 0; i < 2 * MAX_BLOCK_VERIFY_QUEUE; i++)
+    {
+        boost::shared_ptr<CBlock> pblock = EmptyBlock(i);
+        vPushed.push_back(pblock->GetHash());
+        queue.Push(pblock, NULL, boost::bind(&RecordConnect, &recorder, _1, _2, _3));
+    }
+    queue.Drain();
+
+    std::vector<CConnectResult> vConnected = recorder.Get();
+    BOOST_CHECK_EQUAL(vConnected.size(), vPushed.size());
+    for (unsigned int i = 0; i < vConnected.size() && i < vPushed.size(); i++)
+    {
+        BOOST_CHECK(vConnected[i].hash == vPushed[i]);
+        // an empty block never passes the context-free checks
+        BOOST_CHECK(!vConnected[i].fValid);
+    }
+    BOOST_CHECK(!queue.Contains(vPushed.back()));
+    BOOST_CHECK_EQUAL(queue.GetStats().nProcessed, vPushed.size());
+}
+
+// Blocks are handed to the connect callback in the order they were pushed
+BOOST_AUTO_TEST_CASE(blockverify_order)
+{
+    CQueueTestThreads threads;
+    CBlockVerifyQueue queue;
+    queue.Start(threads.threadGroup, 4);
+
+    PushBlocks(queue);
+
+    CBlockVerifyQueue::Stats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nQueued + stats.nChecked, 0U);
+    BOOST_CHECK_EQUAL(stats.nRejected, stats.nProcessed);
+}
+
+// Without workers Push() checks and connects on the caller's thread
+BOOST_AUTO_TEST_CASE(blockverify_inline)
+{
+    CQueueTestThreads threads;
+    CBlockVerifyQueue queue;
+    queue.Start(threads.threadGroup, 0);
+
+    PushBlocks(queue);
+    BOOST_CHECK(!queue.IsFull());
+}
+
+// A full queue is reported, and a push that may not wait goes past the limit
+BOOST_AUTO_TEST_CASE(blockverify_full)
+{
+    CQueueTestThreads threads;
+    CBlockVerifyQueue queue;
+    queue.Start(threads.threadGroup, 2);
+
+    CGate gate;
+    queue.Push(EmptyBlock(0), NULL, boost::bind(&WaitAtGate, &gate, _1, _2, _3));
+    while (queue.GetStats().nQueued + queue.GetStats().nChecked > 0)
+        MilliSleep(1);
+
+    // the connect thread waits at the gate, so nothing leaves the queue
+    for (unsigned int i = 1; i <= MAX_BLOCK_VERIFY_QUEUE; i++)
+    {
+        BOOST_CHECK(!queue.IsFull());
+        queue.Push(EmptyBlock(i), NULL, boost::bind(&WaitAtGate, &gate, _1, _2, _3));
+    }
+    BOOST_CHECK(queue.IsFull());
+    queue.Push(EmptyBlock(MAX_BLOCK_VERIFY_QUEUE + 1), NULL, boost::bind(&WaitAtGate, &gate, _1, _2, _3), false);
+    CBlockVerifyQueue::Stats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nQueued + stats.nChecked, MAX_BLOCK_VERIFY_QUEUE + 1);
+
+    gate.Open();
+    queue.Drain();
+    BOOST_CHECK_EQUAL(queue.GetStats().nProcessed, MAX_BLOCK_VERIFY_QUEUE + 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,60 @@
+#include <boost/test/unit_test.hpp>
+
+#include "anon/stormnode/stormnode-budget.h"
+
+BOOST_AUTO_TEST_SUITE(budget_tests)
+
+static CBudgetVote MakeVote(int n, int nVote, int64_t nTime)
+{
+    CBudgetVote vote(CTxIn(COutPoint(uint256(n), 0)), uint256(1), nVote);
+    vote.nTime = nTime;
+    return vote;
+}
+
+// The tallies follow added, changed and reloaded votes
+BOOST_AUTO_TEST_CASE(budget_vote_tallies)
+{
+    CBudgetProposal proposal;
+    std::string strError;
+    int64_t nTime = 1000000;
+
+    for (int i = 0; i < 5; i++)
+    {
+        CBudgetVote vote = MakeVote(i, i < 3 ? VOTE_YES : VOTE_NO, nTime);
+        BOOST_CHECK(proposal.AddOrUpdateVote(vote, strError));
+    }
+    CBudgetVote voteAbstain = MakeVote(5, VOTE_ABSTAIN, nTime);
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteAbstain, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYesCount(), 3);
+    BOOST_CHECK_EQUAL(proposal.GetNoCount(), 2);
+    BOOST_CHECK_EQUAL(proposal.GetAbstainCount(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetAbsoluteYesCount(), 1);
+    BOOST_CHECK_CLOSE(proposal.GetRatio(), 0.6, 0.0001);
+
+    // too soon to change, then a stormnode changes its mind
+    CBudgetVote voteChanged = MakeVote(0, VOTE_NO, nTime + 1);
+    BOOST_CHECK(!proposal.AddOrUpdateVote(voteChanged, strError));
+    voteChanged.nTime = nTime + BUDGET_VOTE_UPDATE_MIN;
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteChanged, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYesCount(), 2);
+    BOOST_CHECK_EQUAL(proposal.GetNoCount(), 3);
+
+    // invalid votes are not counted, except in the ratio
+    CBudgetVote voteInvalid = MakeVote(6, VOTE_YES, nTime);
+    voteInvalid.fValid = false;
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteInvalid, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYesCount(), 2);
+    BOOST_CHECK_CLOSE(proposal.GetRatio(), 0.5, 0.0001);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << proposal;
+    CBudgetProposal proposalRead;
+    ss >> proposalRead;
+    BOOST_CHECK_EQUAL(proposalRead.GetAbsoluteYesCount(), proposal.GetAbsoluteYesCount() + 1);
+    BOOST_CHECK_EQUAL(proposalRead.GetAbstainCount(), 1);
+
+    CBudgetProposal proposalCopy(proposal);
+    BOOST_CHECK_EQUAL(proposalCopy.GetNoCount(), 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+#include <boost/test/unit_test.hpp>
+
+#include "anon/instantx/instantx.h"
+#include "utiltime.h"
+
+BOOST_AUTO_TEST_SUITE(instantx_tests)
+
+// Locks count the votes at their height, record their latency once and expire in time order
+BOOST_AUTO_TEST_CASE(txlock_manager)
+{
+    CTxLockManager manager;
+    int64_t nNow = GetTime();
+    SetMockTime(nNow);
+
+    CMutableTransaction txNew;
+    txNew.vin.resize(1);
+    txNew.vin[0].prevout = COutPoint(uint256(1), 0);
+    CTransaction tx(txNew);
+    uint256 hash = tx.GetHash();
+
+    // votes can arrive before the request sets the height
+    BOOST_CHECK(manager.CreateLock(hash, 0));
+    int nSignatures = 0;
+    for (int i = 0; i < INSTANTX_SIGNATURES_REQUIRED; i++)
+    {
+        CConsensusVote vote;
+        vote.vinStormnode = CTxIn(COutPoint(uint256(100 + i), 0));
+        vote.txHash = hash;
+        vote.nBlockHeight = 1000;
+        BOOST_CHECK(manager.AddVote(vote));
+        BOOST_CHECK(!manager.AddVote(vote));
+        BOOST_CHECK(manager.AddLockSignature(vote, nSignatures));
+    }
+    BOOST_CHECK_EQUAL(manager.GetLockSignatures(hash), -1);
+    BOOST_CHECK_EQUAL(manager.GetStats().nCompleted, 0U);
+    BOOST_CHECK(!manager.CreateLock(hash, 1000));
+    BOOST_CHECK_EQUAL(manager.GetLockSignatures(hash), INSTANTX_SIGNATURES_REQUIRED);
+    BOOST_CHECK(!manager.CreateLock(hash, 1000));
+    BOOST_CHECK_EQUAL(manager.GetStats().nCompleted, 1U);
+    BOOST_CHECK_EQUAL(manager.GetStats().vLatency[0].second, 1U);
+
+    // a transaction spending the same input conflicts with the lock
+    BOOST_CHECK(manager.AddRequest(tx));
+    manager.LockInputs(tx);
+    txNew.vout.resize(1);
+    CTransaction txDoubleSpend(txNew);
+    uint256 hashLock;
+    BOOST_CHECK(!manager.HasConflictingLock(tx, hashLock));
+    BOOST_CHECK(manager.HasConflictingLock(txDoubleSpend, hashLock));
+    BOOST_CHECK(hashLock == hash);
+
+    // only what expired goes, with its request, votes and inputs
+    uint256 hashOther = uint256(2);
+    BOOST_CHECK(manager.CreateLock(hashOther, 1000));
+    manager.ExpireLock(hash);
+    SetMockTime(nNow + 1);
+    manager.Clean();
+    CTxLockManager::Stats stats = manager.GetStats();
+    BOOST_CHECK_EQUAL(stats.nLocks, 1U);
+    BOOST_CHECK_EQUAL(stats.nRequests, 0U);
+    BOOST_CHECK_EQUAL(stats.nVotes, 0U);
+    BOOST_CHECK_EQUAL(stats.nLockedInputs, 0U);
+    BOOST_CHECK_EQUAL(manager.GetLockSignatures(hashOther), 0);
+
+    SetMockTime(0);
+}
+
+// A complete lock has a proof of its votes at the lock height, one per stormnode
+BOOST_AUTO_TEST_CASE(txlock_proof)
+{
+    CTxLockManager manager;
+    uint256 hash = uint256(3);
+    CTxLockProof proof;
+    std::string strError;
+
+    BOOST_CHECK(manager.CreateLock(hash, 1000));
+    int nSignatures = 0;
+    for (int i = 0; i <= INSTANTX_SIGNATURES_TOTAL; i++)
+    {
+        CConsensusVote vote;
+        vote.vinStormnode = CTxIn(COutPoint(uint256(100 + i), 0));
+        vote.txHash = hash;
+        vote.nBlockHeight = i == 0 ? 999 : 1000;
+        BOOST_CHECK(manager.AddLockSignature(vote, nSignatures));
+        if (i == 1)
+            BOOST_CHECK(manager.AddLockSignature(vote, nSignatures));
+        if (i == INSTANTX_SIGNATURES_REQUIRED - 1)
+            BOOST_CHECK(!manager.GetLockProof(hash, proof));
+    }
+
+    BOOST_CHECK(manager.GetLockProof(hash, proof));
+    BOOST_CHECK(proof.txHash == hash);
+    BOOST_CHECK_EQUAL(proof.nBlockHeight, 1000);
+    BOOST_CHECK_EQUAL(proof.vecVotes.size(), (unsigned int)INSTANTX_SIGNATURES_TOTAL);
+    BOOST_CHECK(proof.IsWellFormed(strError));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << proof;
+    CTxLockProof proofRead;
+    ss >> proofRead;
+    BOOST_CHECK(proofRead.IsWellFormed(strError));
+    BOOST_CHECK(proofRead.GetHash() == hash);
+
+    // a repeated stormnode, a vote for another height or too few votes
+    CTxLockProof proofBad = proof;
+    proofBad.vecVotes[1] = proofBad.vecVotes[0];
+    BOOST_CHECK(!proofBad.IsWellFormed(strError));
+    proofBad = proof;
+    proofBad.vecVotes[0].nBlockHeight = 999;
+    BOOST_CHECK(!proofBad.IsWellFormed(strError));
+    proofBad = proof;
+    proofBad.vecVotes.resize(INSTANTX_SIGNATURES_REQUIRED - 1);
+    BOOST_CHECK(!proofBad.IsWellFormed(strError));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
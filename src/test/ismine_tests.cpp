@@ -0,0 +1,42 @@
+#include <boost/test/unit_test.hpp>
+
+#include "key.h"
+#include "keystore.h"
+#include "wallet/wallet_ismine.h"
+
+BOOST_AUTO_TEST_SUITE(ismine_tests)
+
+// The script filter must never turn away a script IsMine would accept
+BOOST_AUTO_TEST_CASE(ismine_script_filter)
+{
+    CBasicKeyStore keystore;
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    CScript scriptPKH = GetScriptForDestination(pubkey.GetID());
+    CScript scriptPK = CScript() << pubkey << OP_CHECKSIG;
+    CScript scriptMulti = CScript() << OP_1 << pubkey << OP_1 << OP_CHECKMULTISIG;
+    CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    BOOST_CHECK(IsMine(keystore, scriptPKH) == ISMINE_NO);
+
+    keystore.AddKey(key);
+    BOOST_CHECK(IsMine(keystore, scriptPKH) == ISMINE_SPENDABLE);
+    BOOST_CHECK(IsMine(keystore, scriptPK) == ISMINE_SPENDABLE);
+    BOOST_CHECK(IsMine(keystore, scriptMulti) == ISMINE_SPENDABLE);
+    BOOST_CHECK(IsMine(keystore, scriptOther) == ISMINE_NO);
+    BOOST_CHECK(!keystore.MightBeMine(scriptOther));
+
+    CScript scriptP2SH = GetScriptForDestination(scriptPKH.GetID());
+    BOOST_CHECK(IsMine(keystore, scriptP2SH) == ISMINE_NO);
+    keystore.AddCScript(scriptPKH);
+    BOOST_CHECK(IsMine(keystore, scriptP2SH) == ISMINE_SPENDABLE);
+
+    CScript scriptWatch = CScript() << OP_RETURN << ToByteVector(pubkey);
+    BOOST_CHECK(IsMine(keystore, scriptWatch) == ISMINE_NO);
+    keystore.AddWatchOnly(scriptWatch);
+    BOOST_CHECK(IsMine(keystore, scriptWatch) == ISMINE_WATCH_ONLY);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,65 @@
+#include <boost/test/unit_test.hpp>
+
+#include "hash.h"
+#include "net.h"
+
+BOOST_AUTO_TEST_SUITE(msghandler_tests)
+
+BOOST_AUTO_TEST_CASE(msgtime_histogram)
+{
+    BOOST_CHECK(CMessageTimeHistogram::Bucket(0) == 0);
+    BOOST_CHECK(CMessageTimeHistogram::Bucket(1) == 0);
+    BOOST_CHECK(CMessageTimeHistogram::Bucket(2) == 1);
+    BOOST_CHECK(CMessageTimeHistogram::Bucket(3) == 1);
+    BOOST_CHECK(CMessageTimeHistogram::Bucket(1024) == 10);
+    BOOST_CHECK(CMessageTimeHistogram::Bucket(2047) == 10);
+    BOOST_CHECK(CMessageTimeHistogram::Bucket(1000000000) == MSG_TIME_BUCKETS - 1);
+
+    CMessageTimeHistogram hist;
+    hist.Add(1);
+    hist.Add(5);
+    hist.Add(6);
+    BOOST_CHECK(hist.nCount == 3);
+    BOOST_CHECK(hist.nTotalTime == 12);
+    BOOST_CHECK(hist.nMaxTime == 6);
+    BOOST_CHECK(hist.vBuckets[0] == 1);
+    BOOST_CHECK(hist.vBuckets[2] == 2);
+}
+
+BOOST_AUTO_TEST_CASE(msg_cost)
+{
+    BOOST_CHECK(GetMessageCost("ping", 8) == 1);
+    BOOST_CHECK(GetMessageCost("mempool", 0) == 50);
+    // large messages pay for their size
+    BOOST_CHECK(GetMessageCost("block", 1000000) == 20 + 1000000 / MSG_COST_BYTES);
+    BOOST_CHECK(GetMessageCost("block", 1000000) > MSG_BUDGET_QUANTUM);
+
+    BOOST_CHECK(IsPriorityMessage("ix"));
+    BOOST_CHECK(IsPriorityMessage("block"));
+    BOOST_CHECK(!IsPriorityMessage("getdata"));
+}
+
+// A shared message carries the same header a peer's own send stream would get
+BOOST_AUTO_TEST_CASE(shared_message)
+{
+    std::vector<unsigned char> vPayload(1500, 0x5a);
+    CSharedMessage msg = MakeSharedMessage("tx", vPayload);
+
+    CDataStream ss(msg->begin(), msg->end(), SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr;
+    ss >> hdr;
+    BOOST_CHECK(hdr.IsValid());
+    BOOST_CHECK(hdr.GetCommand() == "tx");
+    BOOST_CHECK(hdr.nMessageSize == ss.size());
+
+    uint256 hash = Hash(ss.begin(), ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    BOOST_CHECK(hdr.nChecksum == nChecksum);
+
+    std::vector<unsigned char> vRead;
+    ss >> vRead;
+    BOOST_CHECK(vRead == vPayload);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,60 @@
+#ifndef DARKSILK_TEST_QUEUETEST_UTIL_H
+#define DARKSILK_TEST_QUEUETEST_UTIL_H
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+/**
+ * Collects what the callbacks of a verification queue report. The callbacks
+ * run on the queue's threads, where a failing BOOST_CHECK isn't reported
+ * reliably, so they only record and the test thread checks the records.
+ */
+template <typename T>
+class CCallbackRecorder
+{
+public:
+    void Add(const T& item)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        vItems.push_back(item);
+        cond.notify_all();
+    }
+
+    /** Wait until n items were recorded, false if that takes longer than nTimeoutMillis */
+    bool Wait(size_t n, int nTimeoutMillis = 30000)
+    {
+        boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(nTimeoutMillis);
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (vItems.size() < n)
+            if (!cond.timed_wait(lock, deadline))
+                return vItems.size() >= n;
+        return true;
+    }
+
+    std::vector<T> Get()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return vItems;
+    }
+
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::vector<T> vItems;
+};
+
+/** Threads started by a queue under test, stopped when the test case ends */
+class CQueueTestThreads
+{
+public:
+    boost::thread_group threadGroup;
+
+    ~CQueueTestThreads()
+    {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+    }
+};
+
+#endif // DARKSILK_TEST_QUEUETEST_UTIL_H
@@ -0,0 +1,85 @@
+#include <boost/test/unit_test.hpp>
+
+#include <clocale>
+#include <string>
+
+#include "rpc/rpcprotocol.h"
+
+using namespace json_spirit;
+
+BOOST_AUTO_TEST_SUITE(rpcprotocol_tests)
+
+// Replies must stay byte-for-byte what json_spirit's writer produced
+BOOST_AUTO_TEST_CASE(writejson_matches_json_spirit)
+{
+    const char* vstrJSON[] = {
+        "[]",
+        "{}",
+        "[{},[],null,true,false]",
+        "{\"a\":[1,-2,3.5,0.00000001,21000000],\"b\":\"x\\n\\\"y\\\\\\t\\u0001\\u007f\"}",
+        "{\"big\":18446744073709551615,\"min\":-9223372036854775808,\"exp\":1e3}",
+        "{\"id\":1,\"method\":\"getblock\",\"params\":[\"00ab\",true]}",
+    };
+    for (unsigned int i = 0; i < sizeof(vstrJSON) / sizeof(vstrJSON[0]); i++)
+    {
+        Value value;
+        BOOST_CHECK(read_string(std::string(vstrJSON[i]), value));
+        BOOST_CHECK_EQUAL(WriteJSON(value), write_string(value, false));
+
+        Value valueFast;
+        BOOST_CHECK(ReadJSON(vstrJSON[i], valueFast));
+        BOOST_CHECK_EQUAL(WriteJSON(valueFast), write_string(value, false));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(readjson_rejects_malformed)
+{
+    const char* vstrBad[] = {
+        "", "[", "[1,]", "{\"a\"}", "{\"a\":1,}", "[01]", "[1.]", "[-]", "[tru]",
+        "\"unterminated", "[\"\\x\"]", "[1] 2", "{1:2}",
+    };
+    for (unsigned int i = 0; i < sizeof(vstrBad) / sizeof(vstrBad[0]); i++)
+    {
+        Value value;
+        BOOST_CHECK_MESSAGE(!ReadJSON(vstrBad[i], value), vstrBad[i]);
+    }
+
+    Value value;
+    BOOST_CHECK(ReadJSON(" [ \"\\u00e9\\ud83d\\ude00\" ] \r\n", value));
+    BOOST_CHECK_EQUAL(value.get_array()[0].get_str(), "\xc3\xa9\xf0\x9f\x98\x80");
+}
+
+BOOST_AUTO_TEST_CASE(json_utf8_round_trip)
+{
+    // valid UTF-8 passes through, a stray byte is still escaped
+    Array arr;
+    arr.push_back(std::string("caf\xc3\xa9 \xf0\x9f\x98\x80"));
+    arr.push_back(std::string("\xff"));
+    std::string strJSON = WriteJSON(Value(arr));
+    BOOST_CHECK_EQUAL(strJSON, "[\"caf\xc3\xa9 \xf0\x9f\x98\x80\",\"\\u00FF\"]");
+
+    Value value;
+    BOOST_CHECK(ReadJSON(strJSON, value));
+    BOOST_CHECK_EQUAL(value.get_array()[0].get_str(), "caf\xc3\xa9 \xf0\x9f\x98\x80");
+}
+
+BOOST_AUTO_TEST_CASE(json_numbers_ignore_locale)
+{
+    std::string strLocale = setlocale(LC_NUMERIC, NULL);
+    // only runs where a locale with a decimal comma is installed
+    if (!setlocale(LC_NUMERIC, "de_DE.UTF-8") && !setlocale(LC_NUMERIC, "de_DE"))
+        return;
+
+    Array arr;
+    arr.push_back(3.5);
+    arr.push_back(-0.00000001);
+    BOOST_CHECK_EQUAL(WriteJSON(Value(arr)), "[3.50000000,-0.00000001]");
+
+    Value value;
+    BOOST_CHECK(ReadJSON("[1.25e2]", value));
+    BOOST_CHECK_EQUAL(value.get_array()[0].get_real(), 125.0);
+
+    setlocale(LC_NUMERIC, strLocale.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+#include <boost/test/unit_test.hpp>
+
+#include <openssl/sha.h>
+
+#include <string.h>
+#include <vector>
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "utilstrencodings.h"
+
+BOOST_AUTO_TEST_SUITE(sha256_tests)
+
+// FIPS 180-2 vectors, run through whichever transform the CPU selects
+BOOST_AUTO_TEST_CASE(sha256_vectors)
+{
+    SHA256AutoDetect();
+
+    std::string strAbc = "abc";
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)strAbc.data(), strAbc.size()).Finalize(hash);
+    BOOST_CHECK_EQUAL(HexStr(hash, hash + sizeof(hash)), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    std::string strMillion(1000000, 'a');
+    CSHA256().Write((const unsigned char*)strMillion.data(), strMillion.size()).Finalize(hash);
+    BOOST_CHECK_EQUAL(HexStr(hash, hash + sizeof(hash)), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+// Hash() must agree with the OpenSSL double-SHA256 it replaced, at every buffer offset
+BOOST_AUTO_TEST_CASE(hash_matches_openssl)
+{
+    SHA256AutoDetect();
+
+    std::vector<unsigned char> vch(300);
+    for (unsigned int i = 0; i < vch.size(); i++)
+        vch[i] = insecure_rand();
+    for (unsigned int n = 0; n <= vch.size(); n++)
+    {
+        uint256 hash1, hash2;
+        SHA256(&vch[0], n, (unsigned char*)&hash1);
+        SHA256((unsigned char*)&hash1, sizeof(hash1), (unsigned char*)&hash2);
+        BOOST_CHECK(Hash(vch.begin(), vch.begin() + n) == hash2);
+    }
+}
+
+// The batched 64-byte double-SHA256 has to match Hash() for every lane count
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    SHA256AutoDetect();
+
+    for (int nBlocks = 0; nBlocks <= 34; nBlocks++)
+    {
+        std::vector<unsigned char> vIn(64 * nBlocks), vOut(32 * nBlocks);
+        for (unsigned int i = 0; i < vIn.size(); i++)
+            vIn[i] = insecure_rand();
+        SHA256D64(vOut.empty() ? NULL : &vOut[0], vIn.empty() ? NULL : &vIn[0], nBlocks);
+        for (int i = 0; i < nBlocks; i++)
+        {
+            uint256 hash = Hash(vIn.begin() + 64 * i, vIn.begin() + 64 * (i + 1));
+            BOOST_CHECK(memcmp(&vOut[32 * i], hash.begin(), 32) == 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
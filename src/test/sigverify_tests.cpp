@@ -0,0 +1,99 @@
+#include <boost/test/unit_test.hpp>
+
+#include "anon/sandstorm/sandstorm.h"
+#include "anon/stormnode/stormnode-sigverify.h"
+#include "key.h"
+#include "utiltime.h"
+
+BOOST_AUTO_TEST_SUITE(sigverify_tests)
+
+// Messages wait behind each other per peer and come out once their keys are recovered
+BOOST_AUTO_TEST_CASE(sigverify_defer)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    std::string strError;
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(sandStormSigner.SignMessage("first", strError, vchSig, key));
+
+    boost::thread_group threadGroup;
+    CSigVerifyQueue queue;
+    CDataStream ssFirst(SER_NETWORK, PROTOCOL_VERSION), ssSecond(SER_NETWORK, PROTOCOL_VERSION);
+    ssFirst << 1;
+    ssSecond << 2;
+
+    // without workers nothing is held back
+    BOOST_CHECK(!queue.Defer(1, "snp", ssFirst, std::vector<CSigCheck>(1, CSigCheck("first", vchSig))));
+
+    queue.Start(threadGroup, 2);
+    BOOST_CHECK(queue.Defer(1, "snp", ssFirst, std::vector<CSigCheck>(1, CSigCheck("first", vchSig))));
+    // nothing to check, but behind the first message of the same peer
+    BOOST_CHECK(queue.Defer(1, "snw", ssSecond, std::vector<CSigCheck>()));
+    BOOST_CHECK(!queue.Defer(2, "snw", ssSecond, std::vector<CSigCheck>()));
+
+    while (queue.GetStats().nRecovered < 1)
+        MilliSleep(1);
+
+    std::string strCommand;
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    int n;
+    BOOST_CHECK(queue.PopReady(1, strCommand, ss));
+    ss >> n;
+    BOOST_CHECK(strCommand == "snp" && n == 1);
+    BOOST_CHECK(queue.PopReady(1, strCommand, ss));
+    ss >> n;
+    BOOST_CHECK(strCommand == "snw" && n == 2);
+    BOOST_CHECK(!queue.PopReady(1, strCommand, ss));
+
+    // the key comes from the cache, a bad signature recovers nothing or another key
+    CKeyID keyID;
+    BOOST_CHECK(queue.Recover(CSigCheck("first", vchSig), keyID));
+    BOOST_CHECK(keyID == key.GetPubKey().GetID());
+    BOOST_CHECK_EQUAL(queue.GetStats().nRecoveredInline, 0U);
+    BOOST_CHECK(!queue.Recover(CSigCheck("first", std::vector<unsigned char>(65, 0)), keyID) || keyID != key.GetPubKey().GetID());
+    BOOST_CHECK(!queue.Recover(CSigCheck("second", vchSig), keyID) || keyID != key.GetPubKey().GetID());
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+// A peer's share of held back messages is capped, past it Defer() drops instead of waiting
+BOOST_AUTO_TEST_CASE(sigverify_defer_cap)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    std::string strError;
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(sandStormSigner.SignMessage("cap", strError, vchSig, key));
+
+    boost::thread_group threadGroup;
+    CSigVerifyQueue queue;
+    queue.Start(threadGroup, 1);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << 1;
+    BOOST_CHECK(queue.Defer(1, "snp", ss, std::vector<CSigCheck>(1, CSigCheck("cap", vchSig))));
+    for (unsigned int i = 1; i < MAX_SIG_VERIFY_DEFERRED; i++)
+        BOOST_CHECK(queue.Defer(1, "snw", ss, std::vector<CSigCheck>()));
+    BOOST_CHECK_EQUAL(queue.GetStats().nDropped, 0U);
+    BOOST_CHECK_EQUAL(queue.GetStats().nWaiting, MAX_SIG_VERIFY_DEFERRED);
+
+    // one more is dropped, another peer isn't affected
+    BOOST_CHECK(queue.Defer(1, "snw", ss, std::vector<CSigCheck>()));
+    BOOST_CHECK_EQUAL(queue.GetStats().nDropped, 1U);
+    BOOST_CHECK(!queue.Defer(2, "snw", ss, std::vector<CSigCheck>()));
+
+    // so is a message that doesn't fit in the bytes left to a peer
+    queue.ForgetNode(1);
+    BOOST_CHECK(queue.Defer(1, "snp", ss, std::vector<CSigCheck>(1, CSigCheck("cap", std::vector<unsigned char>(65, 1)))));
+    CDataStream ssBig(SER_NETWORK, PROTOCOL_VERSION);
+    ssBig << std::vector<unsigned char>(MAX_SIG_VERIFY_DEFERRED_SIZE);
+    BOOST_CHECK(queue.Defer(1, "snb", ssBig, std::vector<CSigCheck>()));
+    BOOST_CHECK_EQUAL(queue.GetStats().nDropped, 2U);
+    BOOST_CHECK_EQUAL(queue.GetStats().nWaiting, 1U);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,75 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "chain.h"
+#include "random.h"
+#include "util.h"
+
+#define SKIPLIST_LENGTH 300000
+
+BOOST_AUTO_TEST_SUITE(skiplist_tests)
+
+// Test that pskip points at an ancestor and that GetAncestor() follows it correctly
+BOOST_AUTO_TEST_CASE(skiplist_test)
+{
+    std::vector<CBlockIndex> vIndex(SKIPLIST_LENGTH);
+
+    for (int i=0; i<SKIPLIST_LENGTH; i++) {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+    }
+
+    for (int i=0; i<SKIPLIST_LENGTH; i++) {
+        if (i > 0) {
+            BOOST_CHECK(vIndex[i].pskip == &vIndex[vIndex[i].pskip->nHeight]);
+            BOOST_CHECK(vIndex[i].pskip->nHeight < i);
+        } else {
+            BOOST_CHECK(vIndex[i].pskip == NULL);
+        }
+    }
+
+    for (int i=0; i < 1000; i++) {
+        int from = GetRandInt(SKIPLIST_LENGTH - 1);
+        int to = GetRandInt(from + 1);
+
+        BOOST_CHECK(vIndex[SKIPLIST_LENGTH - 1].GetAncestor(from) == &vIndex[from]);
+        BOOST_CHECK(vIndex[from].GetAncestor(to) == &vIndex[to]);
+        BOOST_CHECK(vIndex[from].GetAncestor(0) == &vIndex[0]);
+    }
+}
+
+// Test that the height-indexed chain follows a switch to a shorter branch
+BOOST_AUTO_TEST_CASE(chain_settip_test)
+{
+    std::vector<CBlockIndex> vMain(1000);
+    std::vector<CBlockIndex> vFork(200);
+
+    for (unsigned int i=0; i<vMain.size(); i++) {
+        vMain[i].nHeight = i;
+        vMain[i].pprev = (i == 0) ? NULL : &vMain[i - 1];
+        vMain[i].BuildSkip();
+    }
+    for (unsigned int i=0; i<vFork.size(); i++) {
+        vFork[i].nHeight = 500 + i;
+        vFork[i].pprev = (i == 0) ? &vMain[499] : &vFork[i - 1];
+        vFork[i].BuildSkip();
+    }
+
+    CChain chain;
+    chain.SetTip(&vMain.back());
+    BOOST_CHECK(chain.Height() == 999);
+    BOOST_CHECK(chain[0] == &vMain[0]);
+    BOOST_CHECK(chain[1000] == NULL);
+    BOOST_CHECK(chain[-1] == NULL);
+
+    chain.SetTip(&vFork.back());
+    BOOST_CHECK(chain.Height() == 699);
+    BOOST_CHECK(chain[499] == &vMain[499]);
+    BOOST_CHECK(chain[500] == &vFork[0]);
+    BOOST_CHECK(!chain.Contains(&vMain[500]));
+    BOOST_CHECK(chain.FindFork(&vMain[900]) == &vMain[499]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,229 @@
+#include <boost/test/unit_test.hpp>
+
+#include "anon/stormnode/stormnode-cache.h"
+#include "primitives/transaction.h"
+
+#include <boost/filesystem.hpp>
+
+BOOST_AUTO_TEST_SUITE(stormnode_cache_tests)
+
+// A directory of its own for the journals of one test case, removed at the end
+struct CJournalDir
+{
+    boost::filesystem::path path;
+
+    CJournalDir()
+    {
+        path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("darksilk_cachetest_%%%%-%%%%-%%%%");
+        boost::filesystem::create_directories(path);
+    }
+
+    ~CJournalDir()
+    {
+        boost::filesystem::remove_all(path);
+    }
+};
+
+static COutPoint OutPointKey(const CTxOut& out)
+{
+    return COutPoint(uint256(out.nValue), 0);
+}
+
+// A manager with one section of each kind
+struct CTestCache
+{
+    std::vector<CTxOut> vOut;
+    std::map<uint256, int64_t> mapSeen;
+    int64_t nCount;
+
+    CTestCache() : nCount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vOut);
+        READWRITE(mapSeen);
+        READWRITE(nCount);
+    }
+
+    void GetCacheSections(CCacheSections& sections) const
+    {
+        sections.AddList(vOut, &OutPointKey);
+        sections.AddSeenMap(mapSeen);
+        sections.AddValue(nCount);
+    }
+
+    void Clear()
+    {
+        vOut.clear();
+        mapSeen.clear();
+        nCount = 0;
+    }
+};
+
+// Sections must serialize to exactly what serializing the members would give
+BOOST_AUTO_TEST_CASE(cache_sections_layout)
+{
+    std::map<uint256, int64_t> mapSeen;
+    mapSeen[uint256(1)] = 10;
+    mapSeen[uint256(2)] = 20;
+    // not in the order of their keys
+    std::vector<CTxOut> vOut;
+    vOut.push_back(CTxOut(2, CScript() << OP_FALSE));
+    vOut.push_back(CTxOut(1, CScript() << OP_TRUE));
+    int64_t nCount = 7;
+
+    CDataStream ssDirect(SER_DISK, CLIENT_VERSION);
+    ssDirect << vOut << mapSeen << nCount;
+
+    CCacheSections sections;
+    sections.AddList(vOut, &OutPointKey);
+    sections.AddMap(mapSeen);
+    sections.AddValue(nCount);
+    CDataStream ssSections(SER_DISK, CLIENT_VERSION);
+    sections.Serialize(ssSections);
+    BOOST_CHECK(ssSections.str() == ssDirect.str());
+
+    // a removed entry drops out of its section only
+    mapSeen.erase(uint256(1));
+    CCacheSections sections2;
+    sections2.AddList(vOut, &OutPointKey);
+    sections2.AddMap(mapSeen);
+    sections2.AddValue(nCount);
+    BOOST_CHECK(sections2.vSections[0].mapEntries == sections.vSections[0].mapEntries);
+    BOOST_CHECK(sections2.vSections[1].mapEntries.size() == 1);
+    BOOST_CHECK(sections2.vSections[2].mapEntries == sections.vSections[2].mapEntries);
+}
+
+static void JournalLayout(CCacheSections& sections, const std::map<uint256, int64_t>& mapSeen, int64_t nCount)
+{
+    sections.AddMap(mapSeen);
+    sections.AddValue(nCount);
+}
+
+static void LoadJournal(const CJournalDir& dir, const std::string& strFilename, std::map<uint256, int64_t>& mapSeenRet, int64_t& nCountRet)
+{
+    CCacheJournal journal(strFilename, "magicCacheTest", dir.path);
+    CCacheSections sections;
+    JournalLayout(sections, std::map<uint256, int64_t>(), 0);
+    BOOST_CHECK(journal.Load(sections));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    sections.Serialize(ss);
+    ss >> mapSeenRet >> nCountRet;
+}
+
+// A flush cut short leaves a torn record at the end, loading keeps everything before it
+BOOST_AUTO_TEST_CASE(cache_journal_torn_record)
+{
+    CJournalDir dir;
+    const std::string strFilename = "cachetest.jnl";
+    boost::filesystem::path path = dir.path / strFilename;
+
+    std::map<uint256, int64_t> mapSeen;
+    mapSeen[uint256(1)] = 10;
+    mapSeen[uint256(2)] = 20;
+    int64_t nCount = 7;
+
+    // the first flush writes the whole cache, the second only appends what changed
+    CCacheJournal journal(strFilename, "magicCacheTest", dir.path);
+    CCacheSections sections;
+    JournalLayout(sections, mapSeen, nCount);
+    BOOST_CHECK(journal.Flush(sections));
+    uint64_t nFullSize = boost::filesystem::file_size(path);
+
+    mapSeen.erase(uint256(1));
+    mapSeen[uint256(3)] = 30;
+    nCount = 8;
+    CCacheSections sections2;
+    JournalLayout(sections2, mapSeen, nCount);
+    BOOST_CHECK(journal.Flush(sections2));
+    uint64_t nAppendedSize = boost::filesystem::file_size(path);
+    BOOST_CHECK(nAppendedSize > nFullSize);
+
+    std::map<uint256, int64_t> mapLoaded;
+    int64_t nCountLoaded = 0;
+    LoadJournal(dir, strFilename, mapLoaded, nCountLoaded);
+    BOOST_CHECK(mapLoaded == mapSeen);
+    BOOST_CHECK_EQUAL(nCountLoaded, 8);
+
+    // cut the last record, the put of nCount, in the middle
+    boost::filesystem::resize_file(path, nAppendedSize - 1);
+    mapLoaded.clear();
+    LoadJournal(dir, strFilename, mapLoaded, nCountLoaded);
+    BOOST_CHECK(mapLoaded == mapSeen);
+    BOOST_CHECK_EQUAL(nCountLoaded, 7);
+    uint64_t nGoodSize = boost::filesystem::file_size(path);
+    BOOST_CHECK(nGoodSize > nFullSize && nGoodSize < nAppendedSize - 1);
+
+    // a flush after the load appends right behind the good records
+    CCacheJournal journal2(strFilename, "magicCacheTest", dir.path);
+    CCacheSections sections3;
+    JournalLayout(sections3, std::map<uint256, int64_t>(), 0);
+    BOOST_CHECK(journal2.Load(sections3));
+    CCacheSections sections4;
+    JournalLayout(sections4, mapSeen, nCount);
+    BOOST_CHECK(journal2.Flush(sections4));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nAppendedSize);
+
+    mapLoaded.clear();
+    LoadJournal(dir, strFilename, mapLoaded, nCountLoaded);
+    BOOST_CHECK(mapLoaded == mapSeen);
+    BOOST_CHECK_EQUAL(nCountLoaded, 8);
+
+    // a journal torn inside its header is not used at all
+    boost::filesystem::resize_file(path, 3);
+    CCacheJournal journal3(strFilename, "magicCacheTest", dir.path);
+    CCacheSections sections5;
+    JournalLayout(sections5, std::map<uint256, int64_t>(), 0);
+    BOOST_CHECK(!journal3.Load(sections5));
+}
+
+// Lists come back in their order, seen entries already written are neither serialized nor written again
+BOOST_AUTO_TEST_CASE(cache_journal_reload)
+{
+    CJournalDir dir;
+    const std::string strFilename = "cachetest.jnl";
+    boost::filesystem::path path = dir.path / strFilename;
+
+    CTestCache cache;
+    cache.vOut.push_back(CTxOut(3, CScript() << OP_TRUE));
+    cache.vOut.push_back(CTxOut(1, CScript() << OP_TRUE));
+    cache.vOut.push_back(CTxOut(2, CScript() << OP_TRUE));
+    cache.mapSeen[uint256(1)] = 10;
+    cache.mapSeen[uint256(2)] = 20;
+    cache.nCount = 7;
+
+    CCacheJournal journal(strFilename, "magicCacheTest", dir.path);
+    BOOST_CHECK(journal.NeedsRewrite());
+    BOOST_CHECK(FlushToJournal(journal, cache));
+    BOOST_CHECK(!journal.NeedsRewrite());
+    uint64_t nFullSize = boost::filesystem::file_size(path);
+
+    {
+        LOCK(journal.cs);
+        CCacheSections sections(&journal);
+        cache.GetCacheSections(sections);
+        BOOST_CHECK(sections.vSections[1].mapEntries.empty());
+        BOOST_CHECK_EQUAL(sections.vSections[1].setWrittenKeys.size(), 2U);
+    }
+    BOOST_CHECK(FlushToJournal(journal, cache));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nFullSize);
+
+    // a new seen entry and an erased one, a list element moved to the end
+    cache.mapSeen.erase(uint256(1));
+    cache.mapSeen[uint256(3)] = 30;
+    cache.vOut.push_back(cache.vOut[0]);
+    cache.vOut.erase(cache.vOut.begin());
+    BOOST_CHECK(FlushToJournal(journal, cache));
+
+    CCacheJournal journal2(strFilename, "magicCacheTest", dir.path);
+    CTestCache loaded;
+    BOOST_CHECK(LoadFromJournal(journal2, loaded));
+    BOOST_CHECK(loaded.vOut == cache.vOut);
+    BOOST_CHECK(loaded.mapSeen == cache.mapSeen);
+    BOOST_CHECK_EQUAL(loaded.nCount, 7);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
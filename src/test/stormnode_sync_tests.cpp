@@ -0,0 +1,38 @@
+#include <boost/test/unit_test.hpp>
+
+#include "anon/stormnode/stormnode.h"
+
+BOOST_AUTO_TEST_SUITE(stormnode_sync_tests)
+
+// Only objects changed after the cursor come back, each in its latest version
+BOOST_AUTO_TEST_CASE(sync_change_log)
+{
+    CSyncChangeLog changeLog;
+    std::vector<CInv> vInv;
+
+    for (int i = 0; i < 100; i++)
+        changeLog.Changed(uint256(i), CInv(MSG_BUDGET_PROPOSAL, uint256(i)));
+    CSyncCursor cursor = changeLog.GetCursor();
+    BOOST_CHECK(changeLog.GetChangesSince(cursor, vInv));
+    BOOST_CHECK(vInv.empty());
+
+    // a changed vote moves to the end, a removed one is gone
+    changeLog.Changed(uint256(3), CInv(MSG_BUDGET_VOTE, uint256(1003)));
+    changeLog.Changed(uint256(100), CInv(MSG_BUDGET_VOTE, uint256(1100)));
+    changeLog.Changed(uint256(3), CInv(MSG_BUDGET_VOTE, uint256(2003)));
+    changeLog.Forget(uint256(100));
+    BOOST_CHECK(changeLog.GetChangesSince(cursor, vInv));
+    BOOST_CHECK_EQUAL(vInv.size(), 1U);
+    BOOST_CHECK(vInv[0].type == MSG_BUDGET_VOTE && vInv[0].hash == uint256(2003));
+    BOOST_CHECK_EQUAL(changeLog.size(), 100U);
+
+    // too many changes, or a cursor from elsewhere, need a full sync
+    BOOST_CHECK(!changeLog.GetChangesSince(CSyncCursor(cursor.nEpoch, 0), vInv));
+    BOOST_CHECK(!changeLog.GetChangesSince(CSyncCursor(cursor.nEpoch, cursor.nSeq + 10), vInv));
+    BOOST_CHECK(!changeLog.GetChangesSince(CSyncCursor(), vInv));
+    changeLog.Clear();
+    BOOST_CHECK(!changeLog.GetChangesSince(cursor, vInv));
+    BOOST_CHECK(changeLog.GetChangesSince(changeLog.GetCursor(), vInv));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/bind.hpp>
+
+#include "consensus/validation.h"
+#include "main.h"
+#include "txverify.h"
+#include "test/queuetest_util.h"
+
+BOOST_AUTO_TEST_SUITE(txverify_tests)
+
+struct CAcceptResult
+{
+    bool fAccepted;
+    bool fMissingInputs;
+    bool fMainLocked;                   //! cs_main was held while the callback ran
+};
+
+static void TryLockMain(bool* pfLockedRet)
+{
+    TRY_LOCK(cs_main, lockMain);
+    *pfLockedRet = !lockMain;
+}
+
+static void RecordAccepted(CCallbackRecorder<CAcceptResult>* precorder, CTransaction& tx, CNode* pfrom, CValidationState& state, bool fAccepted, bool fMissingInputs)
+{
+    CAcceptResult result;
+    result.fAccepted = fAccepted;
+    result.fMissingInputs = fMissingInputs;
+    // cs_main is recursive, only another thread can tell whether this one holds it
+    boost::thread t(boost::bind(&TryLockMain, &result.fMainLocked));
+    t.join();
+    precorder->Add(result);
+}
+
+static void CheckScripts(const CTransaction* ptx, const CMemPoolInputs* pinputs, bool* pfPassedRet)
+{
+    *pfPassedRet = CheckInputScripts(*ptx, *pinputs);
+}
+
+// A transaction spending output 0 of txPrev with an empty scriptSig
+static CTransaction Spend(const CTransaction& txPrev, CMemPoolInputs& inputsRet)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    mtx.vout.push_back(CTxOut(txPrev.vout[0].nValue - CENT, CScript() << OP_TRUE));
+    inputsRet.mapInputs[txPrev.GetHash()] = std::make_pair(CTxIndex(), txPrev);
+    return CTransaction(mtx);
+}
+
+static CTransaction PayTo(const CScript& scriptPubKey)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.push_back(CTxOut(COIN, scriptPubKey));
+    return CTransaction(mtx);
+}
+
+// Rejected transactions still reach the callback under cs_main, inline or on the worker threads
+BOOST_AUTO_TEST_CASE(txverify_reject)
+{
+    for (int nWorkers = 0; nWorkers <= 2; nWorkers += 2)
+    {
+        CQueueTestThreads threads;
+        CTxVerifyQueue queue;
+        queue.Start(threads.threadGroup, nWorkers);
+
+        CCallbackRecorder<CAcceptResult> recorder;
+        for (int i = 0; i < 10; i++)
+        {
+            CMutableTransaction mtx;
+            mtx.nLockTime = i;
+            queue.Push(CTransaction(mtx), NULL, true, false, boost::bind(&RecordAccepted, &recorder, _1, _2, _3, _4, _5));
+        }
+        BOOST_CHECK(recorder.Wait(10));
+
+        // a transaction without inputs never gets into the pool
+        std::vector<CAcceptResult> vResults = recorder.Get();
+        BOOST_CHECK_EQUAL(vResults.size(), 10U);
+        BOOST_FOREACH(const CAcceptResult& result, vResults)
+        {
+            BOOST_CHECK(!result.fAccepted);
+            BOOST_CHECK(!result.fMissingInputs);
+            BOOST_CHECK(result.fMainLocked);
+        }
+
+        while (queue.GetStats().nProcessed < 10)
+            MilliSleep(1);
+        CTxVerifyQueue::Stats stats = queue.GetStats();
+        BOOST_CHECK_EQUAL(stats.nAccepted, 0U);
+        BOOST_CHECK_EQUAL(stats.nQueued, 0U);
+        BOOST_CHECK_EQUAL(stats.nScriptTime, 0);
+    }
+}
+
+// The script checks finish while another thread holds cs_main
+BOOST_AUTO_TEST_CASE(txverify_scripts_without_cs_main)
+{
+    CMemPoolInputs inputs;
+    CTransaction tx = Spend(PayTo(CScript() << OP_TRUE), inputs);
+
+    bool fPassed = false;
+    bool fFinished;
+    boost::thread t(boost::bind(&CheckScripts, &tx, &inputs, &fPassed));
+    {
+        LOCK(cs_main);
+        fFinished = t.timed_join(boost::posix_time::seconds(30));
+    }
+    t.join();
+    BOOST_CHECK(fFinished);
+    BOOST_CHECK(fPassed);
+
+    // and still catch a script that fails
+    CMemPoolInputs inputsFalse;
+    CTransaction txFalse = Spend(PayTo(CScript() << OP_FALSE), inputsFalse);
+    BOOST_CHECK(!CheckInputScripts(txFalse, inputsFalse));
+}
+
+// Inputs fetched before the best chain moved are fetched again before the transaction is added
+BOOST_AUTO_TEST_CASE(txverify_refetch_inputs)
+{
+    LOCK(cs_main);
+
+    // fetched at the current tip: used as they are, even for a previous transaction we don't have
+    CMemPoolInputs inputs;
+    CTransaction tx = Spend(PayTo(CScript() << OP_TRUE), inputs);
+    inputs.hashBestChain = hashBestChain;
+    CValidationState state;
+    bool fMissingInputs = false;
+    BOOST_CHECK(FinishAcceptToMemoryPool(mempool, state, tx, &fMissingInputs, inputs));
+    BOOST_CHECK(mempool.exists(tx.GetHash()));
+    mempool.remove(tx);
+
+    // fetched at an older tip: looked up again, and the previous transaction is missing
+    CMemPoolInputs inputsOld;
+    CTransaction tx2 = Spend(PayTo(CScript() << OP_TRUE), inputsOld);
+    inputsOld.hashBestChain = GetRandHash();
+    BOOST_CHECK(!FinishAcceptToMemoryPool(mempool, state, tx2, &fMissingInputs, inputsOld));
+    BOOST_CHECK(fMissingInputs);
+    BOOST_CHECK(!mempool.exists(tx2.GetHash()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -292,4 +292,123 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     }
 }
 
+// What GetAddressBalances summed up per destination before the address index
+static CAmount scan_address_balance(CWallet& w, const CTxDestination& dest)
+{
+    CAmount nBalance = 0;
+    LOCK2(cs_main, w.cs_wallet);
+    BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, w.mapWallet)
+    {
+        const CWalletTx* pcoin = &item.second;
+        if (!IsFinalTx(*pcoin) || !pcoin->IsTrusted())
+            continue;
+        if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
+            continue;
+        if (pcoin->GetDepthInMainChain() < (pcoin->IsFromMe(ISMINE_ALL) ? 0 : 1))
+            continue;
+        for (unsigned int i = 0; i < pcoin->vout.size(); i++)
+        {
+            CTxDestination addr;
+            if (!w.IsMine(pcoin->vout[i]) || !ExtractDestination(pcoin->vout[i].scriptPubKey, addr) || !(addr == dest))
+                continue;
+            if (!pcoin->IsSpent(i))
+                nBalance += pcoin->vout[i].nValue;
+        }
+    }
+    return nBalance;
+}
+
+// The index must give what a scan of the whole wallet gives
+static void check_address_index(CWallet& w, const CTxDestination& dest)
+{
+    BOOST_CHECK_EQUAL(w.GetAddressBalance(dest), scan_address_balance(w, dest));
+
+    vector<COutput> vAll, vIndexed;
+    w.AvailableCoins(vAll);
+    set<CTxDestination> setDest;
+    setDest.insert(dest);
+    w.AvailableCoinsByAddress(setDest, vIndexed);
+
+    set<COutPoint> setScanned, setIndexed;
+    BOOST_FOREACH(const COutput& out, vAll)
+    {
+        CTxDestination addr;
+        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, addr) && addr == dest)
+            setScanned.insert(COutPoint(out.tx->GetHash(), out.i));
+    }
+    BOOST_FOREACH(const COutput& out, vIndexed)
+        setIndexed.insert(COutPoint(out.tx->GetHash(), out.i));
+    BOOST_CHECK(setIndexed == setScanned);
+}
+
+BOOST_AUTO_TEST_CASE(address_index_tests)
+{
+    CWallet w;
+    CKey keyA, keyB, keyOther;
+    keyA.MakeNewKey(true);
+    keyB.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    BOOST_CHECK(w.AddKeyPubKey(keyA, keyA.GetPubKey()));
+    BOOST_CHECK(w.AddKeyPubKey(keyB, keyB.GetPubKey()));
+    CTxDestination destA = keyA.GetPubKey().GetID();
+    CTxDestination destB = keyB.GetPubKey().GetID();
+
+    // the first query builds the index from an empty wallet, later changes go in one by one
+    check_address_index(w, destA);
+
+    CMutableTransaction txReceive;
+    txReceive.vout.resize(3);
+    txReceive.vout[0].nValue = 5 * COIN;
+    txReceive.vout[0].scriptPubKey = GetScriptForDestination(destA);
+    txReceive.vout[1].nValue = 3 * COIN;
+    txReceive.vout[1].scriptPubKey = GetScriptForDestination(destB);
+    txReceive.vout[2].nValue = 2 * COIN;
+    txReceive.vout[2].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    CWalletTx wtxReceive(&w, CTransaction(txReceive));
+
+    // confirm it as the only transaction of the best block
+    CBlockIndex* pindexBestOld = pindexBest;
+    uint256 hashBlock = GetRandHash();
+    CBlockIndex blockindex;
+    blockindex.nHeight = nBestHeight;
+    blockindex.hashMerkleRoot = wtxReceive.GetHash();
+    blockindex.phashBlock = &mapBlockIndex.insert(make_pair(hashBlock, &blockindex)).first->first;
+    pindexBest = &blockindex;
+    wtxReceive.hashBlock = hashBlock;
+    wtxReceive.nIndex = 0;
+
+    // not file backed, so writing to disk fails after the transaction is in the wallet
+    w.AddToWallet(wtxReceive);
+    BOOST_CHECK(w.mapWallet.count(wtxReceive.GetHash()));
+    BOOST_CHECK_EQUAL(w.GetAddressBalance(destA), 5 * COIN);
+    check_address_index(w, destA);
+    check_address_index(w, destB);
+
+    // spend the output of A, it leaves both results but stays indexed until the spend is settled
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(COutPoint(wtxReceive.GetHash(), 0)));
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 4 * COIN;
+    txSpend.vout[0].scriptPubKey = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    CWalletTx wtxSpend(&w, CTransaction(txSpend));
+    w.AddToWallet(wtxSpend);
+    w.mapWallet[wtxReceive.GetHash()].MarkSpent(0);
+    BOOST_CHECK_EQUAL(w.GetAddressBalance(destA), 0);
+    check_address_index(w, destA);
+    check_address_index(w, destB);
+
+    // erasing the spend brings the output of A back, erasing the receive drops both
+    w.EraseFromWallet(wtxSpend.GetHash());
+    w.mapWallet[wtxReceive.GetHash()].MarkUnspent(0);
+    check_address_index(w, destA);
+    w.EraseFromWallet(wtxReceive.GetHash());
+    BOOST_CHECK_EQUAL(w.GetAddressBalance(destA), 0);
+    BOOST_CHECK_EQUAL(w.GetAddressBalance(destB), 0);
+    check_address_index(w, destA);
+    check_address_index(w, destB);
+
+    pindexBest = pindexBestOld;
+    mapBlockIndex.erase(hashBlock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
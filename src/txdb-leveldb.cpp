@@ -31,14 +31,37 @@ using namespace boost;
 
 leveldb::DB *txdb; // global pointer for LevelDB object instance
 
+static leveldb::Options openOptions; // options the global instance was opened with
+static bool fTxDbSync = DEFAULT_TXDB_SYNC;
+
 static leveldb::Options GetOptions() {
     leveldb::Options options;
     int nCacheSizeMB = GetArg("-dbcache", 25);
     options.block_cache = leveldb::NewLRUCache(nCacheSizeMB * 1048576);
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    // Larger write buffers mean fewer, bigger level-0 files and less
+    // compaction churn during initial sync, at the cost of memory and
+    // recovery time. Spinning disks want larger blocks, NVMe can stay small.
+    options.write_buffer_size = std::max((int64_t)1, GetArg("-dbwritebuffer", nDefaultTxDbWriteBuffer)) << 20;
+    options.max_open_files = std::max(64, (int)GetArg("-dbmaxopenfiles", nDefaultTxDbMaxOpenFiles));
+    options.block_size = std::max((int64_t)1, GetArg("-dbblocksize", nDefaultTxDbBlockSize)) << 10;
+    options.compression = GetBoolArg("-dbcompression", DEFAULT_TXDB_COMPRESSION) ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    fTxDbSync = GetBoolArg("-dbsync", DEFAULT_TXDB_SYNC);
     return options;
 }
 
+leveldb::WriteOptions CTxDB::GetWriteOptions()
+{
+    leveldb::WriteOptions writeOptions;
+    writeOptions.sync = fTxDbSync;
+    return writeOptions;
+}
+
+const leveldb::Options& CTxDB::GetOpenOptions()
+{
+    return openOptions;
+}
+
 static void init_blockindex(leveldb::Options& options, bool fRemoveOld = false, bool fCreateBootstrap = false) {
     // First time init.
     filesystem::path directory = GetDataDir() / "txleveldb";
@@ -69,11 +92,14 @@ static void init_blockindex(leveldb::Options& options, bool fRemoveOld = false,
     options.create_if_missing = true;
 
     filesystem::create_directory(directory);
-    LogPrintf("Opening LevelDB in %s\n", directory.string());
+    LogPrintf("Opening LevelDB in %s (write buffer %dMiB, max open files %d, block size %dKiB, compression %s, sync %s)\n",
+        directory.string(), options.write_buffer_size >> 20, options.max_open_files, options.block_size >> 10,
+        options.compression == leveldb::kNoCompression ? "off" : "on", fTxDbSync ? "on" : "off");
     leveldb::Status status = leveldb::DB::Open(options, directory.string(), &txdb);
     if (!status.ok()) {
         throw runtime_error(strprintf("init_blockindex(): error opening database environment %s", status.ToString()));
     }
+    openOptions = options;
 }
 
 // CDB subclasses are created and destroyed VERY OFTEN. That's why
@@ -155,7 +181,7 @@ bool CTxDB::TxnBegin()
 bool CTxDB::TxnCommit()
 {
     assert(activeBatch);
-    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
+    leveldb::Status status = pdb->Write(GetWriteOptions(), activeBatch);
     delete activeBatch;
     activeBatch = NULL;
     if (!status.ok()) {
@@ -165,6 +191,33 @@ bool CTxDB::TxnCommit()
     return true;
 }
 
+bool CTxDB::GetProperty(const std::string& strProperty, std::string& strValue)
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+uint64_t CTxDB::GetApproximateSize(const std::string& strType)
+{
+    // Keys are serialized as (string type, ...), so every record of a type
+    // shares the serialized type string as a prefix. Bumping its last byte
+    // gives an exclusive upper bound for the range.
+    CDataStream ssBegin(SER_DISK, CLIENT_VERSION);
+    ssBegin << strType;
+    std::string strBegin = ssBegin.str();
+    std::string strEnd = strBegin;
+    strEnd[strEnd.size() - 1]++;
+
+    leveldb::Range range(strBegin, strEnd);
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+void CTxDB::Compact()
+{
+    pdb->CompactRange(NULL, NULL);
+}
+
 class CBatchScanner : public leveldb::WriteBatch::Handler {
 public:
     std::string needle;
@@ -412,7 +465,7 @@ bool CTxDB::LoadBlockIndex()
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainTrust
+    // Calculate nChainTrust and build the skiplist
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
@@ -425,6 +478,7 @@ bool CTxDB::LoadBlockIndex()
     {
         CBlockIndex* pindex = item.second;
         pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + pindex->GetBlockTrust();
+        pindex->BuildSkip();
     }
 
     // Load hashBestChain pointer to end of best chain
@@ -437,6 +491,7 @@ bool CTxDB::LoadBlockIndex()
     if (!mapBlockIndex.count(hashBestChain))
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
     pindexBest = mapBlockIndex[hashBestChain];
+    chainActive.SetTip(pindexBest);
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexBest->nChainTrust;
 
@@ -466,7 +521,7 @@ bool CTxDB::LoadBlockIndex()
             break;
         CValidationState state;
         CBlock block;
-        if (!block.ReadFromDisk(pindex))
+        if (!block.ReadFromDisk(pindex, true, true))
             return error("LoadBlockIndex() : block.ReadFromDisk failed");
         // check level 1: verify block validity
         // check level 7: verify block signature too
@@ -16,6 +16,17 @@
 #include "main.h"
 #include "streams.h"
 
+//! -dbwritebuffer default (MiB), LevelDB's own default
+static const int64_t nDefaultTxDbWriteBuffer = 4;
+//! -dbmaxopenfiles default, LevelDB's own default
+static const int nDefaultTxDbMaxOpenFiles = 1000;
+//! -dbblocksize default (KiB), LevelDB's own default
+static const int64_t nDefaultTxDbBlockSize = 4;
+//! -dbcompression default
+static const bool DEFAULT_TXDB_COMPRESSION = true;
+//! -dbsync default
+static const bool DEFAULT_TXDB_SYNC = false;
+
 /// Create a new block index entry for a given block hash
 CBlockIndex * InsertBlockIndex(uint256 hash);
 class CTxIndex;
@@ -63,6 +74,9 @@ protected:
     // delete for it.
     bool ScanBatch(const CDataStream &key, std::string *value, bool *deleted) const;
 
+    // Write options honouring -dbsync.
+    static leveldb::WriteOptions GetWriteOptions();
+
     template<typename K, typename T>
     bool Read(const K& key, T& value)
     {
@@ -121,7 +135,7 @@ protected:
             activeBatch->Put(ssKey.str(), ssValue.str());
             return true;
         }
-        leveldb::Status status = pdb->Put(leveldb::WriteOptions(), ssKey.str(), ssValue.str());
+        leveldb::Status status = pdb->Put(GetWriteOptions(), ssKey.str(), ssValue.str());
         if (!status.ok()) {
             LogPrintf("LevelDB write failure: %s\n", status.ToString());
             return false;
@@ -144,7 +158,7 @@ protected:
             activeBatch->Delete(ssKey.str());
             return true;
         }
-        leveldb::Status status = pdb->Delete(leveldb::WriteOptions(), ssKey.str());
+        leveldb::Status status = pdb->Delete(GetWriteOptions(), ssKey.str());
         return (status.ok() || status.IsNotFound());
     }
 
@@ -207,6 +221,16 @@ public:
     bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
     bool WriteBestInvalidTrust(CBigNum bnBestInvalidTrust);
     bool LoadBlockIndex();
+
+    // Reads a LevelDB property such as "leveldb.stats" or "leveldb.sstables".
+    bool GetProperty(const std::string& strProperty, std::string& strValue);
+    // Approximate on-disk size of all records whose key starts with strType
+    // (e.g. "tx", "blockindex", "adr").
+    uint64_t GetApproximateSize(const std::string& strType);
+    // Compacts the whole database. Safe to call while the node is running.
+    void Compact();
+    // Options the database was opened with.
+    static const leveldb::Options& GetOpenOptions();
 private:
     bool LoadBlockIndexGuts();
 };
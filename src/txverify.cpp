@@ -0,0 +1,174 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txverify.h"
+
+#include "main.h"
+#include "net.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <math.h>
+
+#include <boost/bind.hpp>
+
+CTxVerifyQueue txVerifyQueue;
+
+/** Time constant of the accepted-per-second average, in microseconds */
+static const double TX_ACCEPT_RATE_WINDOW = 60 * 1000000.0;
+
+static void ThreadTxVerify(CTxVerifyQueue* pqueue)
+{
+    RenameThread("darksilk-txcheck");
+    pqueue->ThreadVerify();
+}
+
+CTxVerifyQueue::CTxVerifyQueue() : nWorkers(0), nLastAccepted(0), dRecentAccepted(0)
+{
+    stats.nWorkers = 0;
+    stats.nQueued = 0;
+    stats.nProcessed = 0;
+    stats.nAccepted = 0;
+    stats.dAcceptRate = 0;
+    stats.nLockWaitTime = 0;
+    stats.nLockHoldTime = 0;
+    stats.nScriptTime = 0;
+}
+
+void CTxVerifyQueue::Start(boost::thread_group& threadGroup, int nWorkersIn)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWorkers = nWorkersIn;
+    }
+    if (nWorkersIn <= 0)
+        return;
+
+    LogPrintf("Using %d threads for transaction verification\n", nWorkersIn);
+    for (int i = 0; i < nWorkersIn; i++)
+        threadGroup.create_thread(boost::bind(&ThreadTxVerify, this));
+}
+
+void CTxVerifyQueue::Process(CEntry& entry)
+{
+    CValidationState state;
+    bool fMissingInputs = false;
+    bool fAccepted = false;
+    CMemPoolInputs inputs;
+    int64_t nLockWait = 0, nLockHold = 0, nScript = 0;
+
+    int64_t nStart = GetTimeMicros();
+    bool fPassed;
+    {
+        LOCK(cs_main);
+        int64_t nLocked = GetTimeMicros();
+        nLockWait += nLocked - nStart;
+        fPassed = PreAcceptToMemoryPool(mempool, state, entry.tx, entry.fLimitFree, &fMissingInputs, entry.fIgnoreFees, inputs);
+        nStart = GetTimeMicros();
+        nLockHold += nStart - nLocked;
+    }
+
+    if (fPassed)
+    {
+        fPassed = CheckInputScripts(entry.tx, inputs);
+        int64_t nEnd = GetTimeMicros();
+        nScript = nEnd - nStart;
+        nStart = nEnd;
+    }
+
+    try {
+        LOCK(cs_main);
+        int64_t nLocked = GetTimeMicros();
+        nLockWait += nLocked - nStart;
+        if (fPassed)
+            fAccepted = FinishAcceptToMemoryPool(mempool, state, entry.tx, &fMissingInputs, inputs);
+        entry.fnAccepted(entry.tx, entry.pfrom, state, fAccepted, fMissingInputs);
+        nLockHold += GetTimeMicros() - nLocked;
+    }
+    catch (std::exception& e) {
+        PrintExceptionContinue(&e, "CTxVerifyQueue::Process()");
+    }
+    if (entry.pfrom)
+        entry.pfrom->Release();
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    stats.nProcessed++;
+    stats.nLockWaitTime += nLockWait;
+    stats.nLockHoldTime += nLockHold;
+    stats.nScriptTime += nScript;
+    if (fAccepted)
+    {
+        int64_t nNow = GetTimeMicros();
+        dRecentAccepted = dRecentAccepted * exp(-(nNow - nLastAccepted) / TX_ACCEPT_RATE_WINDOW) + 1;
+        nLastAccepted = nNow;
+        stats.nAccepted++;
+    }
+}
+
+void CTxVerifyQueue::Push(const CTransaction& tx, CNode* pfrom, bool fLimitFree, bool fIgnoreFees, const TxAcceptedFn& fnAccepted)
+{
+    boost::shared_ptr<CEntry> pentry(new CEntry());
+    pentry->tx = tx;
+    pentry->tx.CacheHash();
+    pentry->hash = pentry->tx.GetHash();
+    pentry->pfrom = pfrom ? pfrom->AddRef() : NULL;
+    pentry->fLimitFree = fLimitFree;
+    pentry->fIgnoreFees = fIgnoreFees;
+    pentry->fnAccepted = fnAccepted;
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (nWorkers > 0)
+        {
+            while (queue.size() >= MAX_TX_VERIFY_QUEUE)
+                condSpace.wait(lock);
+            queue.push_back(pentry);
+            setHashes.insert(pentry->hash);
+            condWork.notify_one();
+            return;
+        }
+    }
+
+    // No verification threads: verify on the caller's thread
+    Process(*pentry);
+}
+
+bool CTxVerifyQueue::Contains(const uint256& hash)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return setHashes.count(hash) > 0;
+}
+
+CTxVerifyQueue::Stats CTxVerifyQueue::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    Stats ret = stats;
+    ret.nWorkers = nWorkers;
+    ret.nQueued = queue.size();
+    ret.dAcceptRate = dRecentAccepted * exp(-(GetTimeMicros() - nLastAccepted) / TX_ACCEPT_RATE_WINDOW) * 1000000.0 / TX_ACCEPT_RATE_WINDOW;
+    return ret;
+}
+
+void CTxVerifyQueue::ThreadVerify()
+{
+    while (true)
+    {
+        boost::shared_ptr<CEntry> pentry;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (queue.empty())
+                condWork.wait(lock);
+            pentry = queue.front();
+            queue.pop_front();
+        }
+        condSpace.notify_one();
+
+        Process(*pentry);
+
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            setHashes.erase(setHashes.find(pentry->hash));
+        }
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2015-2016 Silk Network
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DARKSILK_TXVERIFY_H
+#define DARKSILK_TXVERIFY_H
+
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <set>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+class CNode;
+class CValidationState;
+
+/** Default for -txverifythreads, 0 = half the cores (at least one) */
+static const int DEFAULT_TX_VERIFY_THREADS = 0;
+/** Maximum number of transaction verification threads */
+static const int MAX_TX_VERIFY_THREADS = 16;
+/** Transactions that may wait in the queue before Push() blocks the caller */
+static const unsigned int MAX_TX_VERIFY_QUEUE = 1000;
+
+/** Called under cs_main after FinishAcceptToMemoryPool(), or after the first step that failed */
+typedef boost::function<void(CTransaction& tx, CNode* pfrom, CValidationState& state, bool fAccepted, bool fMissingInputs)> TxAcceptedFn;
+
+/**
+ * Worker pool admitting relayed transactions to the memory pool.
+ *
+ * Each transaction takes cs_main twice, briefly: PreAcceptToMemoryPool() for the
+ * cheap checks and the input lookup, then FinishAcceptToMemoryPool() and the
+ * TxAcceptedFn once the inputs were re-checked. The signature checks in between
+ * run without any lock, so a flood of transactions no longer holds up block
+ * processing and the other peers.
+ */
+class CTxVerifyQueue
+{
+public:
+    struct Stats
+    {
+        int nWorkers;
+        unsigned int nQueued;
+        uint64_t nProcessed;
+        uint64_t nAccepted;
+        double dAcceptRate;             //! accepted per second, averaged over about a minute
+        int64_t nLockWaitTime;          //! waiting for cs_main, microseconds
+        int64_t nLockHoldTime;          //! holding cs_main
+        int64_t nScriptTime;            //! CheckInputScripts, outside of cs_main
+    };
+
+    CTxVerifyQueue();
+
+    /** Start nWorkers verification threads in threadGroup */
+    void Start(boost::thread_group& threadGroup, int nWorkers);
+
+    /** Queue a transaction. Holds a reference on pfrom (may be NULL) until fnAccepted has run.
+     *  When no workers were started the transaction is verified inline. */
+    void Push(const CTransaction& tx, CNode* pfrom, bool fLimitFree, bool fIgnoreFees, const TxAcceptedFn& fnAccepted);
+
+    /** True if a transaction with this hash is queued or being verified */
+    bool Contains(const uint256& hash);
+
+    Stats GetStats();
+
+    void ThreadVerify();
+
+private:
+    struct CEntry
+    {
+        CTransaction tx;
+        uint256 hash;
+        CNode* pfrom;
+        bool fLimitFree;
+        bool fIgnoreFees;
+        TxAcceptedFn fnAccepted;
+    };
+
+    CWaitableCriticalSection cs;
+    CConditionVariable condWork;        //! new entry to verify
+    CConditionVariable condSpace;       //! an entry left the queue
+    std::deque<boost::shared_ptr<CEntry> > queue;
+    std::multiset<uint256> setHashes;
+    int nWorkers;
+    Stats stats;
+    int64_t nLastAccepted;
+    double dRecentAccepted;
+
+    void Process(CEntry& entry);
+};
+
+extern CTxVerifyQueue txVerifyQueue;
+
+#endif // DARKSILK_TXVERIFY_H
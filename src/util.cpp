@@ -62,6 +62,10 @@
 # include <sys/prctl.h>
 #endif
 
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
 // Work around clang compilation problem in Boost 1.46:
 // /usr/include/boost/program_options/detail/config_file.hpp:163:17: error: call to function 'to_internal' that is neither visible in the template definition nor found by argument-dependent lookup
 // See also: http://stackoverflow.com/questions/10020179/compilation-fail-in-boost-librairies-program-options
@@ -675,6 +679,30 @@ void FileCommit(FILE *fileout)
 #endif
 }
 
+/**
+ * Try to raise the file descriptor limit to nMinFD.
+ * Returns the resulting limit, which may be less (or more) than nMinFD.
+ */
+int RaiseFileDescriptorLimit(int nMinFD)
+{
+#ifdef WIN32
+    return 2048;
+#else
+    struct rlimit limitFD;
+    if (getrlimit(RLIMIT_NOFILE, &limitFD) != -1) {
+        if (limitFD.rlim_cur < (rlim_t)nMinFD) {
+            limitFD.rlim_cur = nMinFD;
+            if (limitFD.rlim_cur > limitFD.rlim_max)
+                limitFD.rlim_cur = limitFD.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limitFD);
+            getrlimit(RLIMIT_NOFILE, &limitFD);
+        }
+        return limitFD.rlim_cur;
+    }
+    return nMinFD; // getrlimit failed, assume it's fine
+#endif
+}
+
 std::string getTimeString(int64_t timestamp, char *buffer, size_t nBuffer)
 {
     struct tm* dt;
@@ -209,6 +209,7 @@ bool WildcardMatch(const char* psz, const char* mask);
 bool WildcardMatch(const std::string& str, const std::string& mask);
 bool TryCreateDirectory(const boost::filesystem::path& p);
 void FileCommit(FILE *fileout);
+int RaiseFileDescriptorLimit(int nMinFD);
 bool RenameOver(boost::filesystem::path src, boost::filesystem::path dest);
 boost::filesystem::path GetDefaultDataDir();
 const boost::filesystem::path &GetDataDir(bool fNetSpecific = true);
@@ -36,7 +36,7 @@ static const int DATABASE_VERSION = 70510;
 // network protocol versioning
 //
 
-static const int PROTOCOL_VERSION = 60800;
+static const int PROTOCOL_VERSION = 60801;
 
 // intial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -65,6 +65,9 @@ static const int MIN_POOL_PEER_PROTO_VERSION = 60800;
 /// minimum peer version accepted by SandstormPool
 static const int MIN_INSTANTX_PROTO_VERSION = 60800;
 
+/// minimum peer version for InstantX lock proofs, older peers get the votes one by one
+static const int MIN_TXLOCK_PROOF_PROTO_VERSION = 60801;
+
 //disconnect from Stormnodes older than this proto version
 static const int MIN_SN_PROTO_VERSION = 60800;
 
@@ -572,6 +572,29 @@ Value listaddressgroupings(const Array& params, bool fHelp)
     return jsonGroupings;
 }
 
+Value getaddressbalance(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"darksilkaddress\"\n"
+            "\nReturns the unspent amount held by a wallet address, as listed by listaddressgroupings.\n"
+            "Unconfirmed outputs only count if they come from the wallet itself.\n"
+            "\nArguments:\n"
+            "1. \"darksilkaddress\"  (string, required) The DarkSilk address.\n"
+            "\nResult:\n"
+            "amount   (numeric) The balance of the address in DRKSLK, 0 if it isn't a wallet address.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"Dh4V55Ebdwsef8gMGL2fhWA9ZmMjt4KPwg\"")
+            + HelpExampleRpc("getaddressbalance", "\"Dh4V55Ebdwsef8gMGL2fhWA9ZmMjt4KPwg\"")
+        );
+
+    CDarkSilkAddress address(params[0].get_str());
+    if (!address.IsValid())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid DarkSilk address");
+
+    return ValueFromAmount(pwalletMain->GetAddressBalance(address.Get()));
+}
+
 Value signmessage(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 2)
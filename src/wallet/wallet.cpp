@@ -721,6 +721,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
         {
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
+            AddToSpends(hash);
 
             wtx.nTimeSmart = wtx.nTimeReceived;
             if (wtxIn.hashBlock != 0)
@@ -792,6 +793,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
             fUpdated |= wtx.UpdateSpent(wtxIn.vfSpent);
         }
 
+        // outputs can become ours on an update, after importing their key
+        AddToAddressIndex(wtx);
+
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -800,6 +804,15 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
             if (!wtx.WriteToDisk())
                 return false;
 
+        // Rounds of this transaction's outputs and of anything spending them. Merging
+        // block or spent data doesn't change them, only an output becoming ours does
+        if (fInsertedNew || IsSandstormRoundsStale(wtx))
+        {
+            std::vector<uint256> vTx;
+            InvalidateSandstormRounds(hash, vTx);
+            UpdateSandstormRounds(vTx);
+        }
+
         // Break debit/credit balance caches:
         wtx.MarkDirty();
 
@@ -876,12 +889,16 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock, bool
 
 void CWallet::EraseFromWallet(const uint256 &hash)
 {
-    if (!fFileBacked)
-        return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        std::vector<uint256> vTx;
+        InvalidateSandstormRounds(hash, vTx);
+        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            RemoveFromAddressIndex((*mi).second);
+        if (mapWallet.erase(hash) && fFileBacked)
             CWalletDB(strWalletFile).EraseTx(hash);
+        UpdateSandstormRounds(vTx);
     }
     return;
 }
@@ -901,6 +918,9 @@ isminetype CWallet::IsMine(const CTxIn &txin) const
     return ISMINE_NO;
 }
 
+// An input only names its prevout, so there is no script to filter: a foreign input is
+// turned away by the mapWallet miss, and the script of a prevout we hold goes through
+// IsMine and with it the key store's script filter.
 CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 {
     {
@@ -1290,7 +1310,7 @@ void CWalletTx::RelayWalletTransaction(std::string strCommand)
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if(strCommand == "ix"){
-                mapTxLockReq.insert(make_pair(hash, (CTransaction)*this));
+                txLockManager.AddRequest((CTransaction)*this);
                 CreateNewLock(((CTransaction)*this));
                 RelayTransactionLockReq((CTransaction)*this, true);
             } else {
@@ -1466,8 +1486,6 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
 // Recursively determine the rounds of a given input (How deep is the Sandstorm chain for a given input)
 int CWallet::GetRealInputSandstormRounds(CTxIn in, int rounds) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
-
     if(rounds >= 100) return 99; // 100 rounds max
 
     uint256 hash = in.prevout.hash;
@@ -1476,18 +1494,10 @@ int CWallet::GetRealInputSandstormRounds(CTxIn in, int rounds) const
     const CWalletTx* wtx = GetWalletTx(hash);
     if(wtx != NULL)
     {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        // not known yet, let's add it
-        if(mdwi == mDenomWtxes.end())
-        {
-            LogPrint("sandstorm", "GetInputSandstormRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        }
-        // found and it's not an initial value, just return it
-        else if(mDenomWtxes[hash].vout[nout].nRounds != -10)
-        {
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+        // already known, just return it
+        std::map<COutPoint, int>::const_iterator mi = mapSandstormRounds.find(in.prevout);
+        if(mi != mapSandstormRounds.end())
+            return mi->second;
 
         // bounds check
         if(nout >= wtx->vout.size())
@@ -1497,58 +1507,142 @@ int CWallet::GetRealInputSandstormRounds(CTxIn in, int rounds) const
             return -4;
         }
 
+        int nRounds;
         if(pwalletMain->IsCollateralAmount(wtx->vout[nout].nValue))
         {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            nRounds = -3;
         }
-
         //make sure the final output is non-denominate
-        if(/*rounds == 0 && */!IsDenominatedAmount(wtx->vout[nout].nValue)) //NOT DENOM
+        else if(/*rounds == 0 && */!IsDenominatedAmount(wtx->vout[nout].nValue)) //NOT DENOM
         {
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            nRounds = -2;
         }
+        else
+        {
+            bool fAllDenoms = true;
+            BOOST_FOREACH(const CTxOut& out, wtx->vout)
+            {
+                fAllDenoms = fAllDenoms && IsDenominatedAmount(out.nValue);
+            }
+            // this one is denominated but there is another non-denominated output found in the same tx
+            if(!fAllDenoms)
+            {
+                nRounds = 0;
+            }
+            else
+            {
+                int nShortest = -10; // an initial value, should be no way to get this by calculations
+                bool fDenomFound = false;
+                // only denoms here so let's look up
+                BOOST_FOREACH(const CTxIn& in2, wtx->vin)
+                {
+                    if(IsMine(in2))
+                    {
+                        int n = GetRealInputSandstormRounds(in2, rounds+1);
+                        // denom found, find the shortest chain or initially assign nShortest with the first found value
+                        if(n >= 0 && (n < nShortest || nShortest == -10))
+                        {
+                            nShortest = n;
+                            fDenomFound = true;
+                        }
+                    }
+                }
+                nRounds = fDenomFound
+                        ? (nShortest >= 99 ? 100 : nShortest + 1) // good, we a +1 to the shortest one but only 100 rounds max allowed
+                        : 0;            // too bad, we are the fist one in that chain
+            }
+        }
+        mapSandstormRounds[in.prevout] = nRounds;
+        LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, nRounds);
+        return nRounds;
+    }
+
+    return rounds-1;
+}
+
+// Drop the cached rounds of hashTx's outputs and of every wallet transaction
+// descending from them; vTxRet gets hashTx followed by the descendants
+void CWallet::InvalidateSandstormRounds(const uint256& hashTx, std::vector<uint256>& vTxRet)
+{
+    AssertLockHeld(cs_wallet);
 
-        bool fAllDenoms = true;
-        BOOST_FOREACH(CTxOut out, wtx->vout)
+    std::set<uint256> setSeen;
+    vTxRet.push_back(hashTx);
+    setSeen.insert(hashTx);
+    for (unsigned int i = 0; i < vTxRet.size(); i++)
+    {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(vTxRet[i]);
+        if (mi == mapWallet.end())
+            continue;
+        for (unsigned int n = 0; n < mi->second.vout.size(); n++)
         {
-            fAllDenoms = fAllDenoms && IsDenominatedAmount(out.nValue);
+            COutPoint outpoint(vTxRet[i], n);
+            mapSandstormRounds.erase(outpoint);
+
+            std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+            for (TxSpends::const_iterator it = range.first; it != range.second; ++it)
+                if (setSeen.insert(it->second).second)
+                    vTxRet.push_back(it->second);
         }
-        // this one is denominated but there is another non-denominated output found in the same tx
-        if(!fAllDenoms)
+    }
+}
+
+// Recompute the rounds of our outputs of each transaction in vTx (ancestors are
+// looked up recursively, so the order does not matter) and write them to the
+// wallet file; transactions no longer in the wallet lose their record
+void CWallet::UpdateSandstormRounds(const std::vector<uint256>& vTx)
+{
+    AssertLockHeld(cs_wallet);
+
+    if (!fFileBacked)
+        return;
+
+    CWalletDB walletdb(strWalletFile);
+    BOOST_FOREACH(const uint256& hash, vTx)
+    {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end())
         {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            walletdb.EraseSandstormRounds(hash);
+            continue;
         }
 
-        int nShortest = -10; // an initial value, should be no way to get this by calculations
-        bool fDenomFound = false;
-        // only denoms here so let's look up
-        BOOST_FOREACH(CTxIn in2, wtx->vin)
+        const CWalletTx& wtx = mi->second;
+        std::vector<int> vRounds(wtx.vout.size(), -10);
+        bool fAny = false;
+        for (unsigned int n = 0; n < wtx.vout.size(); n++)
         {
-            if(IsMine(in2))
-            {
-                int n = GetRealInputSandstormRounds(in2, rounds+1);
-                // denom found, find the shortest chain or initially assign nShortest with the first found value
-                if(n >= 0 && (n < nShortest || nShortest == -10))
-                {
-                    nShortest = n;
-                    fDenomFound = true;
-                }
-            }
+            if (!IsMine(wtx.vout[n]))
+                continue;
+            vRounds[n] = GetRealInputSandstormRounds(CTxIn(hash, n), 0);
+            fAny = true;
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
-                ? (nShortest >= 99 ? 100 : nShortest + 1) // good, we a +1 to the shortest one but only 100 rounds max allowed
-                : 0;            // too bad, we are the fist one in that chain
-        LogPrint("sandstorm", "GetInputSandstormRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        if (fAny)
+            walletdb.WriteSandstormRounds(hash, vRounds);
+        else
+            walletdb.EraseSandstormRounds(hash);
     }
+}
 
-    return rounds-1;
+// True if the cached rounds of wtx don't match which of its outputs are ours:
+// UpdateSandstormRounds leaves an entry for each of our outputs and no other
+bool CWallet::IsSandstormRoundsStale(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+
+    uint256 hash = wtx.GetHash();
+    for (unsigned int n = 0; n < wtx.vout.size(); n++)
+        if ((IsMine(wtx.vout[n]) != ISMINE_NO) != (mapSandstormRounds.count(COutPoint(hash, n)) > 0))
+            return true;
+    return false;
+}
+
+void CWallet::LoadSandstormRounds(const uint256& hash, const std::vector<int>& vRounds)
+{
+    LOCK(cs_wallet);
+    for (unsigned int n = 0; n < vRounds.size(); n++)
+        if (vRounds[n] != -10)
+            mapSandstormRounds[COutPoint(hash, n)] = vRounds[n];
 }
 
 // respect current settings
@@ -4376,6 +4470,35 @@ bool CWallet::NewKeyPool()
     return true;
 }
 
+namespace {
+struct CPoolKey
+{
+    CKey secret;
+    CPubKey pubkey;
+    std::vector<unsigned char> vchCryptedSecret;
+};
+}
+
+// Generate vKeys[nBegin..nEnd), encrypting them when vMasterKey is set. Touches
+// nothing but its own slice of vKeys, so several of these can run at once.
+static void GeneratePoolKeys(std::vector<CPoolKey>& vKeys, size_t nBegin, size_t nEnd, bool fCompressed, const CKeyingMaterial& vMasterKey)
+{
+    for (size_t i = nBegin; i < nEnd; i++)
+    {
+        CPoolKey& key = vKeys[i];
+        key.secret.MakeNewKey(fCompressed);
+        key.pubkey = key.secret.GetPubKey();
+        assert(key.secret.VerifyPubKey(key.pubkey));
+
+        if (!vMasterKey.empty())
+        {
+            CKeyingMaterial vchSecret(key.secret.begin(), key.secret.end());
+            if (!EncryptSecret(vMasterKey, vchSecret, key.pubkey.GetHash(), key.vchCryptedSecret))
+                key.vchCryptedSecret.clear();
+        }
+    }
+}
+
 bool CWallet::TopUpKeyPool(unsigned int nSize)
 {
     {
@@ -4384,8 +4507,6 @@ bool CWallet::TopUpKeyPool(unsigned int nSize)
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
-
         // Top up key pool
         unsigned int nTargetSize;
         if (nSize > 0)
@@ -4393,19 +4514,102 @@ bool CWallet::TopUpKeyPool(unsigned int nSize)
         else
             nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
 
+        if (setKeyPool.size() >= (nTargetSize + 1))
+            return true;
+
+        bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+        // Compressed public keys were introduced in version 0.6.0
+        if (fCompressed)
+            SetMinVersion(FEATURE_COMPRPUBKEY);
+
+        CKeyingMaterial vMasterKeyCopy;
+        if (IsCrypted())
+        {
+            LOCK(cs_KeyStore);
+            if (vMasterKey.empty())
+                return false;
+            vMasterKeyCopy = vMasterKey;
+        }
+
+        int nThreads = std::max(std::min((int)boost::thread::hardware_concurrency(), MAX_KEYPOOL_THREADS), 1);
+        std::vector<CScript> vWatchOnly;
+        CWalletDB walletdb(strWalletFile);
+
         while (setKeyPool.size() < (nTargetSize + 1))
         {
+            std::vector<CPoolKey> vKeys(std::min((size_t)(nTargetSize + 1) - setKeyPool.size(), (size_t)KEYPOOL_BATCH_SIZE));
+
+            if (nThreads > 1 && vKeys.size() >= KEYPOOL_MIN_PARALLEL)
+            {
+                boost::thread_group threads;
+                size_t nSlice = (vKeys.size() + nThreads - 1) / nThreads;
+                for (size_t nBegin = 0; nBegin < vKeys.size(); nBegin += nSlice)
+                    threads.create_thread(boost::bind(&GeneratePoolKeys, boost::ref(vKeys), nBegin, std::min(nBegin + nSlice, vKeys.size()), fCompressed, boost::cref(vMasterKeyCopy)));
+                threads.join_all();
+            }
+            else
+                GeneratePoolKeys(vKeys, 0, vKeys.size(), fCompressed, vMasterKeyCopy);
+
             int64_t nEnd = 1;
             if (!setKeyPool.empty())
                 nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error("TopUpKeyPool() : writing generated key failed");
-            setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
-            double dProgress = 100.f * nEnd / (nTargetSize + 1);
+
+            int64_t nCreationTime = GetTime();
+            CKeyMetadata metadata(nCreationTime);
+
+            // Keys, metadata and pool entries of the whole batch go in one database transaction
+            if (!walletdb.TxnBegin())
+                throw runtime_error("TopUpKeyPool() : couldn't start wallet database transaction");
+            int64_t nIndex = nEnd;
+            BOOST_FOREACH(const CPoolKey& key, vKeys)
+            {
+                bool fWritten;
+                if (IsCrypted())
+                    fWritten = !key.vchCryptedSecret.empty() &&
+                               walletdb.WriteCryptedKey(key.pubkey, key.vchCryptedSecret, metadata);
+                else
+                    fWritten = walletdb.WriteKey(key.pubkey, key.secret.GetPrivKey(), metadata);
+                if (!fWritten || !walletdb.WritePool(nIndex++, CKeyPool(key.pubkey)))
+                {
+                    walletdb.TxnAbort();
+                    throw runtime_error("TopUpKeyPool() : writing generated key failed");
+                }
+            }
+            if (!walletdb.TxnCommit())
+                throw runtime_error("TopUpKeyPool() : committing generated keys failed");
+
+            // The keystore only learns about the batch once it is on disk, a failed
+            // write above leaves no key in memory that the database doesn't have
+            if (!nTimeFirstKey || nCreationTime < nTimeFirstKey)
+                nTimeFirstKey = nCreationTime;
+            BOOST_FOREACH(const CPoolKey& key, vKeys)
+            {
+                CKeyID keyID = key.pubkey.GetID();
+                mapKeyMetadata[keyID] = metadata;
+
+                bool fAdded;
+                if (IsCrypted())
+                    fAdded = CCryptoKeyStore::AddCryptedKey(key.pubkey, key.vchCryptedSecret);
+                else
+                    fAdded = CCryptoKeyStore::AddKeyPubKey(key.secret, key.pubkey);
+                if (!fAdded)
+                    throw runtime_error("TopUpKeyPool() : adding generated key failed");
+                setKeyPool.insert(nEnd++);
+
+                CScript script = GetScriptForDestination(keyID);
+                if (HaveWatchOnly(script))
+                    vWatchOnly.push_back(script);
+            }
+
+            LogPrintf("keypool added %u keys, size=%u\n", vKeys.size(), setKeyPool.size());
+            double dProgress = 100.f * setKeyPool.size() / (nTargetSize + 1);
             std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
             uiInterface.InitMessage(strMsg);
         }
+
+        // check if we need to remove from watch-only (outside of the batches, RemoveWatchOnly writes on its own)
+        BOOST_FOREACH(const CScript& script, vWatchOnly)
+            RemoveWatchOnly(script);
     }
     return true;
 }
@@ -4504,15 +4708,111 @@ int64_t CWallet::GetOldestKeyPoolTime()
     return keypool.nTime;
 }
 
-std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
+void CWallet::AddToAddressIndex(const CWalletTx& wtx)
 {
-    map<CTxDestination, CAmount> balances;
+    AssertLockHeld(cs_wallet); // mapAddressIndex
+    if (!fAddressIndexBuilt)
+        return;
+
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        CTxDestination addr;
+        if (!IsMine(wtx.vout[i]) || !ExtractDestination(wtx.vout[i].scriptPubKey, addr))
+            continue;
+        mapAddressIndex[addr].insert(COutPoint(wtx.GetHash(), i));
+    }
+}
+
+void CWallet::RemoveFromAddressIndex(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet); // mapAddressIndex
+    if (!fAddressIndexBuilt)
+        return;
+
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        CTxDestination addr;
+        if (!ExtractDestination(wtx.vout[i].scriptPubKey, addr))
+            continue;
+        AddressIndex::iterator mi = mapAddressIndex.find(addr);
+        if (mi != mapAddressIndex.end())
+            (*mi).second.erase(COutPoint(wtx.GetHash(), i));
+    }
+}
+
+void CWallet::BuildAddressIndex()
+{
+    AssertLockHeld(cs_wallet); // mapWallet
+    if (fAddressIndexBuilt)
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    fAddressIndexBuilt = true;
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        AddToAddressIndex((*it).second);
+    LogPrintf("BuildAddressIndex : %u destinations from %u transactions in %dms\n",
+        mapAddressIndex.size(), mapWallet.size(), GetTimeMillis() - nStart);
+}
+
+// True if a wallet transaction spending outpoint is deep enough not to be undone
+bool CWallet::IsSpendSettled(const COutPoint& outpoint) const
+{
+    pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it)
+    {
+        map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain() >= ADDRESS_INDEX_SETTLED_DEPTH)
+            return true;
+    }
+    return false;
+}
+
+// The unspent outputs of dest, forgetting the ones spent for good on the way
+void CWallet::GetAddressOutputs(const CTxDestination& dest, vector<pair<const CWalletTx*, unsigned int> >& vOutputsRet)
+{
+    AssertLockHeld(cs_wallet); // mapAddressIndex, mapWallet
+    BuildAddressIndex();
+
+    AddressIndex::iterator mi = mapAddressIndex.find(dest);
+    if (mi == mapAddressIndex.end())
+        return;
+
+    set<COutPoint>& setOutputs = (*mi).second;
+    for (set<COutPoint>::iterator it = setOutputs.begin(); it != setOutputs.end(); )
+    {
+        map<uint256, CWalletTx>::const_iterator mit = mapWallet.find((*it).hash);
+        if (mit == mapWallet.end() || (*it).n >= (*mit).second.vout.size())
+        {
+            setOutputs.erase(it++);
+            continue;
+        }
+
+        const CWalletTx* pcoin = &(*mit).second;
+        if (pcoin->IsSpent((*it).n))
+        {
+            if (IsSpendSettled(*it))
+                setOutputs.erase(it++);
+            else
+                ++it;
+            continue;
+        }
+
+        vOutputsRet.push_back(make_pair(pcoin, (*it).n));
+        ++it;
+    }
+}
+
+CAmount CWallet::GetAddressBalance(const CTxDestination& dest)
+{
+    CAmount nBalance = 0;
 
     {
         LOCK(cs_wallet);
-        BOOST_FOREACH(PAIRTYPE(uint256, CWalletTx) walletEntry, mapWallet)
+        vector<pair<const CWalletTx*, unsigned int> > vOutputs;
+        GetAddressOutputs(dest, vOutputs);
+        for (unsigned int i = 0; i < vOutputs.size(); i++)
         {
-            CWalletTx *pcoin = &walletEntry.second;
+            const CWalletTx* pcoin = vOutputs[i].first;
 
             if (!IsFinalTx(*pcoin) || !pcoin->IsTrusted())
                 continue;
@@ -4524,24 +4824,62 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
             if (nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? 0 : 1))
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
+            nBalance += pcoin->vout[vOutputs[i].second].nValue;
+        }
+    }
+
+    return nBalance;
+}
+
+std::map<CTxDestination, CAmount> CWallet::GetAddressBalances()
+{
+    map<CTxDestination, CAmount> balances;
+
+    {
+        LOCK(cs_wallet);
+        BuildAddressIndex();
+        for (AddressIndex::const_iterator it = mapAddressIndex.begin(); it != mapAddressIndex.end(); ++it)
+            balances[(*it).first] = GetAddressBalance((*it).first);
+    }
+
+    return balances;
+}
+
+void CWallet::AvailableCoinsByAddress(const set<CTxDestination>& setDest, vector<COutput>& vCoins, bool fOnlyConfirmed)
+{
+    vCoins.clear();
+
+    {
+        LOCK2(cs_main, cs_wallet);
+        BOOST_FOREACH(const CTxDestination& dest, setDest)
+        {
+            vector<pair<const CWalletTx*, unsigned int> > vOutputs;
+            GetAddressOutputs(dest, vOutputs);
+            for (unsigned int j = 0; j < vOutputs.size(); j++)
             {
-                CTxDestination addr;
-                if (!IsMine(pcoin->vout[i]))
+                const CWalletTx* pcoin = vOutputs[j].first;
+                unsigned int i = vOutputs[j].second;
+
+                if (!IsFinalTx(*pcoin))
+                    continue;
+
+                if (fOnlyConfirmed && !pcoin->IsTrusted())
+                    continue;
+
+                if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
                     continue;
-                if(!ExtractDestination(pcoin->vout[i].scriptPubKey, addr))
+
+                int nDepth = pcoin->GetDepthInMainChain();
+                if (nDepth <= 0)
                     continue;
 
-                CAmount n = pcoin->IsSpent(i) ? 0 : pcoin->vout[i].nValue;
+                if (IsLockedCoin(pcoin->GetHash(), i) || pcoin->vout[i].nValue <= 0)
+                    continue;
 
-                if (!balances.count(addr))
-                    balances[addr] = 0;
-                balances[addr] += n;
+                vCoins.push_back(COutput(pcoin, i, nDepth, ISMINE_SPENDABLE));
             }
         }
     }
-
-    return balances;
 }
 
 set< set<CTxDestination> > CWallet::GetAddressGroupings()
@@ -4671,6 +5009,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, CAmount& nBalanceInQuestion, bo
                 {
                     pcoin->MarkUnspent(n);
                     pcoin->WriteToDisk();
+                    AddToAddressIndex(*pcoin);
                 }
             }
             else if (IsMine(pcoin->vout[n]) && !pcoin->IsSpent(n) && (txindex.vSpent.size() > n && !txindex.vSpent[n].IsNull()))
@@ -4706,6 +5045,7 @@ void CWallet::DisableTransaction(const CTransaction &tx)
             {
                 prev.MarkUnspent(txin.prevout.n);
                 prev.WriteToDisk();
+                AddToAddressIndex(prev);
             }
         }
     }
@@ -31,6 +31,14 @@ static const double MIN_FEE = 0.00001;
 const CAmount MIN_RELAY_TX_FEE = MIN_TX_FEE;
 //! -keypool default
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! keys generated and written per wallet database transaction when topping up the keypool
+static const unsigned int KEYPOOL_BATCH_SIZE = 1000;
+//! smallest batch worth generating on several threads
+static const unsigned int KEYPOOL_MIN_PARALLEL = 64;
+//! maximum number of keypool generation threads
+static const int MAX_KEYPOOL_THREADS = 16;
+//! confirmations of a spend after which the address index forgets the spent output
+static const int ADDRESS_INDEX_SETTLED_DEPTH = 500;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -127,6 +135,28 @@ private:
 
     int GetRealInputSandstormRounds(CTxIn in, int rounds) const;
 
+    // Sandstorm rounds of wallet outputs, filled as they are computed and kept in
+    // the wallet file ("ssrounds") so they survive restarts. Entries are dropped
+    // and recomputed whenever the transaction or one of its ancestors changes.
+    mutable std::map<COutPoint, int> mapSandstormRounds;
+    void InvalidateSandstormRounds(const uint256& hashTx, std::vector<uint256>& vTxRet);
+    void UpdateSandstormRounds(const std::vector<uint256>& vTx);
+    bool IsSandstormRoundsStale(const CWalletTx& wtx) const;
+
+    // The outputs of the wallet by destination, so that balances and coins of an
+    // address don't need a pass over the whole wallet. Built by the first query,
+    // as keys may load after transactions, then updated as transactions come and
+    // go. Outputs spent ADDRESS_INDEX_SETTLED_DEPTH blocks deep are dropped as
+    // they are met; a destination stays once seen.
+    typedef std::map<CTxDestination, std::set<COutPoint> > AddressIndex;
+    AddressIndex mapAddressIndex;
+    bool fAddressIndexBuilt;
+    void AddToAddressIndex(const CWalletTx& wtx);
+    void RemoveFromAddressIndex(const CWalletTx& wtx);
+    void BuildAddressIndex();
+    bool IsSpendSettled(const COutPoint& outpoint) const;
+    void GetAddressOutputs(const CTxDestination& dest, std::vector<std::pair<const CWalletTx*, unsigned int> >& vOutputsRet);
+
 public:
     /// Main wallet lock.
     /// This lock protects all the fields added by CWallet
@@ -192,6 +222,7 @@ public:
         nTimeFirstKey = 0;
         nLastFilteredHeight = 0;
         fWalletUnlockAnonymizeOnly = false;
+        fAddressIndexBuilt = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -241,6 +272,8 @@ public:
     bool LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret);
     bool AddCScript(const CScript& redeemScript);
     bool LoadCScript(const CScript& redeemScript);
+    // Sandstorm rounds of a transaction's outputs (used by LoadWallet)
+    void LoadSandstormRounds(const uint256& hash, const std::vector<int>& vRounds);
 
     // Adds a watch-only address to the store, and saves it to disk.
     bool AddWatchOnly(const CScript &dest);
@@ -338,6 +371,10 @@ public:
 
     std::set< std::set<CTxDestination> > GetAddressGroupings();
     std::map<CTxDestination, CAmount> GetAddressBalances();
+    /** The amount of GetAddressBalances() for one destination, from its outputs only */
+    CAmount GetAddressBalance(const CTxDestination& dest);
+    /** AvailableCoins(vCoins, fOnlyConfirmed) limited to the outputs of the given destinations */
+    void AvailableCoinsByAddress(const std::set<CTxDestination>& setDest, std::vector<COutput>& vCoins, bool fOnlyConfirmed=true);
 
 
     bool IsDenominated(const CTxIn &txin) const;
@@ -371,7 +408,12 @@ public:
     /// should probably be renamed to IsRelevantToMe
     bool IsFromMe(const CTransaction& tx) const
     {
-        return (GetDebit(tx, ISMINE_ALL) > 0);
+        // stops at the first input we own; see GetDebit(const CTxIn&) for how inputs are filtered
+        LOCK(cs_wallet);
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            if (GetDebit(txin, ISMINE_ALL) > 0)
+                return true;
+        return false;
     }
 
     CAmount GetDebit(const CTransaction& tx, const isminefilter& filter) const
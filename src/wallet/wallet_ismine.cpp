@@ -38,6 +38,10 @@ isminetype IsMine(const CKeyStore &keystore, const CTxDestination& dest)
 
 isminetype IsMine(const CKeyStore &keystore, const CScript& scriptPubKey)
 {
+    // Most scripts seen while syncing are someone else's, turn those away before Solver
+    if (!keystore.MightBeMine(scriptPubKey))
+        return ISMINE_NO;
+
     vector<valtype> vSolutions;
     txnouttype whichType;
     if (!Solver(scriptPubKey, whichType, vSolutions)) {
@@ -52,6 +52,18 @@ bool CWalletDB::EraseTx(uint256 hash)
     return Erase(std::make_pair(std::string("tx"), hash));
 }
 
+bool CWalletDB::WriteSandstormRounds(uint256 hash, const std::vector<int>& vRounds)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("ssrounds"), hash), vRounds);
+}
+
+bool CWalletDB::EraseSandstormRounds(uint256 hash)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("ssrounds"), hash));
+}
+
 bool CWalletDB::WriteStealthKeyMeta(const CKeyID& keyId, const CStealthKeyMetadata& sxKeyMeta)
 {
     nWalletDBUpdated++;
@@ -412,6 +424,14 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             //    wtx.hashBlock.ToString(),
             //    wtx.mapValue["message"]);
         } 
+        else if (strType == "ssrounds")
+        {
+            uint256 hash;
+            ssKey >> hash;
+            std::vector<int> vRounds;
+            ssValue >> vRounds;
+            pwallet->LoadSandstormRounds(hash, vRounds);
+        }
         else if (strType == "sxAddr")
         {
             if (fDebug)
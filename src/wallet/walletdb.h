@@ -113,6 +113,9 @@ public:
     bool WriteTx(uint256 hash, const CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
+    bool WriteSandstormRounds(uint256 hash, const std::vector<int>& vRounds);
+    bool EraseSandstormRounds(uint256 hash);
+
     bool WriteStealthKeyMeta(const CKeyID& keyId, const CStealthKeyMetadata& sxKeyMeta);
     bool EraseStealthKeyMeta(const CKeyID& keyId);
     bool WriteStealthAddress(const CStealthAddress& sxAddr);    